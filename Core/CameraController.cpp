@@ -112,6 +112,8 @@ void FlyingFPSCamera::Update( float deltaTime )
 
     Matrix3 orientation = Matrix3(m_WorldEast, m_WorldUp, -m_WorldNorth) * Matrix3::MakeYRotation( m_CurrentHeading ) * Matrix3::MakeXRotation( m_CurrentPitch );
     Vector3 position = orientation * Vector3( strafe, ascent, -forward ) + m_TargetCamera.GetPosition();
+    if (m_MovementFilter)
+        position = m_MovementFilter(m_TargetCamera.GetPosition(), position);
     m_TargetCamera.SetTransform( AffineTransform( orientation, position ) );
     m_TargetCamera.Update();
 }
@@ -16,6 +16,7 @@
 #include "GameCore.h"
 #include "VectorMath.h"
 #include "../Core/Math/BoundingSphere.h"
+#include <functional>
 
 namespace Math
 {
@@ -54,10 +55,17 @@ public:
 
     void EnableMomentum( bool enable ) { m_Momentum = enable; }
 
+    // Lets the application clamp each move, e.g. against level collision.  Receives the current and
+    // requested positions and returns the position to use.
+    typedef std::function<Vector3( const Vector3& from, const Vector3& to )> MovementFilter;
+    void SetMovementFilter( MovementFilter filter ) { m_MovementFilter = filter; }
+
     void SetHeadingPitchAndPosition(float heading, float pitch, const Vector3& position);
 
 private:
 
+    MovementFilter m_MovementFilter;
+
     Vector3 m_WorldUp;
     Vector3 m_WorldNorth;
     Vector3 m_WorldEast;
@@ -0,0 +1,80 @@
+﻿/**
+ * 无状态的计数器随机数 (SplitMix64 / PCG-hash 风格)
+ * 第 i 个随机数只由 (种子, x, y, index, purpose) 与计数 i 经哈希得到，不依赖任何共享状态：
+ *   - 同一个 chunk 无论在哪个线程、以什么顺序生成，结果都完全相同，可以丢弃后重新生成而不必保存
+ *   - 生成线程之间不需要锁，也不会互相影响
+ * 世界生成中 x, y 为 chunk 坐标，index 为 chunk 内的列，purpose 区分同一列上的不同用途 (植物、树叶等)，
+ * 同一列的不同用途互不相关，增加一次随机调用不会改变其它用途的结果。
+ */
+#pragma once
+
+#include <cstdint>
+
+namespace CounterRandom
+{
+    // SplitMix64 finalizer, a bijective 64 bit mix
+    inline uint64_t Mix(uint64_t value)
+    {
+        value ^= value >> 30;
+        value *= 0xBF58476D1CE4E5B9ull;
+        value ^= value >> 27;
+        value *= 0x94D049BB133111EBull;
+        value ^= value >> 31;
+        return value;
+    }
+
+    inline uint64_t MakeKey(uint32_t seed, int32_t x, int32_t y, uint32_t index, uint32_t purpose)
+    {
+        uint64_t key = Mix((uint64_t(seed) << 32 | purpose) + 0x9E3779B97F4A7C15ull);
+        key = Mix(key ^ (uint64_t(uint32_t(x)) | uint64_t(uint32_t(y)) << 32));
+        return Mix(key ^ index);
+    }
+
+    // the random numbers of one key, counter is the position in the sequence
+    class Stream
+    {
+    public:
+        Stream(uint32_t seed, int32_t x, int32_t y, uint32_t index, uint32_t purpose)
+            : key(MakeKey(seed, x, y, index, purpose))
+        {
+        }
+
+        // the number at position in the sequence, without advancing the counter
+        uint32_t At(uint32_t position) const
+        {
+            return uint32_t(Mix(key + (uint64_t(position) + 1) * 0x9E3779B97F4A7C15ull) >> 32);
+        }
+
+        uint32_t NextUInt()
+        {
+            return At(counter++);
+        }
+
+        // same ranges as Math::RandomNumberGenerator: [0, maxVal] with the max included
+        int32_t NextInt(int32_t maxVal)
+        {
+            return maxVal <= 0 ? 0 : int32_t(uint64_t(NextUInt()) * (uint64_t(maxVal) + 1) >> 32);
+        }
+
+        int32_t NextInt(int32_t minVal, int32_t maxVal)
+        {
+            return minVal + NextInt(maxVal - minVal);
+        }
+
+        // [0, maxVal) with the max excluded
+        float NextFloat(float maxVal = 1.0f)
+        {
+            // 24 bits so the result is exact in a float and never rounds up to maxVal
+            return float(NextUInt() >> 8) * (1.0f / 16777216.0f) * maxVal;
+        }
+
+        uint32_t GetCounter() const
+        {
+            return counter;
+        }
+
+    private:
+        uint64_t key;
+        uint32_t counter = 0;
+    };
+}
@@ -3,8 +3,6 @@
 
 #include <cstdint>  // int32_t/uint8_t
 
-#include "Math/Random.h"
-
 /**
  * Computes the largest integer value not greater than the float one
  *
@@ -51,7 +49,19 @@ int SimplexNoise::seed = 0;
 void SimplexNoise::setSeed(int num)
 {
     seed = num;
-    random.SetSeed(num);
+}
+
+void SimplexNoise::reseed(uint32_t num)
+{
+    CounterRandom::Stream random(num, 0, 0, mStream, 0);
+    for (auto& m_perm : perm)
+    {
+        m_perm = static_cast<uint8_t>(random.NextInt(255));
+    }
+    for (int i = 0; i < 256; i++)
+    {
+        permWide[i] = perm[i];
+    }
 }
 
 /**
@@ -2,9 +2,8 @@
 
 #include <cstddef>  // size_t
 
-#include "Math/Random.h"
+#include "CounterRandom.h"
 
-static Math::RandomNumberGenerator random;
 /**
  * @brief A Perlin Simplex Noise C++ Implementation (1D, 2D, 3D, 4D).
  */
@@ -15,6 +14,8 @@ public:
     int32_t fastfloor(float fp) const;
     static int seed;
     static void setSeed(int num);
+    // refills the permutation table from seed, instances with different streams get unrelated tables
+    void reseed(uint32_t num);
     uint8_t hash(int32_t i) const;
     uint8_t hash(int32_t i);
     float grad(int32_t hash, float x) const;
@@ -32,6 +33,28 @@ public:
     float fractal(size_t octaves, float x, float y) const;
     float fractal(size_t octaves, float x, float y, float z) const;
 
+    // Instruction sets of the batch functions, Best picks the widest one the CPU supports
+    enum class SimdLevel { Scalar, Sse41, Avx2, Best };
+    static SimdLevel supportedSimdLevel();
+
+    // Batched 2D noise / fractal: out[i] = noise(x[i], y[i]) or fractal(octaves, x[i], y[i]) for i < count.
+    // 4 (SSE4.1) or 8 (AVX2) points per step with the scalar operation order, so results match the scalar calls.
+    void noiseBatch(const float* x, const float* y, float* out, size_t count,
+                    SimdLevel level = SimdLevel::Best) const;
+    void fractalBatch(size_t octaves, const float* x, const float* y, float* out, size_t count,
+                      SimdLevel level = SimdLevel::Best) const;
+
+    // One field of fractalFields, out receives count values
+    struct FractalField
+    {
+        const SimplexNoise* noise;
+        size_t octaves;
+        float* out;
+    };
+    // Several fractals at the same points, each group of points is loaded once for all fields
+    static void fractalFields(const FractalField* fields, size_t fieldCount, const float* x, const float* y,
+                              size_t count, SimdLevel level = SimdLevel::Best);
+
     /**
      * Constructor of to initialize a fractal noise summation
      *
@@ -39,19 +62,19 @@ public:
      * @param[in] amplitude    Amplitude ("height") of the first octave of noise (default to 1.0)
      * @param[in] lacunarity   Lacunarity specifies the frequency multiplier between successive octaves (default to 2.0).
      * @param[in] persistence  Persistence is the loss of amplitude between successive octaves (usually 1/lacunarity)
+     * @param[in] stream       Selects the permutation table derived from the seed, one per noise field
      */
     SimplexNoise(float frequency = 1.0f,
                           float amplitude = 1.0f,
                           float lacunarity = 2.0f,
-                          float persistence = 0.5f) :
+                          float persistence = 0.5f,
+                          uint32_t stream = 0) :
         mFrequency(frequency),
         mAmplitude(amplitude),
         mLacunarity(lacunarity),
-        mPersistence(persistence) {
-        for (auto& m_perm : perm)
-        {
-            m_perm = random.NextInt(255);
-        }
+        mPersistence(persistence),
+        mStream(stream) {
+        reseed(seed);
     }
 
 private:
@@ -60,5 +83,8 @@ private:
     float mAmplitude;   ///< Amplitude ("height") of the first octave of noise (default to 1.0)
     float mLacunarity;  ///< Lacunarity specifies the frequency multiplier between successive octaves (default to 2.0).
     float mPersistence; ///< Persistence is the loss of amplitude between successive octaves (usually 1/lacunarity)
+    uint32_t mStream;
     uint8_t perm[256];
+    // perm widened to 32 bits for the gathers of the batch functions
+    int32_t permWide[256];
 };
@@ -0,0 +1,351 @@
+﻿#include "pch.h"
+#include "SimplexNoise.h"
+
+#include <immintrin.h>
+#include <intrin.h>
+
+/**
+ * Batched 2D simplex noise.
+ *
+ * The lane templates below repeat SimplexNoise::noise(float, float) and fractal() operation by
+ * operation (same constants, same order of additions and multiplications, no fused multiply-add),
+ * so every lane produces the same value as the scalar call for the same point. The only scalar
+ * work left per lane is the permutation lookup on SSE4.1, AVX2 gathers it.
+ */
+
+namespace
+{
+    const float F2 = 0.366025403f;  // F2 = (sqrt(3) - 1) / 2
+    const float G2 = 0.211324865f;  // G2 = (3 - sqrt(3)) / 6
+
+    struct Sse41Lanes
+    {
+        static const size_t Width = 4;
+        typedef __m128 Float;
+        typedef __m128i Int;
+
+        static Float Load(const float* p) { return _mm_loadu_ps(p); }
+        static void Store(float* p, Float v) { _mm_storeu_ps(p, v); }
+        static Float Set(float v) { return _mm_set1_ps(v); }
+        static Int SetInt(int32_t v) { return _mm_set1_epi32(v); }
+        static Float Add(Float a, Float b) { return _mm_add_ps(a, b); }
+        static Float Sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+        static Float Mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+        static Float Div(Float a, Float b) { return _mm_div_ps(a, b); }
+        static Float Xor(Float a, Float b) { return _mm_xor_ps(a, b); }
+        static Float Floor(Float a) { return _mm_floor_ps(a); }
+        static Int ToInt(Float a) { return _mm_cvttps_epi32(a); }
+        static Float ToFloat(Int a) { return _mm_cvtepi32_ps(a); }
+        static Float AsFloat(Int a) { return _mm_castsi128_ps(a); }
+        static Int AsInt(Float a) { return _mm_castps_si128(a); }
+        static Int AddInt(Int a, Int b) { return _mm_add_epi32(a, b); }
+        static Int SubInt(Int a, Int b) { return _mm_sub_epi32(a, b); }
+        static Int AndInt(Int a, Int b) { return _mm_and_si128(a, b); }
+        static Int EqualInt(Int a, Int b) { return _mm_cmpeq_epi32(a, b); }
+        static Int LessInt(Int a, Int b) { return _mm_cmplt_epi32(a, b); }
+        static Float Greater(Float a, Float b) { return _mm_cmpgt_ps(a, b); }
+        static Float Less(Float a, Float b) { return _mm_cmplt_ps(a, b); }
+        // lanes of mask set take whenTrue
+        static Float Select(Float whenFalse, Float whenTrue, Float mask) { return _mm_blendv_ps(whenFalse, whenTrue, mask); }
+
+        static Int Gather(const int32_t* table, Int index)
+        {
+            alignas(16) int32_t lanes[Width];
+            _mm_store_si128(reinterpret_cast<__m128i*>(lanes), index);
+            return _mm_setr_epi32(table[lanes[0]], table[lanes[1]], table[lanes[2]], table[lanes[3]]);
+        }
+    };
+
+    struct Avx2Lanes
+    {
+        static const size_t Width = 8;
+        typedef __m256 Float;
+        typedef __m256i Int;
+
+        static Float Load(const float* p) { return _mm256_loadu_ps(p); }
+        static void Store(float* p, Float v) { _mm256_storeu_ps(p, v); }
+        static Float Set(float v) { return _mm256_set1_ps(v); }
+        static Int SetInt(int32_t v) { return _mm256_set1_epi32(v); }
+        static Float Add(Float a, Float b) { return _mm256_add_ps(a, b); }
+        static Float Sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+        static Float Mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+        static Float Div(Float a, Float b) { return _mm256_div_ps(a, b); }
+        static Float Xor(Float a, Float b) { return _mm256_xor_ps(a, b); }
+        static Float Floor(Float a) { return _mm256_floor_ps(a); }
+        static Int ToInt(Float a) { return _mm256_cvttps_epi32(a); }
+        static Float ToFloat(Int a) { return _mm256_cvtepi32_ps(a); }
+        static Float AsFloat(Int a) { return _mm256_castsi256_ps(a); }
+        static Int AsInt(Float a) { return _mm256_castps_si256(a); }
+        static Int AddInt(Int a, Int b) { return _mm256_add_epi32(a, b); }
+        static Int SubInt(Int a, Int b) { return _mm256_sub_epi32(a, b); }
+        static Int AndInt(Int a, Int b) { return _mm256_and_si256(a, b); }
+        static Int EqualInt(Int a, Int b) { return _mm256_cmpeq_epi32(a, b); }
+        static Int LessInt(Int a, Int b) { return _mm256_cmpgt_epi32(b, a); }
+        static Float Greater(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+        static Float Less(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+        static Float Select(Float whenFalse, Float whenTrue, Float mask) { return _mm256_blendv_ps(whenFalse, whenTrue, mask); }
+
+        static Int Gather(const int32_t* table, Int index)
+        {
+            return _mm256_i32gather_epi32(table, index, 4);
+        }
+    };
+
+    // perm[uint8_t(i)] of SimplexNoise::hash
+    template <typename V>
+    typename V::Int hashLanes(const int32_t* perm, typename V::Int i)
+    {
+        return V::Gather(perm, V::AndInt(i, V::SetInt(0xFF)));
+    }
+
+    // SimplexNoise::grad(int32_t hash, float x, float y)
+    template <typename V>
+    typename V::Float gradLanes(typename V::Int hash, typename V::Float x, typename V::Float y)
+    {
+        typedef typename V::Float Float;
+        const typename V::Int h = V::AndInt(hash, V::SetInt(0x3F));
+        const Float below4 = V::AsFloat(V::LessInt(h, V::SetInt(4)));
+        const Float u = V::Select(y, x, below4);
+        const Float v = V::Select(x, y, below4);
+        const Float sign = V::Set(-0.0f);
+        const Float uSign = V::AsFloat(V::EqualInt(V::AndInt(h, V::SetInt(1)), V::SetInt(1)));
+        const Float vSign = V::AsFloat(V::EqualInt(V::AndInt(h, V::SetInt(2)), V::SetInt(2)));
+        const Float twoV = V::Mul(V::Set(2.0f), v);
+        return V::Add(V::Select(u, V::Xor(u, sign), uSign), V::Select(twoV, V::Xor(twoV, sign), vSign));
+    }
+
+    // the contribution of one simplex corner, zero outside its radius
+    template <typename V>
+    typename V::Float cornerLanes(typename V::Int hash, typename V::Float x, typename V::Float y)
+    {
+        typedef typename V::Float Float;
+        Float t = V::Sub(V::Sub(V::Set(0.5f), V::Mul(x, x)), V::Mul(y, y));
+        const Float outside = V::Less(t, V::Set(0.0f));
+        t = V::Mul(t, t);
+        const Float n = V::Mul(V::Mul(t, t), gradLanes<V>(hash, x, y));
+        return V::Select(n, V::Set(0.0f), outside);
+    }
+
+    // SimplexNoise::noise(float x, float y)
+    template <typename V>
+    typename V::Float noiseLanes(const int32_t* perm, typename V::Float x, typename V::Float y)
+    {
+        typedef typename V::Float Float;
+        typedef typename V::Int Int;
+        const Int one = V::SetInt(1);
+
+        const Float s = V::Mul(V::Add(x, y), V::Set(F2));
+        const Int i = V::ToInt(V::Floor(V::Add(x, s)));
+        const Int j = V::ToInt(V::Floor(V::Add(y, s)));
+
+        const Float t = V::Mul(V::ToFloat(V::AddInt(i, j)), V::Set(G2));
+        const Float x0 = V::Sub(x, V::Sub(V::ToFloat(i), t));
+        const Float y0 = V::Sub(y, V::Sub(V::ToFloat(j), t));
+
+        // lower triangle (1, 0) when x0 > y0, upper triangle (0, 1) otherwise
+        const Int i1 = V::AndInt(V::AsInt(V::Greater(x0, y0)), one);
+        const Int j1 = V::SubInt(one, i1);
+
+        const Float x1 = V::Add(V::Sub(x0, V::ToFloat(i1)), V::Set(G2));
+        const Float y1 = V::Add(V::Sub(y0, V::ToFloat(j1)), V::Set(G2));
+        const Float x2 = V::Add(V::Sub(x0, V::Set(1.0f)), V::Set(2.0f * G2));
+        const Float y2 = V::Add(V::Sub(y0, V::Set(1.0f)), V::Set(2.0f * G2));
+
+        const Int gi0 = hashLanes<V>(perm, V::AddInt(i, hashLanes<V>(perm, j)));
+        const Int gi1 = hashLanes<V>(perm, V::AddInt(V::AddInt(i, i1), hashLanes<V>(perm, V::AddInt(j, j1))));
+        const Int gi2 = hashLanes<V>(perm, V::AddInt(V::AddInt(i, one), hashLanes<V>(perm, V::AddInt(j, one))));
+
+        const Float n0 = cornerLanes<V>(gi0, x0, y0);
+        const Float n1 = cornerLanes<V>(gi1, x1, y1);
+        const Float n2 = cornerLanes<V>(gi2, x2, y2);
+        return V::Mul(V::Set(45.23065f), V::Add(V::Add(n0, n1), n2));
+    }
+
+    // the octave parameters of one fractal, computed in the scalar order
+    struct Octaves
+    {
+        static const size_t MaxOctaves = 16;
+        size_t count;
+        float frequency[MaxOctaves];
+        float amplitude[MaxOctaves];
+        float denom;
+    };
+
+    template <typename V>
+    typename V::Float fractalLanes(const int32_t* perm, const Octaves& octaves, typename V::Float x,
+                                   typename V::Float y)
+    {
+        typename V::Float output = V::Set(0.0f);
+        for (size_t i = 0; i < octaves.count; i++)
+        {
+            const typename V::Float frequency = V::Set(octaves.frequency[i]);
+            const typename V::Float n = noiseLanes<V>(perm, V::Mul(x, frequency), V::Mul(y, frequency));
+            output = V::Add(output, V::Mul(V::Set(octaves.amplitude[i]), n));
+        }
+        return V::Div(output, V::Set(octaves.denom));
+    }
+
+    // runs body(x, y, index) on every full group of lanes, the last partial group is padded with its first point
+    template <typename V, typename Body>
+    void forEachGroup(const float* x, const float* y, size_t count, Body&& body)
+    {
+        size_t start = 0;
+        for (; start + V::Width <= count; start += V::Width)
+        {
+            body(V::Load(x + start), V::Load(y + start), start, V::Width);
+        }
+        if (start < count)
+        {
+            float tailX[V::Width];
+            float tailY[V::Width];
+            for (size_t lane = 0; lane < V::Width; lane++)
+            {
+                size_t index = start + (lane < count - start ? lane : 0);
+                tailX[lane] = x[index];
+                tailY[lane] = y[index];
+            }
+            body(V::Load(tailX), V::Load(tailY), start, count - start);
+        }
+    }
+
+    template <typename V>
+    void storeLanes(float* out, typename V::Float value, size_t lanes)
+    {
+        if (lanes == V::Width)
+        {
+            V::Store(out, value);
+            return;
+        }
+        float values[V::Width];
+        V::Store(values, value);
+        for (size_t lane = 0; lane < lanes; lane++)
+        {
+            out[lane] = values[lane];
+        }
+    }
+
+    SimplexNoise::SimdLevel detectSimdLevel()
+    {
+        int info[4];
+        __cpuid(info, 1);
+        bool sse41 = (info[2] & (1 << 19)) != 0;
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        bool avx2 = false;
+        // the OS has to save the upper halves of the ymm registers too
+        if (osxsave && avx && (_xgetbv(0) & 0x6) == 0x6)
+        {
+            __cpuidex(info, 7, 0);
+            avx2 = (info[1] & (1 << 5)) != 0;
+        }
+        return avx2 ? SimplexNoise::SimdLevel::Avx2 : sse41 ? SimplexNoise::SimdLevel::Sse41 : SimplexNoise::SimdLevel::Scalar;
+    }
+
+    SimplexNoise::SimdLevel resolveLevel(SimplexNoise::SimdLevel level)
+    {
+        SimplexNoise::SimdLevel supported = SimplexNoise::supportedSimdLevel();
+        return level == SimplexNoise::SimdLevel::Best || level > supported ? supported : level;
+    }
+}
+
+SimplexNoise::SimdLevel SimplexNoise::supportedSimdLevel()
+{
+    static const SimdLevel level = detectSimdLevel();
+    return level;
+}
+
+void SimplexNoise::noiseBatch(const float* x, const float* y, float* out, size_t count, SimdLevel level) const
+{
+    switch (resolveLevel(level))
+    {
+    case SimdLevel::Avx2:
+        forEachGroup<Avx2Lanes>(x, y, count, [&](__m256 px, __m256 py, size_t start, size_t lanes)
+        {
+            storeLanes<Avx2Lanes>(out + start, noiseLanes<Avx2Lanes>(permWide, px, py), lanes);
+        });
+        break;
+    case SimdLevel::Sse41:
+        forEachGroup<Sse41Lanes>(x, y, count, [&](__m128 px, __m128 py, size_t start, size_t lanes)
+        {
+            storeLanes<Sse41Lanes>(out + start, noiseLanes<Sse41Lanes>(permWide, px, py), lanes);
+        });
+        break;
+    default:
+        for (size_t i = 0; i < count; i++)
+        {
+            out[i] = noise(x[i], y[i]);
+        }
+        break;
+    }
+}
+
+void SimplexNoise::fractalBatch(size_t octaves, const float* x, const float* y, float* out, size_t count,
+                                SimdLevel level) const
+{
+    FractalField field{this, octaves, out};
+    fractalFields(&field, 1, x, y, count, level);
+}
+
+void SimplexNoise::fractalFields(const FractalField* fields, size_t fieldCount, const float* x, const float* y,
+                                 size_t count, SimdLevel level)
+{
+    level = resolveLevel(level);
+    const size_t MaxFields = 8;
+    Octaves octaves[MaxFields];
+    for (size_t f = 0; f < fieldCount; f++)
+    {
+        const SimplexNoise& noise = *fields[f].noise;
+        // too many octaves or fields for the fixed tables, the scalar path handles them
+        if (f >= MaxFields || fields[f].octaves > Octaves::MaxOctaves)
+        {
+            level = SimdLevel::Scalar;
+            break;
+        }
+        Octaves& o = octaves[f];
+        o.count = fields[f].octaves;
+        o.denom = 0.f;
+        float frequency = noise.mFrequency;
+        float amplitude = noise.mAmplitude;
+        for (size_t i = 0; i < o.count; i++)
+        {
+            o.frequency[i] = frequency;
+            o.amplitude[i] = amplitude;
+            o.denom += amplitude;
+            frequency *= noise.mLacunarity;
+            amplitude *= noise.mPersistence;
+        }
+    }
+
+    switch (level)
+    {
+    case SimdLevel::Avx2:
+        forEachGroup<Avx2Lanes>(x, y, count, [&](__m256 px, __m256 py, size_t start, size_t lanes)
+        {
+            for (size_t f = 0; f < fieldCount; f++)
+            {
+                __m256 value = fractalLanes<Avx2Lanes>(fields[f].noise->permWide, octaves[f], px, py);
+                storeLanes<Avx2Lanes>(fields[f].out + start, value, lanes);
+            }
+        });
+        break;
+    case SimdLevel::Sse41:
+        forEachGroup<Sse41Lanes>(x, y, count, [&](__m128 px, __m128 py, size_t start, size_t lanes)
+        {
+            for (size_t f = 0; f < fieldCount; f++)
+            {
+                __m128 value = fractalLanes<Sse41Lanes>(fields[f].noise->permWide, octaves[f], px, py);
+                storeLanes<Sse41Lanes>(fields[f].out + start, value, lanes);
+            }
+        });
+        break;
+    default:
+        for (size_t f = 0; f < fieldCount; f++)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                fields[f].out[i] = fields[f].noise->fractal(fields[f].octaves, x[i], y[i]);
+            }
+        }
+        break;
+    }
+}
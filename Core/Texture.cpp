@@ -133,6 +133,65 @@ void Texture::CreateCube( size_t RowPitchBytes, size_t Width, size_t Height, DXG
     g_Device->CreateShaderResourceView(m_pResource.Get(), &srvDesc, m_hCpuDescriptorHandle);
 }
 
+void Texture::Create2DArray( size_t RowPitchBytes, size_t Width, size_t Height, size_t ArraySize, DXGI_FORMAT Format, const void* InitialData )
+{
+    Destroy();
+
+    m_UsageState = D3D12_RESOURCE_STATE_COPY_DEST;
+
+    m_Width = (uint32_t)Width;
+    m_Height = (uint32_t)Height;
+    m_Depth = (uint32_t)ArraySize;
+
+    D3D12_RESOURCE_DESC texDesc = {};
+    texDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+    texDesc.Width = Width;
+    texDesc.Height = (UINT)Height;
+    texDesc.DepthOrArraySize = (UINT16)ArraySize;
+    texDesc.MipLevels = 1;
+    texDesc.Format = Format;
+    texDesc.SampleDesc.Count = 1;
+    texDesc.SampleDesc.Quality = 0;
+    texDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+    texDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+    D3D12_HEAP_PROPERTIES HeapProps;
+    HeapProps.Type = D3D12_HEAP_TYPE_DEFAULT;
+    HeapProps.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+    HeapProps.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+    HeapProps.CreationNodeMask = 1;
+    HeapProps.VisibleNodeMask = 1;
+
+    ASSERT_SUCCEEDED(g_Device->CreateCommittedResource(&HeapProps, D3D12_HEAP_FLAG_NONE, &texDesc,
+        m_UsageState, nullptr, MY_IID_PPV_ARGS(m_pResource.ReleaseAndGetAddressOf())));
+
+    m_pResource->SetName(L"Texture Array");
+
+    std::vector<D3D12_SUBRESOURCE_DATA> texResources(ArraySize);
+    for (size_t i = 0; i < ArraySize; ++i)
+    {
+        texResources[i].RowPitch = RowPitchBytes;
+        texResources[i].SlicePitch = RowPitchBytes * Height;
+        texResources[i].pData = (const uint8_t*)InitialData + i * texResources[i].SlicePitch;
+    }
+
+    CommandContext::InitializeTexture(*this, (UINT)ArraySize, texResources.data());
+
+    if (m_hCpuDescriptorHandle.ptr == D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN)
+        m_hCpuDescriptorHandle = AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+    D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc;
+    srvDesc.Format = Format;
+    srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
+    srvDesc.Texture2DArray.MostDetailedMip = 0;
+    srvDesc.Texture2DArray.MipLevels = 1;
+    srvDesc.Texture2DArray.FirstArraySlice = 0;
+    srvDesc.Texture2DArray.ArraySize = (UINT)ArraySize;
+    srvDesc.Texture2DArray.PlaneSlice = 0;
+    srvDesc.Texture2DArray.ResourceMinLODClamp = 0.0f;
+    g_Device->CreateShaderResourceView(m_pResource.Get(), &srvDesc, m_hCpuDescriptorHandle);
+}
 
 void Texture::CreateTGAFromMemory( const void* _filePtr, size_t, bool sRGB )
 {
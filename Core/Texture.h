@@ -28,6 +28,8 @@ public:
     // Create a 1-level textures
     void Create2D(size_t RowPitchBytes, size_t Width, size_t Height, DXGI_FORMAT Format, const void* InitData );
     void CreateCube(size_t RowPitchBytes, size_t Width, size_t Height, DXGI_FORMAT Format, const void* InitialData);
+    // InitialData holds ArraySize tightly packed slices of RowPitchBytes * Height bytes each
+    void Create2DArray(size_t RowPitchBytes, size_t Width, size_t Height, size_t ArraySize, DXGI_FORMAT Format, const void* InitialData);
 
     void CreateTGAFromMemory( const void* memBuffer, size_t fileSize, bool sRGB );
     bool CreateDDSFromMemory( const void* memBuffer, size_t fileSize, bool sRGB );
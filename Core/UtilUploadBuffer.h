@@ -50,6 +50,17 @@ public:
         memcpy(&mMappedData[elementIndex*mElementByteSize], &data, sizeof(T));
     }
 
+    // direct access for writers filling disjoint element ranges in parallel
+    T* MappedElements() const
+    {
+        return reinterpret_cast<T*>(mMappedData);
+    }
+
+    void CopyRange(int startIndex, const T* data, int elementCount)
+    {
+        memcpy(&mMappedData[startIndex*mElementByteSize], data, sizeof(T)*elementCount);
+    }
+
 private:
     Microsoft::WRL::ComPtr<ID3D12Resource> mUploadBuffer;
     BYTE* mMappedData = nullptr;
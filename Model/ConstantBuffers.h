@@ -66,4 +66,7 @@ __declspec(align(256)) struct GlobalConstants
     Math::Vector3 SunIntensity;
     float IBLRange;
     float IBLBias;
+    // tiles per row of the voxel point light grid (Lighting::UploadBinnedLights), 0 while it is not filled
+    uint32_t LightGridTileCountX = 0;
+    float InvLightGridDim = 0.0f;
 };
\ No newline at end of file
@@ -0,0 +1,295 @@
+#include "LightGridBinning.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+using namespace Lighting;
+
+namespace
+{
+    // the bit mask holds 4 groups of 32 lights per tile
+    constexpr uint32_t kBitMaskWords = 4;
+    constexpr float kMinClipW = 1e-4f;
+
+    bool sameLight(const LightGridBinner::PointLight& a, const LightGridBinner::PointLight& b)
+    {
+        return std::memcmp(&a, &b, sizeof(LightGridBinner::PointLight)) == 0;
+    }
+
+    bool sameView(const LightGridBinner::View& a, const LightGridBinner::View& b)
+    {
+        return std::memcmp(&a, &b, sizeof(LightGridBinner::View)) == 0;
+    }
+}
+
+LightGridBinner::LightGridBinner(uint32_t maxLights)
+    : maxLights(maxLights)
+{
+    assert(maxLights <= 32 * kBitMaskWords);
+    slots.assign(maxLights, PointLight{});
+    slotUsed.assign(maxLights, false);
+    slotRects.assign(maxLights, TileRect{});
+}
+
+// projects the corners of the light's bounding box, a light reaching behind the near plane covers the whole screen
+bool LightGridBinner::project(const View& view, const PointLight& light, TileRect& rect, float& coverage) const
+{
+    const float* m = view.viewProj;
+    float minX = 1.0f;
+    float minY = 1.0f;
+    float maxX = -1.0f;
+    float maxY = -1.0f;
+    bool crossesNear = false;
+    // bit per clip plane (-x, +x, -y, +y, near) that all corners are outside of
+    uint32_t outsideAll = 0x1f;
+    for (int corner = 0; corner < 8; corner++)
+    {
+        float p[3];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            p[axis] = light.pos[axis] + ((corner >> axis) & 1 ? light.radius : -light.radius);
+        }
+        float clip[4];
+        for (int i = 0; i < 4; i++)
+        {
+            clip[i] = p[0] * m[i] + p[1] * m[4 + i] + p[2] * m[8 + i] + m[12 + i];
+        }
+        uint32_t outside = (clip[0] < -clip[3] ? 0x1 : 0) | (clip[0] > clip[3] ? 0x2 : 0)
+            | (clip[1] < -clip[3] ? 0x4 : 0) | (clip[1] > clip[3] ? 0x8 : 0)
+            | (clip[3] < kMinClipW ? 0x10 : 0);
+        outsideAll &= outside;
+        if (clip[3] < kMinClipW)
+        {
+            crossesNear = true;
+            continue;
+        }
+        float x = clip[0] / clip[3];
+        float y = clip[1] / clip[3];
+        minX = std::min(minX, x);
+        minY = std::min(minY, y);
+        maxX = std::max(maxX, x);
+        maxY = std::max(maxY, y);
+    }
+    if (outsideAll != 0)
+    {
+        return false;
+    }
+    if (crossesNear)
+    {
+        minX = minY = -1.0f;
+        maxX = maxY = 1.0f;
+    }
+    minX = std::max(minX, -1.0f);
+    minY = std::max(minY, -1.0f);
+    maxX = std::min(maxX, 1.0f);
+    maxY = std::min(maxY, 1.0f);
+    if (minX > maxX || minY > maxY)
+    {
+        return false;
+    }
+
+    // NDC y points up, pixel rows go down
+    float left = (minX * 0.5f + 0.5f) * view.width;
+    float right = (maxX * 0.5f + 0.5f) * view.width;
+    float top = (0.5f - maxY * 0.5f) * view.height;
+    float bottom = (0.5f - minY * 0.5f) * view.height;
+    rect.minX = std::min(uint32_t(left) / view.tileDim, tileCountX - 1);
+    rect.maxX = std::min(uint32_t(right) / view.tileDim, tileCountX - 1);
+    rect.minY = std::min(uint32_t(top) / view.tileDim, tileCountY - 1);
+    rect.maxY = std::min(uint32_t(bottom) / view.tileDim, tileCountY - 1);
+    // at least one pixel so tiny far lights still rank by brightness
+    coverage = std::max(1.0f, (right - left) * (bottom - top)) / (float(view.width) * float(view.height));
+    return true;
+}
+
+// lights selected again stay in their slot, new ones take the slots freed by lights no longer selected
+void LightGridBinner::assignSlots(const std::vector<uint32_t>& selected, const std::vector<PointLight>& candidates)
+{
+    std::unordered_map<uint32_t, uint32_t> previousSlot;
+    for (uint32_t slot = 0; slot < maxLights; slot++)
+    {
+        if (slotUsed[slot])
+        {
+            previousSlot.emplace(slots[slot].key, slot);
+        }
+    }
+
+    std::vector<bool> taken(maxLights, false);
+    std::vector<uint32_t> pending;
+    std::vector<int> target(selected.size(), -1);
+    for (size_t i = 0; i < selected.size(); i++)
+    {
+        auto it = previousSlot.find(candidates[selected[i]].key);
+        if (it != previousSlot.end() && !taken[it->second])
+        {
+            taken[it->second] = true;
+            target[i] = static_cast<int>(it->second);
+        }
+        else
+        {
+            pending.push_back(static_cast<uint32_t>(i));
+        }
+    }
+    uint32_t freeSlot = 0;
+    for (uint32_t i : pending)
+    {
+        while (taken[freeSlot])
+        {
+            freeSlot++;
+        }
+        taken[freeSlot] = true;
+        target[i] = static_cast<int>(freeSlot);
+    }
+
+    slotsChanged = false;
+    std::vector<PointLight> nextSlots(maxLights, PointLight{});
+    for (size_t i = 0; i < selected.size(); i++)
+    {
+        nextSlots[target[i]] = candidates[selected[i]];
+    }
+    for (uint32_t slot = 0; slot < maxLights; slot++)
+    {
+        if (taken[slot] != slotUsed[slot] || !sameLight(nextSlots[slot], slots[slot]))
+        {
+            slotsChanged = true;
+        }
+        slotUsed[slot] = taken[slot];
+    }
+    slots.swap(nextSlots);
+}
+
+bool LightGridBinner::Bin(const View& view, const std::vector<PointLight>& candidates)
+{
+    dirtyRuns.clear();
+    slotsChanged = false;
+    stats = Stats{};
+    stats.candidates = static_cast<uint32_t>(candidates.size());
+    bool candidatesChanged = candidates.size() != lastCandidates.size()
+        || !std::equal(candidates.begin(), candidates.end(), lastCandidates.begin(), sameLight);
+    if (hasView && sameView(view, lastView) && !candidatesChanged)
+    {
+        stats.skipped = true;
+        return false;
+    }
+
+    uint32_t countX = (view.width + view.tileDim - 1) / view.tileDim;
+    uint32_t countY = (view.height + view.tileDim - 1) / view.tileDim;
+    bool resized = countX != tileCountX || countY != tileCountY;
+    uint32_t tileCount = countX * countY;
+    uint32_t stride = GetTileStride();
+    tileCountX = countX;
+    tileCountY = countY;
+    if (resized)
+    {
+        grid.assign(size_t(tileCount) * stride, 0);
+        bitMask.assign(size_t(tileCount) * kBitMaskWords, 0);
+        nextGrid.assign(grid.size(), 0);
+        nextBitMask.assign(bitMask.size(), 0);
+    }
+
+    // rank by screen contribution, ties by key so the selection does not depend on gather order
+    std::vector<TileRect> rects(candidates.size());
+    std::vector<float> scores(candidates.size(), 0.0f);
+    std::vector<uint32_t> visible;
+    for (uint32_t i = 0; i < candidates.size(); i++)
+    {
+        const PointLight& light = candidates[i];
+        float coverage;
+        if (tileCount == 0 || light.radius <= 0.0f || !project(view, light, rects[i], coverage))
+        {
+            stats.culled++;
+            continue;
+        }
+        float brightness = std::max(light.color[0], std::max(light.color[1], light.color[2]));
+        scores[i] = coverage * brightness;
+        visible.push_back(i);
+    }
+    size_t keep = std::min<size_t>(visible.size(), maxLights);
+    std::partial_sort(visible.begin(), visible.begin() + keep, visible.end(), [&](uint32_t a, uint32_t b)
+    {
+        if (scores[a] != scores[b])
+        {
+            return scores[a] > scores[b];
+        }
+        return candidates[a].key < candidates[b].key;
+    });
+    visible.resize(keep);
+    stats.binned = static_cast<uint32_t>(keep);
+
+    assignSlots(visible, candidates);
+    std::unordered_map<uint32_t, uint32_t> candidateOfKey;
+    for (uint32_t i : visible)
+    {
+        candidateOfKey.emplace(candidates[i].key, i);
+    }
+    for (uint32_t slot = 0; slot < maxLights; slot++)
+    {
+        if (slotUsed[slot])
+        {
+            slotRects[slot] = rects[candidateOfKey[slots[slot].key]];
+        }
+    }
+
+    // slots are visited in order, so every tile lists its lights by ascending index like the compute shader
+    for (uint32_t tile = 0; tile < tileCount; tile++)
+    {
+        nextGrid[size_t(tile) * stride] = 0;
+    }
+    std::fill(nextBitMask.begin(), nextBitMask.end(), 0u);
+    for (uint32_t slot = 0; slot < maxLights; slot++)
+    {
+        if (!slotUsed[slot])
+        {
+            continue;
+        }
+        const TileRect& rect = slotRects[slot];
+        for (uint32_t y = rect.minY; y <= rect.maxY; y++)
+        {
+            for (uint32_t x = rect.minX; x <= rect.maxX; x++)
+            {
+                uint32_t tile = y * tileCountX + x;
+                uint32_t* header = &nextGrid[size_t(tile) * stride];
+                header[1 + *header] = slot;
+                (*header)++;
+                nextBitMask[size_t(tile) * kBitMaskWords + slot / 32] |= 1u << (slot % 32);
+            }
+        }
+    }
+
+    // compare only the words each tile uses, consecutive changed tiles form one upload run
+    for (uint32_t tile = 0; tile < tileCount; tile++)
+    {
+        const uint32_t* next = &nextGrid[size_t(tile) * stride];
+        const uint32_t* current = &grid[size_t(tile) * stride];
+        bool dirty = resized || next[0] != current[0]
+            || std::memcmp(next + 1, current + 1, next[0] * sizeof(uint32_t)) != 0
+            || std::memcmp(&nextBitMask[size_t(tile) * kBitMaskWords], &bitMask[size_t(tile) * kBitMaskWords],
+                           kBitMaskWords * sizeof(uint32_t)) != 0;
+        if (!dirty)
+        {
+            continue;
+        }
+        stats.dirtyTiles++;
+        if (!dirtyRuns.empty() && dirtyRuns.back().second == tile)
+        {
+            dirtyRuns.back().second = tile + 1;
+        }
+        else
+        {
+            dirtyRuns.emplace_back(tile, tile + 1);
+        }
+    }
+    grid.swap(nextGrid);
+    bitMask.swap(nextBitMask);
+
+    lastView = view;
+    hasView = true;
+    if (candidatesChanged)
+    {
+        lastCandidates = candidates;
+    }
+    return true;
+}
@@ -0,0 +1,132 @@
+/**
+ * CPU 端的 Forward+ 光源分块 (tile binning)
+ * 输出与 FillLightGridCS / LightGrid.hlsli 相同的布局，着色器无需区分光源网格是 GPU 还是 CPU 填充的：
+ *   m_LightGrid:        每个 tile (4 + MaxLights * 4) 字节，首个 uint 为点光源数量，之后是光源下标
+ *   m_LightGridBitMask: 每个 tile 4 个 uint，下标为 i 的光源占第 i / 32 组的第 i % 32 位
+ * 1. 候选光源按屏幕贡献 (投影面积 * 亮度) 排序，最多保留 maxLights 个
+ * 2. 上一帧仍被选中的光源保持原来的 slot，光源缓冲和 tile 中的下标尽量不变
+ * 3. 视图和候选光源都没有变化时跳过整个分块；否则只记录内容真正变化的 tile 区间，只需上传这些区间
+ * 只依赖标准库，可以脱离 D3D 单独运行和测试。与 GPU 版本不同，没有深度信息，tile 只按光源包围球的屏幕矩形剔除。
+ */
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace Lighting
+{
+    class LightGridBinner
+    {
+    public:
+        struct PointLight
+        {
+            float pos[3];
+            float radius;
+            float color[3];
+            // identifies where the light comes from, e.g. its block, so it keeps its slot across frames
+            uint32_t key;
+        };
+
+        struct View
+        {
+            // row vector convention as Math::Matrix4 stores it: clip = float4(pos, 1) * viewProj
+            float viewProj[16];
+            uint32_t width;
+            uint32_t height;
+            uint32_t tileDim;
+        };
+
+        struct Stats
+        {
+            uint32_t candidates = 0;
+            uint32_t culled = 0;
+            uint32_t binned = 0;
+            uint32_t dirtyTiles = 0;
+            // neither the view nor the candidates changed, the grid was left as it was
+            bool skipped = false;
+        };
+
+        explicit LightGridBinner(uint32_t maxLights);
+
+        // returns false when nothing changed since the last call, then there is nothing to upload
+        bool Bin(const View& view, const std::vector<PointLight>& candidates);
+
+        uint32_t GetTileCountX() const
+        {
+            return tileCountX;
+        }
+        uint32_t GetTileCountY() const
+        {
+            return tileCountY;
+        }
+        // uint words of one tile in the grid, header plus one index per light
+        uint32_t GetTileStride() const
+        {
+            return 1 + maxLights;
+        }
+        // words of the tile actually in use, the rest of its stride is never read
+        uint32_t GetTileUsedWords(uint32_t tile) const
+        {
+            return 1 + (grid[tile * GetTileStride()] & 0xff);
+        }
+        // one entry per slot, slots without a light have radius 0
+        const std::vector<PointLight>& GetSlots() const
+        {
+            return slots;
+        }
+        const std::vector<uint32_t>& GetGrid() const
+        {
+            return grid;
+        }
+        const std::vector<uint32_t>& GetBitMask() const
+        {
+            return bitMask;
+        }
+        // [first, last) tile ranges whose grid or bit mask changed in the last Bin
+        const std::vector<std::pair<uint32_t, uint32_t>>& GetDirtyTileRuns() const
+        {
+            return dirtyRuns;
+        }
+        // whether any slot got a different light in the last Bin
+        bool SlotsChanged() const
+        {
+            return slotsChanged;
+        }
+        const Stats& GetStats() const
+        {
+            return stats;
+        }
+
+    private:
+        struct TileRect
+        {
+            uint32_t minX;
+            uint32_t minY;
+            uint32_t maxX;
+            uint32_t maxY;
+        };
+
+        bool project(const View& view, const PointLight& light, TileRect& rect, float& coverage) const;
+        void assignSlots(const std::vector<uint32_t>& selected, const std::vector<PointLight>& candidates);
+
+        uint32_t maxLights;
+        uint32_t tileCountX = 0;
+        uint32_t tileCountY = 0;
+        bool hasView = false;
+        View lastView{};
+        std::vector<PointLight> lastCandidates;
+
+        std::vector<PointLight> slots;
+        std::vector<bool> slotUsed;
+        std::vector<TileRect> slotRects;
+        std::vector<uint32_t> grid;
+        std::vector<uint32_t> bitMask;
+        // the next grid is built here and swapped in, so unchanged tiles can be compared against the current one
+        std::vector<uint32_t> nextGrid;
+        std::vector<uint32_t> nextBitMask;
+        std::vector<std::pair<uint32_t, uint32_t>> dirtyRuns;
+        bool slotsChanged = false;
+        Stats stats;
+    };
+}
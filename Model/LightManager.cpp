@@ -13,6 +13,7 @@
 //
 
 #include "LightManager.h"
+#include "LightGridBinning.h"
 #include "PipelineState.h"
 #include "RootSignature.h"
 #include "CommandContext.h"
@@ -70,6 +71,7 @@ namespace Lighting
     void InitializeResources(void);
     void CreateRandomLights(const Vector3 minBound, const Vector3 maxBound);
     void FillLightGrid(GraphicsContext& gfxContext, const Camera& camera);
+    void UploadBinnedLights(CommandContext& context, const LightGridBinner& binner);
     void Shutdown(void);
 }
 
@@ -329,3 +331,72 @@ void Lighting::FillLightGrid(GraphicsContext& gfxContext, const Camera& camera)
     Context.TransitionResource(m_LightGrid, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
     Context.TransitionResource(m_LightGridBitMask, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
 }
+
+void Lighting::UploadBinnedLights(CommandContext& context, const LightGridBinner& binner)
+{
+    ScopedTimer _prof(L"UploadBinnedLights", context);
+
+    const auto& runs = binner.GetDirtyTileRuns();
+    if (!binner.SlotsChanged() && runs.empty())
+    {
+        return;
+    }
+
+    if (binner.SlotsChanged())
+    {
+        const auto& slots = binner.GetSlots();
+        memset(m_LightData, 0, sizeof(m_LightData));
+        for (uint32_t n = 0; n < slots.size() && n < MaxLights; n++)
+        {
+            LightData& light = m_LightData[n];
+            memcpy(light.pos, slots[n].pos, sizeof(light.pos));
+            light.radiusSq = slots[n].radius * slots[n].radius;
+            memcpy(light.color, slots[n].color, sizeof(light.color));
+            light.type = 0;
+        }
+        m_FirstConeLight = MaxLights;
+        m_FirstConeShadowedLight = MaxLights;
+        DynAlloc staging = context.ReserveUploadMemory(sizeof(m_LightData));
+        memcpy(staging.DataPtr, m_LightData, sizeof(m_LightData));
+        context.CopyBufferRegion(m_LightBuffer, 0, staging.Buffer, staging.Offset, sizeof(m_LightData));
+    }
+
+    if (!runs.empty())
+    {
+        // the last tile of a run only needs its used words, everything behind its count is never read
+        const uint32_t stride = binner.GetTileStride() * sizeof(uint32_t);
+        auto runGridBytes = [&](const std::pair<uint32_t, uint32_t>& run) -> size_t
+        {
+            return (run.second - 1 - run.first) * stride + binner.GetTileUsedWords(run.second - 1) * 4;
+        };
+        size_t gridBytes = 0;
+        size_t maskBytes = 0;
+        for (const auto& run : runs)
+        {
+            gridBytes += runGridBytes(run);
+            maskBytes += (run.second - run.first) * 16;
+        }
+        DynAlloc staging = context.ReserveUploadMemory(gridBytes + maskBytes);
+        uint8_t* dest = (uint8_t*)staging.DataPtr;
+        size_t offset = 0;
+
+        for (const auto& run : runs)
+        {
+            size_t bytes = runGridBytes(run);
+            memcpy(dest + offset, &binner.GetGrid()[run.first * binner.GetTileStride()], bytes);
+            context.CopyBufferRegion(m_LightGrid, run.first * stride, staging.Buffer, staging.Offset + offset, bytes);
+            offset += bytes;
+        }
+        for (const auto& run : runs)
+        {
+            size_t bytes = (run.second - run.first) * 16;
+            memcpy(dest + offset, &binner.GetBitMask()[run.first * 4], bytes);
+            context.CopyBufferRegion(m_LightGridBitMask, run.first * 16, staging.Buffer, staging.Offset + offset, bytes);
+            offset += bytes;
+        }
+    }
+
+    context.TransitionResource(m_LightBuffer, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    context.TransitionResource(m_LightGrid, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    context.TransitionResource(m_LightGridBitMask, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+}
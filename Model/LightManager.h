@@ -21,6 +21,7 @@ class ByteAddressBuffer;
 class ColorBuffer;
 class ShadowBuffer;
 class GraphicsContext;
+class CommandContext;
 class IntVar;
 namespace Math
 {
@@ -31,6 +32,8 @@ namespace Math
 
 namespace Lighting
 {
+    class LightGridBinner;
+
     extern IntVar LightGridDim;
 
     enum { MaxLights = 128 };
@@ -50,5 +53,7 @@ namespace Lighting
     void InitializeResources(void);
     void CreateRandomLights(const Math::Vector3 minBound, const Math::Vector3 maxBound);
     void FillLightGrid(GraphicsContext& gfxContext, const Math::Camera& camera);
+    // uploads the lights and the changed tiles of a grid binned on the CPU, in place of FillLightGrid
+    void UploadBinnedLights(CommandContext& context, const LightGridBinner& binner);
     void Shutdown(void);
 }
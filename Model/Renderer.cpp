@@ -47,6 +47,9 @@
 #include "CompiledShaders/CutoutDepthPS.h"
 #include "CompiledShaders/SkyboxVS.h"
 #include "CompiledShaders/SkyboxPS.h"
+#include "CompiledShaders/BlockVS.h"
+#include "CompiledShaders/BlockDepthVS.h"
+#include "CompiledShaders/BlockPS.h"
 
 #pragma warning(disable:4319) // '~': zero extending 'uint32_t' to 'uint64_t' of greater size
 
@@ -79,7 +82,17 @@ namespace Renderer
     GraphicsPSO m_DefaultPSO(L"Renderer: Default PSO"); // Not finalized.  Used as a template.
     GraphicsPSO m_OcclusionPSO(L"Renderer: OcclusionPSO");
 
+    // voxel blocks: procedural cube, no input layout, one draw per pass
+    GraphicsPSO m_BlockDepthPSO(L"Renderer: Block Depth PSO");
+    GraphicsPSO m_BlockShadowPSO(L"Renderer: Block Shadow PSO");
+    GraphicsPSO m_BlockColorPSO(L"Renderer: Block Color PSO");
+    GraphicsPSO m_BlockColorEqualPSO(L"Renderer: Block Color Equal PSO");
+    GraphicsPSO m_BlockTransparentPSO(L"Renderer: Block Transparent PSO");
+    // matches VOXEL_CUBE_VERTEX_COUNT in VoxelBlock.hlsli
+    constexpr uint32_t kVoxelCubeVertexCount = 36;
+
     DescriptorHandle m_CommonTextures;
+    DescriptorHandle m_BlockTextures;
 }
 
 D3D12_INPUT_ELEMENT_DESC posOnly[] =
@@ -116,6 +129,8 @@ void Renderer::Initialize(void)
     m_RootSig[kCommonCBV].InitAsConstantBuffer(1);
     m_RootSig[kSkinMatrices].InitAsBufferSRV(20, D3D12_SHADER_VISIBILITY_VERTEX);
     m_RootSig[kInstanceData].InitAsBufferSRV(0, D3D12_SHADER_VISIBILITY_VERTEX, 2);
+    m_RootSig[kChunkOrigins].InitAsBufferSRV(1, D3D12_SHADER_VISIBILITY_VERTEX, 2);
+    m_RootSig[kInstanceIndices].InitAsBufferSRV(2, D3D12_SHADER_VISIBILITY_VERTEX, 2);
     m_RootSig.Finalize(L"RootSig", D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
     DXGI_FORMAT ColorFormat = g_SceneColorBuffer.GetFormat();
@@ -261,6 +276,37 @@ void Renderer::Initialize(void)
     m_SkyboxPSO.SetPixelShader(g_pSkyboxPS, sizeof(g_pSkyboxPS));
     m_SkyboxPSO.Finalize();
 
+    // Block PSOs
+
+    m_BlockDepthPSO.SetRootSignature(m_RootSig);
+    m_BlockDepthPSO.SetRasterizerState(RasterizerDefault);
+    m_BlockDepthPSO.SetBlendState(BlendDisable);
+    m_BlockDepthPSO.SetDepthStencilState(DepthStateReadWrite);
+    m_BlockDepthPSO.SetInputLayout(0, nullptr);
+    m_BlockDepthPSO.SetPrimitiveTopologyType(D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE);
+    m_BlockDepthPSO.SetRenderTargetFormats(0, nullptr, DepthFormat);
+    m_BlockDepthPSO.SetVertexShader(g_pBlockDepthVS, sizeof(g_pBlockDepthVS));
+    m_BlockDepthPSO.Finalize();
+
+    m_BlockShadowPSO = m_BlockDepthPSO;
+    m_BlockShadowPSO.SetRasterizerState(RasterizerShadow);
+    m_BlockShadowPSO.SetRenderTargetFormats(0, nullptr, g_ShadowBuffer.GetFormat());
+    m_BlockShadowPSO.Finalize();
+
+    m_BlockColorPSO = m_DefaultPSO;
+    m_BlockColorPSO.SetVertexShader(g_pBlockVS, sizeof(g_pBlockVS));
+    m_BlockColorPSO.SetPixelShader(g_pBlockPS, sizeof(g_pBlockPS));
+    m_BlockColorPSO.Finalize();
+
+    m_BlockColorEqualPSO = m_BlockColorPSO;
+    m_BlockColorEqualPSO.SetDepthStencilState(DepthStateTestEqual);
+    m_BlockColorEqualPSO.Finalize();
+
+    m_BlockTransparentPSO = m_BlockColorPSO;
+    m_BlockTransparentPSO.SetBlendState(BlendPreMultiplied);
+    m_BlockTransparentPSO.SetDepthStencilState(DepthStateReadOnly);
+    m_BlockTransparentPSO.Finalize();
+
     TextureManager::Initialize(L"");
 
     s_TextureHeap.Create(L"Scene Texture Descriptors", D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, 4096);
@@ -272,6 +318,9 @@ void Renderer::Initialize(void)
 
     // Allocate a descriptor table for the common textures
     m_CommonTextures = s_TextureHeap.Alloc(8);
+    m_BlockTextures = s_TextureHeap.Alloc(1);
+    g_Device->CopyDescriptorsSimple(1, m_BlockTextures, GetDefaultTexture(kMagenta2D),
+                                    D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 
     uint32_t DestCount = 8;
     uint32_t SourceCounts[] = {1, 1, 1, 1, 1, 1, 1, 1};
@@ -350,6 +399,11 @@ void Renderer::SetIBLTextures(TextureRef diffuseIBL, TextureRef specularIBL)
                               D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 }
 
+void Renderer::SetBlockTextures(D3D12_CPU_DESCRIPTOR_HANDLE blockTextureArray)
+{
+    g_Device->CopyDescriptorsSimple(1, m_BlockTextures, blockTextureArray, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+}
+
 void Renderer::SetIBLBias(float LODBias)
 {
     s_SpecularIBLBias = Min(LODBias, s_SpecularIBLRange);
@@ -704,11 +758,6 @@ void MeshSorter::RenderMeshes(
     GlobalConstants& globals)
 {
     ASSERT(m_DSV != nullptr);
-    BlockResourceManager::InstancesManager& manager = BlockResourceManager::getManager(currentBlockType);
-    if (manager.visibleBlockNumber == 0)
-    {
-        return;
-    }
     Renderer::UpdateGlobalDescriptors();
 
 
@@ -717,9 +766,6 @@ void MeshSorter::RenderMeshes(
                                      ? D3D_PRIMITIVE_TOPOLOGY_LINELIST
                                      : D3D10_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
-    context.GetCommandList()->SetGraphicsRootShaderResourceView(kInstanceData,
-                                                                manager.InstanceBuffer->Resource()->
-                                                                        GetGPUVirtualAddress());
     context.SetDescriptorHeap(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, s_TextureHeap.GetHeapPointer());
     context.SetDescriptorHeap(D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER, s_SamplerHeap.GetHeapPointer());
 
@@ -781,8 +827,11 @@ void MeshSorter::RenderMeshes(
 
     for (; m_CurrentPass <= pass; m_CurrentPass = (DrawPass)(m_CurrentPass + 1))
     {
+        GraphicsPSO* pso = nullptr;
+        BlockResourceManager::InstancesManager* manager = GetPassBlocks(m_CurrentPass, pso);
+        const bool drawBlocks = manager != nullptr && manager->visibleBlockNumber > 0;
         const uint32_t passCount = m_PassCounts[m_CurrentPass];
-        if (passCount == 0)
+        if (!drawBlocks && passCount == 0)
             continue;
 
         if (m_BatchType == kDefault)
@@ -818,57 +867,9 @@ void MeshSorter::RenderMeshes(
         context.SetViewportAndScissor(m_Viewport, m_Scissor);
         context.FlushResourceBarriers();
 
-        const uint32_t lastDraw = m_CurrentDraw + passCount;
-
-        while (m_CurrentDraw < lastDraw)
-        {
-            SortKey key;
-            key.value = m_SortKeys[m_CurrentDraw];
-            const SortObject& object = m_SortObjects[key.objectIdx];
-            const Mesh& mesh = *object.mesh;
-
-            //context.SetConstantBuffer(kMeshConstants, object.meshCBV);
-            context.SetConstantBuffer(kMaterialConstants, object.materialCBV);
-            context.SetDescriptorTable(kMaterialSRVs, s_TextureHeap[mesh.srvTable]);
-            context.SetDescriptorTable(kMaterialSamplers, s_SamplerHeap[mesh.samplerTable]);
-            if (mesh.numJoints > 0)
-            {
-                ASSERT(object.skeleton != nullptr, "Unspecified joint matrix array");
-                context.SetDynamicSRV(kSkinMatrices, sizeof(Joint) * mesh.numJoints, object.skeleton + mesh.startJoint);
-            }
-            context.SetPipelineState(sm_PSOs[key.psoIdx]);
-
-            if (m_CurrentPass == kZPass)
-            {
-                bool alphaTest = (mesh.psoFlags & PSOFlags::kAlphaTest) == PSOFlags::kAlphaTest;
-                uint32_t stride = alphaTest ? 16u : 12u;
-                if (mesh.numJoints > 0)
-                    stride += 16;
-                context.SetVertexBuffer(0, {object.bufferPtr + mesh.vbDepthOffset, mesh.vbDepthSize, stride});
-            }
-            else
-            {
-                context.SetVertexBuffer(0, {object.bufferPtr + mesh.vbOffset, mesh.vbSize, mesh.vbStride});
-            }
-
-            context.SetIndexBuffer({object.bufferPtr + mesh.ibOffset, mesh.ibSize, (DXGI_FORMAT)mesh.ibFormat});
-            // for (uint32_t i = 0; i < mesh.numDraws; ++i)
-            // {
-            //     //context.DrawIndexed(mesh.draw[i].primCount, mesh.draw[i].startIndex, mesh.draw[i].baseVertex);
-            //     std::cout << "checkMesh: primCount: " << mesh.draw[i].primCount<<std::endl;
-            //     std::cout << "checkMesh: startIndex: " << mesh.draw[i].startIndex<<std::endl;
-            //     std::cout << "checkMesh: baseVertex: " << mesh.draw[i].baseVertex<<std::endl;
-            //     std::cout << "checkMesh: vbOffset: " << mesh.vbOffset<<std::endl;
-            //     std::cout << "checkMesh: vbDepthOffset: " << mesh.vbDepthOffset<<std::endl;
-            //     std::cout << "checkMesh: numDraws: " << mesh.numDraws<<std::endl;
-            //     std::cout << "checkMesh: ibOffset " << mesh.ibOffset<<std::endl;
-            // }
-
-            context.DrawIndexedInstanced(mesh.draw[0].primCount, manager.visibleBlockNumber, 0, 0, 0);
-            // context.DrawIndexedInstanced(36, ModelCount,0,0,1);
-            // context.DrawIndexedInstanced(36, 1,0,0,3);
-            ++m_CurrentDraw;
-        }
+        if (drawBlocks)
+            DrawBlocks(context, *pso, *manager);
+        DrawMeshes(context, passCount);
     }
 
     if (m_BatchType == kShadows)
@@ -885,12 +886,6 @@ void MeshSorter::RenderMeshes(
 {
     ASSERT(m_DSV != nullptr);
 
-    BlockResourceManager::InstancesManager& manager = BlockResourceManager::getManager(currentBlockType);
-    if (manager.visibleBlockNumber ==0)
-    {
-        return;
-    }
-    
     Renderer::UpdateGlobalDescriptors();
 
     context.SetRootSignature(m_RootSig);
@@ -955,13 +950,13 @@ void MeshSorter::RenderMeshes(
         }
     }
 
-    context.GetCommandList()->SetGraphicsRootShaderResourceView(kInstanceData,
-                                                                manager.InstanceBuffer->Resource()->
-                                                                        GetGPUVirtualAddress());
     for (; m_CurrentPass <= pass; m_CurrentPass = (DrawPass)(m_CurrentPass + 1))
     {
+        GraphicsPSO* pso = nullptr;
+        BlockResourceManager::InstancesManager* manager = GetPassBlocks(m_CurrentPass, pso);
+        const bool drawBlocks = manager != nullptr && manager->visibleBlockNumber > 0;
         const uint32_t passCount = m_PassCounts[m_CurrentPass];
-        if (passCount == 0)
+        if (!drawBlocks && passCount == 0)
             continue;
 
         if (m_BatchType == kDefault)
@@ -997,51 +992,89 @@ void MeshSorter::RenderMeshes(
         context.SetViewportAndScissor(m_Viewport, m_Scissor);
         context.FlushResourceBarriers();
 
-        const uint32_t lastDraw = m_CurrentDraw + passCount;
+        if (drawBlocks)
+            DrawBlocks(context, *pso, *manager);
+        DrawMeshes(context, passCount);
+    }
 
-        while (m_CurrentDraw < lastDraw)
-        {
-            SortKey key;
-            key.value = m_SortKeys[m_CurrentDraw];
-            const SortObject& object = m_SortObjects[key.objectIdx];
-            const Mesh& mesh = *object.mesh;
+    if (m_BatchType == kShadows)
+    {
+        context.TransitionResource(*m_DSV, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    }
+}
 
-            context.SetConstantBuffer(kMeshConstants, object.meshCBV);
-            context.SetConstantBuffer(kMaterialConstants, object.materialCBV);
-            context.SetDescriptorTable(kMaterialSRVs, s_TextureHeap[mesh.srvTable]);
-            context.SetDescriptorTable(kMaterialSamplers, s_SamplerHeap[mesh.samplerTable]);
-            if (mesh.numJoints > 0)
-            {
-                ASSERT(object.skeleton != nullptr, "Unspecified joint matrix array");
-                context.SetDynamicSRV(kSkinMatrices, sizeof(Joint) * mesh.numJoints, object.skeleton + mesh.startJoint);
-            }
-            context.SetPipelineState(sm_PSOs[key.psoIdx]);
+BlockResourceManager::InstancesManager* MeshSorter::GetPassBlocks(DrawPass pass, GraphicsPSO*& pso) const
+{
+    if (m_BatchType == kShadows)
+    {
+        if (pass != kZPass)
+            return nullptr;
+        pso = &m_BlockShadowPSO;
+        return &BlockResourceManager::getManager(OpaqueBucket);
+    }
 
-            if (m_CurrentPass == kZPass)
-            {
-                bool alphaTest = (mesh.psoFlags & PSOFlags::kAlphaTest) == PSOFlags::kAlphaTest;
-                uint32_t stride = alphaTest ? 16u : 12u;
-                if (mesh.numJoints > 0)
-                    stride += 16;
-                context.SetVertexBuffer(0, {object.bufferPtr + mesh.vbDepthOffset, mesh.vbDepthSize, stride});
-            }
-            else
-            {
-                context.SetVertexBuffer(0, {object.bufferPtr + mesh.vbOffset, mesh.vbSize, mesh.vbStride});
-            }
+    switch (pass)
+    {
+    case kZPass:
+        if (!SeparateZPass)
+            return nullptr;
+        pso = &m_BlockDepthPSO;
+        return &BlockResourceManager::getManager(OpaqueBucket);
+    case kOpaque:
+        pso = SeparateZPass ? &m_BlockColorEqualPSO : &m_BlockColorPSO;
+        return &BlockResourceManager::getManager(OpaqueBucket);
+    default:
+        pso = &m_BlockTransparentPSO;
+        return &BlockResourceManager::getManager(TransparentBucket);
+    }
+}
 
-            context.SetIndexBuffer({object.bufferPtr + mesh.ibOffset, mesh.ibSize, (DXGI_FORMAT)mesh.ibFormat});
+void MeshSorter::DrawBlocks(GraphicsContext& context, GraphicsPSO& pso,
+                            BlockResourceManager::InstancesManager& manager)
+{
+    context.SetPipelineState(pso);
+    context.SetDescriptorTable(kMaterialSRVs, m_BlockTextures);
+    context.GetCommandList()->SetGraphicsRootShaderResourceView(kInstanceData,
+                                                                manager.InstanceBuffer->Resource()->
+                                                                        GetGPUVirtualAddress());
+    context.GetCommandList()->SetGraphicsRootShaderResourceView(kChunkOrigins,
+                                                                BlockResourceManager::ChunkOriginTable->Resource()->
+                                                                        GetGPUVirtualAddress());
+    context.GetCommandList()->SetGraphicsRootShaderResourceView(kInstanceIndices,
+                                                                manager.IndexBuffer->Resource()->
+                                                                        GetGPUVirtualAddress());
+    context.DrawInstanced(kVoxelCubeVertexCount, manager.visibleBlockNumber, 0, 0);
+}
 
-            // for (uint32_t i = 0; i < mesh.numDraws; ++i)
-            //     context.DrawIndexed(mesh.draw[i].primCount, mesh.draw[i].startIndex, mesh.draw[i].baseVertex);
-            context.DrawIndexedInstanced(mesh.draw[0].primCount, manager.visibleBlockNumber, 0, 0, 0);
-            ++m_CurrentDraw;
-        }
-    }
+void MeshSorter::DrawMeshes(GraphicsContext& context, uint32_t drawCount)
+{
+    const uint32_t lastDraw = m_CurrentDraw + drawCount;
 
-    if (m_BatchType == kShadows)
+    while (m_CurrentDraw < lastDraw)
     {
-        context.TransitionResource(*m_DSV, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+        SortKey key;
+        key.value = m_SortKeys[m_CurrentDraw];
+        const SortObject& object = m_SortObjects[key.objectIdx];
+        const Mesh& mesh = *object.mesh;
+
+        context.SetConstantBuffer(kMeshConstants, object.meshCBV);
+        context.SetConstantBuffer(kMaterialConstants, object.materialCBV);
+        context.SetDescriptorTable(kMaterialSRVs, s_TextureHeap[mesh.srvTable]);
+        context.SetDescriptorTable(kMaterialSamplers, s_SamplerHeap[mesh.samplerTable]);
+        if (mesh.numJoints > 0)
+        {
+            ASSERT(object.skeleton != nullptr, "Unspecified joint matrix array");
+            context.SetDynamicSRV(kSkinMatrices, sizeof(Joint) * mesh.numJoints, object.skeleton + mesh.startJoint);
+        }
+        context.SetPipelineState(sm_PSOs[key.psoIdx]);
+        context.SetVertexBuffer(0, {object.bufferPtr + mesh.vbOffset, mesh.vbSize, mesh.vbStride});
+        context.SetIndexBuffer({object.bufferPtr + mesh.ibOffset, mesh.ibSize, (DXGI_FORMAT)mesh.ibFormat});
+
+        for (uint32_t i = 0; i < mesh.numDraws; ++i)
+        {
+            context.DrawIndexed(mesh.draw[i].primCount, mesh.draw[i].startIndex, mesh.draw[i].baseVertex);
+        }
+        ++m_CurrentDraw;
     }
 }
 
@@ -50,6 +50,7 @@ namespace Renderer
     extern DescriptorHeap s_TextureHeap;
     extern DescriptorHeap s_SamplerHeap;
     extern DescriptorHandle m_CommonTextures;
+    extern DescriptorHandle m_BlockTextures;
 
     enum RootBindings
     {
@@ -61,6 +62,8 @@ namespace Renderer
         kCommonCBV,
         kSkinMatrices,
 		kInstanceData,
+		kChunkOrigins,
+		kInstanceIndices,
         kNumRootBindings
     };
 
@@ -70,6 +73,7 @@ namespace Renderer
     uint8_t GetPSO(uint16_t psoFlags);
     void SetIBLTextures(TextureRef diffuseIBL, TextureRef specularIBL);
     void SetIBLBias(float LODBias);
+    void SetBlockTextures(D3D12_CPU_DESCRIPTOR_HANDLE blockTextureArray);
     void UpdateGlobalDescriptors(void);
     void DrawSkybox( GraphicsContext& gfxContext, const Camera& camera, const D3D12_VIEWPORT& viewport, const D3D12_RECT& scissor );
 
@@ -79,8 +83,6 @@ namespace Renderer
 		enum BatchType { kDefault, kShadows };
         enum DrawPass { kZPass, kOpaque, kTransparent, kNumPasses };
 
-    	BlockType currentBlockType;
-
 		MeshSorter(BatchType type)
 		{
 			m_BatchType = type;
@@ -124,6 +126,11 @@ namespace Renderer
 		void RenderMeshes(DrawPass pass, GraphicsContext& context, GlobalConstants& globals, const Matrix4& viewprojmat);
 		void ClearMeshes();
 	private:
+		// the block instance pool and PSO drawn in a pass, nullptr when the pass draws no blocks
+		BlockResourceManager::InstancesManager* GetPassBlocks(DrawPass pass, GraphicsPSO*& pso) const;
+		void DrawBlocks(GraphicsContext& context, GraphicsPSO& pso, BlockResourceManager::InstancesManager& manager);
+		// draws the next drawCount sorted meshes (model instances added with AddMesh), Sort() must run first
+		void DrawMeshes(GraphicsContext& context, uint32_t drawCount);
 
         struct SortKey
         {
@@ -0,0 +1,35 @@
+//
+// Depth-only and shadow variant of BlockVS.hlsl.
+//
+
+#include "VoxelBlock.hlsli"
+
+cbuffer GlobalConstants : register(b1)
+{
+    float4x4 ViewProjMatrix;
+}
+
+struct VSOutput
+{
+    float4 position : SV_POSITION;
+};
+
+// [RootSignature(Renderer_RootSig)]
+VSOutput main(uint vertexID : SV_VertexID, uint instanceID : SV_InstanceID)
+{
+    VSOutput vsOutput;
+
+    InstanceData instData = gInstanceData[gInstanceIndices[instanceID]];
+    DecodedInstance inst = UnpackInstance(instData);
+    float3 blockCenter = GetBlockCenter(inst, gChunkOrigins[BLOCK_TYPE_SLOTS + inst.ChunkIndex]);
+    VoxelVertex vertex = GetVoxelVertex(vertexID, instData.AO);
+    float3 worldPos = blockCenter + vertex.position * gChunkOrigins[inst.BlockType].x;
+
+    vsOutput.position = mul(ViewProjMatrix, float4(worldPos, 1.0));
+    if (((inst.FaceMask >> vertex.face) & 0x1) == 0)
+    {
+        vsOutput.position = float4(0.0, 0.0, 0.0, 0.0);
+    }
+
+    return vsOutput;
+}
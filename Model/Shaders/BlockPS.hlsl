@@ -0,0 +1,9 @@
+//
+// Pixel shader for the voxel world: DefaultPS lighting with the base colour taken from
+// the block texture array instead of per-material textures.
+//
+
+#define NO_TANGENT_FRAME 1
+#define NO_SECOND_UV 1
+#define VOXEL_BLOCK 1
+#include "DefaultPS.hlsl"
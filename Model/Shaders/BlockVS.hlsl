@@ -0,0 +1,55 @@
+//
+// Vertex shader for the voxel world: one instanced, vertex-buffer-less draw per pass.
+//
+
+#include "VoxelBlock.hlsli"
+
+cbuffer GlobalConstants : register(b1)
+{
+    float4x4 ViewProjMatrix;
+    float4x4 SunShadowMatrix;
+    float3 ViewerPos;
+    float3 SunDirection;
+    float3 SunIntensity;
+}
+
+struct VSOutput
+{
+    float4 position : SV_POSITION;
+    float3 normal : NORMAL;
+    float2 uv0 : TEXCOORD0;
+    float3 worldPos : TEXCOORD2;
+    float3 sunShadowCoord : TEXCOORD3;
+    float voxelAO : TEXCOORD4;
+    nointerpolation uint textureLayer : TEXCOORD5;
+    nointerpolation float2 voxelLight : TEXCOORD6;
+};
+
+// [RootSignature(Renderer_RootSig)]
+VSOutput main(uint vertexID : SV_VertexID, uint instanceID : SV_InstanceID)
+{
+    VSOutput vsOutput = (VSOutput)0.0f;
+
+    InstanceData instData = gInstanceData[gInstanceIndices[instanceID]];
+    DecodedInstance inst = UnpackInstance(instData);
+    float3 blockCenter = GetBlockCenter(inst, gChunkOrigins[BLOCK_TYPE_SLOTS + inst.ChunkIndex]);
+    float4 blockType = gChunkOrigins[inst.BlockType];
+    VoxelVertex vertex = GetVoxelVertex(vertexID, instData.AO);
+
+    vsOutput.worldPos = blockCenter + vertex.position * blockType.x;
+    vsOutput.position = mul(ViewProjMatrix, float4(vsOutput.worldPos, 1.0));
+    vsOutput.sunShadowCoord = mul(SunShadowMatrix, float4(vsOutput.worldPos, 1.0)).xyz;
+    vsOutput.normal = vertex.normal;
+    vsOutput.uv0 = vertex.uv;
+    vsOutput.voxelAO = DecodeVoxelAO(instData.AO, vertex.face, vertex.corner);
+    vsOutput.textureLayer = GetFaceTextureLayer(blockType, vertex.face);
+    vsOutput.voxelLight = DecodeVoxelLight(instData.AO);
+
+    // faces touching an opaque neighbour collapse to a degenerate triangle
+    if (((inst.FaceMask >> vertex.face) & 0x1) == 0)
+    {
+        vsOutput.position = float4(0.0, 0.0, 0.0, 0.0);
+    }
+
+    return vsOutput;
+}
@@ -20,12 +20,42 @@
 #pragma warning (disable: 3557)
 
 
+// Packed 16 byte block instance, see ModelViewer/Blocks/BlockInstance.h
 struct InstanceData
 {
-	float4x4 WorldMatrix;
-	float3x3 WorldIT;
+	uint Position;  // x 10 | y 10 | z 8, chunk-local block coordinates (z up)
+	uint Info;      // chunkIndex 16 | faceMask 6 | blockType 8
+	uint2 AO;       // baked voxel AO, 2 bits per face corner (see VoxelAO.h), light byte in AO.y >> 24
 };
 
+// gChunkOrigins[0, BLOCK_TYPE_SLOTS) holds the per block type (cube side length, packed face texture layers),
+// followed by one float4(first block centre, block step) per visible chunk.
+#define BLOCK_TYPE_SLOTS 16
+
+struct DecodedInstance
+{
+	uint3 BlockCoord;
+	uint ChunkIndex;
+	uint FaceMask;
+	uint BlockType;
+};
+
+DecodedInstance UnpackInstance(InstanceData instData)
+{
+	DecodedInstance result;
+	result.BlockCoord = uint3(instData.Position & 0x3FF, (instData.Position >> 10) & 0x3FF, (instData.Position >> 20) & 0xFF);
+	result.ChunkIndex = instData.Info & 0xFFFF;
+	result.FaceMask = (instData.Info >> 16) & 0x3F;
+	result.BlockType = (instData.Info >> 22) & 0xFF;
+	return result;
+}
+
+float3 GetBlockCenter(DecodedInstance inst, float4 chunkOrigin)
+{
+	// chunk storage is z-up while the world is y-up
+	return chunkOrigin.xyz + float3(inst.BlockCoord.x, inst.BlockCoord.z, inst.BlockCoord.y) * chunkOrigin.w;
+}
+
 #define Renderer_RootSig \
     "RootFlags(ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT), " \
     "CBV(b0, visibility = SHADER_VISIBILITY_VERTEX), " \
@@ -36,6 +66,8 @@ struct InstanceData
     "CBV(b1), " \
     "SRV(t20, visibility = SHADER_VISIBILITY_VERTEX), " \
     "SRV(t0, visibility = SHADER_VISIBILITY_VERTEX), "\
+    "SRV(t1, visibility = SHADER_VISIBILITY_VERTEX), "\
+    "SRV(t2, visibility = SHADER_VISIBILITY_VERTEX), "\
     "StaticSampler(s10, maxAnisotropy = 8, visibility = SHADER_VISIBILITY_PIXEL)," \
     "StaticSampler(s11, visibility = SHADER_VISIBILITY_PIXEL," \
         "addressU = TEXTURE_ADDRESS_CLAMP," \
@@ -13,11 +13,16 @@
 
 #include "Common.hlsli"
 
+#ifdef VOXEL_BLOCK
+// layers are picked per block face, see BlockResourceManager::getBlockTextureSRV
+Texture2DArray<float4> blockTextureArray    : register(t0);
+#else
 Texture2D<float4> baseColorTexture          : register(t0);
 Texture2D<float3> metallicRoughnessTexture  : register(t1);
 Texture2D<float1> occlusionTexture          : register(t2);
 Texture2D<float3> emissiveTexture           : register(t3);
 Texture2D<float3> normalTexture             : register(t4);
+#endif
 
 SamplerState baseColorSampler               : register(s0);
 SamplerState metallicRoughnessSampler       : register(s1);
@@ -49,8 +54,18 @@ cbuffer GlobalConstants : register(b1)
     float _pad;
     float IBLRange;
     float IBLBias;
+    uint LightGridTileCountX;
+    float InvLightGridDim;
 }
 
+#ifdef VOXEL_BLOCK
+#include "LightGrid.hlsli"
+
+// torches and lamps binned on the CPU, see Lighting::LightGridBinner
+StructuredBuffer<LightData> lightBuffer     : register(t14);
+ByteAddressBuffer lightGrid                 : register(t16);
+#endif
+
 struct VSOutput
 {
     float4 position : SV_POSITION;
@@ -64,6 +79,11 @@ struct VSOutput
 #endif
     float3 worldPos : TEXCOORD2;
     float3 sunShadowCoord : TEXCOORD3;
+    float voxelAO : TEXCOORD4;
+#ifdef VOXEL_BLOCK
+    nointerpolation uint textureLayer : TEXCOORD5;
+    nointerpolation float2 voxelLight : TEXCOORD6;
+#endif
 };
 
 // Numeric constants
@@ -194,6 +214,18 @@ float3 ShadeDirectionalLight(SurfaceProperties Surface, float3 L, float3 c_light
     return Light.NdotL * c_light * (diffuse + specular);
 }
 
+#ifdef VOXEL_BLOCK
+// the falloff of ApplyPointLight in Lighting.hlsli, (R/d)^2 - d/R reaches zero at the light radius
+float3 ShadePointLight(SurfaceProperties Surface, float3 worldPos, LightData lightData)
+{
+    float3 L = lightData.pos - worldPos;
+    float invLightDist = rsqrt(max(dot(L, L), 1e-4));
+    float distanceFalloff = lightData.radiusSq * (invLightDist * invLightDist);
+    distanceFalloff = max(0, distanceFalloff - rsqrt(distanceFalloff));
+    return ShadeDirectionalLight(Surface, L * invLightDist, distanceFalloff * lightData.color);
+}
+#endif
+
 // Diffuse irradiance
 float3 Diffuse_IBL(SurfaceProperties Surface)
 {
@@ -266,12 +298,20 @@ float getFilterShadowValue(float3 ShadowCoord, Texture2D<float> texShadow)
 float4 main(VSOutput vsOutput) : SV_Target0
 {
 # define SAMPLE_TEX(texName) texName.Sample(defaultSampler, vsOutput.uv0)
+#ifdef VOXEL_BLOCK
+    // blocks are rough dielectrics, occlusion comes from the baked voxel AO below
+    float4 baseColor = blockTextureArray.Sample(defaultSampler, float3(vsOutput.uv0, vsOutput.textureLayer));
+    float2 metallicRoughness = float2(0.0, 0.9);
+    float occlusion = 1.0;
+    float3 emissive = 0.0;
+#else
     // Load and modulate textures
     float4 baseColor = baseColorFactor * baseColorTexture.Sample(baseColorSampler, UVSET(BASECOLOR));
     float2 metallicRoughness = metallicRoughnessFactor * 
         metallicRoughnessTexture.Sample(metallicRoughnessSampler, UVSET(METALLICROUGHNESS)).bg;
     float occlusion = occlusionTexture.Sample(occlusionSampler, UVSET(OCCLUSION));
     float3 emissive = emissiveFactor * emissiveTexture.Sample(emissiveSampler, UVSET(EMISSIVE));
+#endif
     float3 normal = ComputeNormal(vsOutput);
 
     SurfaceProperties Surface;
@@ -291,14 +331,36 @@ float4 main(VSOutput vsOutput) : SV_Target0
 # define SAMPLE_TEX(texName) texName.Sample(defaultSampler, vsOutput.uv0)
     float sunShadow = texSunShadow.SampleCmpLevelZero( shadowSampler, vsOutput.sunShadowCoord.xy, vsOutput.sunShadowCoord.z );
     sunShadow = getFilterShadowValue(vsOutput.sunShadowCoord, texSunShadow);
+#ifdef VOXEL_BLOCK
+    // skylight keeps the sun out of caves and overhangs the shadow map misses
+    sunShadow *= vsOutput.voxelLight.x;
+#endif
     colorAccum += ShadeDirectionalLight(Surface, SunDirection, sunShadow * SunIntensity);
     
     uint2 pixelPos = uint2(vsOutput.position.xy);
-    float ssao = texSSAO[pixelPos];
+    float ssao = texSSAO[pixelPos] * vsOutput.voxelAO;
 
     Surface.c_diff *= ssao;
     Surface.c_spec *= ssao;
 
+#ifdef VOXEL_BLOCK
+    // warm fill from torches and lamps
+    colorAccum += Surface.c_diff * vsOutput.voxelLight.y * float3(1.0, 0.85, 0.6);
+
+    // the ones contributing most on screen also shade as point lights through the Forward+ tiles
+    if (LightGridTileCountX > 0)
+    {
+        uint2 tilePos = GetTilePos(vsOutput.position.xy, InvLightGridDim);
+        uint tileOffset = GetTileOffset(GetTileIndex(tilePos, LightGridTileCountX));
+        uint pointLightCount = lightGrid.Load(tileOffset) & 0xff;
+        for (uint n = 0; n < pointLightCount; n++)
+        {
+            uint lightIndex = lightGrid.Load(tileOffset + 4 + n * 4);
+            colorAccum += ShadePointLight(Surface, vsOutput.worldPos, lightBuffer[lightIndex]);
+        }
+    }
+#endif
+
     // Old-school ambient light
     // Add IBL
     // colorAccum += Diffuse_IBL(Surface) * 0.3;
@@ -307,7 +369,7 @@ float4 main(VSOutput vsOutput) : SV_Target0
 #else
 
     uint2 pixelPos = uint2(vsOutput.position.xy);
-    float ssao = texSSAO[pixelPos];
+    float ssao = texSSAO[pixelPos] * vsOutput.voxelAO;
 
     Surface.c_diff *= ssao;
     Surface.c_spec *= ssao;
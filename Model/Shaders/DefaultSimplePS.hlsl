@@ -64,6 +64,7 @@ struct VSOutput
 #endif
     float3 worldPos : TEXCOORD2;
     float3 sunShadowCoord : TEXCOORD3;
+    float voxelAO : TEXCOORD4;
 };
 
 // Numeric constants
@@ -295,7 +296,7 @@ float4 main(VSOutput vsOutput) : SV_Target0
     colorAccum += ShadeDirectionalLight(Surface, SunDirection, sunShadow * SunIntensity);
     
     uint2 pixelPos = uint2(vsOutput.position.xy);
-    float ssao = texSSAO[pixelPos];
+    float ssao = texSSAO[pixelPos] * vsOutput.voxelAO;
 
     Surface.c_diff *= ssao;
     Surface.c_spec *= ssao;
@@ -308,7 +309,7 @@ float4 main(VSOutput vsOutput) : SV_Target0
 #else
 
     uint2 pixelPos = uint2(vsOutput.position.xy);
-    float ssao = texSSAO[pixelPos];
+    float ssao = texSSAO[pixelPos] * vsOutput.voxelAO;
 
     Surface.c_diff *= ssao;
     Surface.c_spec *= ssao;
@@ -18,6 +18,8 @@
 #endif
 
 StructuredBuffer<InstanceData> gInstanceData: register(t0, space2);
+StructuredBuffer<float4> gChunkOrigins: register(t1, space2);
+StructuredBuffer<uint> gInstanceIndices: register(t2, space2);
 
 cbuffer GlobalConstants : register(b1)
 {
@@ -68,16 +70,36 @@ struct VSOutput
 #endif
     float3 worldPos : TEXCOORD2;
     float3 sunShadowCoord : TEXCOORD3;
+    float voxelAO : TEXCOORD4;
 };
 
+// Face numbering matches VoxelAO::BlockAO: 0:+X 1:-X 2:+Y 3:-Y 4:+Z 5:-Z
+uint GetVoxelFace(float3 normal)
+{
+    float3 absNormal = abs(normal);
+    uint axis = absNormal.x > absNormal.y ? (absNormal.x > absNormal.z ? 0 : 2) : (absNormal.y > absNormal.z ? 1 : 2);
+    return axis * 2 + (normal[axis] < 0 ? 1 : 0);
+}
+
+// Picks the corner from the signs of the model-space tangent axes of the face.
+float DecodeVoxelAO(uint2 aoBits, float3 position, uint face)
+{
+    uint axis = face / 2;
+    uint corner = (position[(axis + 1) % 3] > 0 ? 1 : 0) | (position[(axis + 2) % 3] > 0 ? 2 : 0);
+    uint bit = face * 8 + corner * 2;
+    uint ao = ((bit < 32 ? aoBits.x : aoBits.y) >> (bit % 32)) & 0x3;
+    return 0.4 + 0.2 * ao;
+}
+
 // [RootSignature(Renderer_RootSig)]
 VSOutput main(VSInput vsInput, uint instanceID : SV_InstanceID)
 {
     VSOutput vsOutput = (VSOutput)0.0f;
 
-    InstanceData instData = gInstanceData[instanceID];
-    float4x4 WorldMatrix = instData.WorldMatrix;
-    float3x3 WorldIT = instData.WorldIT;
+    InstanceData instData = gInstanceData[gInstanceIndices[instanceID]];
+    DecodedInstance inst = UnpackInstance(instData);
+    float3 blockCenter = GetBlockCenter(inst, gChunkOrigins[BLOCK_TYPE_SLOTS + inst.ChunkIndex]);
+    float blockScale = gChunkOrigins[inst.BlockType].x;
     float4 position = float4(vsInput.position, 1.0);
     float3 normal = vsInput.normal * 2 - 1;
 #ifndef NO_TANGENT_FRAME
@@ -108,13 +130,21 @@ VSOutput main(VSInput vsInput, uint instanceID : SV_InstanceID)
 #endif
 
 #endif
-    vsOutput.worldPos = mul(WorldMatrix, position).xyz;
+    // blocks only carry a uniform scale and a translation, so normals need no inverse-transpose
+    uint face = GetVoxelFace(normal);
+    vsOutput.worldPos = blockCenter + position.xyz * blockScale;
     vsOutput.position = mul(ViewProjMatrix, float4(vsOutput.worldPos, 1.0));
     vsOutput.sunShadowCoord = mul(SunShadowMatrix, float4(vsOutput.worldPos, 1.0)).xyz;
-    vsOutput.normal = mul(WorldIT, normal);
+    vsOutput.normal = normal;
+    vsOutput.voxelAO = DecodeVoxelAO(instData.AO, vsInput.position, face);
 #ifndef NO_TANGENT_FRAME
-    vsOutput.tangent = float4(mul(WorldIT, tangent.xyz), tangent.w);
+    vsOutput.tangent = tangent;
 #endif
+    // faces touching an opaque neighbour collapse to a degenerate triangle
+    if (((inst.FaceMask >> face) & 0x1) == 0)
+    {
+        vsOutput.position = float4(0.0, 0.0, 0.0, 0.0);
+    }
     vsOutput.uv0 = vsInput.uv0;
 #ifndef NO_SECOND_UV
     vsOutput.uv1 = vsInput.uv1;
@@ -17,6 +17,8 @@
 //#undef ENABLE_SKINNING
 #endif
 StructuredBuffer<InstanceData> gInstanceData: register(t0, space2);
+StructuredBuffer<float4> gChunkOrigins: register(t1, space2);
+StructuredBuffer<uint> gInstanceIndices: register(t2, space2);
 
 cbuffer GlobalConstants : register(b1)
 {
@@ -57,10 +59,11 @@ struct VSOutput
 VSOutput main(VSInput vsInput, uint instanceID : SV_InstanceID)
 {
     VSOutput vsOutput;
-    InstanceData instData = gInstanceData[instanceID];
-    float4x4 WorldMatrix =instData.WorldMatrix;
+    InstanceData instData = gInstanceData[gInstanceIndices[instanceID]];
+    DecodedInstance inst = UnpackInstance(instData);
+    float3 blockCenter = GetBlockCenter(inst, gChunkOrigins[BLOCK_TYPE_SLOTS + inst.ChunkIndex]);
     float4 position = float4(vsInput.position, 1.0);
-    float3 worldPos = mul(WorldMatrix, position).xyz;
+    float3 worldPos = blockCenter + position.xyz * gChunkOrigins[inst.BlockType].x;
 
 #ifdef ENABLE_SKINNING
     // I don't like this hack.  The weights should be normalized already, but something is fishy.
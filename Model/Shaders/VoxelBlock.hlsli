@@ -0,0 +1,97 @@
+//
+// Procedural unit cube shared by every block type.  A block instance is drawn with
+// 36 vertices (6 faces x 2 triangles) generated from SV_VertexID, so no vertex or
+// index buffer is bound; the block type only selects texture array layers per face.
+//
+
+#ifndef __VOXEL_BLOCK_HLSLI__
+#define __VOXEL_BLOCK_HLSLI__
+
+#include "Common.hlsli"
+
+#define VOXEL_CUBE_VERTEX_COUNT 36
+
+StructuredBuffer<InstanceData> gInstanceData: register(t0, space2);
+StructuredBuffer<float4> gChunkOrigins: register(t1, space2);
+StructuredBuffer<uint> gInstanceIndices: register(t2, space2);
+
+struct VoxelVertex
+{
+    float3 position;    // cube space, [-0.5, 0.5]
+    float3 normal;
+    float2 uv;
+    uint face;          // 0:+X 1:-X 2:+Y 3:-Y 4:+Z 5:-Z, see VoxelAO.h
+    uint corner;        // bit0 = +u, bit1 = +v
+};
+
+// corners of the two triangles of a face quad; the flipped split uses the other diagonal.
+static const uint kQuadCorners[2][6] =
+{
+    { 0, 1, 3, 0, 3, 2 },
+    { 0, 1, 2, 2, 1, 3 },
+};
+
+VoxelVertex GetVoxelVertex(uint vertexID, uint2 aoBits)
+{
+    VoxelVertex v;
+    v.face = vertexID / 6;
+    uint k = vertexID % 6;
+
+    uint axis = v.face / 2;
+    float sign = (v.face % 2 == 0) ? 1.0 : -1.0;
+    uint uAxis = (axis + 1) % 3;
+    uint vAxis = (axis + 2) % 3;
+
+    // (u, v, n) is right handed, so negative faces swap two vertices to stay counter-clockwise
+    if (sign < 0 && k % 3 != 0)
+    {
+        k = (k % 3 == 1) ? k + 1 : k - 1;
+    }
+    uint flipped = (aoBits.y >> (16 + v.face)) & 0x1;
+    v.corner = kQuadCorners[flipped][k];
+
+    v.position = 0;
+    v.position[axis] = 0.5 * sign;
+    v.position[uAxis] = (v.corner & 0x1) ? 0.5 : -0.5;
+    v.position[vAxis] = (v.corner & 0x2) ? 0.5 : -0.5;
+
+    v.normal = 0;
+    v.normal[axis] = sign;
+
+    // side faces keep the texture upright along world +Y, top and bottom map x/z
+    if (axis == 1)
+    {
+        v.uv = float2(v.position.x, -v.position.z) + 0.5;
+    }
+    else
+    {
+        float horizontal = (axis == 0) ? v.position.z : v.position.x;
+        v.uv = float2(horizontal, -v.position.y) + 0.5;
+    }
+    return v;
+}
+
+// blockType.y / .z hold the layers of faces 0-2 / 3-5 as 3 x 10 bits, see BlockResourceManager::initBlocks
+uint GetFaceTextureLayer(float4 blockType, uint face)
+{
+    uint packedLayers = asuint(face < 3 ? blockType.y : blockType.z);
+    return (packedLayers >> ((face % 3) * 10)) & 0x3FF;
+}
+
+float DecodeVoxelAO(uint2 aoBits, uint face, uint corner)
+{
+    uint bit = face * 8 + corner * 2;
+    uint ao = ((bit < 32 ? aoBits.x : aoBits.y) >> (bit % 32)) & 0x3;
+    return 0.4 + 0.2 * ao;
+}
+
+// (sky, block) light intensity from the light byte in the top of aoBits.y, see VoxelLight.h
+float2 DecodeVoxelLight(uint2 aoBits)
+{
+    uint packed = aoBits.y >> 24;
+    float2 level = float2(packed >> 4, packed & 0xF);
+    // each level is 80% of the one above, like the usual voxel light curve; level 0 is dark
+    return (level > 0.0) * pow(0.8, 15.0 - level);
+}
+
+#endif // __VOXEL_BLOCK_HLSLI__
@@ -28,6 +28,7 @@ Block& Block::operator=(const Block& block)
     this->position = block.position;
     // this->boundingSphere = block.boundingSphere;
     this->transparent = block.transparent;
+    this->fluidLevel = block.fluidLevel;
 
     return *this;
 }
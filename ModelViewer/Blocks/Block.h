@@ -1,6 +1,7 @@
 ﻿#pragma once
 #include "BlockResourceManager.h"
 #include "Math/Vector.h"
+#include "../World/VoxelAO.h"
 
 class Chunk;
 
@@ -36,6 +37,12 @@ public:
     bool isEdgeBlock = false;
     bool transparent = false;
     bool adjacent2Air = false;
+    // water only: distance from the feeding source (0 for sources), see FluidSimulation
+    uint8_t fluidLevel = 0;
+    // baked per-corner ambient occlusion and exposed faces, recomputed lazily when aoDirty is set.
+    bool aoDirty = true;
+    uint8_t faceMask = 0;
+    VoxelAO::BlockAO ao{};
 
 private:
 };
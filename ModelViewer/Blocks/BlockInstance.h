@@ -0,0 +1,90 @@
+﻿/**
+ * 方块实例数据的紧凑编码 (16 bytes / instance)
+ * 世界矩阵完全可以由 chunk 原点 + 方块整数坐标 + 方块类型对应的统一缩放重建，
+ * 因此实例中只存整数坐标，chunk 原点和类型缩放放在每帧上传的 ChunkOriginTable 中。
+ *
+ *   Position: x 10bit | y 10bit | z 8bit | 4bit reserved        (chunk 内局部坐标, z 向上)
+ *   Info:     chunkIndex 16bit | faceMask 6bit | blockType 8bit | 2bit reserved
+ *   AO[2]:    VoxelAO::BlockAO::Bits, the top byte of AO[1] (unused by the AO bits) holds the block's light:
+ *             sky 4bit | block light 4bit, the brightest cells in front of its exposed faces (see VoxelLight.h)
+ *
+ * 布局需要与 Model/Shaders/Common.hlsli 中的 InstanceData 保持一致。
+ */
+#pragma once
+#include <cstdint>
+
+#include "../World/VoxelAO.h"
+
+namespace BlockInstance
+{
+    constexpr uint32_t X_BITS = 10;
+    constexpr uint32_t Y_BITS = 10;
+    constexpr uint32_t Z_BITS = 8;
+    constexpr uint32_t CHUNK_INDEX_BITS = 16;
+    constexpr uint32_t FACE_MASK_BITS = 6;
+    constexpr uint32_t BLOCK_TYPE_BITS = 8;
+
+    constexpr uint32_t MAX_CHUNK_INDEX = (1u << CHUNK_INDEX_BITS) - 1;
+    constexpr uint8_t ALL_FACES = (1u << FACE_MASK_BITS) - 1;
+    constexpr uint32_t LIGHT_SHIFT = 24;
+
+    struct PackedInstance
+    {
+        uint32_t Position;
+        uint32_t Info;
+        uint32_t AO[2];
+    };
+    static_assert(sizeof(PackedInstance) == 16, "PackedInstance must stay 16 bytes");
+
+    struct InstanceFields
+    {
+        uint32_t x = 0;
+        uint32_t y = 0;
+        uint32_t z = 0;
+        uint32_t chunkIndex = 0;
+        uint8_t faceMask = ALL_FACES;
+        uint8_t blockType = 0;
+        VoxelAO::BlockAO ao{};
+        uint8_t light = 0xF0;
+    };
+
+    inline uint32_t Mask(uint32_t bits)
+    {
+        return (1u << bits) - 1;
+    }
+
+    inline PackedInstance Encode(const InstanceFields& fields)
+    {
+        PackedInstance packed;
+        packed.Position = (fields.x & Mask(X_BITS))
+            | ((fields.y & Mask(Y_BITS)) << X_BITS)
+            | ((fields.z & Mask(Z_BITS)) << (X_BITS + Y_BITS));
+        packed.Info = (fields.chunkIndex & Mask(CHUNK_INDEX_BITS))
+            | ((uint32_t(fields.faceMask) & Mask(FACE_MASK_BITS)) << CHUNK_INDEX_BITS)
+            | ((uint32_t(fields.blockType) & Mask(BLOCK_TYPE_BITS)) << (CHUNK_INDEX_BITS + FACE_MASK_BITS));
+        packed.AO[0] = fields.ao.Bits[0];
+        packed.AO[1] = (fields.ao.Bits[1] & Mask(LIGHT_SHIFT)) | (uint32_t(fields.light) << LIGHT_SHIFT);
+        return packed;
+    }
+
+    // rewrites only the chunk index, e.g. when a chunk's cached instances move to another origin slot
+    inline void SetChunkIndex(PackedInstance& packed, uint32_t chunkIndex)
+    {
+        packed.Info = (packed.Info & ~Mask(CHUNK_INDEX_BITS)) | (chunkIndex & Mask(CHUNK_INDEX_BITS));
+    }
+
+    inline InstanceFields Decode(const PackedInstance& packed)
+    {
+        InstanceFields fields;
+        fields.x = packed.Position & Mask(X_BITS);
+        fields.y = (packed.Position >> X_BITS) & Mask(Y_BITS);
+        fields.z = (packed.Position >> (X_BITS + Y_BITS)) & Mask(Z_BITS);
+        fields.chunkIndex = packed.Info & Mask(CHUNK_INDEX_BITS);
+        fields.faceMask = uint8_t((packed.Info >> CHUNK_INDEX_BITS) & Mask(FACE_MASK_BITS));
+        fields.blockType = uint8_t((packed.Info >> (CHUNK_INDEX_BITS + FACE_MASK_BITS)) & Mask(BLOCK_TYPE_BITS));
+        fields.ao.Bits[0] = packed.AO[0];
+        fields.ao.Bits[1] = packed.AO[1] & Mask(LIGHT_SHIFT);
+        fields.light = uint8_t(packed.AO[1] >> LIGHT_SHIFT);
+        return fields;
+    }
+}
@@ -1,9 +1,12 @@
 ﻿#include "BlockResourceManager.h"
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <ostream>
 
-#include "ModelLoader.h"
+#include "FileUtility.h"
+#include "GraphicsCore.h"
 #include "../World/World.h"
 
 namespace BlockResourceManager
@@ -25,99 +28,326 @@ namespace BlockResourceManager
         {GrassLeaf, "grass_leaf"}
     };
 
+    const bool BlockSolid[Air + 1] = {
+        true,  // Grass
+        true,  // Stone
+        true,  // Leaf
+        true,  // Dirt
+        false, // Water
+        true,  // WoodOak
+        true,  // Diamond
+        true,  // RedStoneLamp
+        true,  // Torch
+        true,  // Sand
+        true,  // GrassSnow
+        true,  // GrassWilt
+        false, // GrassLeaf
+        false, // Air
+    };
+
+    const uint8_t BlockLightOpacity[Air + 1] = {
+        15, // Grass
+        15, // Stone
+        1,  // Leaf
+        15, // Dirt
+        2,  // Water
+        15, // WoodOak
+        15, // Diamond
+        15, // RedStoneLamp
+        15, // Torch
+        15, // Sand
+        15, // GrassSnow
+        15, // GrassWilt
+        0,  // GrassLeaf
+        0,  // Air
+    };
+
+    const uint8_t BlockLightEmission[Air + 1] = {
+        0,  // Grass
+        0,  // Stone
+        0,  // Leaf
+        0,  // Dirt
+        0,  // Water
+        0,  // WoodOak
+        0,  // Diamond
+        15, // RedStoneLamp
+        14, // Torch
+        0,  // Sand
+        0,  // GrassSnow
+        0,  // GrassWilt
+        0,  // GrassLeaf
+        0,  // Air
+    };
+
     std::unordered_set<BlockType> TransparentBlocks = {
         Water,
         GrassLeaf,
     };
     
-    std::unordered_map<BlockType, ModelInstance> m_BlockMap;
-    std::unordered_map<BlockType, InstancesManager*> BlocksInstancesManagerMap;
-    
+    InstancesManager* BucketInstancesManagers[BucketCount] = {};
+    std::unique_ptr<UtilUploadBuffer<DirectX::XMFLOAT4>> ChunkOriginTable = nullptr;
+    TextureRef BlockTextureArray;
+    Texture BlockFallbackTextureArray;
+    bool BlockTextureArrayBaked = false;
+    uint16_t BlockFaceLayers[Air][VoxelAO::FACE_COUNT] = {};
+
+    // RGBA8 packed as 0xAABBGGRR, indexed by BlockType
+    const uint32_t BlockFallbackColors[Air] = {
+        0xFF3FA04Au, // Grass
+        0xFF7F7F7Fu, // Stone
+        0xFF2E7A2Fu, // Leaf
+        0xFF2F4A79u, // Dirt
+        0xB0C8602Fu, // Water
+        0xFF305A8Au, // WoodOak
+        0xFFE0E26Au, // Diamond
+        0xFF2F6FD8u, // RedStoneLamp
+        0xFF30B0F0u, // Torch
+        0xFF9CD8E2u, // Sand
+        0xFFF2F2F2u, // GrassSnow
+        0xFF3C98A8u, // GrassWilt
+        0xC040B050u, // GrassLeaf
+    };
+
+    uint32_t getArraySize(const TextureRef& texture)
+    {
+        if (!texture.IsValid())
+        {
+            return 0;
+        }
+        ID3D12Resource* resource = const_cast<ID3D12Resource*>(texture->GetResource());
+        return resource->GetDesc().DepthOrArraySize;
+    }
+
+    // reads the BlockType x face layer table written next to the array by Tools/BlockTextureBaker
+    bool loadBlockTextureLayers(uint32_t arraySize)
+    {
+        Utility::ByteArray file = Utility::ReadFileSync(Utility::UTF8ToWideString(BLOCK_TEXTURE_LAYERS_PATH));
+        const size_t headerSize = 5 * sizeof(uint32_t);
+        const size_t tableSize = sizeof(BlockFaceLayers);
+        if (file == Utility::NullFile || file->size() < headerSize + tableSize)
+        {
+            return false;
+        }
+
+        uint32_t header[5];
+        memcpy(header, file->data(), headerSize);
+        if (memcmp(&header[0], "BTLT", 4) != 0 || header[1] != 1 || header[2] != Air
+            || header[3] != VoxelAO::FACE_COUNT || header[4] > arraySize || header[4] > 1024)
+        {
+            std::cout << BLOCK_TEXTURE_LAYERS_PATH << " does not match the block types, re-run BlockTextureBaker"
+                << std::endl;
+            return false;
+        }
+        memcpy(BlockFaceLayers, file->data() + headerSize, tableSize);
+        return true;
+    }
+
+    // three 10 bit layers stored in the bits of a float, decoded by GetFaceTextureLayer in VoxelBlock.hlsli
+    float packFaceLayers(const uint16_t* layers)
+    {
+        uint32_t bits = layers[0] | (layers[1] << 10) | (layers[2] << 20);
+        float packed;
+        memcpy(&packed, &bits, sizeof(packed));
+        return packed;
+    }
+
 }
 
 void BlockResourceManager::clearVisibleBlocks()
 {
-    for (int i =0; i<Air; i++)
+    for (int i = 0; i < BucketCount; i++)
     {
-        auto type = static_cast<BlockType>(i);
-        InstancesManager* manager = BlocksInstancesManagerMap[type];
+        InstancesManager* manager = BucketInstancesManagers[i];
         manager->visibleBlockNumber = 0;
+        manager->uploadedInstanceNumber = 0;
     }
 }
 
-void BlockResourceManager::addBlockIntoManager(BlockType blockType, Math::Vector3 position, float radius)
+void BlockResourceManager::printStagingStats()
 {
-    InstancesManager* manager = BlocksInstancesManagerMap[blockType];
-    
-    InstanceData data{};
-    
-    Math::Matrix4 worldMatrix(Math::kIdentity);
-    Math::UniformTransform locator(Math::kIdentity);
-    locator.SetScale(radius/ getBlockRef(blockType).GetBoundingSphere().GetRadius());
-    locator.SetTranslation(position);   
-    worldMatrix = Math::Matrix4((Math::AffineTransform)locator) * worldMatrix;
-
-    XMStoreFloat4x4(&data.WorldMatrix, XMMATRIX(worldMatrix));
-    Math::Matrix3 worldIT = Math::InverseTranspose(worldMatrix.Get3x3());
-    XMStoreFloat3x3(&data.WorldIT, XMMATRIX(worldIT));
-    
-    manager->mtx.lock();
-    if (manager->MAX_BLOCK_NUMBER <= manager->visibleBlockNumber)
+    uint32_t locks = 0;
+    uint32_t contended = 0;
+    uint32_t blockLocks = 0;
+    uint32_t contendedBlockLocks = 0;
+    uint32_t reserves = 0;
+    uint32_t uploaded = 0;
+    uint32_t visible = 0;
+    for (int i = 0; i < BucketCount; i++)
     {
-        std::cout << "achieve max number" << std::endl;
-        manager->mtx.unlock();
-        return;
+        InstancesManager* manager = BucketInstancesManagers[i];
+        locks += manager->lockCount.exchange(0);
+        contended += manager->contendedLockCount.exchange(0);
+        blockLocks += manager->blockLockCount.exchange(0);
+        contendedBlockLocks += manager->contendedBlockLockCount.exchange(0);
+        reserves += manager->reserveCount.exchange(0);
+        uploaded += manager->uploadedInstanceNumber;
+        visible += manager->visibleBlockNumber;
     }
-    manager->InstanceBuffer.get()->CopyData(manager->visibleBlockNumber, data);
-    manager->visibleBlockNumber++;
-    std::atomic_signal_fence(std::memory_order_release);
-    manager->mtx.unlock();
+    std::cout << "instance staging: visible " << visible << " uploaded " << uploaded
+        << " pool locks " << locks << " contended " << contended
+        << " index reservations " << reserves << " per-block locks " << blockLocks
+        << " contended " << contendedBlockLocks << std::endl;
 }
-void BlockResourceManager::initBlocks()
+
+InstanceRange BlockResourceManager::InstancesManager::UpdateRange(InstanceRange range,
+                                                                  const std::vector<InstanceData>& instances)
 {
-    //read resources according to BlockType enum list;
-    for (int i = 0; i < BlockType::Air; i++)
+    auto lock = LockPool();
+    uint32_t count = static_cast<uint32_t>(instances.size());
+
+    if (range.IsValid() && range.count == count)
     {
-        auto type = static_cast<BlockType>(i);
-        std::string BlockName = BlockNameMap[type];
-        std::string BlockPath = BLOCKS_RESOURCE_PATH + BlockName + "/" + "scene.gltf";
-
-        ModelInstance model{Renderer::LoadModel(Utility::ConvertToWideString(BlockPath), true)};
-        std::cout << "ModelCheck blockName: " << BlockName << std::endl; 
-        std::cout << "ModelCheck numJoints: "<<model.m_Model->m_NumJoints <<std::endl;
-        std::cout << "ModelCheck numMeshes: " << model.m_Model->m_NumMeshes << std::endl; 
-        std::cout << "ModelCheck numNodes: "<<model.m_Model->m_NumNodes <<std::endl;
-        m_BlockMap[type] = model.m_Model;
-
-        BlocksInstancesManagerMap[type] = new InstancesManager();
-        // if (type != Dirt && type !=Grass && type!=Stone && type!=Water)
-        // {
-        //     BlocksInstancesManagerMap[type].MAX_BLOCK_NUMBER/=10;
-        // }
-        BlocksInstancesManagerMap[type]->initManager();
-        ASSERT_SUCCEEDED(BlocksInstancesManagerMap.size()==BlockType::Air);
+        uploadedInstanceNumber += CopyChangedRuns(InstanceVector, range.offset, instances,
+                                                  [&](uint32_t first, uint32_t runCount)
+        {
+            InstanceBuffer->CopyRange(first, &InstanceVector[first], runCount);
+        });
+        return range;
     }
-    m_BlocksInitialized = true;
+
+    Allocator.Free(range);
+    InstanceRange newRange = Allocator.Allocate(count);
+    if (count > 0 && !newRange.IsValid())
+    {
+        GrowPool(Allocator.GetCapacity() + count);
+        newRange = Allocator.Allocate(count);
+    }
+    if (count > 0)
+    {
+        std::copy(instances.begin(), instances.end(), InstanceVector.begin() + newRange.offset);
+        InstanceBuffer->CopyRange(newRange.offset, instances.data(), count);
+        uploadedInstanceNumber += count;
+    }
+    return newRange;
 }
 
-ModelInstance BlockResourceManager::getBlock(BlockType type)
+void BlockResourceManager::InstancesManager::FreeRange(InstanceRange range)
 {
-    ASSERT(m_BlocksInitialized);
+    auto lock = LockPool();
+    Allocator.Free(range);
+}
 
-    if (m_BlockMap.find(type) != m_BlockMap.end())
+void BlockResourceManager::InstancesManager::PrepareVisibleIndices(uint32_t totalCount)
+{
+    if (totalCount > indexCapacity)
     {
-        return m_BlockMap[type];
+        // the previous index buffer may still be referenced by frames in flight
+        Graphics::g_CommandManager.IdleGPU();
+        while (indexCapacity < totalCount)
+        {
+            indexCapacity *= 2;
+        }
+        IndexBuffer = std::make_unique<UtilUploadBuffer<uint32_t>>(Graphics::g_Device, indexCapacity);
     }
-    return m_BlockMap[Grass];
+    visibleCursor = 0;
+}
+
+uint32_t* BlockResourceManager::InstancesManager::ReserveVisibleIndices(uint32_t count)
+{
+    reserveCount++;
+    uint32_t start = visibleCursor.fetch_add(count);
+    ASSERT(start + count <= indexCapacity);
+    return IndexBuffer->MappedElements() + start;
+}
+
+void BlockResourceManager::InstancesManager::FinishVisibleIndices()
+{
+    visibleBlockNumber = visibleCursor;
+}
+
+void BlockResourceManager::InstancesManager::AddVisibleIndex(uint32_t index)
+{
+    auto lock = lockCounted(blockLockCount, contendedBlockLockCount);
+    uint32_t slot = visibleCursor.load(std::memory_order_relaxed);
+    ASSERT(slot < indexCapacity);
+    IndexBuffer->MappedElements()[slot] = index;
+    visibleCursor.store(slot + 1, std::memory_order_relaxed);
+}
+
+std::unique_lock<std::mutex> BlockResourceManager::InstancesManager::LockPool()
+{
+    return lockCounted(lockCount, contendedLockCount);
+}
+
+// a failed try_lock means another thread held the mutex, that acquisition counts as contended
+std::unique_lock<std::mutex> BlockResourceManager::InstancesManager::lockCounted(std::atomic<uint32_t>& locks,
+                                                                                 std::atomic<uint32_t>& contended)
+{
+    std::unique_lock<std::mutex> lock(mtx, std::try_to_lock);
+    locks++;
+    if (!lock.owns_lock())
+    {
+        contended++;
+        lock.lock();
+    }
+    return lock;
+}
+
+void BlockResourceManager::InstancesManager::GrowPool(uint32_t minCapacity)
+{
+    uint32_t capacity = Allocator.GetCapacity();
+    while (capacity < minCapacity)
+    {
+        capacity *= 2;
+    }
+    std::cout << "grow instance pool to " << capacity << std::endl;
+
+    Graphics::g_CommandManager.IdleGPU();
+    InstanceVector.resize(capacity);
+    InstanceBuffer = std::make_unique<UtilUploadBuffer<InstanceData>>(Graphics::g_Device, capacity);
+    InstanceBuffer->CopyRange(0, InstanceVector.data(), Allocator.GetCapacity());
+    Allocator.Grow(capacity);
+}
+
+void BlockResourceManager::setChunkOrigin(uint32_t chunkIndex, Math::Vector3 firstBlockCenter, float blockStep)
+{
+    ASSERT(chunkIndex < MAX_CHUNK_NUMBER);
+    DirectX::XMFLOAT4 origin(firstBlockCenter.GetX(), firstBlockCenter.GetY(), firstBlockCenter.GetZ(), blockStep);
+    ChunkOriginTable->CopyData(BLOCK_TYPE_SLOTS + chunkIndex, origin);
+}
+
+void BlockResourceManager::initBlocks()
+{
+    ChunkOriginTable = std::make_unique<UtilUploadBuffer<DirectX::XMFLOAT4>>(
+        Graphics::g_Device, BLOCK_TYPE_SLOTS + MAX_CHUNK_NUMBER);
+
+    BlockTextureArray = TextureManager::LoadDDSFromFile(BLOCK_TEXTURE_ARRAY_PATH, Graphics::kMagenta2D, true);
+    BlockTextureArrayBaked = loadBlockTextureLayers(getArraySize(BlockTextureArray));
+    if (!BlockTextureArrayBaked)
+    {
+        std::cout << "block texture array " << BLOCK_TEXTURE_ARRAY_PATH
+            << " missing or incomplete, using flat colours" << std::endl;
+        BlockFallbackTextureArray.Create2DArray(sizeof(uint32_t), 1, 1, Air, DXGI_FORMAT_R8G8B8A8_UNORM_SRGB,
+                                                BlockFallbackColors);
+        // fallback layer i belongs to BlockType i on every face
+        for (int i = 0; i < BlockType::Air; i++)
+        {
+            std::fill(std::begin(BlockFaceLayers[i]), std::end(BlockFaceLayers[i]), static_cast<uint16_t>(i));
+        }
+    }
+
+    // the shared cube spans [-0.5, 0.5]
+    for (int i = 0; i < BlockType::Air; i++)
+    {
+        ChunkOriginTable->CopyData(i, DirectX::XMFLOAT4(World::UnitBlockSize, packFaceLayers(&BlockFaceLayers[i][0]),
+                                                        packFaceLayers(&BlockFaceLayers[i][3]), 0));
+    }
+
+    for (int i = 0; i < BucketCount; i++)
+    {
+        BucketInstancesManagers[i] = new InstancesManager();
+        BucketInstancesManagers[i]->initManager();
+    }
+    m_BlocksInitialized = true;
 }
 
-ModelInstance& BlockResourceManager::getBlockRef(BlockType type)
+D3D12_CPU_DESCRIPTOR_HANDLE BlockResourceManager::getBlockTextureSRV()
 {
     ASSERT(m_BlocksInitialized);
 
-    if (m_BlockMap.find(type) != m_BlockMap.end())
+    if (BlockTextureArrayBaked)
     {
-        return m_BlockMap[type];
+        return BlockTextureArray.GetSRV();
     }
-    return m_BlockMap[Grass];
+    return BlockFallbackTextureArray.GetSRV();
 }
@@ -1,27 +1,36 @@
 ﻿/**
  * 管理所有Block静态资源
- * 1. 负责从静态资源中加载Block
- * 2. 负责所有Block的存储、读取
+ * 1. 负责加载离线烘焙的方块纹理数组 (Tools/BlockTextureBaker，每种方块每个面对应一层)，
+ *    方块几何体由顶点着色器按 SV_VertexID 程序化生成
+ * 2. 负责所有Block实例的存储、读取
  */
 #pragma once
+#include <atomic>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
 
 #include "Model.h"
+#include "Texture.h"
+#include "TextureManager.h"
 #include "UtilUploadBuffer.h"
+#include "BlockInstance.h"
+#include "InstanceRangeAllocator.h"
 
 #define BLOCKS_RESOURCE_PATH "../Resources/Blocks/"
+#define BLOCK_TEXTURE_ARRAY_PATH BLOCKS_RESOURCE_PATH "block_textures.dds"
+#define BLOCK_TEXTURE_LAYERS_PATH BLOCKS_RESOURCE_PATH "block_textures.layers"
 
 namespace BlockResourceManager
 {
-    struct InstanceData
-    {
-        // Matrix4 WorldMatrix;
-        // Matrix3 WorldIT;
-        DirectX::XMFLOAT4X4 WorldMatrix;
-        DirectX::XMFLOAT3X3 WorldIT;
-    };
+    // 16 bytes per block, world transform is rebuilt in the vertex shader from ChunkOriginTable
+    typedef BlockInstance::PackedInstance InstanceData;
+
+    // first BLOCK_TYPE_SLOTS entries: per block type (cube side length, face layers 0-2, face layers 3-5),
+    // followed by one (first block centre, block step) entry per chunk, indexed by Chunk::originSlot.
+    constexpr uint32_t BLOCK_TYPE_SLOTS = 16;
+    constexpr uint32_t MAX_CHUNK_NUMBER = BlockInstance::MAX_CHUNK_INDEX + 1;
 
     class InstancesManager;
     extern bool m_BlocksInitialized;
@@ -44,11 +53,24 @@ namespace BlockResourceManager
         Air,
     };
 
-    extern std::unordered_map<BlockType, InstancesManager*> BlocksInstancesManagerMap;
+    // every block type shares the same procedural cube, so instances are only split by the pass they draw in.
+    enum RenderBucket
+    {
+        OpaqueBucket,
+        TransparentBucket,
+        BucketCount,
+    };
+
+    extern InstancesManager* BucketInstancesManagers[BucketCount];
     extern std::unordered_set<BlockType> TransparentBlocks;
-    extern std::unordered_map<BlockType, ModelInstance> m_BlockMap;
 
     extern std::unordered_map<BlockType, std::string> BlockNameMap;
+    extern std::unique_ptr<UtilUploadBuffer<DirectX::XMFLOAT4>> ChunkOriginTable;
+    // baked offline into BLOCK_TEXTURE_ARRAY_PATH, BLOCK_TEXTURE_LAYERS_PATH maps each face to a layer
+    extern TextureRef BlockTextureArray;
+    // flat colour layers used when the baked array is missing
+    extern Texture BlockFallbackTextureArray;
+    extern uint16_t BlockFaceLayers[Air][VoxelAO::FACE_COUNT];
 
     inline bool isTransparentBlock(BlockType& type)
     {
@@ -58,29 +80,67 @@ namespace BlockResourceManager
         }
         return false;
     }
+
+    // indexed by BlockType, Air included; non solid blocks are walked through by VoxelCollision
+    extern const bool BlockSolid[Air + 1];
+
+    inline bool isSolidBlock(BlockType type)
+    {
+        return BlockSolid[type];
+    }
+
+    // light lost when entering a block, 15 blocks light completely; indexed by BlockType, Air included
+    extern const uint8_t BlockLightOpacity[Air + 1];
+    // block light a block gives off from its own cell
+    extern const uint8_t BlockLightEmission[Air + 1];
+
+    inline RenderBucket getRenderBucket(BlockType type)
+    {
+        return TransparentBlocks.count(type) ? TransparentBucket : OpaqueBucket;
+    }
     void clearVisibleBlocks();
+    void printStagingStats();
 
-    void addBlockIntoManager(BlockType blockType, Math::Vector3 position, float radius);
+    void setChunkOrigin(uint32_t chunkIndex, Math::Vector3 firstBlockCenter, float blockStep);
 
     void initBlocks();
+    D3D12_CPU_DESCRIPTOR_HANDLE getBlockTextureSRV();
 
-    ModelInstance getBlock(BlockType);
-    ModelInstance& getBlockRef(BlockType);
-
-    inline InstancesManager& getManager(BlockType type)
+    inline InstancesManager& getManager(RenderBucket bucket)
     {
-        return *BlocksInstancesManagerMap[type];
+        return *BucketInstancesManagers[bucket];
     }
 
+    /**
+     * 每个渲染分组 (不透明 / 半透明) 一个实例池：
+     * 1. 每个 chunk 在池中持有一段持久区间，只有 chunk 的可见方块变化时才重写该区间
+     * 2. 每帧只上传可见 chunk 区间展开后的索引列表 (4 bytes / instance)，
+     *    工作线程每批 chunk 只做一次 atomic fetch-add 预留输出区间，然后直接连续写入 upload buffer
+     * 3. 池空间不足时按倍数扩容，InstanceVector 保存池的 CPU 副本用于扩容后回填
+     */
     class InstancesManager
     {
     public:
-        uint32_t MAX_BLOCK_NUMBER = 80960;
+        uint32_t INITIAL_BLOCK_NUMBER = 80960;
+        InstanceRangeAllocator Allocator{};
         std::vector<InstanceData> InstanceVector{};
         std::unique_ptr<UtilUploadBuffer<InstanceData>> InstanceBuffer = nullptr;
+        std::unique_ptr<UtilUploadBuffer<uint32_t>> IndexBuffer = nullptr;
+        uint32_t indexCapacity = 0;
         uint32_t visibleBlockNumber = 0;
+        std::atomic<uint32_t> visibleCursor{0};
+        // instances written into the pool since the last clearVisibleBlocks()
+        uint32_t uploadedInstanceNumber = 0;
         std::mutex mtx;
 
+        // contention metrics, reset by printStagingStats()
+        std::atomic<uint32_t> lockCount{0};
+        std::atomic<uint32_t> contendedLockCount{0};
+        std::atomic<uint32_t> reserveCount{0};
+        // the same counters for the legacy per-block path
+        std::atomic<uint32_t> blockLockCount{0};
+        std::atomic<uint32_t> contendedBlockLockCount{0};
+
         InstancesManager()
         {
         }
@@ -88,6 +148,7 @@ namespace BlockResourceManager
         ~InstancesManager()
         {
             InstanceBuffer.release();
+            IndexBuffer.release();
         }
 
         InstancesManager& operator=(const InstancesManager& other)
@@ -97,8 +158,28 @@ namespace BlockResourceManager
 
         void initManager()
         {
-            InstanceBuffer = std::make_unique<UtilUploadBuffer<InstanceData>>(Graphics::g_Device, MAX_BLOCK_NUMBER);
-            // InstanceVector.resize(MAX_BLOCK_NUMBER);
+            Allocator.Grow(INITIAL_BLOCK_NUMBER);
+            InstanceVector.resize(INITIAL_BLOCK_NUMBER);
+            InstanceBuffer = std::make_unique<UtilUploadBuffer<InstanceData>>(Graphics::g_Device, INITIAL_BLOCK_NUMBER);
+            indexCapacity = INITIAL_BLOCK_NUMBER;
+            IndexBuffer = std::make_unique<UtilUploadBuffer<uint32_t>>(Graphics::g_Device, indexCapacity);
         }
+
+        // rewrites a chunk's range; reuses it in place (writing only changed instances) when the size is unchanged.
+        InstanceRange UpdateRange(InstanceRange range, const std::vector<InstanceData>& instances);
+        void FreeRange(InstanceRange range);
+
+        // sizes the index buffer for this frame, must be called before any ReserveVisibleIndices.
+        void PrepareVisibleIndices(uint32_t totalCount);
+        // thread safe, returns a pointer into the mapped index buffer with room for count indices.
+        uint32_t* ReserveVisibleIndices(uint32_t count);
+        void FinishVisibleIndices();
+        // legacy staging, takes mtx for every block like the old addBlockIntoManager; kept to compare contention
+        void AddVisibleIndex(uint32_t index);
+
+    private:
+        std::unique_lock<std::mutex> LockPool();
+        std::unique_lock<std::mutex> lockCounted(std::atomic<uint32_t>& locks, std::atomic<uint32_t>& contended);
+        void GrowPool(uint32_t minCapacity);
     };
 };
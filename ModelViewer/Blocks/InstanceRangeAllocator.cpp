@@ -0,0 +1,80 @@
+﻿#include "InstanceRangeAllocator.h"
+
+#include <iterator>
+
+InstanceRangeAllocator::InstanceRangeAllocator(uint32_t capacity)
+{
+    Grow(capacity);
+}
+
+InstanceRange InstanceRangeAllocator::Allocate(uint32_t count)
+{
+    InstanceRange range;
+    if (count == 0)
+    {
+        return range;
+    }
+    for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it)
+    {
+        if (it->second < count)
+        {
+            continue;
+        }
+        range.offset = it->first;
+        range.count = count;
+        uint32_t remain = it->second - count;
+        freeRanges.erase(it);
+        if (remain > 0)
+        {
+            freeRanges.emplace(range.offset + count, remain);
+        }
+        usedCount += count;
+        return range;
+    }
+    return range;
+}
+
+void InstanceRangeAllocator::Free(InstanceRange range)
+{
+    if (!range.IsValid() || range.count == 0)
+    {
+        return;
+    }
+    usedCount -= range.count;
+    InsertFreeRange(range.offset, range.count);
+}
+
+void InstanceRangeAllocator::Grow(uint32_t newCapacity)
+{
+    if (newCapacity <= capacity)
+    {
+        return;
+    }
+    uint32_t oldCapacity = capacity;
+    capacity = newCapacity;
+    InsertFreeRange(oldCapacity, newCapacity - oldCapacity);
+}
+
+void InstanceRangeAllocator::InsertFreeRange(uint32_t offset, uint32_t count)
+{
+    auto next = freeRanges.lower_bound(offset);
+
+    // merge with the following range
+    if (next != freeRanges.end() && offset + count == next->first)
+    {
+        count += next->second;
+        next = freeRanges.erase(next);
+    }
+
+    // merge with the preceding range
+    if (next != freeRanges.begin())
+    {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset)
+        {
+            prev->second += count;
+            return;
+        }
+    }
+    freeRanges.emplace_hint(next, offset, count);
+}
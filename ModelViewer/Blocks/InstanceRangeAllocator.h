@@ -0,0 +1,85 @@
+﻿/**
+ * 实例池的区间分配器
+ * 每个 chunk 在实例池中持有一段连续区间，只有 chunk 的可见方块集合变化时才重新分配并写入。
+ * 空闲区间按 offset 排序并在释放时合并，分配采用 first-fit；不涉及任何 GPU 资源，方便单独测试。
+ */
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <vector>
+
+struct InstanceRange
+{
+    static constexpr uint32_t INVALID_OFFSET = UINT32_MAX;
+
+    uint32_t offset = INVALID_OFFSET;
+    uint32_t count = 0;
+
+    bool IsValid() const
+    {
+        return offset != INVALID_OFFSET;
+    }
+};
+
+class InstanceRangeAllocator
+{
+public:
+    explicit InstanceRangeAllocator(uint32_t capacity = 0);
+
+    // returns an invalid range when no free range is large enough, the caller is expected to Grow().
+    InstanceRange Allocate(uint32_t count);
+    void Free(InstanceRange range);
+    // appends [capacity, newCapacity) to the free list, existing ranges keep their offsets.
+    void Grow(uint32_t newCapacity);
+
+    uint32_t GetCapacity() const
+    {
+        return capacity;
+    }
+
+    uint32_t GetUsedCount() const
+    {
+        return usedCount;
+    }
+
+    uint32_t GetFreeRangeCount() const
+    {
+        return static_cast<uint32_t>(freeRanges.size());
+    }
+
+private:
+    void InsertFreeRange(uint32_t offset, uint32_t count);
+
+    uint32_t capacity = 0;
+    uint32_t usedCount = 0;
+    // offset -> count
+    std::map<uint32_t, uint32_t> freeRanges{};
+};
+
+// copies instances over pool[offset, offset + instances.size()) and calls upload(first, count) once per run of
+// elements that actually changed, returns the number of changed elements
+template <typename T, typename Upload>
+uint32_t CopyChangedRuns(std::vector<T>& pool, uint32_t offset, const std::vector<T>& instances, Upload&& upload)
+{
+    uint32_t changed = 0;
+    uint32_t count = static_cast<uint32_t>(instances.size());
+    uint32_t i = 0;
+    while (i < count)
+    {
+        if (std::memcmp(&pool[offset + i], &instances[i], sizeof(T)) == 0)
+        {
+            i++;
+            continue;
+        }
+        uint32_t first = i;
+        while (i < count && std::memcmp(&pool[offset + i], &instances[i], sizeof(T)) != 0)
+        {
+            pool[offset + i] = instances[i];
+            i++;
+        }
+        upload(offset + first, i - first);
+        changed += i - first;
+    }
+    return changed;
+}
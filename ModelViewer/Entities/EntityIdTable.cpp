@@ -0,0 +1,33 @@
+﻿#include "EntityIdTable.h"
+
+uint32_t EntityIdTable::Add()
+{
+    uint32_t id;
+    if (!freeIds.empty())
+    {
+        id = freeIds.back();
+        freeIds.pop_back();
+    }
+    else
+    {
+        id = static_cast<uint32_t>(idToIndex.size());
+        idToIndex.push_back(0);
+    }
+    idToIndex[id] = static_cast<uint32_t>(ids.size());
+    ids.push_back(id);
+    return id;
+}
+
+uint32_t EntityIdTable::Remove(uint32_t id)
+{
+    uint32_t index = idToIndex[id];
+    uint32_t lastId = ids.back();
+    // the last entity fills the hole, so its id now points at the removed index
+    ids[index] = lastId;
+    idToIndex[lastId] = index;
+    ids.pop_back();
+
+    idToIndex[id] = InvalidId;
+    freeIds.push_back(id);
+    return index;
+}
@@ -0,0 +1,43 @@
+﻿/**
+ * 稳定实体 id 与紧凑下标之间的映射
+ * 实体数据按紧凑下标存放，删除时末尾实体移入空位，下标会变化；对外的 id 保持不变，
+ * 释放的 id 会被之后创建的实体复用。不涉及任何实体数据，方便单独测试。
+ */
+#pragma once
+#include <cstdint>
+#include <vector>
+
+class EntityIdTable
+{
+public:
+    static constexpr uint32_t InvalidId = UINT32_MAX;
+
+    // returns the id of a new entity whose data the caller appends at dense index GetCount() - 1
+    uint32_t Add();
+    // returns the dense index the entity had; the caller moves its last element into that index and pops the back
+    uint32_t Remove(uint32_t id);
+
+    bool IsAlive(uint32_t id) const
+    {
+        return id < idToIndex.size() && idToIndex[id] != InvalidId;
+    }
+    uint32_t GetIndex(uint32_t id) const
+    {
+        return idToIndex[id];
+    }
+    uint32_t GetId(uint32_t index) const
+    {
+        return ids[index];
+    }
+    uint32_t GetCount() const
+    {
+        return static_cast<uint32_t>(ids.size());
+    }
+
+private:
+    // dense index -> id
+    std::vector<uint32_t> ids;
+    // id -> dense index, InvalidId once released
+    std::vector<uint32_t> idToIndex;
+    std::vector<uint32_t> freeIds;
+};
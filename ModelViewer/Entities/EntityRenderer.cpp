@@ -0,0 +1,99 @@
+﻿#include "EntityRenderer.h"
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+#include "EngineTuning.h"
+#include "ModelLoader.h"
+#include "Renderer.h"
+#include "../World/World.h"
+using namespace Math;
+
+// MeshSorter keeps 16 bit object indices, every drawn entity adds one sort object per mesh
+NumVar EntityMaxDrawn("World/Entities/Max Drawn", 1024, 0, 4096, 256);
+
+namespace
+{
+    // model folder and bounding sphere radius in blocks
+    struct EntityModelDesc
+    {
+        const char* name;
+        float radius;
+    };
+
+    const EntityModelDesc kEntityModels[] = {
+        {"chicken", 0.4f},
+        {"pig", 0.7f},
+        {"wolf", 0.7f},
+    };
+}
+
+void EntityRenderer::LoadModels()
+{
+    for (const EntityModelDesc& desc : kEntityModels)
+    {
+        std::string path = std::string(ENTITY_RESOURCE_PATH) + desc.name + "/scene.gltf";
+        std::shared_ptr<Model> model = Renderer::LoadModel(Utility::ConvertToWideString(path), false);
+        if (model == nullptr)
+        {
+            std::cout << "entity model missing: " << path << std::endl;
+            continue;
+        }
+        models.push_back({model, desc.radius * World::UnitBlockSize});
+    }
+}
+
+void EntityRenderer::Shutdown()
+{
+    instances.clear();
+    instanceCount = 0;
+    models.clear();
+}
+
+void EntityRenderer::Update(GraphicsContext& context, const std::vector<EntitySystem::EntityRenderData>& snapshot,
+                            float deltaTime)
+{
+    instanceCount = 0;
+    if (models.empty())
+    {
+        return;
+    }
+    uint32_t count = std::min(static_cast<uint32_t>(snapshot.size()), static_cast<uint32_t>((int)EntityMaxDrawn));
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const EntityModel& entry = models[snapshot[i].modelHandle % models.size()];
+        if (i == instances.size())
+        {
+            instances.emplace_back(new ModelInstance(entry.model));
+            instances[i]->LoopAllAnimations();
+        }
+        else if (instances[i]->m_Model != entry.model)
+        {
+            // the entity at this index changed, only then are the instance buffers rebuilt
+            *instances[i] = entry.model;
+            instances[i]->LoopAllAnimations();
+        }
+
+        ModelInstance& instance = *instances[i];
+        instance.Resize(entry.radius);
+        // the snapshot holds the box centre, put the centre of the model's bounding sphere there
+        Vector3 position(snapshot[i].position[0], snapshot[i].position[1], snapshot[i].position[2]);
+        instance.Translate(position - entry.model->m_BoundingSphere.GetCenter() * instance.m_Locator.GetScale());
+        instance.Update(context, deltaTime);
+    }
+    instanceCount = count;
+}
+
+void EntityRenderer::Render(Renderer::MeshSorter& sorter, bool frustumCull) const
+{
+    const Frustum& frustum = sorter.GetWorldFrustum();
+    for (uint32_t i = 0; i < instanceCount; i++)
+    {
+        BoundingSphere sphere = instances[i]->GetBoundingSphere();
+        if (!frustumCull || frustum.IntersectSphere(sphere))
+        {
+            instances[i]->Render(sorter);
+        }
+    }
+}
@@ -0,0 +1,45 @@
+﻿/**
+ * 实体渲染，读取 EntitySystem 的渲染快照
+ * 1. 实体模型在启动时各加载一次 (Resources/Entity/<名字>/scene.gltf)，快照里的模型句柄即模型的加载顺序
+ * 2. 每帧按快照下标复用 ModelInstance，只在该下标的模型变化时重建实例的常量缓冲，其余只更新位置
+ * 3. 实例经由 ModelInstance::Render 加入 MeshSorter，与方块在同一组 pass 中绘制
+ */
+#pragma once
+#include <memory>
+#include <vector>
+
+#include "Model.h"
+#include "EntitySystem.h"
+
+#define ENTITY_RESOURCE_PATH "../Resources/Entity/"
+
+class EntityRenderer
+{
+public:
+    // loads every entity model, an out of range model handle wraps around
+    void LoadModels();
+    void Shutdown();
+
+    uint32_t GetModelCount() const
+    {
+        return static_cast<uint32_t>(models.size());
+    }
+
+    // places one instance on every snapshot entry and uploads its transforms
+    void Update(GraphicsContext& context, const std::vector<EntitySystem::EntityRenderData>& snapshot,
+                float deltaTime);
+    // shadow sorters pass frustumCull = false, their casters may lie outside the camera frustum
+    void Render(Renderer::MeshSorter& sorter, bool frustumCull) const;
+
+private:
+    struct EntityModel
+    {
+        std::shared_ptr<const Model> model;
+        // bounding sphere radius in world units
+        float radius;
+    };
+
+    std::vector<EntityModel> models;
+    std::vector<std::unique_ptr<ModelInstance>> instances;
+    uint32_t instanceCount = 0;
+};
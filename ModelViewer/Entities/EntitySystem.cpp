@@ -0,0 +1,306 @@
+﻿#include "EntitySystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <thread>
+
+#include "EngineTuning.h"
+#include "SystemTime.h"
+#include "../World/VoxelCollision.h"
+#include "../World/WorldMap.h"
+#include "Math/Random.h"
+using namespace Math;
+
+NumVar EntityUpdateBatch("World/Entities/Update Batch", 1024, 64, 16384, 64);
+NumVar EntityGravity("World/Entities/Gravity (blocks per s2)", 32, 0, 100, 1);
+
+namespace
+{
+    // hash cells span this many blocks per axis, a divisor of the chunk size keeps cells inside one chunk
+    constexpr int kHashCellBlocks = 4;
+}
+
+EntitySystem::EntitySystem(WorldMap* world, int threadCount)
+    : world(world)
+{
+    thread_pool = new ThreadPool(threadCount);
+
+    float cellSize[3];
+    float gridOrigin[3];
+    world->getCellGrid(cellSize, gridOrigin);
+    for (float& size : cellSize)
+    {
+        size *= kHashCellBlocks;
+    }
+    spatialHash.Configure(cellSize, gridOrigin);
+}
+
+EntitySystem::~EntitySystem()
+{
+    delete thread_pool;
+}
+
+EntitySystem::EntityId EntitySystem::Create(const Vector3& position, const Vector3& velocity,
+                                            const Vector3& halfExtent, uint32_t model, uint8_t entityFlags)
+{
+    EntityId id = idTable.Add();
+    posX.push_back(position.GetX());
+    posY.push_back(position.GetY());
+    posZ.push_back(position.GetZ());
+    velX.push_back(velocity.GetX());
+    velY.push_back(velocity.GetY());
+    velZ.push_back(velocity.GetZ());
+    halfX.push_back(halfExtent.GetX());
+    halfY.push_back(halfExtent.GetY());
+    halfZ.push_back(halfExtent.GetZ());
+    modelHandle.push_back(model);
+    flags.push_back(entityFlags);
+    return id;
+}
+
+void EntitySystem::Destroy(EntityId id)
+{
+    if (!IsAlive(id))
+    {
+        return;
+    }
+    uint32_t index = idTable.Remove(id);
+
+    // move the last entity into the hole so every array stays dense
+    auto removeAt = [index](auto& values)
+    {
+        values[index] = values.back();
+        values.pop_back();
+    };
+    removeAt(posX);
+    removeAt(posY);
+    removeAt(posZ);
+    removeAt(velX);
+    removeAt(velY);
+    removeAt(velZ);
+    removeAt(halfX);
+    removeAt(halfY);
+    removeAt(halfZ);
+    removeAt(modelHandle);
+    removeAt(flags);
+}
+
+bool EntitySystem::IsAlive(EntityId id) const
+{
+    return idTable.IsAlive(id);
+}
+
+Vector3 EntitySystem::GetPosition(EntityId id) const
+{
+    uint32_t index = idTable.GetIndex(id);
+    return Vector3(posX[index], posY[index], posZ[index]);
+}
+
+void EntitySystem::SetVelocity(EntityId id, const Vector3& velocity)
+{
+    uint32_t index = idTable.GetIndex(id);
+    velX[index] = velocity.GetX();
+    velY[index] = velocity.GetY();
+    velZ[index] = velocity.GetZ();
+}
+
+void EntitySystem::Update(float deltaTime)
+{
+    uint32_t count = GetEntityCount();
+    uint32_t batch = static_cast<uint32_t>((int)EntityUpdateBatch);
+
+    threadResultVector.clear();
+    for (uint32_t begin = 0; begin < count; begin += batch)
+    {
+        uint32_t end = std::min(count, begin + batch);
+        threadResultVector.emplace_back(thread_pool->enqueue([this, begin, end, deltaTime]
+        {
+            integrate(begin, end, deltaTime);
+        }));
+    }
+    waitThreadsWorkDone();
+
+    rebuildSpatialHash();
+    publishSnapshot();
+}
+
+void EntitySystem::integrate(uint32_t begin, uint32_t end, float deltaTime)
+{
+    float gravity = EntityGravity * World::UnitBlockStep * deltaTime;
+    for (uint32_t i = begin; i < end; i++)
+    {
+        if (flags[i] & Gravity)
+        {
+            velY[i] -= gravity;
+        }
+        Vector3 motion(velX[i] * deltaTime, velY[i] * deltaTime, velZ[i] * deltaTime);
+        if (!(flags[i] & CollideVoxels))
+        {
+            posX[i] += motion.GetX();
+            posY[i] += motion.GetY();
+            posZ[i] += motion.GetZ();
+            continue;
+        }
+
+        Vector3 center(posX[i], posY[i], posZ[i]);
+        Vector3 half(halfX[i], halfY[i], halfZ[i]);
+        VoxelCollision::SweepResult sweep = VoxelCollision::SweepBox(
+            *world, AxisAlignedBox(center - half, center + half), motion);
+        posX[i] += sweep.moved.GetX();
+        posY[i] += sweep.moved.GetY();
+        posZ[i] += sweep.moved.GetZ();
+
+        // a blocked axis loses its velocity so the entity rests against the face instead of pushing into it
+        float* velocity[3] = {&velX[i], &velY[i], &velZ[i]};
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (sweep.blocked[axis])
+            {
+                *velocity[axis] = 0.0f;
+            }
+        }
+        flags[i] = sweep.onGround ? flags[i] | OnGround : flags[i] & ~OnGround;
+    }
+}
+
+void EntitySystem::rebuildSpatialHash()
+{
+    float maxHalf[3] = {};
+    for (uint32_t i = 0; i < GetEntityCount(); i++)
+    {
+        maxHalf[0] = std::max(maxHalf[0], halfX[i]);
+        maxHalf[1] = std::max(maxHalf[1], halfY[i]);
+        maxHalf[2] = std::max(maxHalf[2], halfZ[i]);
+    }
+    spatialHash.Build(posX.data(), posY.data(), posZ.data(), GetEntityCount(), maxHalf);
+}
+
+void EntitySystem::publishSnapshot()
+{
+    std::vector<EntityRenderData>& back = renderSnapshots[1 - frontSnapshot];
+    back.resize(GetEntityCount());
+    for (uint32_t i = 0; i < GetEntityCount(); i++)
+    {
+        back[i] = {modelHandle[i], {posX[i], posY[i], posZ[i]}};
+    }
+    frontSnapshot = 1 - frontSnapshot;
+}
+
+bool EntitySystem::overlaps(uint32_t a, uint32_t b) const
+{
+    return std::abs(posX[a] - posX[b]) < halfX[a] + halfX[b]
+        && std::abs(posY[a] - posY[b]) < halfY[a] + halfY[b]
+        && std::abs(posZ[a] - posZ[b]) < halfZ[a] + halfZ[b];
+}
+
+void EntitySystem::QueryAABB(const Vector3& boxMin, const Vector3& boxMax, std::vector<EntityId>& result) const
+{
+    result.clear();
+    float lo[3] = {boxMin.GetX(), boxMin.GetY(), boxMin.GetZ()};
+    float hi[3] = {boxMax.GetX(), boxMax.GetY(), boxMax.GetZ()};
+    // the hash reflects the positions of the last Update
+    if (spatialHash.GetEntityCount() != GetEntityCount())
+    {
+        return;
+    }
+    spatialHash.ForEachCandidate(lo, hi, [&](uint32_t i)
+    {
+        if (posX[i] + halfX[i] > lo[0] && posX[i] - halfX[i] < hi[0]
+            && posY[i] + halfY[i] > lo[1] && posY[i] - halfY[i] < hi[1]
+            && posZ[i] + halfZ[i] > lo[2] && posZ[i] - halfZ[i] < hi[2])
+        {
+            result.push_back(idTable.GetId(i));
+        }
+    });
+}
+
+void EntitySystem::FindOverlappingPairs(std::vector<std::pair<EntityId, EntityId>>& pairs)
+{
+    pairs.clear();
+    uint32_t count = GetEntityCount();
+    if (spatialHash.GetEntityCount() != count)
+    {
+        return;
+    }
+    uint32_t batch = static_cast<uint32_t>((int)EntityUpdateBatch);
+    uint32_t batchCount = (count + batch - 1) / batch;
+    std::vector<std::vector<std::pair<EntityId, EntityId>>> batchPairs(batchCount);
+
+    threadResultVector.clear();
+    for (uint32_t b = 0; b < batchCount; b++)
+    {
+        threadResultVector.emplace_back(thread_pool->enqueue([this, b, batch, count, &batchPairs]
+        {
+            uint32_t end = std::min(count, (b + 1) * batch);
+            for (uint32_t i = b * batch; i < end; i++)
+            {
+                float lo[3] = {posX[i] - halfX[i], posY[i] - halfY[i], posZ[i] - halfZ[i]};
+                float hi[3] = {posX[i] + halfX[i], posY[i] + halfY[i], posZ[i] + halfZ[i]};
+                spatialHash.ForEachCandidate(lo, hi, [&](uint32_t j)
+                {
+                    // the lower index owns the pair so it is emitted once
+                    if (j > i && overlaps(i, j))
+                    {
+                        batchPairs[b].emplace_back(idTable.GetId(i), idTable.GetId(j));
+                    }
+                });
+            }
+        }));
+    }
+    waitThreadsWorkDone();
+
+    for (auto& found : batchPairs)
+    {
+        pairs.insert(pairs.end(), found.begin(), found.end());
+    }
+}
+
+void EntitySystem::waitThreadsWorkDone()
+{
+    for (auto&& result : threadResultVector)
+    {
+        result.wait();
+    }
+}
+
+void EntitySystem::RunBenchmark(WorldMap* world, const Vector3& center)
+{
+    const uint32_t entityCounts[] = {1000, 10000, 100000};
+    const int frameCount = 16;
+    const float spread = 64 * World::UnitBlockSize;
+    const float worldHeight = WorldGenerator::WORLD_DEPTH * World::UnitBlockStep;
+    const Vector3 halfExtent(0.3f * World::UnitBlockSize, 0.9f * World::UnitBlockStep, 0.3f * World::UnitBlockSize);
+    const float speed = 4 * World::UnitBlockSize;
+
+    for (uint32_t entityCount : entityCounts)
+    {
+        EntitySystem entities(world, std::max(1u, std::thread::hardware_concurrency()));
+        RandomNumberGenerator rng(20240701);
+        for (uint32_t i = 0; i < entityCount; i++)
+        {
+            Vector3 position(center.GetX() + rng.NextFloat(-spread, spread), rng.NextFloat(0.0f, worldHeight),
+                             center.GetZ() + rng.NextFloat(-spread, spread));
+            Vector3 velocity(rng.NextFloat(-speed, speed), 0.0f, rng.NextFloat(-speed, speed));
+            entities.Create(position, velocity, halfExtent, i % 16);
+        }
+
+        std::vector<std::pair<EntityId, EntityId>> pairs;
+        double updateTime = 0.0;
+        double pairTime = 0.0;
+        for (int frame = 0; frame < frameCount; frame++)
+        {
+            int64_t start = SystemTime::GetCurrentTick();
+            entities.Update(1.0f / 60.0f);
+            int64_t updateEnd = SystemTime::GetCurrentTick();
+            entities.FindOverlappingPairs(pairs);
+            int64_t pairEnd = SystemTime::GetCurrentTick();
+            updateTime += SystemTime::TimeBetweenTicks(start, updateEnd);
+            pairTime += SystemTime::TimeBetweenTicks(updateEnd, pairEnd);
+        }
+
+        std::cout << "entity benchmark: " << entityCount << " entities, update "
+            << updateTime / frameCount * 1000.0 << " ms, overlap pairs "
+            << pairTime / frameCount * 1000.0 << " ms, " << pairs.size() << " pairs" << std::endl;
+    }
+}
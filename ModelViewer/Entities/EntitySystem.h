@@ -0,0 +1,97 @@
+﻿/**
+ * 面向数据 (SoA) 的实体系统
+ * 1. 位置、速度、包围盒半尺寸、模型句柄各自存放在连续数组中，删除时与末尾交换，数组始终紧凑
+ *    实体对外只暴露稳定的 EntityId，内部下标可能随删除变化
+ * 2. Update 按固定批大小把积分与体素碰撞分发到线程池，每个批次只写自己那段数组
+ * 3. 每帧更新结束后重建与 chunk 对齐的 SpatialHash，作为实体与实体、实体与区域查询的粗筛
+ * 4. GetRenderSnapshot 返回双缓冲快照 (模型句柄 + 位置)，EntityRenderer 据此摆放 ModelInstance，
+ *    渲染端不直接访问正在更新的数组
+ */
+#pragma once
+#include <cstdint>
+#include <future>
+#include <utility>
+#include <vector>
+
+#include "EntityIdTable.h"
+#include "SpatialHash.h"
+#include "ThreadPool.h"
+#include "Math/Vector.h"
+
+class WorldMap;
+
+class EntitySystem
+{
+public:
+    using EntityId = uint32_t;
+    static constexpr EntityId InvalidEntity = EntityIdTable::InvalidId;
+
+    enum Flags : uint8_t
+    {
+        CollideVoxels = 1 << 0,
+        Gravity = 1 << 1,
+        OnGround = 1 << 2,
+    };
+
+    struct EntityRenderData
+    {
+        uint32_t modelHandle;
+        float position[3];
+    };
+
+    EntitySystem(WorldMap* world, int threadCount);
+    ~EntitySystem();
+
+    // halfExtent is half of the world space box size, the box is centred on position
+    EntityId Create(const Math::Vector3& position, const Math::Vector3& velocity, const Math::Vector3& halfExtent,
+                    uint32_t modelHandle, uint8_t flags = CollideVoxels | Gravity);
+    void Destroy(EntityId id);
+    bool IsAlive(EntityId id) const;
+    uint32_t GetEntityCount() const
+    {
+        return idTable.GetCount();
+    }
+
+    Math::Vector3 GetPosition(EntityId id) const;
+    void SetVelocity(EntityId id, const Math::Vector3& velocity);
+
+    void Update(float deltaTime);
+
+    // ids of all entities whose box overlaps [boxMin, boxMax], valid after the last Update
+    void QueryAABB(const Math::Vector3& boxMin, const Math::Vector3& boxMax, std::vector<EntityId>& result) const;
+    // every pair of overlapping entity boxes, each pair reported once
+    void FindOverlappingPairs(std::vector<std::pair<EntityId, EntityId>>& pairs);
+
+    // positions published by the last Update, stable until the next one
+    const std::vector<EntityRenderData>& GetRenderSnapshot() const
+    {
+        return renderSnapshots[frontSnapshot];
+    }
+
+    static void RunBenchmark(WorldMap* world, const Math::Vector3& center);
+
+private:
+    void integrate(uint32_t begin, uint32_t end, float deltaTime);
+    void rebuildSpatialHash();
+    void publishSnapshot();
+    bool overlaps(uint32_t a, uint32_t b) const;
+    void waitThreadsWorkDone();
+
+    WorldMap* world;
+    ThreadPool* thread_pool;
+    std::vector<std::future<void>> threadResultVector{};
+
+    // SoA entity state, all indexed by the dense entity index
+    std::vector<float> posX, posY, posZ;
+    std::vector<float> velX, velY, velZ;
+    std::vector<float> halfX, halfY, halfZ;
+    std::vector<uint32_t> modelHandle;
+    std::vector<uint8_t> flags;
+
+    // EntityId <-> dense index, released ids are reused
+    EntityIdTable idTable;
+
+    SpatialHash spatialHash;
+    std::vector<EntityRenderData> renderSnapshots[2];
+    int frontSnapshot = 0;
+};
@@ -0,0 +1,68 @@
+﻿#include "SpatialHash.h"
+
+#include <algorithm>
+#include <cmath>
+
+void SpatialHash::Configure(const float size[3], const float gridOrigin[3])
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        cellSize[axis] = size[axis];
+        origin[axis] = gridOrigin[axis];
+    }
+}
+
+void SpatialHash::Build(const float* x, const float* y, const float* z, uint32_t count, const float halfExtent[3])
+{
+    std::copy(halfExtent, halfExtent + 3, maxHalfExtent);
+
+    // about two buckets per entity keeps unrelated cells from sharing a bucket
+    uint32_t bucketCount = 1;
+    while (bucketCount < count * 2)
+    {
+        bucketCount <<= 1;
+    }
+    bucketMask = bucketCount - 1;
+
+    const float* positions[3] = {x, y, z};
+    std::vector<uint32_t> entityBuckets(count);
+    bucketStart.assign(bucketCount + 1, 0);
+    for (int axis = 0; axis < 3; axis++)
+    {
+        entityCells[axis].resize(count);
+    }
+    for (uint32_t i = 0; i < count; i++)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            entityCells[axis][i] = CellCoord(axis, positions[axis][i]);
+        }
+        entityBuckets[i] = Bucket(entityCells[0][i], entityCells[1][i], entityCells[2][i]);
+        bucketStart[entityBuckets[i] + 1]++;
+    }
+
+    // counting sort: prefix sums give each bucket its slice, then entities are dropped in order
+    for (uint32_t b = 0; b < bucketCount; b++)
+    {
+        bucketStart[b + 1] += bucketStart[b];
+    }
+    sortedIndices.resize(count);
+    std::vector<uint32_t> cursor(bucketStart.begin(), bucketStart.end() - 1);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        sortedIndices[cursor[entityBuckets[i]]++] = i;
+    }
+}
+
+int SpatialHash::CellCoord(int axis, float value) const
+{
+    return static_cast<int>(std::floor((value - origin[axis]) / cellSize[axis]));
+}
+
+uint32_t SpatialHash::Bucket(int cellX, int cellY, int cellZ) const
+{
+    uint32_t h = static_cast<uint32_t>(cellX) * 73856093u
+        ^ static_cast<uint32_t>(cellY) * 19349663u
+        ^ static_cast<uint32_t>(cellZ) * 83492791u;
+    return h & bucketMask;
+}
@@ -0,0 +1,76 @@
+﻿/**
+ * 均匀空间哈希，实体与实体、实体与体素查询的粗筛阶段 (broadphase)
+ * 1. 哈希格子的大小是方块格子的整数倍且整除 chunk，格子边界与 chunk 边界对齐
+ * 2. 每帧用计数排序一次性重建：按实体中心所在格子分桶，O(n)，不做逐实体的增删
+ * 3. 查询时把查询盒按最大实体半尺寸外扩，遍历覆盖到的格子；不同格子可能落在同一个桶中，
+ *    因此候选实体还要比对自身格子坐标，保证每个实体只被报告一次
+ */
+#pragma once
+#include <cstdint>
+#include <vector>
+
+class SpatialHash
+{
+public:
+    // cellSize / origin: world size of a hash cell and a world position on a cell corner, per axis
+    void Configure(const float cellSize[3], const float origin[3]);
+
+    // rebuilds the table from entity centres, maxHalfExtent bounds the half size of every entity box
+    void Build(const float* x, const float* y, const float* z, uint32_t count, const float maxHalfExtent[3]);
+
+    // calls visit(index) once for every entity whose box may overlap [boxMin, boxMax]
+    template <class Visitor>
+    void ForEachCandidate(const float boxMin[3], const float boxMax[3], Visitor&& visit) const;
+
+    uint32_t GetEntityCount() const
+    {
+        return static_cast<uint32_t>(sortedIndices.size());
+    }
+
+private:
+    int CellCoord(int axis, float value) const;
+    uint32_t Bucket(int cellX, int cellY, int cellZ) const;
+
+    float cellSize[3] = {1.0f, 1.0f, 1.0f};
+    float origin[3] = {};
+    float maxHalfExtent[3] = {};
+    uint32_t bucketMask = 0;
+    // entities of bucket b are sortedIndices[bucketStart[b], bucketStart[b + 1])
+    std::vector<uint32_t> bucketStart;
+    std::vector<uint32_t> sortedIndices;
+    std::vector<int32_t> entityCells[3];
+};
+
+template <class Visitor>
+void SpatialHash::ForEachCandidate(const float boxMin[3], const float boxMax[3], Visitor&& visit) const
+{
+    if (sortedIndices.empty())
+    {
+        return;
+    }
+    int lo[3];
+    int hi[3];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        lo[axis] = CellCoord(axis, boxMin[axis] - maxHalfExtent[axis]);
+        hi[axis] = CellCoord(axis, boxMax[axis] + maxHalfExtent[axis]);
+    }
+    for (int x = lo[0]; x <= hi[0]; x++)
+    {
+        for (int y = lo[1]; y <= hi[1]; y++)
+        {
+            for (int z = lo[2]; z <= hi[2]; z++)
+            {
+                uint32_t bucket = Bucket(x, y, z);
+                for (uint32_t i = bucketStart[bucket]; i < bucketStart[bucket + 1]; i++)
+                {
+                    uint32_t index = sortedIndices[i];
+                    if (entityCells[0][index] == x && entityCells[1][index] == y && entityCells[2][index] == z)
+                    {
+                        visit(index);
+                    }
+                }
+            }
+        }
+    }
+}
@@ -36,12 +36,17 @@
 #include "ShadowCamera.h"
 #include "Display.h"
 #include "LightManager.h"
+#include "LightGridBinning.h"
 #include "SimplexNoise.h"
 #include "ThreadPool.h"
+#include "Math/Random.h"
 #include "Blocks/BlockResourceManager.h"
 #include "World/WorldMap.h"
 #include "World/World.h"
 #include "World/Chunk.h"
+#include "World/VoxelCollision.h"
+#include "Entities/EntitySystem.h"
+#include "Entities/EntityRenderer.h"
 
 #define LEGACY_RENDERER
 
@@ -83,7 +88,11 @@ private:
     ModelInstance m_ModelInst;
     Chunk world_block;
     WorldMap* worldMap;
+    EntitySystem* entitySystem = nullptr;
+    EntityRenderer entityRenderer;
     ShadowCamera m_SunShadow;
+    Lighting::LightGridBinner m_PointLightBinner{Lighting::MaxLights};
+    std::vector<Lighting::LightGridBinner::PointLight> m_PointLights;
 };
 
 NumVar ShadowDimX("Sponza/Lighting/Shadow Dim X", 10000, 1000, 10000, 100);
@@ -95,6 +104,22 @@ ExpVar g_SunLightIntensity("Viewer/Lighting/Sun Light Intensity", 4.0f, 0.0f, 16
 NumVar g_SunOrientation("Viewer/Lighting/Sun Orientation", -0.5f, -100.0f, 100.0f, 0.1f);
 NumVar g_SunInclination("Viewer/Lighting/Sun Inclination", 0.75f, 0.0f, 1.0f, 0.01f);
 NumVar ModelUnitSize("Model/Unit Size", 500.0f, 100.0f, 1000.0f, 100.0f);
+BoolVar RunRaycastBenchmark("World/Run Raycast Benchmark", false);
+BoolVar RunEntityBenchmark("World/Run Entity Benchmark", false);
+BoolVar SpawnEntities("World/Entities/Spawn", false);
+NumVar SpawnEntityCount("World/Entities/Spawn Count", 64, 1, 4096, 16);
+BoolVar ClearEntities("World/Entities/Clear", false);
+BoolVar RunRegionEditBenchmark("World/Run Region Edit Benchmark", false);
+BoolVar RunNoiseBenchmark("World/Run Noise Benchmark", false);
+BoolVar RunLatticeNoiseReport("World/Run Lattice Noise Report", false);
+BoolVar RunClimateCacheReport("World/Run Climate Cache Report", false);
+BoolVar RunDensityTerrainReport("World/Run Density Terrain Report", false);
+BoolVar RunHeightBenchmark("World/Run Height Benchmark", false);
+BoolVar CameraCollision("World/Camera Collision", true);
+BoolVar VoxelPointLights("World/Light/Point Lights", true);
+BoolVar LogPointLights("World/Light/Log Point Lights", false);
+// blocks are full cubes, so a one block step lets the camera walk up terrain without climbing walls
+NumVar CameraStepHeight("World/Camera Step Height (blocks)", 1.0f, 0.0f, 2.0f, 0.1f);
 
 void ChangeIBLSet(EngineVar::ActionType);
 void ChangeIBLBias(EngineVar::ActionType);
@@ -188,7 +213,7 @@ void ModelViewer::Startup(void)
 {
     // 初始化动态模糊
     std::cout <<"Sizeof Block: " << sizeof(Block) << std::endl;
-    SimplexNoise::setSeed(20);
+    WorldGenerator::SetSeed(20);
     MotionBlur::Enable = true;
 
     TemporalEffects::EnableTAA = true;
@@ -199,10 +224,12 @@ void ModelViewer::Startup(void)
     PostEffects::EnableAdaptation = true;
 
     // Screen Space Ambient Occlusion 屏幕空间环境光遮蔽
-    SSAO::Enable = true;
+    // 方块的环境光遮蔽已在生成实例数据时逐顶点烘焙 (World/VoxelAO.h)，默认关闭 SSAO
+    SSAO::Enable = false;
 
     Renderer::Initialize();
     BlockResourceManager::initBlocks();
+    Renderer::SetBlockTextures(BlockResourceManager::getBlockTextureSRV());
     LoadIBLTextures();
 
     std::wstring gltfFileName;
@@ -224,6 +251,8 @@ void ModelViewer::Startup(void)
     else
     {
         worldMap = new WorldMap(27,16,2);
+        entitySystem = new EntitySystem(worldMap, std::max(1u, std::thread::hardware_concurrency()));
+        entityRenderer.LoadModels();
         
         // world_block = WorldBlock(Vector3(0, 0, 0), 16);
         MotionBlur::Enable = false;
@@ -234,7 +263,19 @@ void ModelViewer::Startup(void)
     m_Camera.SetPosition({0,128.0f*World::UnitBlockSize, 0});
     if (gltfFileName.size() == 0)
     {
-        m_CameraController.reset(new FlyingFPSCamera(m_Camera, Vector3(kYUnitVector)));
+        FlyingFPSCamera* flyingCamera = new FlyingFPSCamera(m_Camera, Vector3(kYUnitVector));
+        // player sized body: 0.6 x 1.8 blocks with the eye at 1.62
+        VoxelCollision::CameraBody body{0.3f * World::UnitBlockSize, 1.8f * World::UnitBlockSize,
+                                        1.62f * World::UnitBlockSize};
+        flyingCamera->SetMovementFilter([this, body](const Vector3& from, const Vector3& to)
+        {
+            if (!CameraCollision)
+            {
+                return to;
+            }
+            return VoxelCollision::MoveEye(*worldMap, body, from, to, CameraStepHeight * World::UnitBlockStep);
+        });
+        m_CameraController.reset(flyingCamera);
         //m_CameraController.reset(new OrbitCamera(m_Camera, m_ModelInst.GetBoundingSphere(), Vector3(kYUnitVector)));
     }
     else
@@ -244,6 +285,9 @@ void ModelViewer::Startup(void)
 void ModelViewer::Cleanup(void)
 {
     m_ModelInst = nullptr;
+    entityRenderer.Shutdown();
+    delete entitySystem;
+    entitySystem = nullptr;
     // world_block.CleanUp();
 
     g_IBLTextures.clear();
@@ -278,10 +322,88 @@ void ModelViewer::Update(float deltaT)
     {
         worldMap->PutBlock(ori,dir, Grass);
     }
+    if (GameInput::IsPressed(GameInput::kKey_lcontrol))
+    {
+        if (GameInput::IsFirstPressed(GameInput::kKey_z))
+        {
+            worldMap->GetJournal().Undo();
+        }
+        else if (GameInput::IsFirstPressed(GameInput::kKey_y))
+        {
+            worldMap->GetJournal().Redo();
+        }
+    }
+    if (RunRaycastBenchmark)
+    {
+        RunRaycastBenchmark = false;
+        worldMap->RunRaycastBenchmark(ori);
+    }
+    if (RunEntityBenchmark)
+    {
+        RunEntityBenchmark = false;
+        EntitySystem::RunBenchmark(worldMap, ori);
+    }
+    if (RunNoiseBenchmark)
+    {
+        RunNoiseBenchmark = false;
+        WorldGenerator::RunNoiseBenchmark();
+    }
+    if (RunLatticeNoiseReport)
+    {
+        RunLatticeNoiseReport = false;
+        WorldGenerator::RunLatticeNoiseReport();
+    }
+    if (RunClimateCacheReport)
+    {
+        RunClimateCacheReport = false;
+        WorldGenerator::RunClimateCacheReport();
+    }
+    if (RunDensityTerrainReport)
+    {
+        RunDensityTerrainReport = false;
+        WorldGenerator::RunDensityTerrainReport();
+    }
+    if (RunHeightBenchmark)
+    {
+        RunHeightBenchmark = false;
+        WorldGenerator::RunHeightBenchmark();
+    }
+    if (RunRegionEditBenchmark)
+    {
+        RunRegionEditBenchmark = false;
+        // 100 cells on each side, a million blocks unless the box sticks out of the world height
+        worldMap->GetRegionEdits().RunBenchmark(ori, 50);
+    }
+    worldMap->TickBlocks(deltaT, ori);
+    if (SpawnEntities)
+    {
+        SpawnEntities = false;
+        // a ring of entities a few blocks around the camera, dropped onto the terrain by gravity
+        const Vector3 halfExtent(0.3f * World::UnitBlockSize, 0.45f * World::UnitBlockStep, 0.3f * World::UnitBlockSize);
+        const float speed = 2 * World::UnitBlockSize;
+        for (int i = 0; i < (int)SpawnEntityCount; i++)
+        {
+            float angle = g_RNG.NextFloat(2.0f * XM_PI);
+            float distance = g_RNG.NextFloat(3.0f, 16.0f) * World::UnitBlockSize;
+            Vector3 position = ori + Vector3(cosf(angle) * distance, 0.0f, sinf(angle) * distance);
+            Vector3 velocity(g_RNG.NextFloat(-speed, speed), 0.0f, g_RNG.NextFloat(-speed, speed));
+            // the renderer wraps the model handle onto the loaded entity models
+            entitySystem->Create(position, velocity, halfExtent, i);
+        }
+    }
+    if (ClearEntities)
+    {
+        ClearEntities = false;
+        delete entitySystem;
+        entitySystem = new EntitySystem(worldMap, std::max(1u, std::thread::hardware_concurrency()));
+    }
+    entitySystem->Update(deltaT);
     
     
     GraphicsContext& gfxContext = GraphicsContext::Begin(L"Scene Update");
 
+    entityRenderer.Update(gfxContext, entitySystem->GetRenderSnapshot(), deltaT);
+
     gfxContext.Finish();
 
     // We use viewport offsets to jitter sample positions from frame to frame (for TAA.)
@@ -322,29 +444,14 @@ void ModelViewer::Update(float deltaT)
 void ModelViewer::RenderBlocks(MeshSorter& sorter, MeshSorter::DrawPass pass, GraphicsContext& context,
                                GlobalConstants& globals)
 {
-    for (int i = 0; i < BlockResourceManager::BlockType::Air; i++)
-    {
-        auto type = static_cast<BlockResourceManager::BlockType>(i);
-        sorter.ClearMeshes();
-        sorter.currentBlockType = type;
-        BlockResourceManager::getBlockRef(type).Render(sorter);
-        sorter.Sort();
-        sorter.RenderMeshes(pass, context, globals);
-    }
+    // every block type shares the procedural cube, so each pass is a single instanced draw
+    sorter.RenderMeshes(pass, context, globals);
 }
 
 void ModelViewer::RenderShadowBlocks(MeshSorter& sorter, MeshSorter::DrawPass pass, GraphicsContext& context,
                                      GlobalConstants& globals, Matrix4 matrix)
 {
-    for (int i = 0; i < BlockResourceManager::BlockType::Air; i++)
-    {
-        auto type = static_cast<BlockResourceManager::BlockType>(i);
-        sorter.ClearMeshes();
-        sorter.currentBlockType = type;
-        BlockResourceManager::getBlockRef(type).Render(sorter);
-        sorter.Sort();
-        sorter.RenderMeshes(pass, context, globals, matrix);
-    }
+    sorter.RenderMeshes(pass, context, globals, matrix);
 }
 
 void ModelViewer::RenderScene(void)
@@ -391,6 +498,34 @@ void ModelViewer::RenderScene(void)
         worldMap->renderVisibleBlocks(m_Camera, gfxContext);
     }
 
+    if (VoxelPointLights)
+    {
+        ScopedTimer _prof(L"Bin Voxel Point Lights", gfxContext);
+        worldMap->GatherPointLights(m_PointLights);
+        Lighting::LightGridBinner::View view;
+        memcpy(view.viewProj, &m_Camera.GetViewProjMatrix(), sizeof(view.viewProj));
+        view.width = g_SceneColorBuffer.GetWidth();
+        view.height = g_SceneColorBuffer.GetHeight();
+        view.tileDim = (uint32_t)(int)Lighting::LightGridDim;
+        // an unchanged view and light set leaves the grid on the GPU as it is
+        if (m_PointLightBinner.Bin(view, m_PointLights))
+        {
+            Lighting::UploadBinnedLights(gfxContext, m_PointLightBinner);
+        }
+        if (LogPointLights)
+        {
+            const auto& stats = m_PointLightBinner.GetStats();
+            std::cout << "point lights: " << stats.candidates << " gathered, " << stats.culled << " culled, "
+                << stats.binned << " binned, " << stats.dirtyTiles << " tiles uploaded"
+                << (stats.skipped ? " (unchanged)" : "") << std::endl;
+        }
+        globals.LightGridTileCountX = m_PointLightBinner.GetTileCountX();
+        globals.InvLightGridDim = 1.0f / view.tileDim;
+    }
+
+    entityRenderer.Render(sorter, true);
+    sorter.Sort();
+
     {
         ScopedTimer _prof(L"Depth Pre-Pass", gfxContext);
         RenderBlocks(sorter, MeshSorter::kZPass, gfxContext, globals);
@@ -407,6 +542,8 @@ void ModelViewer::RenderScene(void)
             MeshSorter shadowSorter(MeshSorter::kShadows);
             shadowSorter.SetCamera(m_Camera);
             shadowSorter.SetDepthStencilTarget(g_ShadowBuffer);
+            entityRenderer.Render(shadowSorter, false);
+            shadowSorter.Sort();
             RenderShadowBlocks(shadowSorter, MeshSorter::kZPass, gfxContext, globals, m_SunShadow.GetViewProjMatrix());
         }
 
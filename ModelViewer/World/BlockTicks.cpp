@@ -0,0 +1,308 @@
+﻿#include "BlockTicks.h"
+
+#include <algorithm>
+#include <array>
+#include <iostream>
+
+#include "EngineTuning.h"
+#include "SystemTime.h"
+#include "WorldMap.h"
+using namespace BlockResourceManager;
+
+NumVar BlockTickBudget("World/Ticks/Budget per Tick", 4096, 64, 65536, 64);
+NumVar RandomTicksPerSection("World/Ticks/Random Ticks per Section", 3, 0, 64, 1);
+NumVar RandomTickRadius("World/Ticks/Random Tick Radius (chunks)", 4, 0, 13, 1);
+BoolVar LogBlockTicks("World/Ticks/Log Stats", false);
+
+namespace
+{
+    // a long frame runs at most this many ticks, the rest of the backlog is dropped instead of stalling
+    constexpr int kMaxCatchUpTicks = 4;
+
+    // falls into the air below, the block that lands is notified again and keeps falling
+    bool tickFalling(BlockTickContext& context)
+    {
+        BlockCoord below = context.scheduler.GetNeighbour(context.block, 0, -1, 0);
+        if (!below.IsValid() || below.GetBlock().blockType != Air)
+        {
+            return false;
+        }
+        BlockType type = context.block.GetBlock().blockType;
+        context.world.SetBlock(context.block, Air);
+        context.world.SetBlock(below, type);
+        return false;
+    }
+
+    // grass dies under a solid block, otherwise spreads to an uncovered dirt block nearby
+    void randomTickGrass(BlockTickContext& context)
+    {
+        BlockCoord above = context.scheduler.GetNeighbour(context.block, 0, 1, 0);
+        if (above.IsValid() && isSolidBlock(above.GetBlock().blockType))
+        {
+            context.world.SetBlock(context.block, Dirt);
+            return;
+        }
+
+        Math::RandomNumberGenerator& random = context.scheduler.GetRandom();
+        BlockCoord target = context.scheduler.GetNeighbour(context.block, random.NextInt(-1, 1),
+                                                           random.NextInt(-3, 1), random.NextInt(-1, 1));
+        if (!target.IsValid() || target.GetBlock().blockType != Dirt)
+        {
+            return;
+        }
+        BlockCoord targetAbove = context.scheduler.GetNeighbour(target, 0, 1, 0);
+        if (!targetAbove.IsValid() || !isSolidBlock(targetAbove.GetBlock().blockType))
+        {
+            context.world.SetBlock(target, Grass);
+        }
+    }
+
+    std::array<BlockBehaviour, Air + 1> createBehaviours()
+    {
+        std::array<BlockBehaviour, Air + 1> behaviours{};
+        behaviours[Sand].onTick = tickFalling;
+        behaviours[Sand].notifyDelay = 2;
+        behaviours[Grass].onRandomTick = randomTickGrass;
+        return behaviours;
+    }
+
+    std::array<BlockBehaviour, Air + 1> Behaviours = createBehaviours();
+}
+
+BlockTickScheduler::BlockTickScheduler(WorldMap* world)
+    : world(world), random(20240801)
+{
+}
+
+void BlockTickScheduler::SetBehaviour(BlockType type, const BlockBehaviour& behaviour)
+{
+    Behaviours[type] = behaviour;
+}
+
+const BlockBehaviour& BlockTickScheduler::GetBehaviour(BlockType type)
+{
+    return Behaviours[type];
+}
+
+void BlockTickScheduler::Update(float deltaT, int centerChunkX, int centerChunkY)
+{
+    const float tickLength = 1.0f / TICKS_PER_SECOND;
+    accumulator = std::min(accumulator + deltaT, kMaxCatchUpTicks * tickLength);
+    while (accumulator >= tickLength)
+    {
+        accumulator -= tickLength;
+        tick(centerChunkX, centerChunkY);
+    }
+}
+
+void BlockTickScheduler::tick(int centerChunkX, int centerChunkY)
+{
+    int64_t start = SystemTime::GetCurrentTick();
+    stats = TickStats();
+    currentTick++;
+
+    uint32_t budget = static_cast<uint32_t>((int)BlockTickBudget);
+    budget -= runScheduled(budget);
+    runActive(budget);
+    runRandom(centerChunkX, centerChunkY);
+
+    stats.pendingScheduled = static_cast<uint32_t>(scheduled.size());
+    for (Chunk* chunk : activeChunks)
+    {
+        stats.activeBlocks += static_cast<uint32_t>(chunk->activeBlocks.size());
+    }
+    stats.milliseconds = SystemTime::TimeBetweenTicks(start, SystemTime::GetCurrentTick()) * 1000.0;
+    lastStats = stats;
+
+    if (LogBlockTicks && currentTick % static_cast<uint64_t>(TICKS_PER_SECOND) == 0)
+    {
+        std::cout << "block ticks: scheduled " << stats.scheduledTicks << " (pending " << stats.pendingScheduled
+            << "), active " << stats.activeTicks << " of " << stats.activeBlocks << ", deferred " << stats.deferred
+            << ", random " << stats.randomTicks << " of " << stats.randomSamples << " samples, "
+            << stats.milliseconds << " ms" << std::endl;
+    }
+}
+
+uint32_t BlockTickScheduler::runScheduled(uint32_t budget)
+{
+    uint32_t used = 0;
+    while (!scheduled.empty() && scheduled.top().dueTick <= currentTick)
+    {
+        if (used >= budget)
+        {
+            // due ticks stay at the front of the queue and run first next tick
+            stats.deferred++;
+            break;
+        }
+        ScheduledTick entry = scheduled.top();
+        scheduled.pop();
+        scheduledCells.erase(cellKey(entry.cell));
+
+        Chunk* lastChunk = nullptr;
+        BlockCoord coord = world->getBlockAtCell(entry.cell[0], entry.cell[1], entry.cell[2], lastChunk);
+        if (!coord.IsValid())
+        {
+            continue;
+        }
+        // the block may have changed type since the tick was scheduled
+        BlockTickHandler handler = Behaviours[coord.GetBlock().blockType].onTick;
+        if (handler == nullptr)
+        {
+            continue;
+        }
+        used++;
+        stats.scheduledTicks++;
+        BlockTickContext context{*world, *this, coord};
+        if (handler(context))
+        {
+            Activate(coord);
+        }
+    }
+    return used;
+}
+
+uint32_t BlockTickScheduler::runActive(uint32_t budget)
+{
+    if (activeChunks.empty())
+    {
+        return 0;
+    }
+    uint32_t used = 0;
+    std::vector<Chunk*> chunks(activeChunks.begin(), activeChunks.end());
+    std::vector<int> indices;
+    for (size_t n = 0; n < chunks.size(); n++)
+    {
+        Chunk* chunk = chunks[(activeCursor + n) % chunks.size()];
+        // blocks activated while handlers run land in the fresh set and tick next time
+        indices.assign(chunk->activeBlocks.begin(), chunk->activeBlocks.end());
+        chunk->activeBlocks.clear();
+        int layer = chunk->chunkSize * chunk->chunkSize;
+        for (int index : indices)
+        {
+            if (used >= budget)
+            {
+                chunk->activeBlocks.insert(index);
+                stats.deferred++;
+                continue;
+            }
+            BlockCoord coord{chunk, index % chunk->chunkSize, index / chunk->chunkSize % chunk->chunkSize, index / layer};
+            BlockTickHandler handler = Behaviours[coord.GetBlock().blockType].onTick;
+            if (handler == nullptr)
+            {
+                continue;
+            }
+            used++;
+            stats.activeTicks++;
+            BlockTickContext context{*world, *this, coord};
+            if (handler(context))
+            {
+                chunk->activeBlocks.insert(index);
+            }
+        }
+    }
+    activeCursor++;
+
+    for (Chunk* chunk : chunks)
+    {
+        if (chunk->activeBlocks.empty())
+        {
+            activeChunks.erase(chunk);
+        }
+    }
+    return used;
+}
+
+void BlockTickScheduler::runRandom(int centerChunkX, int centerChunkY)
+{
+    int radius = (int)RandomTickRadius;
+    int samples = (int)RandomTicksPerSection;
+    for (int cx = centerChunkX - radius; cx <= centerChunkX + radius; cx++)
+    {
+        for (int cy = centerChunkY - radius; cy <= centerChunkY + radius; cy++)
+        {
+            if (!world->hasBlock(cx, cy))
+            {
+                continue;
+            }
+            Chunk* chunk = world->getWorldBlockRef(cx, cy);
+            for (int sectionZ = 0; sectionZ < chunk->chunkDepth; sectionZ += WorldGenerator::SECTION_HEIGHT)
+            {
+                for (int i = 0; i < samples; i++)
+                {
+                    BlockCoord coord{chunk, random.NextInt(chunk->chunkSize - 1), random.NextInt(chunk->chunkSize - 1),
+                                     sectionZ + random.NextInt(WorldGenerator::SECTION_HEIGHT - 1)};
+                    stats.randomSamples++;
+                    RandomTickHandler handler = Behaviours[coord.GetBlock().blockType].onRandomTick;
+                    if (handler != nullptr)
+                    {
+                        stats.randomTicks++;
+                        BlockTickContext context{*world, *this, coord};
+                        handler(context);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void BlockTickScheduler::ScheduleTick(const BlockCoord& coord, uint32_t delay)
+{
+    ScheduledTick entry;
+    cellOf(coord, entry.cell);
+    if (!scheduledCells.insert(cellKey(entry.cell)).second)
+    {
+        return;
+    }
+    // never due on the tick being processed, a handler rescheduling itself cannot spin within one tick
+    entry.dueTick = currentTick + std::max(delay, 1u);
+    entry.sequence = nextSequence++;
+    scheduled.push(entry);
+}
+
+void BlockTickScheduler::Activate(const BlockCoord& coord)
+{
+    coord.chunk->activeBlocks.insert(coord.chunk->GetBlockOffsetOnHeap(coord.x, coord.y, coord.z));
+    activeChunks.insert(coord.chunk);
+}
+
+void BlockTickScheduler::NotifyChanged(const BlockCoord& coord)
+{
+    static const int offsets[7][3] = {{0, 0, 0}, {1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}};
+    for (const auto& offset : offsets)
+    {
+        BlockCoord neighbour = GetNeighbour(coord, offset[0], offset[1], offset[2]);
+        if (!neighbour.IsValid())
+        {
+            continue;
+        }
+        const BlockBehaviour& behaviour = Behaviours[neighbour.GetBlock().blockType];
+        if (behaviour.onTick != nullptr)
+        {
+            ScheduleTick(neighbour, behaviour.notifyDelay);
+        }
+    }
+}
+
+BlockCoord BlockTickScheduler::GetNeighbour(const BlockCoord& coord, int dx, int dy, int dz)
+{
+    int cell[3];
+    cellOf(coord, cell);
+    Chunk* lastChunk = coord.chunk;
+    return world->getBlockAtCell(cell[0] + dx, cell[1] + dy, cell[2] + dz, lastChunk);
+}
+
+// world cell of a chunk-local block, axes X, Y (up), Z as in WorldMap::getCellGrid
+void BlockTickScheduler::cellOf(const BlockCoord& coord, int cell[3])
+{
+    cell[0] = coord.chunk->posX * coord.chunk->chunkSize + coord.x;
+    cell[1] = coord.z;
+    cell[2] = coord.chunk->posY * coord.chunk->chunkSize + coord.y;
+}
+
+uint64_t BlockTickScheduler::cellKey(const int cell[3])
+{
+    const uint64_t mask = (1ull << 21) - 1;
+    return (static_cast<uint64_t>(cell[0]) & mask)
+        | (static_cast<uint64_t>(cell[1]) & mask) << 21
+        | (static_cast<uint64_t>(cell[2]) & mask) << 42;
+}
@@ -0,0 +1,132 @@
+﻿/**
+ * 稀疏方块更新 (block tick)
+ * 1. 计划更新：全局按到期 tick 排序的队列，方块或其邻居改变时为有行为的方块安排一次延迟更新
+ * 2. 活跃集合：每个 chunk 记录需要每个 tick 持续更新的方块，处理函数返回 false 即移出集合
+ * 3. 随机更新：在摄像机附近的 chunk 中，每个 16 格高的 section 每 tick 随机抽取固定数量的方块，
+ *    用于生长类的缓慢变化
+ * 每 tick 的开销只与活跃方块和计划更新的数量有关，与 chunk 体积无关；
+ * 计划更新和活跃方块共用一个每 tick 预算，超出的部分顺延到下一个 tick
+ */
+#pragma once
+#include <cstdint>
+#include <queue>
+#include <unordered_set>
+#include <vector>
+
+#include "VoxelRaycast.h"
+#include "Math/Random.h"
+
+class WorldMap;
+class BlockTickScheduler;
+
+struct BlockTickContext
+{
+    WorldMap& world;
+    BlockTickScheduler& scheduler;
+    BlockCoord block;
+};
+
+// returns true to keep the block in its chunk's active set
+using BlockTickHandler = bool (*)(BlockTickContext& context);
+using RandomTickHandler = void (*)(BlockTickContext& context);
+
+struct BlockBehaviour
+{
+    // scheduled and active ticks
+    BlockTickHandler onTick = nullptr;
+    // growth style updates from the random sampler
+    RandomTickHandler onRandomTick = nullptr;
+    // delay of the tick scheduled when the block or one of its neighbours changes
+    uint32_t notifyDelay = 1;
+};
+
+class BlockTickScheduler
+{
+public:
+    static constexpr float TICKS_PER_SECOND = 20.0f;
+
+    struct TickStats
+    {
+        uint32_t scheduledTicks = 0;
+        uint32_t activeTicks = 0;
+        uint32_t randomSamples = 0;
+        uint32_t randomTicks = 0;
+        // scheduled ticks and active blocks pushed to the next tick by the budget
+        uint32_t deferred = 0;
+        uint32_t pendingScheduled = 0;
+        uint32_t activeBlocks = 0;
+        double milliseconds = 0.0;
+    };
+
+    explicit BlockTickScheduler(WorldMap* world);
+
+    // runs the ticks that are due after deltaT seconds, random ticks sample around the given chunk
+    void Update(float deltaT, int centerChunkX, int centerChunkY);
+
+    // ticks the block after delay ticks, a block has at most one pending scheduled tick
+    void ScheduleTick(const BlockCoord& coord, uint32_t delay);
+    // keeps ticking the block every tick until its handler returns false
+    void Activate(const BlockCoord& coord);
+    // the block at coord changed, schedules it and its six neighbours if their type has a tick handler
+    void NotifyChanged(const BlockCoord& coord);
+
+    BlockCoord GetNeighbour(const BlockCoord& coord, int dx, int dy, int dz);
+    Math::RandomNumberGenerator& GetRandom()
+    {
+        return random;
+    }
+    uint64_t GetCurrentTick() const
+    {
+        return currentTick;
+    }
+    const TickStats& GetLastStats() const
+    {
+        return lastStats;
+    }
+
+    static void SetBehaviour(BlockResourceManager::BlockType type, const BlockBehaviour& behaviour);
+    static const BlockBehaviour& GetBehaviour(BlockResourceManager::BlockType type);
+
+private:
+    struct ScheduledTick
+    {
+        uint64_t dueTick;
+        // insertion order, keeps ticks due on the same tick deterministic
+        uint64_t sequence;
+        int cell[3];
+
+        bool operator>(const ScheduledTick& other) const
+        {
+            return dueTick != other.dueTick ? dueTick > other.dueTick : sequence > other.sequence;
+        }
+    };
+
+    struct CellHash
+    {
+        size_t operator()(const uint64_t& key) const
+        {
+            return std::hash<uint64_t>()(key * 0x9E3779B97F4A7C15ull);
+        }
+    };
+
+    void tick(int centerChunkX, int centerChunkY);
+    uint32_t runScheduled(uint32_t budget);
+    uint32_t runActive(uint32_t budget);
+    void runRandom(int centerChunkX, int centerChunkY);
+    static void cellOf(const BlockCoord& coord, int cell[3]);
+    static uint64_t cellKey(const int cell[3]);
+
+    WorldMap* world;
+    // ticks only run on the main thread, unlike generation they do not need to be reproducible
+    Math::RandomNumberGenerator random;
+    float accumulator = 0.0f;
+    uint64_t currentTick = 0;
+    uint64_t nextSequence = 0;
+    std::priority_queue<ScheduledTick, std::vector<ScheduledTick>, std::greater<ScheduledTick>> scheduled;
+    std::unordered_set<uint64_t, CellHash> scheduledCells;
+    std::unordered_set<Chunk*> activeChunks;
+    // chunk active sets are visited starting from a rotating offset so a tight budget does not starve any chunk
+    uint32_t activeCursor = 0;
+    TickStats stats;
+    TickStats lastStats;
+};
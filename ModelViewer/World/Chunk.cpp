@@ -1,5 +1,6 @@
 ﻿#include "Chunk.h"
 
+#include <algorithm>
 #include <stdbool.h>
 
 #include "BufferManager.h"
@@ -13,13 +14,6 @@
 using namespace Math;
 using namespace World;
 
-NumVar MaxOctreeDepth("Octree/Depth", 2, 0, 10, 1);
-NumVar MaxOctreeNodeLength("Octree/Length", 2, 0, 20, 1);
-BoolVar EnableOctree("Octree/EnableOctree", true);
-BoolVar EnableContainTest("Octree/EnableContainTest", true);
-BoolVar EnableOctreeCompute("Octree/ComputeOptimize", true);
-BoolVar EnableBoxDetect("Octree/BoxDetect", true);
-
 AxisAlignedBox Chunk::GetAxisAlignedBox(int x, int y, int z)
 {
     Vector3& position = blocks[x][y][z].position;
@@ -36,142 +30,49 @@ AxisAlignedBox Chunk::GetAxisAlignedBox(int x, int y, int z)
     return box;
 }
 
-void Chunk::RandomlyGenerateBlocks()
+void Chunk::GenerateTerrain()
 {
-    //PerlinNoise noise = PerlinNoise(9);
-    std::vector<std::vector<BlockPlantInfo>> plantInfos;
-    plantInfos.resize(chunkSize, std::vector<BlockPlantInfo>(chunkSize));
+    int columns = chunkSize * chunkSize;
+    // the noise of all columns at once, column x * chunkSize + y
+    std::vector<WorldGenerator::ColumnNoise> columnNoise(columns);
+    WorldGenerator::sampleChunkColumnNoise(originPoint.GetX(), originPoint.GetY(), chunkSize, columnNoise.data());
+    columnHeights.resize(columns);
+    columnBiomes.resize(columns);
+    for (int column = 0; column < columns; column++)
+    {
+        auto depthRandom = WorldGenerator::ColumnRandom(posX, posY, column, WorldGenerator::SurfaceDepthRandom);
+        columnHeights[column] = WorldGenerator::getHeightAndBiomes(columnNoise[column], columnBiomes[column],
+                                                                   depthRandom);
+    }
+    generatedTypes.resize(columns * chunkDepth);
+    WorldGenerator::generateChunkGround(originPoint.GetX(), originPoint.GetY(), chunkSize, columnHeights.data(),
+                                        generatedTypes.data());
+}
+
+void Chunk::GenerateSurface()
+{
+    WorldGenerator::layChunkSurface(chunkSize, columnHeights.data(), columnBiomes.data(), generatedTypes.data());
+    groundHeights.assign(chunkSize * chunkSize, 0);
     for (int x = 0; x < chunkSize; x++)
     {
         for (int y = 0; y < chunkSize; y++)
         {
-            float xCoor = (float(originPoint.GetX()) + (x + 0.5f) * UnitBlockSize * 1.001) * WorldGenerator::COOR_STEP;
-            float yCoor = (float(originPoint.GetY()) + (y + 0.5f) * UnitBlockSize * 1.001) * WorldGenerator::COOR_STEP;
-
-            WorldGenerator::Biomes biomes;
-            int realHeight = WorldGenerator::getRealHeightAndBiomes(xCoor, yCoor, biomes);
-
-            plantInfos[x][y].height = realHeight;
+            int column = x * chunkSize + y;
+            const BlockType* types = generatedTypes.data() + column * chunkDepth;
             for (int z = 0; z < this->chunkDepth; z++)
             {
-                Vector3 pointPos = originPoint + Vector3(x + 0.5f, y + 0.5f, z + 0.5f) * UnitBlockSize * 1.001;
+                Vector3 pointPos = originPoint + Vector3(x + 0.5f, y + 0.5f, z + 0.5f) * UnitBlockStep;
                 pointPos = Vector3(pointPos.GetX(), pointPos.GetZ(), pointPos.GetY());
 
-                auto blockType = WorldGenerator::getBlockType(xCoor, yCoor, realHeight, biomes, z);
-                blocks[x][y][z] = std::move(Block(pointPos, blockType, UnitBlockSize));
-            }
-
-            if (realHeight <= WorldGenerator::SEA_HEIGHT)
-            {
-                continue;
-            }
-
-            // generate biomes condition
-            int leafWidth = biomes.TreeHeight / 4;
-            leafWidth += (biomes.TreeWidth - 1);
-            if (random.NextFloat() < biomes.PlantDensity)
-            {
-                if (random.NextFloat() > pow(biomes.PlantDensity, 0.5))
-                {
-                    plantInfos[x][y].plantType = 1;
-                }
-                else
+                blocks[x][y][z] = std::move(Block(pointPos, types[z], UnitBlockSize));
+                if (types[z] != Air)
                 {
-                    if (biomes.TreeHeight <= 0) continue;
-                    if (!(x <= leafWidth - 1 || x >= chunkSize - leafWidth || y <= leafWidth - 1 || y >= chunkSize -
-                        leafWidth))
-                    {
-                        if (plantInfos[x][y].plantType != 0)
-                        {
-                            continue;
-                        }
-                        plantInfos[x][y].plantType = 3;
-                        int woodTop = realHeight + biomes.TreeHeight + (random.NextInt(biomes.TreeHeight / 10)) + 2;
-                        plantInfos[x][y].woodTopHeight = woodTop;
-                        int tw = biomes.TreeWidth - 1;
-                        for (int i = x - leafWidth; i <= x + leafWidth; i++)
-                        {
-                            for (int j = y - leafWidth; j <= y + leafWidth; j++)
-                            {
-                                if (i <= x + tw && i >= x - tw && j >= y - tw && j <= y + tw)
-                                {
-                                    plantInfos[i][j].plantType = 3;
-                                    plantInfos[i][j].woodTopHeight = woodTop;
-                                    continue;
-                                }
-                                plantInfos[i][j].plantType = 2;
-                                plantInfos[i][j].woodTopHeight = woodTop;
-                            }
-                        }
-                    }
-                }
-            }
-        }
-    }
-
-    // adopt plants
-    for (int x = 0; x < chunkSize; x++)
-    {
-        for (int y = 0; y < chunkSize; y++)
-        {
-            int type = plantInfos[x][y].plantType;
-            if (type == 0)
-            {
-                continue;
-            }
-            if (type == 1)
-            {
-                Block& block = blocks[x][y][plantInfos[x][y].height + 1];
-                block.blockType = GrassLeaf;
-                block.transparent = true;
-            }
-            if (type == 2)
-            {
-                for (int h = plantInfos[x][y].woodTopHeight - 3 - random.NextInt(1);
-                     h <= plantInfos[x][y].woodTopHeight - random.NextInt(1);
-                     h++)
-                {
-                    if (h >= chunkDepth)
-                    {
-                        continue;
-                    }
-                    Block& block = blocks[x][y][h];
-                    if (block.blockType == Air)
-                    {
-                        if (random.NextFloat() < 0.7)
-                        {
-                            block.blockType = Leaf;
-                        }
-                    }
-                }
-            }
-            if (type == 3)
-            {
-                BlockPlantInfo& info = plantInfos[x][y];
-                for (int h = info.height + 1; h <= info.woodTopHeight; h++)
-                {
-                    if (h >= chunkDepth)
-                    {
-                        continue;
-                    }
-                    Block& block = blocks[x][y][h];
-                    if (h >= info.woodTopHeight - 1)
-                    {
-                        block.blockType = Leaf;
-                    }
-                    else
-                    {
-                        block.blockType = WoodOak;
-                    }
-                }
-                auto& blockType = blocks[x][y][info.height].blockType;
-                if (blockType == Grass || blockType == GrassSnow || blockType == GrassWilt)
-                {
-                    blockType = Dirt;
+                    groundHeights[column] = z;
                 }
             }
         }
     }
+    std::vector<BlockType>().swap(generatedTypes);
 
     for (int z = 0; z < chunkDepth; z++)
     {
@@ -192,165 +93,141 @@ void Chunk::RandomlyGenerateBlocks()
     }
 }
 
-bool Chunk::Intersect(const Vector3& ori, const Vector3& dir, const AxisAlignedBox& box, float& t)
+namespace
 {
-    Vector3 ptOnPlane;
-    Vector3 min = box.GetMin();
-    Vector3 max = box.GetMax();
-
-    if ((float)ori.GetX() < max.GetX()
-        && (float)ori.GetX() > min.GetX()
-        && (float)ori.GetY() < max.GetY()
-        && (float)ori.GetY() > min.GetY()
-        && (float)ori.GetZ() < max.GetZ()
-        && (float)ori.GetZ() > min.GetZ())
+    // wood replaces air, leaves and grass, leaves and grass only fill air and dirt only replaces grass,
+    // so overlapping plants end up as the same blocks whichever chunk places them first
+    void placeDecoration(Block& block, BlockType type)
     {
-        return true;
-    }
-
-    if (dir.GetX() != 0.f)
-    {
-        if (dir.GetX() > 0.f)
+        BlockType current = block.blockType;
+        bool replace = current == Air;
+        if (type == WoodOak)
         {
-            t = (min.GetX() - ori.GetX()) / dir.GetX();
+            replace |= current == Leaf || current == GrassLeaf;
         }
-        else
+        if (type == Dirt)
         {
-            t = (max.GetX() - ori.GetX()) / dir.GetX();
+            replace = current == Grass || current == GrassSnow || current == GrassWilt;
         }
-        if (t > 0.f)
+        if (replace)
         {
-            ptOnPlane = ori + t * dir;
-            if ((float)min.GetY() < ptOnPlane.GetY()
-                && (float)ptOnPlane.GetY() < max.GetY()
-                && (float)min.GetZ() < ptOnPlane.GetZ()
-                && (float)ptOnPlane.GetZ() < max.GetZ())
-            {
-                return true;
-            }
+            block.blockType = type;
+            block.transparent = isTransparentBlock(type);
         }
     }
+}
 
-    if (dir.GetY() != 0.f)
+void Chunk::Decorate(Chunk* const neighbours[3][3])
+{
+    // x / y may reach one chunk past either edge, those blocks are handed to the neighbour
+    auto place = [&](int x, int y, int z, BlockType type)
     {
-        if (dir.GetY() > 0.f)
+        if (z < 0 || z >= chunkDepth)
         {
-            t = (min.GetY() - ori.GetY()) / dir.GetY();
+            return;
         }
-        else
+        int dx = x < 0 ? -1 : x >= chunkSize ? 1 : 0;
+        int dy = y < 0 ? -1 : y >= chunkSize ? 1 : 0;
+        if (dx == 0 && dy == 0)
         {
-            t = (max.GetY() - ori.GetY()) / dir.GetY();
+            placeDecoration(blocks[x][y][z], type);
+            return;
         }
-        if (t > 0.f)
-        {
-            ptOnPlane = ori + t * dir;
-            if ((float)min.GetZ() < ptOnPlane.GetZ()
-                && (float)ptOnPlane.GetZ() < max.GetZ()
-                && (float)min.GetX() < ptOnPlane.GetX()
-                && (float)ptOnPlane.GetX() < max.GetX())
-            {
-                return true;
-            }
-        }
-    }
+        neighbours[dx + 1][dy + 1]->StageDecoration(x - dx * chunkSize, y - dy * chunkSize, z, type);
+    };
+    auto groundAt = [&](int x, int y)
+    {
+        int dx = x < 0 ? -1 : x >= chunkSize ? 1 : 0;
+        int dy = y < 0 ? -1 : y >= chunkSize ? 1 : 0;
+        const Chunk* chunk = neighbours[dx + 1][dy + 1];
+        return chunk->groundHeights[(x - dx * chunkSize) * chunkSize + (y - dy * chunkSize)];
+    };
 
-    if (dir.GetZ() != 0.f)
+    for (int x = 0; x < chunkSize; x++)
     {
-        if (dir.GetZ() > 0.f)
-        {
-            t = (min.GetZ() - ori.GetZ()) / dir.GetZ();
-        }
-        else
-        {
-            t = (max.GetZ() - ori.GetZ()) / dir.GetZ();
-        }
-        if (t > 0.f)
+        for (int y = 0; y < chunkSize; y++)
         {
-            ptOnPlane = ori + t * dir;
-            if ((float)min.GetX() < ptOnPlane.GetX()
-                && (float)ptOnPlane.GetX() < max.GetX()
-                && (float)min.GetY() < ptOnPlane.GetY()
-                && (float)ptOnPlane.GetY() < max.GetY())
+            int column = x * chunkSize + y;
+            const WorldGenerator::Biomes& biomes = columnBiomes[column];
+            int groundHeight = groundHeights[column];
+            if (columnHeights[column] <= WorldGenerator::SEA_HEIGHT || groundHeight + 1 >= chunkDepth)
             {
-                return true;
+                continue;
             }
-        }
-    }
-    return false;
-}
-
-void Chunk::InitChunks()
-{
-    RandomlyGenerateBlocks();
-    SearchBlocksAdjacent2OuterAir();
-    // InitOcclusionQueriesHeaps();
-    CreateOctreeNode(this->octreeNode, 0, this->chunkSize - 1, 0, this->chunkSize - 1, 0,
-                     this->chunkDepth - 1, 0);
-}
 
+            // generate biomes condition
+            auto random = WorldGenerator::ColumnRandom(posX, posY, column, WorldGenerator::PlantRandom);
+            if (random.NextFloat() >= biomes.PlantDensity)
+            {
+                continue;
+            }
+            if (random.NextFloat() > pow(biomes.PlantDensity, 0.5))
+            {
+                place(x, y, groundHeight + 1, GrassLeaf);
+                continue;
+            }
+            if (biomes.TreeHeight <= 0)
+            {
+                continue;
+            }
 
-bool Chunk::FindPickBlockInRange(int minX, int maxX, int minY, int maxY, int minZ, int maxZ, Vector3 ori,
-                                 Vector3 dir, Block*& empty, Block*& entity)
-{
-    float t;
-    bool result = false;
-    for (int x = minX; x <= maxX; x++)
-    {
-        for (int y = minY; y <= maxY; y++)
-        {
-            for (int z = minZ; z <= maxZ; z++)
+            // leaves may reach into the neighbouring chunks, so trees grow right up to the chunk border
+            int leafWidth = biomes.TreeHeight / 4;
+            leafWidth += (biomes.TreeWidth - 1);
+            int woodTop = groundHeight + biomes.TreeHeight + (random.NextInt(biomes.TreeHeight / 10)) + 2;
+            int tw = biomes.TreeWidth - 1;
+            auto leafRandom = WorldGenerator::ColumnRandom(posX, posY, column, WorldGenerator::LeafRandom);
+            for (int i = x - leafWidth; i <= x + leafWidth; i++)
             {
-                if (blocks[x][y][z].IsNull() || !blocks[x][y][z].adjacent2Air)
-                {
-                    continue;
-                }
-                if (Intersect(ori, dir, GetAxisAlignedBox(x, y, z), t))
+                for (int j = y - leafWidth; j <= y + leafWidth; j++)
                 {
-                    if (t < WorldMap::minEntityDis)
+                    if (i <= x + tw && i >= x - tw && j >= y - tw && j <= y + tw)
+                    {
+                        int ground = groundAt(i, j);
+                        for (int h = ground + 1; h <= woodTop; h++)
+                        {
+                            place(i, j, h, h >= woodTop - 1 ? Leaf : WoodOak);
+                        }
+                        place(i, j, ground, Dirt);
+                        continue;
+                    }
+                    for (int h = woodTop - 3 - leafRandom.NextInt(1); h <= woodTop - leafRandom.NextInt(1); h++)
                     {
-                        WorldMap::minEntityDis = t;
-                        entity = &blocks[x][y][z];
-                        WorldMap::entityX = x;
-                        WorldMap::entityY = y;
-                        WorldMap::entityZ = z;
-                        WorldMap::entityBlockX = posX;
-                        WorldMap::entityBlockY = posY;
+                        if (leafRandom.NextFloat() < 0.7)
+                        {
+                            place(i, j, h, Leaf);
+                        }
                     }
-                    result = true;
                 }
             }
         }
     }
-    return result;
+    std::vector<int>().swap(columnHeights);
+    std::vector<WorldGenerator::Biomes>().swap(columnBiomes);
 }
 
-bool Chunk::FindPickBlockInOctree(OctreeNode* node, Vector3& ori, Vector3& dir, Block*& empty, Block*& entity)
+void Chunk::StageDecoration(int x, int y, int z, BlockType type)
 {
-    float t;
-    if (!Intersect(ori, dir, node->box, t))
-    {
-        return false;
-    }
-    if (node->isLeafNode)
+    std::lock_guard<std::mutex> lock(stagedMutex);
+    stagedDecoration.push_back({uint8_t(x), uint8_t(y), uint8_t(z), type});
+}
+
+void Chunk::ApplyStagedDecoration()
+{
+    std::lock_guard<std::mutex> lock(stagedMutex);
+    for (const StagedBlock& staged : stagedDecoration)
     {
-        return FindPickBlockInRange(node->minX, node->maxX,
-                                    node->minY, node->maxY,
-                                    node->minZ, node->maxZ,
-                                    ori, dir,
-                                    empty, entity);
+        placeDecoration(blocks[staged.x][staged.y][staged.z], staged.type);
     }
-    bool result = false;
-
-    result |= FindPickBlockInOctree(node->leftBottomBack, ori, dir, empty, entity);
-    result |= FindPickBlockInOctree(node->leftTopBack, ori, dir, empty, entity);
-    result |= FindPickBlockInOctree(node->rightBottomBack, ori, dir, empty, entity);
-    result |= FindPickBlockInOctree(node->rightTopBack, ori, dir, empty, entity);
-    result |= FindPickBlockInOctree(node->leftBottomFront, ori, dir, empty, entity);
-    result |= FindPickBlockInOctree(node->leftTopFront, ori, dir, empty, entity);
-    result |= FindPickBlockInOctree(node->rightBottomFront, ori, dir, empty, entity);
-    result |= FindPickBlockInOctree(node->rightTopFront, ori, dir, empty, entity);
+    std::vector<StagedBlock>().swap(stagedDecoration);
+}
 
-    return result;
+void Chunk::FinishGeneration()
+{
+    SearchBlocksAdjacent2OuterAir();
+    // InitOcclusionQueriesHeaps();
+    CreateOctreeNode(this->octreeNode, 0, this->chunkSize - 1, 0, this->chunkSize - 1, 0,
+                     this->chunkDepth - 1, 0);
 }
 
 std::vector<Block*> Chunk::getSiblingBlocks(int x, int y, int z)
@@ -457,25 +334,6 @@ std::vector<Block*> Chunk::getSiblingBlocks(int x, int y, int z)
     return result;
 }
 
-bool Chunk::FindPickBlock(Vector3& ori, Vector3& dir, Block*& empty, Block*& entity)
-{
-    return FindPickBlockInOctree(octreeNode, ori, dir, empty, entity);
-}
-
-void Chunk::Update(float deltaTime)
-{
-    for (int x = 0; x < chunkSize; x++)
-    {
-        for (int y = 0; y < chunkSize; y++)
-        {
-            for (int z = 0; z < chunkDepth; z++)
-            {
-                blocks[x][y][z].Update(deltaTime);
-            }
-        }
-    }
-}
-
 int Chunk::GetBlockOffsetOnHeap(int x, int y, int z) const
 {
     return z * (chunkSize * chunkSize) + y * chunkSize + x;
@@ -540,55 +398,186 @@ bool Chunk::CheckOutOfRange(int x, int y, int z) const
 {
     return x < 0 || x >= chunkSize || y < 0 || y >= chunkSize || z < 0 || z >= chunkDepth;
 }
-void Chunk::RenderSingleBlock(int x, int y, int z)
+Chunk* Chunk::GetChunkAcross(int& x, int& y)
 {
-    Block& block = blocks[x][y][z];
-    BlockResourceManager::addBlockIntoManager(block.blockType, block.position, block.radius);
+    int chunkX = posX;
+    int chunkY = posY;
+    if (x < 0)
+    {
+        chunkX--;
+        x += chunkSize;
+    }
+    else if (x >= chunkSize)
+    {
+        chunkX++;
+        x -= chunkSize;
+    }
+    if (y < 0)
+    {
+        chunkY--;
+        y += chunkSize;
+    }
+    else if (y >= chunkSize)
+    {
+        chunkY++;
+        y -= chunkSize;
+    }
+    if (chunkX == posX && chunkY == posY)
+    {
+        return this;
+    }
+    if (!worldMap->hasBlock(chunkX, chunkY))
+    {
+        return nullptr;
+    }
+    return worldMap->getWorldBlockRef(chunkX, chunkY);
+}
+
+Block* Chunk::GetBlockAcrossChunks(int x, int y, int z)
+{
+    if (z < 0 || z >= chunkDepth)
+    {
+        return nullptr;
+    }
+    Chunk* chunk = GetChunkAcross(x, y);
+    if (chunk == nullptr)
+    {
+        return nullptr;
+    }
+    return &chunk->blocks[x][y][z];
+}
+
+void Chunk::MarkBlockDirty(int x, int y, int z)
+{
+    if (z < 0 || z >= chunkDepth)
+    {
+        return;
+    }
+    Chunk* chunk = GetChunkAcross(x, y);
+    if (chunk == nullptr)
+    {
+        return;
+    }
+    Block& block = chunk->blocks[x][y][z];
+    block.aoDirty = true;
+    block.hasCheckSibling = false;
+    chunk->MarkSectionDirty(z);
+}
+
+void Chunk::MarkSectionDirty(int z)
+{
+    dirtySections.fetch_or(1u << (z / WorldGenerator::SECTION_HEIGHT));
+    instancesDirty = true;
+}
+
+bool Chunk::IsAOOccluder(int x, int y, int z)
+{
+    Block* block = GetBlockAcrossChunks(x, y, z);
+    return block != nullptr && !block->IsNull() && !block->isTransparent();
+}
+
+namespace
+{
+    struct AOQueryContext
+    {
+        Chunk* chunk;
+        int x;
+        int y;
+        int z;
+    };
+
+    // VoxelAO works in world space (Y up) while chunk storage is indexed [x][y][z] with z up.
+    bool QueryChunkOccluder(const void* context, int dx, int dy, int dz)
+    {
+        const AOQueryContext* query = static_cast<const AOQueryContext*>(context);
+        return query->chunk->IsAOOccluder(query->x + dx, query->y + dz, query->z + dy);
+    }
 }
 
-void Chunk::RenderBlocksInRange(int minX, int maxX, int minY, int maxY, int minZ, int maxZ,
-                                const Camera& camera)
+const VoxelAO::BlockAO& Chunk::GetBlockAO(int x, int y, int z)
 {
-    for (int x = minX; x <= maxX; x++)
+    Block& block = blocks[x][y][z];
+    if (block.aoDirty)
     {
-        for (int y = minY; y <= maxY; y++)
+        AOQueryContext context{this, x, y, z};
+        block.ao = VoxelAO::ComputeBlockAO(QueryChunkOccluder, &context);
+        block.faceMask = 0;
+        for (int face = 0; face < VoxelAO::FACE_COUNT; face++)
         {
-            for (int z = minZ; z <= maxZ; z++)
+            int offset[3] = {0, 0, 0};
+            offset[face / 2] = (face % 2 == 0) ? 1 : -1;
+            if (!QueryChunkOccluder(&context, offset[0], offset[1], offset[2]))
             {
-                Block& block = blocks[x][y][z];
-
-                if (!block.IsNull()
-                    && isAdjacent2OuterAir(x, y, z)
-                    && camera.GetWorldSpaceFrustum().IntersectBoundingBox(GetAxisAlignedBox(x,y,z))
-                )
-                {
-                    RenderSingleBlock(x, y, z);
-                }
+                block.faceMask |= 1 << face;
             }
         }
+        block.aoDirty = false;
     }
+    return block.ao;
 }
 
-void Chunk::RenderBlocksInRangeNoIntersectCheck(int minX, int maxX, int minY, int maxY, int minZ, int maxZ)
+uint8_t Chunk::GetExposedLight(int x, int y, int z, uint8_t faceMask)
 {
-    for (int x = minX; x <= maxX; x++)
+    uint8_t sky = 0;
+    uint8_t block = 0;
+    for (int face = 0; face < VoxelAO::FACE_COUNT; face++)
     {
-        for (int y = minY; y <= maxY; y++)
+        if ((faceMask & (1 << face)) == 0)
         {
-            for (int z = minZ; z <= maxZ; z++)
-            {
-                Block& block = blocks[x][y][z];
+            continue;
+        }
+        // faces are numbered in world space, world (dx, dy, dz) is chunk (dx, dz, dy)
+        int offset[3] = {0, 0, 0};
+        offset[face / 2] = (face % 2 == 0) ? 1 : -1;
+        int nx = x + offset[0];
+        int ny = y + offset[2];
+        int nz = z + offset[1];
+        if (nz >= chunkDepth)
+        {
+            sky = VoxelLight::MAX_LIGHT;
+            continue;
+        }
+        Chunk* chunk = nz < 0 ? nullptr : GetChunkAcross(nx, ny);
+        if (chunk == nullptr)
+        {
+            continue;
+        }
+        uint8_t packed = chunk->light.GetPacked(nx, ny, nz);
+        sky = std::max<uint8_t>(sky, VoxelLight::Unpack(packed, VoxelLight::SkyChannel));
+        block = std::max<uint8_t>(block, VoxelLight::Unpack(packed, VoxelLight::BlockChannel));
+    }
+    return VoxelLight::Pack(sky, block);
+}
 
-                if (!block.IsNull()
-                    && isAdjacent2OuterAir(x, y, z))
-                {
-                    RenderSingleBlock(x, y, z);
-                }
+void Chunk::InvalidateAOAround(int x, int y, int z, int range)
+{
+    for (int i = x - range; i <= x + range; i++)
+    {
+        for (int j = y - range; j <= y + range; j++)
+        {
+            for (int k = z - range; k <= z + range; k++)
+            {
+                MarkBlockDirty(i, j, k);
             }
         }
     }
 }
 
+// neighbours may have baked their edge AO before this chunk existed.
+void Chunk::InvalidateNeighbourEdgeAO()
+{
+    for (int z = 0; z < chunkDepth; z++)
+    {
+        for (int i = -1; i <= chunkSize; i++)
+        {
+            MarkBlockDirty(-1, i, z);
+            MarkBlockDirty(chunkSize, i, z);
+            MarkBlockDirty(i, -1, z);
+            MarkBlockDirty(i, chunkSize, z);
+        }
+    }
+}
+
 bool Chunk::isAdjacent2OuterAir(int x, int y, int z)
 {
     Block& block = blocks[x][y][z];
@@ -707,142 +696,113 @@ void Chunk::CreateOctreeNode(OctreeNode* & node, int minX, int maxX, int minY, i
     CreateOctreeNode(node->rightTopFront, middleX + 1, maxX, middleY + 1, maxY, middleZ + 1, maxZ, depth + 1);
 }
 
-void Chunk::OctreeRenderBlocks(OctreeNode* & node, const Camera& camera)
+bool Chunk::BuildInstances()
 {
-    AxisAlignedBox& box = node->box;
-
-    if (!camera.GetWorldSpaceFrustum().IntersectBoundingBox(box))
+    uint32_t sections = dirtySections.exchange(0);
+    for (int section = 0; section < WorldGenerator::SECTION_COUNT; section++)
     {
-        return;
+        if (sections & (1u << section))
+        {
+            BuildSectionInstances(section);
+        }
     }
-
-    int minX = node->minX;
-    int maxX = node->maxX;
-    int minY = node->minY;
-    int maxY = node->maxY;
-    int minZ = node->minZ;
-    int maxZ = node->maxZ;
-
-    if (EnableContainTest && camera.GetWorldSpaceFrustum().ContainingBoundingBox(box))
+    for (int i = 0; i < BlockResourceManager::BucketCount; i++)
     {
-        RenderBlocksInRangeNoIntersectCheck(minX, maxX, minY, maxY, minZ, maxZ);
-        return;
+        cachedInstances[i].clear();
+        for (auto& section : sectionInstances)
+        {
+            cachedInstances[i].insert(cachedInstances[i].end(), section[i].begin(), section[i].end());
+        }
     }
-    // if depth > n, then invoke render in range
-    // if any node side reaches 1, invoke render in range
-    if (node->isLeafNode || maxX - minX <= MaxOctreeNodeLength || maxY - minY <= MaxOctreeNodeLength || maxZ -
-        minZ <= MaxOctreeNodeLength)
+    return true;
+}
+
+void Chunk::BuildSectionInstances(int section)
+{
+    auto& instances = sectionInstances[section];
+    for (auto& bucket : instances)
     {
-        RenderBlocksInRange(minX, maxX, minY, maxY, minZ, maxZ, camera);
-        return;
+        bucket.clear();
     }
+    int zBegin = section * WorldGenerator::SECTION_HEIGHT;
+    int zEnd = std::min<int>(zBegin + WorldGenerator::SECTION_HEIGHT, chunkDepth);
+    for (int x = 0; x < chunkSize; x++)
+    {
+        for (int y = 0; y < chunkSize; y++)
+        {
+            for (int z = zBegin; z < zEnd; z++)
+            {
+                Block& block = blocks[x][y][z];
+                if (block.IsNull() || !isAdjacent2OuterAir(x, y, z))
+                {
+                    continue;
+                }
+                const VoxelAO::BlockAO& ao = GetBlockAO(x, y, z);
+                if (block.faceMask == 0)
+                {
+                    continue;
+                }
 
-    // separate to eight sub space.
-    OctreeRenderBlocks(node->leftBottomBack, camera);
-    OctreeRenderBlocks(node->leftBottomFront, camera);
-    OctreeRenderBlocks(node->leftTopBack, camera);
-    OctreeRenderBlocks(node->leftTopFront, camera);
-    OctreeRenderBlocks(node->rightBottomBack, camera);
-    OctreeRenderBlocks(node->rightBottomFront, camera);
-    OctreeRenderBlocks(node->rightTopBack, camera);
-    OctreeRenderBlocks(node->rightTopFront, camera);
+                BlockInstance::InstanceFields fields;
+                fields.x = x;
+                fields.y = y;
+                fields.z = z;
+                fields.chunkIndex = originSlot;
+                fields.faceMask = block.faceMask;
+                fields.blockType = static_cast<uint8_t>(block.blockType);
+                fields.ao = ao;
+                fields.light = GetExposedLight(x, y, z, block.faceMask);
+                instances[BlockResourceManager::getRenderBucket(block.blockType)].push_back(
+                    BlockInstance::Encode(fields));
+            }
+        }
+    }
 }
 
-void Chunk::OctreeRenderBlocks(int minX, int maxX, int minY, int maxY, int minZ, int maxZ, int depth,
-                               const Camera& camera)
+void Chunk::CommitInstances()
 {
-    //check bounding box intersection
-    AxisAlignedBox box;
-
-    box.AddBoundingBox(GetAxisAlignedBox(minX, minY, minZ));
-    box.AddBoundingBox(GetAxisAlignedBox(minX, maxY, minZ));
-    box.AddBoundingBox(GetAxisAlignedBox(minX, minY, maxZ));
-    box.AddBoundingBox(GetAxisAlignedBox(minX, maxY, maxZ));
-    box.AddBoundingBox(GetAxisAlignedBox(maxX, minY, minZ));
-    box.AddBoundingBox(GetAxisAlignedBox(maxX, maxY, minZ));
-    box.AddBoundingBox(GetAxisAlignedBox(maxX, minY, maxZ));
-    box.AddBoundingBox(GetAxisAlignedBox(maxX, maxY, maxZ));
-
-    if (!camera.GetWorldSpaceFrustum().IntersectBoundingBox(box))
+    for (int i = 0; i < BlockResourceManager::BucketCount; i++)
     {
-        return;
+        auto bucket = static_cast<BlockResourceManager::RenderBucket>(i);
+        instanceRanges[i] = BlockResourceManager::getManager(bucket).UpdateRange(instanceRanges[i], cachedInstances[i]);
     }
+    instancesResident = true;
+}
 
-    if (EnableContainTest && camera.GetWorldSpaceFrustum().ContainingBoundingBox(box))
-    {
-        RenderBlocksInRangeNoIntersectCheck(minX, maxX, minY, maxY, minZ, maxZ);
-        return;
-    }
-    // if depth > n, then invoke render in range
-    // if any node side reaches 1, invoke render in range
-    if (depth >= MaxOctreeDepth || maxX - minX <= MaxOctreeNodeLength || maxY - minY <= MaxOctreeNodeLength || maxZ -
-        minZ <= MaxOctreeNodeLength)
+void Chunk::ReleaseInstances()
+{
+    for (int i = 0; i < BlockResourceManager::BucketCount; i++)
     {
-        RenderBlocksInRange(minX, maxX, minY, maxY, minZ, maxZ, camera);
-        return;
+        auto bucket = static_cast<BlockResourceManager::RenderBucket>(i);
+        BlockResourceManager::getManager(bucket).FreeRange(instanceRanges[i]);
+        instanceRanges[i] = InstanceRange();
     }
-
-    // separate to eight sub space.
-    int middleX = (maxX - minX) / 2 + minX;
-    int middleY = (maxY - minY) / 2 + minY;
-    int middleZ = (maxZ - minZ) / 2 + minZ;
-
-    OctreeRenderBlocks(minX, middleX, minY, middleY, minZ, middleZ, depth + 1, camera);
-    OctreeRenderBlocks(minX, middleX, minY, middleY, middleZ + 1, maxZ, depth + 1, camera);
-    OctreeRenderBlocks(middleX + 1, maxX, minY, middleY, minZ, middleZ, depth + 1, camera);
-    OctreeRenderBlocks(middleX + 1, maxX, minY, middleY, middleZ + 1, maxZ, depth + 1, camera);
-    OctreeRenderBlocks(minX, middleX, middleY + 1, maxY, minZ, middleZ, depth + 1, camera);
-    OctreeRenderBlocks(minX, middleX, middleY + 1, maxY, middleZ + 1, maxZ, depth + 1, camera);
-    OctreeRenderBlocks(middleX + 1, maxX, middleY + 1, maxY, minZ, middleZ, depth + 1, camera);
-    OctreeRenderBlocks(middleX + 1, maxX, middleY + 1, maxY, middleZ + 1, maxZ, depth + 1, camera);
+    instancesResident = false;
 }
 
-bool Chunk::Render(const Camera& camera, GraphicsContext& context)
+void Chunk::SetOriginSlot(uint32_t slot)
 {
-    // blocksRenderedVector.clear();
-    if (EnableOctree)
+    originSlot = slot;
+    // clean chunks re-enter the pools with their cached payload, which still names the previous slot
+    for (int i = 0; i < BlockResourceManager::BucketCount; i++)
     {
-        if (EnableOctreeCompute)
+        for (auto& instance : cachedInstances[i])
         {
-            OctreeRenderBlocks(this->octreeNode, camera);
+            BlockInstance::SetChunkIndex(instance, slot);
         }
-        else
+        for (auto& section : sectionInstances)
         {
-            OctreeRenderBlocks(0, chunkSize - 1, 0, chunkSize - 1, 0, chunkDepth - 1, 0, camera);
-        }
-    }
-    else
-    {
-        for (int x = 0; x < chunkSize; x++)
-        {
-            for (int y = 0; y < chunkSize; y++)
+            for (auto& instance : section[i])
             {
-                for (int z = 0; z < chunkDepth; z++)
-                {
-                    Block& block = blocks[x][y][z];
-                    if (EnableBoxDetect)
-                    {
-                        if (!block.IsNull()
-                            && isAdjacent2OuterAir(x,y,z)
-                            && (camera.GetWorldSpaceFrustum().IntersectBoundingBox(GetAxisAlignedBox(x, y, z)))
-                        )
-                        {
-                            RenderSingleBlock(x, y, z);
-                        }
-                    }
-                    else
-                    {
-                        if (!block.IsNull()
-                            && isAdjacent2OuterAir(x,y,z))
-                        {
-                            RenderSingleBlock(x, y, z);
-                        }
-                    }
-                }
+                BlockInstance::SetChunkIndex(instance, slot);
             }
         }
     }
-    return false;
+}
+
+bool Chunk::IntersectFrustum(const Camera& camera) const
+{
+    return camera.GetWorldSpaceFrustum().IntersectBoundingBox(octreeNode->box);
 }
 
 void Chunk::CleanUp()
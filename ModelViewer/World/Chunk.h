@@ -1,12 +1,15 @@
 ﻿#pragma once
+#include <atomic>
 #include <cstdint>
 #include <intsafe.h>
 #include <iostream>
+#include <mutex>
 #include <unordered_set>
 #include <vector>
 
 #include "OctreeNode.h"
 #include "ShadowCamera.h"
+#include "VoxelLight.h"
 #include "World.h"
 #include "WorldGenerator.h"
 #include "../Blocks/Block.h"
@@ -19,13 +22,15 @@ struct GlobalConstants;
 class Chunk
 {
 public:
-    Chunk(Math::Vector3 originPoint, uint16_t blockSize)
-        : originPoint(originPoint), chunkSize(blockSize)
+    // posX / posY key the chunk's generation random streams, the blocks are generated by ChunkPipeline's stages
+    Chunk(Math::Vector3 originPoint, uint16_t blockSize, int posX, int posY)
+        : originPoint(originPoint), chunkSize(blockSize), posX(posX), posY(posY)
     {
+        // light and region edit storage is sized for CHUNK_WIDTH, any other size would index out of bounds
+        ASSERT(chunkSize == WorldGenerator::CHUNK_WIDTH, "chunks must be %d blocks wide", WorldGenerator::CHUNK_WIDTH);
         blocks.resize(chunkSize,
               std::vector<std::vector<Block>>(chunkSize,
                                               std::vector<Block>(chunkDepth)));
-        InitChunks();
         id = blockId;
         blockId++;
     }
@@ -33,13 +38,6 @@ public:
     static int blockId;
     int id;
 
-    struct BlockPlantInfo
-    {
-        int height = 0;
-        int plantType = 0; //0 for nothing, 1 for grass, 2 for leaf, 3 for wood.
-        int woodTopHeight = 0;
-    };
-
     struct BlockPosition
     {
         int x;
@@ -54,37 +52,49 @@ public:
     };
 
     Chunk(){};
-    static Math::AxisAlignedBox GetScaledSizeAxisBox(Math::Vector3& position)
-    {
-        float sideSize = World::UnitBlockSize;
-        return {position+ Math::Vector3(-sideSize/2,-sideSize/2,-sideSize/2),
-        position+Math::Vector3(sideSize/2, sideSize/2,sideSize/2)};
-    }
     Math::AxisAlignedBox GetAxisAlignedBox(int x, int y, int z);
-    void RandomlyGenerateBlocks();
-    static bool Intersect(const Math::Vector3& ori, const Math::Vector3& dir, const Math::AxisAlignedBox& box, float& t);
-    void InitChunks();
-    bool FindPickBlockInRange(int minX, int maxX, int minY, int maxY, int minZ, int maxZ, Math::Vector3 ori,
-                              Math::Vector3 dir, Block*& empty, Block*& entity);
-    bool FindPickBlockInOctree(OctreeNode* node, Math::Vector3& ori, Math::Vector3& dir, Block*& empty, Block*& entity);
+    // generation stages in the order ChunkPipeline runs them
+    // column heights, biomes and the Stone / Air ground
+    void GenerateTerrain();
+    // biome layers and sea, creates the blocks and groundHeights
+    void GenerateSurface();
+    // grass and trees; neighbours[dx + 1][dy + 1] are the chunks around this one, all past GenerateSurface,
+    // plants reaching into them are staged there
+    void Decorate(Chunk* const neighbours[3][3]);
+    // a block of a neighbour's plant, applied by ApplyStagedDecoration, thread safe
+    void StageDecoration(int x, int y, int z, BlockType type);
+    // once every neighbour has decorated
+    void ApplyStagedDecoration();
+    // exposed blocks and the octree
+    void FinishGeneration();
     std::vector<Block*> getSiblingBlocks(int x, int y, int z);
-    bool FindPickBlock(Math::Vector3& ori, Math::Vector3& dir, Block*& empty, Block*& entity);
 
-    void Update(float deltaTime);
     int GetBlockOffsetOnHeap(int x, int y, int z) const;
     void SpreadAdjacent2OuterAir(int x, int y, int z, std::vector<std::vector<std::vector<int>>>& blockStatus);
     void SearchBlocksAdjacent2OuterAir();
     bool CheckOutOfRange(int x, int y, int z) const;
-    void RenderSingleBlock(int x, int y, int z);
-    void RenderBlocksInRange(int minX, int maxX, int minY, int maxY, int minZ, int maxZ,
-                             const Math::Camera& camera);
-    void RenderBlocksInRangeNoIntersectCheck(int minX, int maxX, int minY, int maxY, int minZ, int maxZ);
     bool isAdjacent2OuterAir(int x, int y, int z);
+    Chunk* GetChunkAcross(int& x, int& y);
+    Block* GetBlockAcrossChunks(int x, int y, int z);
+    void MarkBlockDirty(int x, int y, int z);
+    // the instances of the section holding height z need re-baking, e.g. after a light change
+    void MarkSectionDirty(int z);
+    bool IsAOOccluder(int x, int y, int z);
+    const VoxelAO::BlockAO& GetBlockAO(int x, int y, int z);
+    // brightest sky and block light (VoxelLight::Pack) of the cells in front of the faces in faceMask
+    uint8_t GetExposedLight(int x, int y, int z, uint8_t faceMask);
+    void InvalidateAOAround(int x, int y, int z, int range = 1);
+    void InvalidateNeighbourEdgeAO();
     void CreateOctreeNode(OctreeNode* &node, int minX,int maxX, int minY, int maxY, int minZ, int maxZ, int depth);
-    void OctreeRenderBlocks(OctreeNode*& node, const Math::Camera& camera);
-    void OctreeRenderBlocks(int minX, int maxX, int minY, int maxY, int minZ, int maxZ, int depth,
-                            const Math::Camera& camera);
-    bool Render(const Math::Camera& camera, GraphicsContext& context);
+    // bakes the instances of all exposed blocks into cachedInstances, safe to run on worker threads
+    bool BuildInstances();
+    void BuildSectionInstances(int section);
+    // copies cachedInstances into the per block type pools, main thread only
+    void CommitInstances();
+    void ReleaseInstances();
+    // moves the chunk to another origin slot and patches the chunk index of its baked instances, main thread only
+    void SetOriginSlot(uint32_t slot);
+    bool IntersectFrustum(const Math::Camera& camera) const;
     void CleanUp();
 
 
@@ -93,10 +103,48 @@ public:
     uint16_t chunkSize = 16;
     uint16_t chunkDepth = WorldGenerator::WORLD_DEPTH;
     std::vector<std::vector<std::vector<Block>>> blocks{};
+    VoxelLight::ChunkLight light;
     WorldMap* worldMap;
     int posX;
     int posY;
+    static constexpr uint32_t NO_ORIGIN_SLOT = UINT32_MAX;
+    // unique for the chunk's lifetime, keys its journal and fluid state
+    uint32_t chunkId = 0;
+    // index into BlockResourceManager::ChunkOriginTable while the chunk holds instances, recycled by WorldMap
+    uint32_t originSlot = NO_ORIGIN_SLOT;
+    // set whenever the exposed block set or its baked data may have changed
+    std::atomic<bool> instancesDirty{true};
+    // one bit per section whose baked instances are stale, BuildInstances only re-bakes these
+    std::atomic<uint32_t> dirtySections{(1u << WorldGenerator::SECTION_COUNT) - 1};
+    // whether instanceRanges currently hold cachedInstances in the pools
+    bool instancesResident = false;
+    InstanceRange instanceRanges[BlockResourceManager::BucketCount]{};
+    // baked instance payload, kept while the chunk is clean so it can re-enter the pools without a rebuild
+    std::vector<BlockResourceManager::InstanceData> cachedInstances[BlockResourceManager::BucketCount]{};
+    // the same payload split by section, cachedInstances is their concatenation
+    std::vector<BlockResourceManager::InstanceData>
+        sectionInstances[WorldGenerator::SECTION_COUNT][BlockResourceManager::BucketCount]{};
+    // GetBlockOffsetOnHeap of the blocks ticked every tick by the world's BlockTickScheduler
+    std::unordered_set<int> activeBlocks{};
+    // GetBlockOffsetOnHeap of the blocks with BlockLightEmission, kept up to date by the world's LightEngine
+    std::unordered_set<int> emissiveBlocks{};
+    // highest non-air block of each column (x * chunkSize + y) after GenerateSurface, what plants stand on
+    std::vector<int> groundHeights{};
 
 private:
+    struct StagedBlock
+    {
+        uint8_t x;
+        uint8_t y;
+        uint8_t z;
+        BlockType type;
+    };
+
     int count = 0;
+    // generation data of the columns, x * chunkSize + y, released once the stages needing it are done
+    std::vector<int> columnHeights{};
+    std::vector<WorldGenerator::Biomes> columnBiomes{};
+    std::vector<BlockType> generatedTypes{};
+    std::mutex stagedMutex;
+    std::vector<StagedBlock> stagedDecoration{};
 };
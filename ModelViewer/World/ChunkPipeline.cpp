@@ -0,0 +1,303 @@
+﻿#include "ChunkPipeline.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "Chunk.h"
+#include "EngineTuning.h"
+#include "LightEngine.h"
+#include "SystemTime.h"
+#include "World.h"
+
+NumVar OutOfViewPenalty("World/Generation/Out Of View Penalty (chunks)", 3, 0, 32, 1);
+NumVar MotionLookahead("World/Generation/Motion Lookahead (s)", 1.0f, 0.0f, 10.0f, 0.25f);
+
+ChunkPipeline::ChunkPipeline(WorldMap* world, int chunkSize, int threadCount)
+    : world(world), chunkSize(chunkSize)
+{
+    threadPool = new ThreadPool(threadCount);
+}
+
+ChunkPipeline::~ChunkPipeline()
+{
+    WaitIdle();
+    delete threadPool;
+}
+
+ChunkPipeline::Entry* ChunkPipeline::find(int x, int y)
+{
+    auto it = entries.find(key(x, y));
+    return it == entries.end() ? nullptr : &it->second;
+}
+
+void ChunkPipeline::Request(int x, int y, Stage stage)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    request(x, y, stage);
+}
+
+void ChunkPipeline::request(int x, int y, Stage stage)
+{
+    Entry& entry = entries[key(x, y)];
+    if (entry.target >= stage)
+    {
+        return;
+    }
+    entry.target = stage;
+    pending.insert(key(x, y));
+    // every stage from Decoration on needs the neighbours one stage behind
+    if (stage >= Decoration)
+    {
+        for (int dx = -1; dx <= 1; dx++)
+        {
+            for (int dy = -1; dy <= 1; dy++)
+            {
+                if (dx != 0 || dy != 0)
+                {
+                    request(x + dx, y + dy, static_cast<Stage>(stage - 1));
+                }
+            }
+        }
+    }
+    schedule(x, y);
+}
+
+void ChunkPipeline::schedule(int x, int y)
+{
+    Entry* entry = find(x, y);
+    if (entry == nullptr || entry->queued || entry->running || entry->done >= entry->target)
+    {
+        return;
+    }
+    auto next = static_cast<Stage>(entry->done + 1);
+    if (next >= Decoration)
+    {
+        for (int dx = -1; dx <= 1; dx++)
+        {
+            for (int dy = -1; dy <= 1; dy++)
+            {
+                Entry* neighbour = find(x + dx, y + dy);
+                if (neighbour == nullptr || neighbour->done < next - 1)
+                {
+                    return;
+                }
+            }
+        }
+    }
+
+    entry->queued = true;
+    active++;
+    queue.push_back({priority(x, y, next), x, y});
+    std::push_heap(queue.begin(), queue.end(), later);
+    // the pool runs whichever job is most urgent by the time a worker gets to it
+    threadPool->enqueue([this]
+    {
+        runNext();
+    });
+}
+
+// std heaps keep the largest element on top, so the lowest priority value has to compare largest
+bool ChunkPipeline::later(const Job& a, const Job& b)
+{
+    return a.priority > b.priority;
+}
+
+float ChunkPipeline::priority(int x, int y, Stage stage) const
+{
+    float dx = x - focus.x;
+    float dy = y - focus.y;
+    float distance = std::sqrt(dx * dx + dy * dy);
+    float score = distance;
+    // chunks the camera moves towards count as as close as they will be after the lookahead
+    if (distance > 0.0f)
+    {
+        float approach = (dx * focus.velocityX + dy * focus.velocityY) / distance;
+        score -= approach * MotionLookahead;
+    }
+    if (focus.inView && !focus.inView(x, y))
+    {
+        score += OutOfViewPenalty;
+    }
+    // a chunk further along is closer to filling its hole
+    return score - stage * 0.1f;
+}
+
+ChunkPipeline::Stage ChunkPipeline::allowedStage(int x, int y) const
+{
+    if (focus.radius == INT_MAX)
+    {
+        return Visible;
+    }
+    int distance = std::max(std::abs(x - focus.centerX), std::abs(y - focus.centerY));
+    int beyond = std::max(0, distance - focus.radius);
+    return static_cast<Stage>(std::max(int(NotStarted), int(Visible) - beyond));
+}
+
+void ChunkPipeline::SetFocus(const Focus& next)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    focus = next;
+    for (auto it = pending.begin(); it != pending.end();)
+    {
+        Entry& entry = entries[*it];
+        Stage allowed = allowedStage(int32_t(*it >> 32), int32_t(*it & 0xffffffff));
+        if (entry.target > allowed)
+        {
+            entry.target = std::max(allowed, entry.done);
+        }
+        if (entry.queued && entry.done >= entry.target)
+        {
+            // out of range before it started, its job is dropped from the queue below
+            entry.queued = false;
+            active--;
+            cancelled++;
+        }
+        it = entry.done >= entry.target ? pending.erase(it) : std::next(it);
+    }
+
+    std::vector<Job> ranked;
+    ranked.reserve(queue.size());
+    for (const Job& job : queue)
+    {
+        const Entry& entry = *find(job.x, job.y);
+        if (entry.queued)
+        {
+            ranked.push_back({priority(job.x, job.y, static_cast<Stage>(entry.done + 1)), job.x, job.y});
+        }
+    }
+    std::make_heap(ranked.begin(), ranked.end(), later);
+    queue.swap(ranked);
+    if (active == 0)
+    {
+        idle.notify_all();
+    }
+}
+
+void ChunkPipeline::runNext()
+{
+    int x;
+    int y;
+    Stage stage;
+    Chunk* chunk;
+    Neighbours neighbours;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // cancelled jobs leave a call without a job behind
+        if (queue.empty())
+        {
+            return;
+        }
+        std::pop_heap(queue.begin(), queue.end(), later);
+        x = queue.back().x;
+        y = queue.back().y;
+        queue.pop_back();
+        Entry& entry = *find(x, y);
+        entry.queued = false;
+        entry.running = true;
+        stage = static_cast<Stage>(entry.done + 1);
+        chunk = entry.chunk;
+        // neighbours never go back a stage, so the ones that let the job queue are still there
+        if (stage >= Decoration)
+        {
+            for (int dx = -1; dx <= 1; dx++)
+            {
+                for (int dy = -1; dy <= 1; dy++)
+                {
+                    neighbours.chunks[dx + 1][dy + 1] = find(x + dx, y + dy)->chunk;
+                }
+            }
+        }
+    }
+    run(x, y, stage, chunk, neighbours);
+}
+
+void ChunkPipeline::run(int x, int y, Stage stage, Chunk* chunk, const Neighbours& neighbours)
+{
+    int64_t start = SystemTime::GetCurrentTick();
+    switch (stage)
+    {
+    case Terrain:
+        {
+            // same origin as the chunk grid of WorldMap
+            Math::Vector3 originPoint = Math::Vector3((x - 0.5) * chunkSize * World::UnitBlockSize,
+                                                      (y - 0.5) * chunkSize * World::UnitBlockSize, 0);
+            chunk = new Chunk(originPoint, chunkSize, x, y);
+            chunk->worldMap = world;
+            chunk->GenerateTerrain();
+            break;
+        }
+    case Surface:
+        chunk->GenerateSurface();
+        break;
+    case Decoration:
+        chunk->Decorate(neighbours.chunks);
+        break;
+    case Lighting:
+        chunk->ApplyStagedDecoration();
+        LightEngine::LightChunk(chunk);
+        break;
+    case Visible:
+        chunk->FinishGeneration();
+        break;
+    default:
+        break;
+    }
+    double seconds = SystemTime::TimeBetweenTicks(start, SystemTime::GetCurrentTick());
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry& entry = entries[key(x, y)];
+    entry.chunk = chunk;
+    entry.done = stage;
+    entry.running = false;
+    stageSeconds[stage] += seconds;
+    stageChunks[stage]++;
+    if (entry.done >= entry.target)
+    {
+        pending.erase(key(x, y));
+    }
+    if (stage == Visible)
+    {
+        finished.push_back(chunk);
+    }
+    // this stage may be the last one the chunk itself or a neighbour was waiting for
+    for (int dx = -1; dx <= 1; dx++)
+    {
+        for (int dy = -1; dy <= 1; dy++)
+        {
+            schedule(x + dx, y + dy);
+        }
+    }
+    active--;
+    if (active == 0)
+    {
+        idle.notify_all();
+    }
+}
+
+void ChunkPipeline::TakeFinished(std::vector<Chunk*>& chunks)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    chunks.swap(finished);
+    finished.clear();
+}
+
+void ChunkPipeline::WaitIdle()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this] { return active == 0; });
+}
+
+void ChunkPipeline::PrintStats()
+{
+    const char* names[StageCount] = {"", "terrain", "surface", "decoration", "lighting", "visible"};
+    std::lock_guard<std::mutex> lock(mutex);
+    std::cout << "chunk pipeline: " << entries.size() << " chunks, " << active << " stages in flight, " << cancelled
+        << " cancelled" << std::endl;
+    for (int stage = Terrain; stage < StageCount; stage++)
+    {
+        double average = stageChunks[stage] ? stageSeconds[stage] * 1000.0 / stageChunks[stage] : 0.0;
+        std::cout << "  " << names[stage] << ": " << stageChunks[stage] << " chunks, " << average << "ms each"
+            << std::endl;
+    }
+}
@@ -0,0 +1,133 @@
+﻿/**
+ * 分阶段的 chunk 生成流水线
+ *   Terrain:    列噪声、高度、群系和地形 (Stone / Air)
+ *   Surface:    群系表层和海面，创建方块并记录每列地面高度
+ *   Decoration: 草和树，需要周围 8 个 chunk 都完成 Surface (读取它们的地面高度)，伸进邻居的部分放入邻居的暂存区
+ *   Lighting:   应用暂存区中的装饰并计算 chunk 内光照，需要周围 8 个 chunk 都完成 Decoration
+ *   Visible:    外露方块和八叉树，需要周围 8 个 chunk 都完成 Lighting，之后由主线程发布到 WorldMap
+ * 请求一个 chunk 到某个阶段时，周围 8 个 chunk 被请求到前一个阶段，所以可见区域外有几圈停在较早阶段的 chunk。
+ * 每个阶段是线程池上的一个任务，完成后在工作线程上直接调度自己和邻居中依赖已经满足的下一个阶段。
+ * 依赖已满足的阶段进入按优先级排序的队列 (距离、是否在视锥内、是否在相机移动方向上)，线程池总是先取最紧急的一个；
+ * 每帧 SetFocus 重新计算优先级，并取消已经离开范围、还没开始的阶段。
+ */
+#pragma once
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "ThreadPool.h"
+
+class Chunk;
+class WorldMap;
+
+class ChunkPipeline
+{
+public:
+    // the last stage a chunk has completed
+    enum Stage : uint8_t
+    {
+        NotStarted,
+        Terrain,
+        Surface,
+        Decoration,
+        Lighting,
+        Visible,
+        StageCount
+    };
+
+    // where generation is needed first, updated by the world once per frame
+    struct Focus
+    {
+        // camera position and velocity in chunks, chunk (x, y) is centered on (x, y)
+        float x = 0.0f;
+        float y = 0.0f;
+        float velocityX = 0.0f;
+        float velocityY = 0.0f;
+        // chunks up to radius from the center keep every requested stage, one stage less per chunk beyond that
+        int centerX = 0;
+        int centerY = 0;
+        int radius = INT_MAX;
+        // whether chunk (x, y) is inside the view frustum, every chunk is when empty
+        std::function<bool(int, int)> inView;
+    };
+
+    ChunkPipeline(WorldMap* world, int chunkSize, int threadCount);
+    ~ChunkPipeline();
+
+    // re-ranks the queued stages and cancels the ones of chunks that left the range before they started
+    void SetFocus(const Focus& focus);
+
+    // makes sure the chunk at (x, y) gets to stage, requesting its neighbours up to the stage before
+    void Request(int x, int y, Stage stage = Visible);
+    // chunks that got to Visible since the last call, in the order they finished
+    void TakeFinished(std::vector<Chunk*>& chunks);
+    // blocks until no stage is running or waiting to run
+    void WaitIdle();
+    // chunks per stage and the average time spent in each stage
+    void PrintStats();
+
+private:
+    // the chunks around one, [dx + 1][dy + 1]
+    struct Neighbours
+    {
+        Chunk* chunks[3][3] = {};
+    };
+
+    struct Entry
+    {
+        Chunk* chunk = nullptr;
+        Stage done = NotStarted;
+        Stage target = NotStarted;
+        // the next stage waits in the queue
+        bool queued = false;
+        bool running = false;
+    };
+
+    // the next stage of chunk (x, y), lower priority runs first
+    struct Job
+    {
+        float priority;
+        int x;
+        int y;
+    };
+
+    static uint64_t key(int x, int y)
+    {
+        return uint64_t(uint32_t(x)) << 32 | uint32_t(y);
+    }
+    // the entry of (x, y) or nullptr, with the lock held
+    Entry* find(int x, int y);
+    void request(int x, int y, Stage stage);
+    // queues the next stage of (x, y) if its neighbours allow it, with the lock held
+    void schedule(int x, int y);
+    static bool later(const Job& a, const Job& b);
+    float priority(int x, int y, Stage stage) const;
+    // the furthest stage focus still wants for (x, y)
+    Stage allowedStage(int x, int y) const;
+    // takes the most urgent queued stage and runs it, one call per queued job
+    void runNext();
+    void run(int x, int y, Stage stage, Chunk* chunk, const Neighbours& neighbours);
+
+    WorldMap* world;
+    int chunkSize;
+    ThreadPool* threadPool;
+    std::mutex mutex;
+    std::condition_variable idle;
+    // stages queued or running
+    size_t active = 0;
+    std::unordered_map<uint64_t, Entry> entries;
+    // entries whose target is beyond the stage they have done
+    std::unordered_set<uint64_t> pending;
+    // min heap on priority
+    std::vector<Job> queue;
+    Focus focus;
+    size_t cancelled = 0;
+    std::vector<Chunk*> finished;
+    double stageSeconds[StageCount] = {};
+    size_t stageChunks[StageCount] = {};
+};
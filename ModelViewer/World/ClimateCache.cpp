@@ -0,0 +1,80 @@
+﻿#include "ClimateCache.h"
+
+#include <algorithm>
+
+ClimateCache::ClimateCache(TileBuilder builder)
+    : builder(std::move(builder))
+{
+}
+
+std::shared_ptr<const ClimateCache::Tile> ClimateCache::Get(int tileX, int tileY, int chunkSize)
+{
+    TileKey key{tileX, tileY, chunkSize};
+    Shard& shard = shards[TileKeyHash()(key) % SHARD_COUNT];
+    std::shared_future<std::shared_ptr<const Tile>> tile;
+    std::promise<std::shared_ptr<const Tile>> built;
+    bool build = false;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.slots.find(key);
+        if (it != shard.slots.end())
+        {
+            shard.order.splice(shard.order.begin(), shard.order, it->second.position);
+            tile = it->second.tile;
+            hits++;
+        }
+        else
+        {
+            // the slot goes in before the tile is built, other threads asking for it wait instead of building it again
+            tile = built.get_future().share();
+            shard.order.push_front(key);
+            shard.slots.emplace(key, Shard::Slot{tile, shard.order.begin()});
+            build = true;
+            misses++;
+            size_t limit = std::max<size_t>(1, (capacity + SHARD_COUNT - 1) / SHARD_COUNT);
+            while (shard.slots.size() > limit)
+            {
+                // evicted tiles still in use stay alive through their shared_ptr
+                shard.slots.erase(shard.order.back());
+                shard.order.pop_back();
+                evictions++;
+            }
+        }
+    }
+    if (build)
+    {
+        auto fresh = std::make_shared<Tile>();
+        builder(tileX, tileY, chunkSize, *fresh);
+        built.set_value(fresh);
+    }
+    return tile.get();
+}
+
+void ClimateCache::SetCapacity(size_t tiles)
+{
+    capacity = tiles;
+}
+
+void ClimateCache::Clear()
+{
+    for (Shard& shard : shards)
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.slots.clear();
+        shard.order.clear();
+    }
+}
+
+ClimateCache::Stats ClimateCache::GetStats()
+{
+    Stats stats;
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.evictions = evictions;
+    for (Shard& shard : shards)
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        stats.tiles += shard.slots.size();
+    }
+    return stats;
+}
@@ -0,0 +1,104 @@
+﻿/**
+ * 相邻 chunk 共享的低分辨率气候缓存
+ * 大陆度、侵蚀、温度和湿度变化很慢，按 TILE_COLUMNS x TILE_COLUMNS 列的 tile 以 1/SPACING 分辨率计算一次格点
+ * (含远端边缘)，tile 内的 chunk 直接读取格点再插值，不再各自调用 SimplexNoise::fractal。
+ * 缓存按 tile 坐标分成 SHARD_COUNT 个分片，每个分片有自己的锁和 LRU 链表，超过容量时淘汰最久未使用的 tile；
+ * 缺失的 tile 在锁外计算，同时请求同一个 tile 的线程等待同一个结果。
+ */
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+class ClimateCache
+{
+public:
+    static constexpr int TILE_COLUMNS = 64;
+    static constexpr int SPACING = 4;
+    static constexpr int TILE_POINTS = TILE_COLUMNS / SPACING + 1;
+
+    enum Field
+    {
+        Continent,
+        Erosion,
+        Temperature,
+        Humidity,
+        FieldCount
+    };
+
+    struct Tile
+    {
+        // lattice point (i, j) lies on column (i * SPACING, j * SPACING) of the tile, at i * TILE_POINTS + j
+        float values[FieldCount][TILE_POINTS * TILE_POINTS];
+    };
+
+    struct Stats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        size_t tiles = 0;
+    };
+
+    // fills the tile at (tileX, tileY) for chunks of chunkSize columns, called without any lock held
+    using TileBuilder = std::function<void(int tileX, int tileY, int chunkSize, Tile& tile)>;
+
+    explicit ClimateCache(TileBuilder builder);
+
+    // the tile, built on the first request; thread safe
+    std::shared_ptr<const Tile> Get(int tileX, int tileY, int chunkSize);
+    // tiles kept over all shards, the least recently used ones are evicted beyond it
+    void SetCapacity(size_t tiles);
+    // drops every tile, e.g. after the noise was reseeded
+    void Clear();
+    Stats GetStats();
+
+private:
+    static constexpr int SHARD_COUNT = 16;
+
+    struct TileKey
+    {
+        int x;
+        int y;
+        int chunkSize;
+
+        bool operator==(const TileKey& key) const
+        {
+            return x == key.x && y == key.y && chunkSize == key.chunkSize;
+        }
+    };
+
+    struct TileKeyHash
+    {
+        size_t operator()(const TileKey& key) const
+        {
+            return size_t(uint32_t(key.x) * 73856093u ^ uint32_t(key.y) * 19349663u ^ uint32_t(key.chunkSize));
+        }
+    };
+
+    struct Shard
+    {
+        struct Slot
+        {
+            std::shared_future<std::shared_ptr<const Tile>> tile;
+            std::list<TileKey>::iterator position;
+        };
+
+        std::mutex mutex;
+        // most recently used first
+        std::list<TileKey> order;
+        std::unordered_map<TileKey, Slot, TileKeyHash> slots;
+    };
+
+    TileBuilder builder;
+    Shard shards[SHARD_COUNT];
+    std::atomic<size_t> capacity{256};
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> evictions{0};
+};
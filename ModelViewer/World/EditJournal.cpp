@@ -0,0 +1,355 @@
+﻿#include "EditJournal.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "EngineTuning.h"
+#include "WorldMap.h"
+using namespace BlockResourceManager;
+
+NumVar UndoDepth("World/Edit/Undo Depth", 64, 1, 1024, 1);
+NumVar JournalMemoryLimit("World/Edit/Journal Memory Limit (MB)", 64, 1, 4096, 16);
+BoolVar LogEditJournal("World/Edit/Log Journal", false);
+
+namespace
+{
+    constexpr uint32_t kPageSize = 64 * 1024;
+
+    bool sameValues(const EditJournal::Run& run, uint8_t oldType, uint8_t newType, uint8_t oldFluid, uint8_t newFluid)
+    {
+        return run.oldType == oldType && run.newType == newType && run.oldFluid == oldFluid && run.newFluid == newFluid;
+    }
+}
+
+EditJournal::EditJournal(WorldMap* world)
+    : world(world)
+{
+}
+
+void EditJournal::Begin(uint32_t transactionFlags)
+{
+    if (depth++ == 0)
+    {
+        flags = transactionFlags;
+    }
+}
+
+void EditJournal::Record(const Chunk* chunk, int offset, BlockType oldType, uint8_t oldFluid, BlockType newType,
+                         uint8_t newFluid)
+{
+    if (oldType == newType && oldFluid == newFluid)
+    {
+        return;
+    }
+    if (depth == 0)
+    {
+        Begin(0);
+        Record(chunk, offset, oldType, oldFluid, newType, newFluid);
+        Commit();
+        return;
+    }
+    int sectionCells = chunk->chunkSize * chunk->chunkSize * WorldGenerator::SECTION_HEIGHT;
+    uint16_t section = uint16_t(offset / sectionCells);
+    uint64_t key = (uint64_t(chunk->chunkId) << 8) | section;
+    auto it = stagedIndex.find(key);
+    if (it == stagedIndex.end())
+    {
+        it = stagedIndex.emplace(key, staged.size()).first;
+        staged.emplace_back();
+        staged.back().chunkX = chunk->posX;
+        staged.back().chunkY = chunk->posY;
+        staged.back().section = section;
+    }
+    staged[it->second].changes.push_back({uint16_t(offset % sectionCells), uint8_t(oldType), uint8_t(newType),
+                                          oldFluid, newFluid});
+}
+
+void EditJournal::Commit()
+{
+    if (depth == 0 || --depth > 0)
+    {
+        return;
+    }
+
+    // sections in chunk order, so the same edit always encodes to the same bytes
+    std::vector<size_t> order(staged.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [this](size_t a, size_t b)
+    {
+        const StagedSection& l = staged[a];
+        const StagedSection& r = staged[b];
+        if (l.chunkX != r.chunkX)
+        {
+            return l.chunkX < r.chunkX;
+        }
+        if (l.chunkY != r.chunkY)
+        {
+            return l.chunkY < r.chunkY;
+        }
+        return l.section < r.section;
+    });
+
+    std::vector<Run> runs;
+    // first run and run count of every section that still changes something
+    std::vector<std::pair<size_t, size_t>> sectionRuns;
+    std::vector<const StagedSection*> sections;
+    uint64_t cells = 0;
+    for (size_t i : order)
+    {
+        StagedSection& section = staged[i];
+        auto& changes = section.changes;
+        // stable, so repeated changes of a cell stay in recording order
+        std::stable_sort(changes.begin(), changes.end(), [](const StagedChange& a, const StagedChange& b)
+        {
+            return a.index < b.index;
+        });
+        size_t first = runs.size();
+        for (size_t c = 0; c < changes.size();)
+        {
+            StagedChange merged = changes[c];
+            for (c++; c < changes.size() && changes[c].index == merged.index; c++)
+            {
+                merged.newType = changes[c].newType;
+                merged.newFluid = changes[c].newFluid;
+            }
+            if (merged.oldType == merged.newType && merged.oldFluid == merged.newFluid)
+            {
+                continue;
+            }
+            cells++;
+            if (runs.size() > first)
+            {
+                Run& last = runs.back();
+                if (last.start + last.count == merged.index && last.count < UINT16_MAX
+                    && sameValues(last, merged.oldType, merged.newType, merged.oldFluid, merged.newFluid))
+                {
+                    last.count++;
+                    continue;
+                }
+            }
+            runs.push_back({merged.index, 1, merged.oldType, merged.newType, merged.oldFluid, merged.newFluid});
+        }
+        if (runs.size() > first)
+        {
+            sectionRuns.emplace_back(first, runs.size() - first);
+            sections.push_back(&section);
+        }
+    }
+
+    if (!sections.empty())
+    {
+        uint32_t size = uint32_t(sizeof(TransactionHeader) + sections.size() * sizeof(SectionHeader)
+            + runs.size() * sizeof(Run));
+        Location location;
+        uint8_t* cursor = allocate(size, location);
+        TransactionHeader header{nextSequence++, flags, uint32_t(sections.size()), size};
+        std::memcpy(cursor, &header, sizeof(header));
+        cursor += sizeof(header);
+        for (size_t i = 0; i < sections.size(); i++)
+        {
+            SectionHeader sectionHeader{sections[i]->chunkX, sections[i]->chunkY, sections[i]->section,
+                                        uint16_t(sectionRuns[i].second)};
+            std::memcpy(cursor, &sectionHeader, sizeof(sectionHeader));
+            cursor += sizeof(sectionHeader);
+            std::memcpy(cursor, &runs[sectionRuns[i].first], sectionRuns[i].second * sizeof(Run));
+            cursor += sectionRuns[i].second * sizeof(Run);
+        }
+        stats.transactions++;
+        stats.cellsRecorded += cells;
+        stats.runs += runs.size();
+        stats.bytesWritten += size;
+
+        // a new user edit drops the edits that were undone before it
+        if (flags & UserEdit)
+        {
+            history.resize(undoCursor);
+            history.push_back(location);
+            undoCursor++;
+            while (history.size() > static_cast<size_t>((int)UndoDepth))
+            {
+                history.pop_front();
+                undoCursor--;
+            }
+        }
+        if (LogEditJournal && (flags & (UserEdit | UndoReplay | RedoReplay)))
+        {
+            std::cout << "edit journal: transaction " << header.sequence << ", " << cells << " cells in "
+                << runs.size() << " runs, " << size << " bytes, " << undoCursor << "/" << history.size()
+                << " undoable" << std::endl;
+        }
+    }
+
+    staged.clear();
+    stagedIndex.clear();
+    flags = 0;
+    releasePages();
+}
+
+uint8_t* EditJournal::allocate(uint32_t size, Location& location)
+{
+    if (pages.empty() || pages.back().capacity - pages.back().used < size)
+    {
+        pages.emplace_back();
+        Page& page = pages.back();
+        page.index = nextPage++;
+        page.capacity = std::max(kPageSize, size);
+        page.data.reset(new uint8_t[page.capacity]);
+    }
+    Page& page = pages.back();
+    location.page = page.index;
+    location.offset = page.used;
+    page.used += size;
+    bytesRetained += size;
+    return page.data.get() + location.offset;
+}
+
+bool EditJournal::isReferenced(uint64_t page) const
+{
+    return std::any_of(history.begin(), history.end(), [page](const Location& location)
+    {
+        return location.page == page;
+    });
+}
+
+// pages stay sorted by index, only the ones the history references are looked up
+EditJournal::Page& EditJournal::findPage(uint64_t page)
+{
+    return *std::lower_bound(pages.begin(), pages.end(), page, [](const Page& p, uint64_t index)
+    {
+        return p.index < index;
+    });
+}
+
+void EditJournal::releasePage(std::deque<Page>::iterator page)
+{
+    uint64_t index = page->index;
+    stats.bytesDropped += page->used - page->flushed;
+    bytesRetained -= page->used;
+    pages.erase(page);
+    // only the oldest page is released while referenced, so its edits are the oldest in the history
+    while (!history.empty() && history.front().page == index)
+    {
+        if (undoCursor == 0)
+        {
+            // redo has to start from the oldest undone edit, without it none of them can be redone
+            history.clear();
+            break;
+        }
+        history.pop_front();
+        undoCursor--;
+    }
+}
+
+// flushed pages go once no undoable edit lives in them; over the memory limit the oldest page without an undoable
+// edit goes even if it was never flushed, so a long simulation cannot push the undo history out
+void EditJournal::releasePages()
+{
+    while (pages.size() > 1 && pages.front().flushed == pages.front().used && !isReferenced(pages.front().index))
+    {
+        releasePage(pages.begin());
+    }
+    uint64_t limit = uint64_t((int)JournalMemoryLimit) * 1024 * 1024;
+    while (pages.size() > 1 && bytesRetained > limit)
+    {
+        // the last page is still being written
+        auto page = pages.begin();
+        while (page + 1 != pages.end() && isReferenced(page->index))
+        {
+            page++;
+        }
+        releasePage(page + 1 == pages.end() ? pages.begin() : page);
+    }
+}
+
+bool EditJournal::Undo()
+{
+    return replay(true);
+}
+
+bool EditJournal::Redo()
+{
+    return replay(false);
+}
+
+bool EditJournal::replay(bool undo)
+{
+    if (depth > 0 || (undo ? !CanUndo() : !CanRedo()))
+    {
+        return false;
+    }
+    const Location& location = history[undo ? undoCursor - 1 : undoCursor];
+    TransactionView view(findPage(location.page).data.get() + location.offset);
+
+    std::vector<RegionEditor::BlockWrite> writes;
+    view.ForEachSection([&](const SectionHeader& section, const Run* runs)
+    {
+        if (!world->hasBlock(section.chunkX, section.chunkY))
+        {
+            return;
+        }
+        Chunk* chunk = world->getWorldBlockRef(section.chunkX, section.chunkY);
+        int sectionStart = section.section * chunk->chunkSize * chunk->chunkSize * WorldGenerator::SECTION_HEIGHT;
+        for (uint16_t r = 0; r < section.runCount; r++)
+        {
+            const Run& run = runs[r];
+            BlockType type = BlockType(undo ? run.oldType : run.newType);
+            uint8_t fluidLevel = undo ? run.oldFluid : run.newFluid;
+            for (uint16_t i = 0; i < run.count; i++)
+            {
+                writes.push_back({chunk, uint16_t(sectionStart + run.start + i), type, fluidLevel});
+            }
+        }
+    });
+
+    // the cursor moves first, the replay is journaled and may release pages the history points into
+    if (undo)
+    {
+        undoCursor--;
+    }
+    else
+    {
+        undoCursor++;
+    }
+    Begin(undo ? UndoReplay : RedoReplay);
+    world->GetRegionEdits().Write(writes);
+    Commit();
+    return true;
+}
+
+size_t EditJournal::Flush(const FlushSink& sink, size_t maxBytes)
+{
+    size_t total = 0;
+    bool full = false;
+    for (Page& page : pages)
+    {
+        if (full)
+        {
+            break;
+        }
+        uint32_t end = page.flushed;
+        while (end < page.used)
+        {
+            uint32_t size = reinterpret_cast<const TransactionHeader*>(page.data.get() + end)->byteSize;
+            size_t pending = total + (end - page.flushed);
+            if (pending > 0 && pending + size > maxBytes)
+            {
+                full = true;
+                break;
+            }
+            end += size;
+        }
+        if (end > page.flushed)
+        {
+            sink(page.data.get() + page.flushed, end - page.flushed);
+            total += end - page.flushed;
+            page.flushed = end;
+        }
+    }
+    stats.bytesFlushed += total;
+    releasePages();
+    return total;
+}
@@ -0,0 +1,226 @@
+﻿/**
+ * 方块修改日志：所有方块修改 (WorldMap::SetBlock 与 RegionEditor) 都追加到只增不改的紧凑日志中
+ * 1. 修改按事务分组：玩家编辑、一帧的方块 tick 与水流、撤销 / 重做各为一个事务；事务外的单个修改自成一个事务
+ * 2. 事务内按 (chunk, section) 分组，格子下标为 section 内的 GetBlockOffsetOnHeap，
+ *    下标连续且 (旧类型, 新类型, 旧水位, 新水位) 相同的格子合并为一段 (run-length)，同一格子多次修改只保留首个旧值和最后的新值
+ * 3. 日志以页为单位存放，事务不会跨页，可以直接在页内原地遍历 (ForEachTransaction)，
+ *    Flush 按页把尚未输出的完整事务交给存档或网络同步，不复制数据
+ *    超出内存上限时先丢弃撤销历史没有引用的最旧页 (通常只含模拟事务)，没有这样的页时才丢弃最旧的撤销记录
+ * 4. 撤销 / 重做只针对玩家编辑，把事务的旧值 / 新值经 RegionEditor::Write 直接写回 chunk 存储，每个 chunk 只失效一次；
+ *    之后被模拟改变的格子同样会被覆盖
+ * 页内布局 (小端，自然对齐)：TransactionHeader，随后 sectionCount 个 SectionHeader，每个后接 runCount 个 Run
+ */
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "Chunk.h"
+
+class WorldMap;
+
+class EditJournal
+{
+public:
+    enum TransactionFlags : uint32_t
+    {
+        UserEdit = 1,
+        Simulation = 2,
+        UndoReplay = 4,
+        RedoReplay = 8,
+    };
+
+    struct TransactionHeader
+    {
+        uint32_t sequence;
+        uint32_t flags;
+        uint32_t sectionCount;
+        // the whole transaction including this header
+        uint32_t byteSize;
+    };
+
+    struct SectionHeader
+    {
+        int32_t chunkX;
+        int32_t chunkY;
+        uint16_t section;
+        uint16_t runCount;
+    };
+
+    struct Run
+    {
+        // first cell, GetBlockOffsetOnHeap relative to the section's first block
+        uint16_t start;
+        uint16_t count;
+        uint8_t oldType;
+        uint8_t newType;
+        uint8_t oldFluid;
+        uint8_t newFluid;
+    };
+    static_assert(sizeof(TransactionHeader) == 16 && sizeof(SectionHeader) == 12 && sizeof(Run) == 8,
+                  "journal records are written and read in place");
+
+    // a transaction read in place from its page, valid until the page is released
+    class TransactionView
+    {
+    public:
+        explicit TransactionView(const uint8_t* data)
+            : data(data)
+        {
+        }
+
+        const TransactionHeader& Header() const
+        {
+            return *reinterpret_cast<const TransactionHeader*>(data);
+        }
+
+        // visitor(const SectionHeader& section, const Run* runs)
+        template <typename Visitor>
+        void ForEachSection(Visitor&& visitor) const
+        {
+            const uint8_t* cursor = data + sizeof(TransactionHeader);
+            for (uint32_t i = 0; i < Header().sectionCount; i++)
+            {
+                const auto& section = *reinterpret_cast<const SectionHeader*>(cursor);
+                const Run* runs = reinterpret_cast<const Run*>(cursor + sizeof(SectionHeader));
+                visitor(section, runs);
+                cursor += sizeof(SectionHeader) + section.runCount * sizeof(Run);
+            }
+        }
+
+        const uint8_t* Data() const
+        {
+            return data;
+        }
+
+    private:
+        const uint8_t* data;
+    };
+
+    struct Stats
+    {
+        uint32_t transactions = 0;
+        uint64_t cellsRecorded = 0;
+        uint64_t runs = 0;
+        uint64_t bytesWritten = 0;
+        uint64_t bytesFlushed = 0;
+        // pages released before they were flushed because the journal outgrew its memory limit
+        uint64_t bytesDropped = 0;
+    };
+
+    // receives consecutive whole transactions of one page
+    using FlushSink = std::function<void(const uint8_t* data, size_t size)>;
+
+    explicit EditJournal(WorldMap* world);
+
+    // transactions nest, the outermost one decides the flags and writes the record on Commit
+    void Begin(uint32_t flags);
+    void Commit();
+    // called for every block that changed, offset is the block's GetBlockOffsetOnHeap
+    void Record(const Chunk* chunk, int offset, BlockResourceManager::BlockType oldType, uint8_t oldFluid,
+                BlockResourceManager::BlockType newType, uint8_t newFluid);
+
+    bool CanUndo() const
+    {
+        return undoCursor > 0;
+    }
+    bool CanRedo() const
+    {
+        return undoCursor < history.size();
+    }
+    // puts the old blocks of the last user edit back, returns false when there is nothing to undo
+    bool Undo();
+    bool Redo();
+
+    // hands the transactions written since the last flush to sink, at most about maxBytes per call
+    // but always at least one transaction; returns the bytes flushed
+    size_t Flush(const FlushSink& sink, size_t maxBytes = SIZE_MAX);
+
+    // visitor(const TransactionView&) for every retained transaction with sequence >= fromSequence, oldest first
+    template <typename Visitor>
+    void ForEachTransaction(uint32_t fromSequence, Visitor&& visitor) const
+    {
+        for (const Page& page : pages)
+        {
+            for (uint32_t offset = 0; offset < page.used;)
+            {
+                TransactionView view(page.data.get() + offset);
+                if (view.Header().sequence >= fromSequence)
+                {
+                    visitor(view);
+                }
+                offset += view.Header().byteSize;
+            }
+        }
+    }
+
+    uint32_t GetNextSequence() const
+    {
+        return nextSequence;
+    }
+    const Stats& GetStats() const
+    {
+        return stats;
+    }
+
+private:
+    struct Page
+    {
+        // counted from the first page ever allocated, pages may be released out of order
+        uint64_t index = 0;
+        std::unique_ptr<uint8_t[]> data;
+        uint32_t capacity = 0;
+        uint32_t used = 0;
+        uint32_t flushed = 0;
+    };
+
+    // a user edit in the undo history, page is the Page::index it lives in
+    struct Location
+    {
+        uint64_t page;
+        uint32_t offset;
+    };
+
+    struct StagedChange
+    {
+        uint16_t index;
+        uint8_t oldType;
+        uint8_t newType;
+        uint8_t oldFluid;
+        uint8_t newFluid;
+    };
+
+    struct StagedSection
+    {
+        int32_t chunkX;
+        int32_t chunkY;
+        uint16_t section;
+        // in recording order, a cell may appear more than once
+        std::vector<StagedChange> changes;
+    };
+
+    bool replay(bool undo);
+    uint8_t* allocate(uint32_t size, Location& location);
+    bool isReferenced(uint64_t page) const;
+    Page& findPage(uint64_t page);
+    void releasePage(std::deque<Page>::iterator page);
+    void releasePages();
+
+    WorldMap* world;
+    int depth = 0;
+    uint32_t flags = 0;
+    std::unordered_map<uint64_t, size_t> stagedIndex;
+    std::vector<StagedSection> staged;
+
+    std::deque<Page> pages;
+    uint64_t nextPage = 0;
+    uint64_t bytesRetained = 0;
+    uint32_t nextSequence = 0;
+
+    std::deque<Location> history;
+    size_t undoCursor = 0;
+    Stats stats;
+};
@@ -0,0 +1,266 @@
+﻿#include "FluidSimulation.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "EngineTuning.h"
+#include "WorldMap.h"
+using namespace BlockResourceManager;
+
+NumVar MaxFluidCellsPerTick("World/Fluids/Max Cells per Tick", 2048, 64, 65536, 64);
+BoolVar LogFluidFlow("World/Fluids/Log Stats", false);
+
+namespace
+{
+    constexpr uint8_t kNoFeed = 0xFF;
+    constexpr int kMaxCatchUpTicks = 2;
+    const int kHorizontal[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+
+    bool isSource(uint8_t level)
+    {
+        return level == 0;
+    }
+
+    // how far water spreading out of a cell has already travelled, falling water spreads like a source
+    uint8_t spreadDistance(uint8_t level)
+    {
+        return (level & FluidSimulation::FLUID_FALLING) ? 0 : level;
+    }
+}
+
+FluidSimulation::FluidSimulation(WorldMap* world)
+    : world(world)
+{
+}
+
+void FluidSimulation::Update(float deltaT)
+{
+    const float tickLength = 1.0f / FLOW_TICKS_PER_SECOND;
+    accumulator = std::min(accumulator + deltaT, kMaxCatchUpTicks * tickLength);
+    while (accumulator >= tickLength)
+    {
+        accumulator -= tickLength;
+        step();
+    }
+}
+
+void FluidSimulation::step()
+{
+    stats = FlowStats();
+    if (frontier.empty())
+    {
+        lastStats = stats;
+        return;
+    }
+
+    // cells woken while this step runs belong to the next one
+    std::unordered_map<uint64_t, SectionFrontier> current;
+    current.swap(frontier);
+    std::vector<uint64_t> keys;
+    keys.reserve(current.size());
+    for (const auto& section : current)
+    {
+        keys.push_back(section.first);
+    }
+    std::sort(keys.begin(), keys.end());
+
+    uint32_t budget = static_cast<uint32_t>((int)MaxFluidCellsPerTick);
+    std::vector<int> cells;
+    for (uint64_t key : keys)
+    {
+        SectionFrontier& section = current[key];
+        cells.assign(section.cells.begin(), section.cells.end());
+        std::sort(cells.begin(), cells.end());
+        Chunk* chunk = section.chunk;
+        int layer = chunk->chunkSize * chunk->chunkSize;
+        bool touched = false;
+        for (int index : cells)
+        {
+            BlockCoord coord{chunk, index % chunk->chunkSize, index / chunk->chunkSize % chunk->chunkSize, index / layer};
+            if (stats.cellsUpdated >= budget)
+            {
+                Wake(coord);
+                stats.deferred++;
+                continue;
+            }
+            stats.cellsUpdated++;
+            touched = true;
+            updateCell(coord);
+        }
+        stats.sectionsTouched += touched;
+    }
+
+    for (const auto& section : frontier)
+    {
+        stats.frontierSize += static_cast<uint32_t>(section.second.cells.size());
+    }
+    lastStats = stats;
+    if (LogFluidFlow)
+    {
+        std::cout << "fluid flow: updated " << stats.cellsUpdated << " cells in " << stats.sectionsTouched
+            << " sections, changed " << stats.cellsChanged << ", deferred " << stats.deferred
+            << ", frontier " << stats.frontierSize << std::endl;
+    }
+}
+
+void FluidSimulation::updateCell(const BlockCoord& coord)
+{
+    Block& block = coord.GetBlock();
+    if (block.blockType != Water)
+    {
+        return;
+    }
+
+    uint8_t level = block.fluidLevel;
+    if (!isSource(level))
+    {
+        uint8_t expected = feedLevel(coord);
+        if (expected == kNoFeed)
+        {
+            setBlock(coord, Air, 0);
+            return;
+        }
+        if (expected != level)
+        {
+            setLevel(coord, expected);
+            level = expected;
+        }
+    }
+
+    // water falls first and only spreads sideways once it rests on something solid
+    BlockCoord below = neighbour(coord, 0, -1, 0);
+    if (canFlowInto(below))
+    {
+        setBlock(below, Water, FLUID_FALLING);
+        return;
+    }
+    if (isWater(below))
+    {
+        return;
+    }
+
+    uint8_t next = spreadDistance(level) + 1;
+    if (next > MAX_FLOW_LEVEL)
+    {
+        return;
+    }
+    for (const auto& offset : kHorizontal)
+    {
+        BlockCoord side = neighbour(coord, offset[0], 0, offset[1]);
+        if (canFlowInto(side))
+        {
+            setBlock(side, Water, next);
+        }
+        else if (isWater(side))
+        {
+            uint8_t sideLevel = side.GetBlock().fluidLevel;
+            if (!isSource(sideLevel) && !(sideLevel & FLUID_FALLING) && sideLevel > next)
+            {
+                setLevel(side, next);
+            }
+        }
+    }
+}
+
+uint8_t FluidSimulation::feedLevel(const BlockCoord& coord)
+{
+    if (isWater(neighbour(coord, 0, 1, 0)))
+    {
+        return FLUID_FALLING;
+    }
+
+    BlockCoord below = neighbour(coord, 0, -1, 0);
+    bool grounded = !below.IsValid() || isSolidBlock(below.GetBlock().blockType)
+        || (isWater(below) && isSource(below.GetBlock().fluidLevel));
+    int sources = 0;
+    uint8_t best = kNoFeed;
+    for (const auto& offset : kHorizontal)
+    {
+        BlockCoord side = neighbour(coord, offset[0], 0, offset[1]);
+        if (!isWater(side))
+        {
+            continue;
+        }
+        // a neighbour that can still fall does not spread sideways, so it does not feed this cell
+        if (canFlowInto(neighbour(side, 0, -1, 0)))
+        {
+            continue;
+        }
+        uint8_t sideLevel = side.GetBlock().fluidLevel;
+        sources += isSource(sideLevel);
+        best = std::min<uint8_t>(best, spreadDistance(sideLevel) + 1);
+    }
+    // water between two sources over solid ground becomes a source itself
+    if (sources >= 2 && grounded)
+    {
+        return 0;
+    }
+    return best <= MAX_FLOW_LEVEL ? best : kNoFeed;
+}
+
+void FluidSimulation::setLevel(const BlockCoord& coord, uint8_t level)
+{
+    // only the flow state changes, the block keeps its instance so no section rebuild is needed
+    world->SetFluidLevel(coord, level);
+    stats.cellsChanged++;
+    NotifyChanged(coord);
+}
+
+void FluidSimulation::setBlock(const BlockCoord& coord, BlockType type, uint8_t level)
+{
+    stats.cellsChanged++;
+    world->SetBlock(coord, type, level);
+}
+
+void FluidSimulation::NotifyChanged(const BlockCoord& coord)
+{
+    Wake(coord);
+    for (const auto& offset : kHorizontal)
+    {
+        Wake(neighbour(coord, offset[0], 0, offset[1]));
+    }
+    Wake(neighbour(coord, 0, 1, 0));
+    Wake(neighbour(coord, 0, -1, 0));
+}
+
+void FluidSimulation::Wake(const BlockCoord& coord)
+{
+    if (!isWater(coord))
+    {
+        return;
+    }
+    int section = coord.z / WorldGenerator::SECTION_HEIGHT;
+    SectionFrontier& entry = frontier[sectionKey(coord.chunk, section)];
+    entry.chunk = coord.chunk;
+    entry.section = section;
+    entry.cells.insert(coord.chunk->GetBlockOffsetOnHeap(coord.x, coord.y, coord.z));
+}
+
+bool FluidSimulation::canFlowInto(const BlockCoord& coord) const
+{
+    if (!coord.IsValid())
+    {
+        return false;
+    }
+    BlockType type = coord.GetBlock().blockType;
+    return type != Water && !isSolidBlock(type);
+}
+
+bool FluidSimulation::isWater(const BlockCoord& coord) const
+{
+    return coord.IsValid() && coord.GetBlock().blockType == Water;
+}
+
+BlockCoord FluidSimulation::neighbour(const BlockCoord& coord, int dx, int dy, int dz) const
+{
+    if (!coord.IsValid())
+    {
+        return BlockCoord();
+    }
+    return world->GetBlockTicks().GetNeighbour(coord, dx, dy, dz);
+}
+
+uint64_t FluidSimulation::sectionKey(const Chunk* chunk, int section)
+{
+    return static_cast<uint64_t>(chunk->chunkId) << 8 | static_cast<uint64_t>(section);
+}
@@ -0,0 +1,388 @@
+﻿#include "LightEngine.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "EngineTuning.h"
+#include "SystemTime.h"
+#include "WorldMap.h"
+using namespace BlockResourceManager;
+using namespace VoxelLight;
+
+NumVar LightStepsPerFrame("World/Light/Max Steps per Frame", 65536, 1024, 1048576, 1024);
+BoolVar LogLightEdits("World/Light/Log Edits", false);
+
+namespace
+{
+    // chunk space directions, z is up
+    const int kDirections[6][3] = {{1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}};
+    constexpr int kDown = 5;
+
+    using LightNode = LightEngine::LightNode;
+
+    struct PassCounters
+    {
+        uint32_t steps = 0;
+        uint32_t cellsChanged = 0;
+    };
+
+    uint8_t opacityAt(const LightNode& node)
+    {
+        return BlockLightOpacity[node.chunk->blocks[node.x][node.y][node.z].blockType];
+    }
+
+    uint8_t lightAt(const LightNode& node, Channel channel)
+    {
+        return node.chunk->light.Get(node.x, node.y, node.z, channel);
+    }
+
+    // the cell next to 'from', bound keeps generation time propagation inside one chunk
+    bool stepNode(const LightNode& from, int direction, const Chunk* bound, LightNode& to)
+    {
+        int x = from.x + kDirections[direction][0];
+        int y = from.y + kDirections[direction][1];
+        int z = from.z + kDirections[direction][2];
+        Chunk* chunk = from.chunk;
+        if (z < 0 || z >= chunk->chunkDepth)
+        {
+            return false;
+        }
+        if (x < 0 || x >= chunk->chunkSize || y < 0 || y >= chunk->chunkSize)
+        {
+            if (bound != nullptr)
+            {
+                return false;
+            }
+            chunk = chunk->GetChunkAcross(x, y);
+            if (chunk == nullptr)
+            {
+                return false;
+            }
+        }
+        to = LightNode{chunk, uint8_t(x), uint8_t(y), uint8_t(z), 0};
+        return true;
+    }
+
+    // blocks take their instance light from the cells in front of their faces, so the neighbours re-bake
+    void markLightChanged(const LightNode& node)
+    {
+        for (int direction = 0; direction < 6; direction++)
+        {
+            LightNode neighbour;
+            if (stepNode(node, direction, nullptr, neighbour))
+            {
+                neighbour.chunk->MarkSectionDirty(neighbour.z);
+            }
+        }
+    }
+
+    void propagateAdd(std::queue<LightNode>& queue, Channel channel, const Chunk* bound, uint32_t maxSteps,
+                      PassCounters& counters)
+    {
+        while (!queue.empty() && counters.steps < maxSteps)
+        {
+            LightNode node = queue.front();
+            queue.pop();
+            counters.steps++;
+            int light = lightAt(node, channel);
+            if (light <= 1)
+            {
+                continue;
+            }
+            for (int direction = 0; direction < 6; direction++)
+            {
+                LightNode next;
+                if (!stepNode(node, direction, bound, next))
+                {
+                    continue;
+                }
+                int opacity = opacityAt(next);
+                if (opacity >= MAX_LIGHT)
+                {
+                    continue;
+                }
+                bool skyColumn = channel == SkyChannel && direction == kDown && light == MAX_LIGHT && opacity == 0;
+                int spread = skyColumn ? MAX_LIGHT : light - std::max(1, opacity);
+                if (spread > lightAt(next, channel))
+                {
+                    next.chunk->light.Set(next.x, next.y, next.z, channel, uint8_t(spread));
+                    counters.cellsChanged++;
+                    if (bound == nullptr)
+                    {
+                        markLightChanged(next);
+                    }
+                    queue.push(next);
+                }
+            }
+        }
+    }
+
+    // clears light that came through the removed cells; anything brighter is kept and re-spread by the add pass
+    void propagateRemove(std::queue<LightNode>& removeQueue, std::queue<LightNode>& addQueue, Channel channel,
+                         uint32_t maxSteps, PassCounters& counters)
+    {
+        while (!removeQueue.empty() && counters.steps < maxSteps)
+        {
+            LightNode node = removeQueue.front();
+            removeQueue.pop();
+            counters.steps++;
+            for (int direction = 0; direction < 6; direction++)
+            {
+                LightNode next;
+                if (!stepNode(node, direction, nullptr, next))
+                {
+                    continue;
+                }
+                uint8_t light = lightAt(next, channel);
+                if (light == 0)
+                {
+                    continue;
+                }
+                bool skyColumn = channel == SkyChannel && direction == kDown && node.light == MAX_LIGHT
+                    && light == MAX_LIGHT;
+                if (light >= node.light && !skyColumn)
+                {
+                    addQueue.push(next);
+                    continue;
+                }
+                next.chunk->light.Set(next.x, next.y, next.z, channel, 0);
+                counters.cellsChanged++;
+                markLightChanged(next);
+                next.light = light;
+                removeQueue.push(next);
+
+                uint8_t emission = BlockLightEmission[next.chunk->blocks[next.x][next.y][next.z].blockType];
+                if (channel == BlockChannel && emission > 0)
+                {
+                    next.chunk->light.Set(next.x, next.y, next.z, channel, emission);
+                    addQueue.push(next);
+                }
+            }
+        }
+    }
+}
+
+LightEngine::LightEngine(WorldMap* world)
+    : world(world)
+{
+}
+
+void LightEngine::LightChunk(Chunk* chunk)
+{
+    ChunkLight& light = chunk->light;
+    LightQueues local;
+
+    // full skylight falls straight down without loss until something absorbs part of it, then fades per cell
+    for (int x = 0; x < chunk->chunkSize; x++)
+    {
+        for (int y = 0; y < chunk->chunkSize; y++)
+        {
+            uint8_t sky = MAX_LIGHT;
+            for (int z = chunk->chunkDepth - 1; z >= 0; z--)
+            {
+                BlockType type = chunk->blocks[x][y][z].blockType;
+                uint8_t opacity = BlockLightOpacity[type];
+                if (opacity >= MAX_LIGHT)
+                {
+                    sky = 0;
+                }
+                else if (sky < MAX_LIGHT || opacity > 0)
+                {
+                    sky -= std::min<uint8_t>(sky, std::max<uint8_t>(1, opacity));
+                }
+                light.Set(x, y, z, SkyChannel, sky);
+                if (BlockLightEmission[type] > 0)
+                {
+                    chunk->emissiveBlocks.insert(chunk->GetBlockOffsetOnHeap(x, y, z));
+                    light.Set(x, y, z, BlockChannel, BlockLightEmission[type]);
+                    local.add[BlockChannel].push(LightNode{chunk, uint8_t(x), uint8_t(y), uint8_t(z), 0});
+                }
+            }
+        }
+    }
+
+    // only lit cells next to a darker open cell can spread sideways, e.g. into overhangs and caves
+    for (int x = 0; x < chunk->chunkSize; x++)
+    {
+        for (int y = 0; y < chunk->chunkSize; y++)
+        {
+            for (int z = 0; z < chunk->chunkDepth; z++)
+            {
+                uint8_t sky = light.Get(x, y, z, SkyChannel);
+                if (sky <= 1)
+                {
+                    continue;
+                }
+                LightNode node{chunk, uint8_t(x), uint8_t(y), uint8_t(z), 0};
+                for (int direction = 0; direction < 4; direction++)
+                {
+                    LightNode next;
+                    if (stepNode(node, direction, chunk, next) && opacityAt(next) < MAX_LIGHT
+                        && lightAt(next, SkyChannel) + 1 < sky)
+                    {
+                        local.add[SkyChannel].push(node);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    PassCounters counters;
+    propagateAdd(local.add[SkyChannel], SkyChannel, chunk, UINT32_MAX, counters);
+    propagateAdd(local.add[BlockChannel], BlockChannel, chunk, UINT32_MAX, counters);
+    light.Compact();
+}
+
+void LightEngine::QueueBorderStitch(Chunk* chunk)
+{
+    std::lock_guard<std::mutex> lock(stitchMutex);
+    pendingStitches.push_back(chunk);
+}
+
+void LightEngine::stitch(Chunk* chunk)
+{
+    int size = chunk->chunkSize;
+    for (int side = 0; side < 4; side++)
+    {
+        int axis = side / 2;
+        int inside = side % 2 == 0 ? size - 1 : 0;
+        int outside = side % 2 == 0 ? size : -1;
+        for (int i = 0; i < size; i++)
+        {
+            int ox = axis == 0 ? outside : i;
+            int oy = axis == 0 ? i : outside;
+            Chunk* neighbour = chunk->GetChunkAcross(ox, oy);
+            if (neighbour == nullptr)
+            {
+                break;
+            }
+            LightNode a{chunk, uint8_t(axis == 0 ? inside : i), uint8_t(axis == 0 ? i : inside), 0, 0};
+            LightNode b{neighbour, uint8_t(ox), uint8_t(oy), 0, 0};
+            for (int z = 0; z < chunk->chunkDepth; z++)
+            {
+                a.z = b.z = uint8_t(z);
+                for (int channel = 0; channel < 2; channel++)
+                {
+                    auto c = static_cast<Channel>(channel);
+                    int la = lightAt(a, c);
+                    int lb = lightAt(b, c);
+                    // queue only the side that would actually brighten the other
+                    if (la > lb + std::max<int>(1, opacityAt(b)))
+                    {
+                        queues.add[c].push(a);
+                    }
+                    else if (lb > la + std::max<int>(1, opacityAt(a)))
+                    {
+                        queues.add[c].push(b);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void LightEngine::OnBlockChanged(const BlockCoord& coord, BlockType oldType)
+{
+    BlockType newType = coord.GetBlock().blockType;
+    if (BlockLightOpacity[newType] == BlockLightOpacity[oldType]
+        && BlockLightEmission[newType] == BlockLightEmission[oldType])
+    {
+        return;
+    }
+    int offset = coord.chunk->GetBlockOffsetOnHeap(coord.x, coord.y, coord.z);
+    if (BlockLightEmission[newType] > 0)
+    {
+        coord.chunk->emissiveBlocks.insert(offset);
+    }
+    else
+    {
+        coord.chunk->emissiveBlocks.erase(offset);
+    }
+
+    int64_t start = SystemTime::GetCurrentTick();
+    LightNode node{coord.chunk, uint8_t(coord.x), uint8_t(coord.y), uint8_t(coord.z), 0};
+    ChunkLight& light = coord.chunk->light;
+    uint8_t opacity = BlockLightOpacity[newType];
+    for (int channel = 0; channel < 2; channel++)
+    {
+        auto c = static_cast<Channel>(channel);
+        uint8_t old = light.Get(node.x, node.y, node.z, c);
+        if (old > 0)
+        {
+            light.Set(node.x, node.y, node.z, c, 0);
+            markLightChanged(node);
+            queues.remove[c].push(LightNode{node.chunk, node.x, node.y, node.z, old});
+        }
+        if (c == BlockChannel && BlockLightEmission[newType] > 0)
+        {
+            light.Set(node.x, node.y, node.z, c, BlockLightEmission[newType]);
+            markLightChanged(node);
+            queues.add[c].push(node);
+        }
+        if (opacity >= MAX_LIGHT)
+        {
+            continue;
+        }
+        // the open cell is refilled by whatever light its neighbours still hold after the removal pass
+        for (int direction = 0; direction < 6; direction++)
+        {
+            LightNode next;
+            if (stepNode(node, direction, nullptr, next) && lightAt(next, c) > 0)
+            {
+                queues.add[c].push(next);
+            }
+        }
+        if (c == SkyChannel && opacity == 0 && node.z == coord.chunk->chunkDepth - 1)
+        {
+            light.Set(node.x, node.y, node.z, c, MAX_LIGHT);
+            markLightChanged(node);
+            queues.add[c].push(node);
+        }
+    }
+
+    lastEdit = EditStats();
+    process(static_cast<uint32_t>((int)LightStepsPerFrame), lastEdit);
+    lastEdit.deferred = !queues.Empty();
+    lastEdit.milliseconds = SystemTime::TimeBetweenTicks(start, SystemTime::GetCurrentTick()) * 1000.0;
+    if (LogLightEdits)
+    {
+        std::cout << "light edit: " << lastEdit.steps << " steps, " << lastEdit.cellsChanged << " cells changed, "
+            << lastEdit.milliseconds << " ms" << (lastEdit.deferred ? ", continues next frame" : "") << std::endl;
+    }
+}
+
+void LightEngine::Update()
+{
+    std::vector<Chunk*> chunks;
+    {
+        std::lock_guard<std::mutex> lock(stitchMutex);
+        chunks.swap(pendingStitches);
+    }
+    for (Chunk* chunk : chunks)
+    {
+        stitch(chunk);
+    }
+    if (!queues.Empty())
+    {
+        EditStats stats;
+        process(static_cast<uint32_t>((int)LightStepsPerFrame), stats);
+    }
+}
+
+void LightEngine::process(uint32_t maxSteps, EditStats& stats)
+{
+    PassCounters counters;
+    for (int channel = 0; channel < 2; channel++)
+    {
+        auto c = static_cast<Channel>(channel);
+        propagateRemove(queues.remove[c], queues.add[c], c, maxSteps, counters);
+        // refilling before the removal is complete could re-spread light that is about to be cleared
+        if (queues.remove[c].empty())
+        {
+            propagateAdd(queues.add[c], c, nullptr, maxSteps, counters);
+        }
+    }
+    stats.steps += counters.steps;
+    stats.cellsChanged += counters.cellsChanged;
+}
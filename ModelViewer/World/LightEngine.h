@@ -0,0 +1,80 @@
+﻿/**
+ * 广度优先 (BFS) 的天空光 / 方块光传播
+ * 1. chunk 生成时在生成线程上完成 chunk 内部的完整传播 (LightChunk)，此时 chunk 尚未发布，不与其他线程共享
+ * 2. chunk 发布后排队，在主线程上与已加载的相邻 chunk 沿边界互相补光 (stitch)
+ * 3. 方块改变时只更新受影响的区域：先用删除队列清掉依赖旧方块的光，再用添加队列从仍然有效的光源补回，
+ *    跨 chunk 边界通过 Chunk::GetChunkAcross 访问相邻 chunk
+ * 4. 天空光向下穿过完全透光的格子不衰减，其余方向每格至少衰减 1
+ * 5. 同时维护每个 chunk 的发光方块列表 (Chunk::emissiveBlocks)，WorldMap 从中收集 Forward+ 点光源
+ * 每帧最多执行 "Max Steps per Frame" 步，未完成的队列留到下一帧；每次编辑的步数和耗时会被记录
+ */
+#pragma once
+#include <cstdint>
+#include <mutex>
+#include <queue>
+#include <vector>
+
+#include "VoxelLight.h"
+#include "VoxelRaycast.h"
+
+class WorldMap;
+
+class LightEngine
+{
+public:
+    struct EditStats
+    {
+        uint32_t steps = 0;
+        uint32_t cellsChanged = 0;
+        // the edit did not finish within the budget and continues next frame
+        bool deferred = false;
+        double milliseconds = 0.0;
+    };
+
+    explicit LightEngine(WorldMap* world);
+
+    // full propagation inside a freshly generated chunk, runs on the generating thread before the chunk is published
+    static void LightChunk(Chunk* chunk);
+    // propagates light across the borders of a published chunk with its loaded neighbours on the next Update
+    void QueueBorderStitch(Chunk* chunk);
+    // the block at coord was oldType, relights the region depending on it
+    void OnBlockChanged(const BlockCoord& coord, BlockResourceManager::BlockType oldType);
+    // runs queued stitches and work left over by earlier edits, main thread only
+    void Update();
+
+    const EditStats& GetLastEditStats() const
+    {
+        return lastEdit;
+    }
+
+    struct LightNode
+    {
+        Chunk* chunk;
+        uint8_t x;
+        uint8_t y;
+        uint8_t z;
+        // light of the cell when it was queued, used by the removal pass
+        uint8_t light;
+    };
+
+    struct LightQueues
+    {
+        std::queue<LightNode> add[2];
+        std::queue<LightNode> remove[2];
+
+        bool Empty() const
+        {
+            return add[0].empty() && add[1].empty() && remove[0].empty() && remove[1].empty();
+        }
+    };
+
+private:
+    void process(uint32_t maxSteps, EditStats& stats);
+    void stitch(Chunk* chunk);
+
+    WorldMap* world;
+    LightQueues queues;
+    std::mutex stitchMutex;
+    std::vector<Chunk*> pendingStitches;
+    EditStats lastEdit;
+};
@@ -0,0 +1,635 @@
+﻿#include "RegionEdit.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <unordered_set>
+
+#include "EngineTuning.h"
+#include "SystemTime.h"
+#include "WorldMap.h"
+using namespace BlockResourceManager;
+
+NumVar PerBlockRelightLimit("World/Edit/Per Block Relight Limit", 4096, 0, 1048576, 1024);
+BoolVar LogRegionEdits("World/Edit/Log Region Edits", false);
+
+namespace
+{
+    constexpr int kRowBits = WorldGenerator::CHUNK_WIDTH;
+    // a neighbour row as seen from a chunk: bit 0 is x = -1, bits 1..kRowBits the chunk's own x, then x = kRowBits
+    constexpr uint32_t kFullRow = (1u << (kRowBits + 2)) - 1;
+    // the chunk's own x bits once the neighbour row is shifted back by one
+    constexpr uint32_t kOwnRow = (1u << kRowBits) - 1;
+
+    int floorDiv(int value, int divisor)
+    {
+        return value >= 0 ? value / divisor : (value + 1) / divisor - 1;
+    }
+
+    // the edits of a chunk and its 8 neighbours, rows outside them read as unchanged
+    struct EditNeighbourhood
+    {
+        const RegionEditor::ChunkEdit* edits[3][3]{};
+
+        uint32_t Row(int y, int z) const
+        {
+            int dy = y < 0 ? -1 : (y >= kRowBits ? 1 : 0);
+            int ly = y - dy * kRowBits;
+            uint32_t row = 0;
+            if (const auto* left = edits[0][dy + 1])
+            {
+                row |= (left->changed[z][ly] >> (kRowBits - 1)) & 1u;
+            }
+            if (const auto* middle = edits[1][dy + 1])
+            {
+                row |= uint32_t(middle->changed[z][ly]) << 1;
+            }
+            if (const auto* right = edits[2][dy + 1])
+            {
+                row |= (right->changed[z][ly] & 1u) << (kRowBits + 1);
+            }
+            return row;
+        }
+    };
+
+    void decodeOffset(const Chunk* chunk, int offset, int& x, int& y, int& z)
+    {
+        x = offset % chunk->chunkSize;
+        y = offset / chunk->chunkSize % chunk->chunkSize;
+        z = offset / (chunk->chunkSize * chunk->chunkSize);
+    }
+
+    // one block written by a chunk task, the first write of a block remembers what was there before the edit
+    void writeBlock(RegionEditor::ChunkEdit& edit, int x, int y, int z, BlockType type, uint8_t fluidLevel)
+    {
+        Chunk* chunk = edit.chunk;
+        Block& block = chunk->blocks[x][y][z];
+        if (type == block.blockType && fluidLevel == block.fluidLevel)
+        {
+            return;
+        }
+        int offset = chunk->GetBlockOffsetOnHeap(x, y, z);
+        uint16_t bit = uint16_t(1u << x);
+        if ((edit.changed[z][y] & bit) == 0)
+        {
+            edit.previous.push_back({uint16_t(offset), block.blockType, block.fluidLevel});
+            edit.changed[z][y] |= bit;
+        }
+        if (BlockLightEmission[type] > 0)
+        {
+            chunk->emissiveBlocks.insert(offset);
+        }
+        else if (BlockLightEmission[block.blockType] > 0)
+        {
+            chunk->emissiveBlocks.erase(offset);
+        }
+        block.blockType = type;
+        block.transparent = isTransparentBlock(type);
+        block.fluidLevel = fluidLevel;
+    }
+}
+
+RegionEditor::RegionEditor(WorldMap* world, int threadCount)
+    : world(world)
+{
+    thread_pool = new ThreadPool(threadCount);
+}
+
+RegionEditor::~RegionEditor()
+{
+    delete thread_pool;
+}
+
+void RegionEditor::Fill(const CellBox& box, BlockType type)
+{
+    apply(box, [type](const int*, BlockType& current, uint8_t& fluidLevel)
+    {
+        current = type;
+        fluidLevel = 0;
+        return true;
+    });
+}
+
+void RegionEditor::Replace(const CellBox& box, BlockType from, BlockType to)
+{
+    apply(box, [from, to](const int*, BlockType& current, uint8_t& fluidLevel)
+    {
+        if (current != from)
+        {
+            return false;
+        }
+        current = to;
+        fluidLevel = 0;
+        return true;
+    });
+}
+
+void RegionEditor::Copy(const CellBox& box, BlockClipboard& clipboard)
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        clipboard.size[axis] = std::max(0, box.Size(axis));
+    }
+    size_t count = size_t(clipboard.size[0]) * clipboard.size[1] * clipboard.size[2];
+    clipboard.types.assign(count, Air);
+    clipboard.fluidLevels.assign(count, 0);
+    if (count == 0)
+    {
+        return;
+    }
+
+    int size = world->GetChunkSize();
+    int minZ = std::max(box.min[1], 0);
+    int maxZ = std::min(box.max[1], WorldGenerator::WORLD_DEPTH - 1);
+    threadResultVector.clear();
+    for (int cx = floorDiv(box.min[0], size); cx <= floorDiv(box.max[0], size); cx++)
+    {
+        for (int cy = floorDiv(box.min[2], size); cy <= floorDiv(box.max[2], size); cy++)
+        {
+            if (!world->hasBlock(cx, cy))
+            {
+                continue;
+            }
+            Chunk* chunk = world->getWorldBlockRef(cx, cy);
+            // every task fills the clipboard cells of its own chunk only
+            threadResultVector.emplace_back(thread_pool->enqueue([=, &box, &clipboard]
+            {
+                int baseX = cx * size;
+                int baseY = cy * size;
+                int x0 = std::max(box.min[0] - baseX, 0);
+                int x1 = std::min(box.max[0] - baseX, size - 1);
+                int y0 = std::max(box.min[2] - baseY, 0);
+                int y1 = std::min(box.max[2] - baseY, size - 1);
+                for (int x = x0; x <= x1; x++)
+                {
+                    for (int y = y0; y <= y1; y++)
+                    {
+                        for (int z = minZ; z <= maxZ; z++)
+                        {
+                            const Block& block = chunk->blocks[x][y][z];
+                            size_t index = clipboard.Index(baseX + x - box.min[0], z - box.min[1],
+                                                           baseY + y - box.min[2]);
+                            clipboard.types[index] = block.blockType;
+                            clipboard.fluidLevels[index] = block.fluidLevel;
+                        }
+                    }
+                }
+            }));
+        }
+    }
+    waitThreadsWorkDone();
+}
+
+void RegionEditor::Paste(const BlockClipboard& clipboard, const int origin[3], int quarterTurns, bool pasteAir)
+{
+    int turns = ((quarterTurns % 4) + 4) % 4;
+    int sizeX = clipboard.size[0];
+    int sizeZ = clipboard.size[2];
+    if (sizeX == 0 || clipboard.size[1] == 0 || sizeZ == 0)
+    {
+        return;
+    }
+    bool swapped = turns % 2 == 1;
+    CellBox box;
+    box.min[0] = origin[0];
+    box.min[1] = origin[1];
+    box.min[2] = origin[2];
+    box.max[0] = origin[0] + (swapped ? sizeZ : sizeX) - 1;
+    box.max[1] = origin[1] + clipboard.size[1] - 1;
+    box.max[2] = origin[2] + (swapped ? sizeX : sizeZ) - 1;
+
+    apply(box, [&](const int* cell, BlockType& current, uint8_t& fluidLevel)
+    {
+        // maps the pasted cell back into the clipboard, undoing the turns around the up axis
+        int dx = cell[0] - origin[0];
+        int dz = cell[2] - origin[2];
+        int sx = dx;
+        int sz = dz;
+        switch (turns)
+        {
+        case 1: sx = dz; sz = sizeZ - 1 - dx; break;
+        case 2: sx = sizeX - 1 - dx; sz = sizeZ - 1 - dz; break;
+        case 3: sx = sizeX - 1 - dz; sz = dx; break;
+        default: break;
+        }
+        size_t index = clipboard.Index(sx, cell[1] - origin[1], sz);
+        if (!pasteAir && clipboard.types[index] == Air)
+        {
+            return false;
+        }
+        current = clipboard.types[index];
+        fluidLevel = clipboard.fluidLevels[index];
+        return true;
+    });
+}
+
+template <typename Writer>
+void RegionEditor::apply(const CellBox& box, const Writer& writer)
+{
+    int64_t start = SystemTime::GetCurrentTick();
+    int size = world->GetChunkSize();
+    int minZ = std::max(box.min[1], 0);
+    int maxZ = std::min(box.max[1], WorldGenerator::WORLD_DEPTH - 1);
+    if (minZ > maxZ || box.min[0] > box.max[0] || box.min[2] > box.max[2])
+    {
+        return;
+    }
+
+    // the chunks one cell around the box are included, their blocks next to the box need fresh AO
+    std::vector<ChunkEdit> edits;
+    for (int cx = floorDiv(box.min[0] - 1, size); cx <= floorDiv(box.max[0] + 1, size); cx++)
+    {
+        for (int cy = floorDiv(box.min[2] - 1, size); cy <= floorDiv(box.max[2] + 1, size); cy++)
+        {
+            if (world->hasBlock(cx, cy))
+            {
+                edits.emplace_back();
+                edits.back().chunk = world->getWorldBlockRef(cx, cy);
+            }
+        }
+    }
+
+    // each task writes the blocks of one chunk straight into its storage
+    threadResultVector.clear();
+    for (ChunkEdit& edit : edits)
+    {
+        threadResultVector.emplace_back(thread_pool->enqueue([&, size, minZ, maxZ]
+        {
+            Chunk* chunk = edit.chunk;
+            int baseX = chunk->posX * size;
+            int baseY = chunk->posY * size;
+            int x0 = std::max(box.min[0] - baseX, 0);
+            int x1 = std::min(box.max[0] - baseX, size - 1);
+            int y0 = std::max(box.min[2] - baseY, 0);
+            int y1 = std::min(box.max[2] - baseY, size - 1);
+            for (int x = x0; x <= x1; x++)
+            {
+                for (int y = y0; y <= y1; y++)
+                {
+                    for (int z = minZ; z <= maxZ; z++)
+                    {
+                        const Block& block = chunk->blocks[x][y][z];
+                        const int cell[3] = {baseX + x, z, baseY + y};
+                        BlockType type = block.blockType;
+                        uint8_t fluidLevel = block.fluidLevel;
+                        if (writer(cell, type, fluidLevel))
+                        {
+                            writeBlock(edit, x, y, z, type, fluidLevel);
+                        }
+                    }
+                }
+            }
+        }));
+    }
+    waitThreadsWorkDone();
+
+    invalidate(edits);
+    finish(edits, start);
+}
+
+void RegionEditor::Write(const std::vector<BlockWrite>& writes)
+{
+    int64_t start = SystemTime::GetCurrentTick();
+    if (writes.empty())
+    {
+        return;
+    }
+
+    // the written chunks and their neighbours, whose blocks along the shared border need fresh AO
+    std::vector<ChunkEdit> edits;
+    std::unordered_map<Chunk*, size_t> editIndex;
+    std::vector<std::vector<const BlockWrite*>> writesOfEdit;
+    auto addChunk = [&](Chunk* chunk)
+    {
+        auto it = editIndex.find(chunk);
+        if (it != editIndex.end())
+        {
+            return it->second;
+        }
+        editIndex.emplace(chunk, edits.size());
+        edits.emplace_back();
+        edits.back().chunk = chunk;
+        writesOfEdit.emplace_back();
+        return edits.size() - 1;
+    };
+    for (const BlockWrite& write : writes)
+    {
+        writesOfEdit[addChunk(write.chunk)].push_back(&write);
+    }
+    size_t written = edits.size();
+    for (size_t i = 0; i < written; i++)
+    {
+        Chunk* chunk = edits[i].chunk;
+        for (int dx = -1; dx <= 1; dx++)
+        {
+            for (int dy = -1; dy <= 1; dy++)
+            {
+                int x = dx < 0 ? -1 : dx * chunk->chunkSize;
+                int y = dy < 0 ? -1 : dy * chunk->chunkSize;
+                if (Chunk* neighbour = chunk->GetChunkAcross(x, y))
+                {
+                    addChunk(neighbour);
+                }
+            }
+        }
+    }
+
+    threadResultVector.clear();
+    for (size_t i = 0; i < written; i++)
+    {
+        threadResultVector.emplace_back(thread_pool->enqueue([&edits, &writesOfEdit, i]
+        {
+            ChunkEdit& edit = edits[i];
+            for (const BlockWrite* write : writesOfEdit[i])
+            {
+                int x, y, z;
+                decodeOffset(edit.chunk, write->offset, x, y, z);
+                writeBlock(edit, x, y, z, write->type, write->fluidLevel);
+            }
+        }));
+    }
+    waitThreadsWorkDone();
+
+    invalidate(edits);
+    finish(edits, start);
+}
+
+// every chunk fixes up its own blocks once, reading its neighbours' changed rows
+void RegionEditor::invalidate(std::vector<ChunkEdit>& edits)
+{
+    std::unordered_map<Chunk*, ChunkEdit*> editOfChunk;
+    for (ChunkEdit& edit : edits)
+    {
+        editOfChunk.emplace(edit.chunk, &edit);
+    }
+    threadResultVector.clear();
+    for (ChunkEdit& edit : edits)
+    {
+        threadResultVector.emplace_back(thread_pool->enqueue([this, &edit, &editOfChunk]
+        {
+            invalidateChunk(edit, editOfChunk);
+        }));
+    }
+    waitThreadsWorkDone();
+}
+
+void RegionEditor::invalidateChunk(ChunkEdit& edit, const std::unordered_map<Chunk*, ChunkEdit*>& edits)
+{
+    Chunk* chunk = edit.chunk;
+    int size = chunk->chunkSize;
+    EditNeighbourhood neighbourhood;
+    for (int dx = -1; dx <= 1; dx++)
+    {
+        for (int dy = -1; dy <= 1; dy++)
+        {
+            int x = dx < 0 ? -1 : dx * size;
+            int y = dy < 0 ? -1 : dy * size;
+            Chunk* neighbour = chunk->GetChunkAcross(x, y);
+            auto it = neighbour == nullptr ? edits.end() : edits.find(neighbour);
+            neighbourhood.edits[dx + 1][dy + 1] = it == edits.end() ? nullptr : it->second;
+        }
+    }
+
+    // same exposure rule as WorldMap::SetBlock, applied to the changed blocks of this chunk
+    for (const auto& change : edit.previous)
+    {
+        int x, y, z;
+        decodeOffset(chunk, change.offset, x, y, z);
+        Block& block = chunk->blocks[x][y][z];
+        if (!block.IsNull())
+        {
+            block.adjacent2Air = true;
+            continue;
+        }
+        block.adjacent2Air = false;
+        // the siblings inside this chunk, like Chunk::getSiblingBlocks without building a vector per block
+        static const int offsets[6][3] = {{1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}};
+        for (const auto& offset : offsets)
+        {
+            int sx = x + offset[0];
+            int sy = y + offset[1];
+            int sz = z + offset[2];
+            if (chunk->CheckOutOfRange(sx, sy, sz))
+            {
+                continue;
+            }
+            Block& sibling = chunk->blocks[sx][sy][sz];
+            if (!sibling.IsNull())
+            {
+                sibling.adjacent2Air = true;
+            }
+        }
+    }
+
+    int depth = chunk->chunkDepth;
+    for (int z = 0; z < depth; z++)
+    {
+        for (int y = 0; y < size; y++)
+        {
+            // AO of every block within one cell of a changed block, as InvalidateAOAround does per block
+            uint32_t grown = 0;
+            for (int dz = std::max(z - 1, 0); dz <= std::min(z + 1, depth - 1); dz++)
+            {
+                for (int dy = y - 1; dy <= y + 1; dy++)
+                {
+                    uint32_t row = neighbourhood.Row(dy, dz);
+                    grown |= row | (row << 1) | (row >> 1);
+                }
+            }
+            uint32_t dirty = (grown >> 1) & kOwnRow;
+            if (dirty == 0)
+            {
+                continue;
+            }
+            edit.sectionMask |= 1u << (z / WorldGenerator::SECTION_HEIGHT);
+            for (int x = 0; x < size; x++)
+            {
+                if (dirty & (1u << x))
+                {
+                    Block& block = chunk->blocks[x][y][z];
+                    block.aoDirty = true;
+                    block.hasCheckSibling = false;
+                }
+            }
+
+            // changed blocks with all six neighbours changed too are inside the edit and need no notification
+            uint32_t row = neighbourhood.Row(y, z);
+            if (edit.changed[z][y] == 0)
+            {
+                continue;
+            }
+            uint32_t below = z > 0 ? neighbourhood.Row(y, z - 1) : kFullRow;
+            uint32_t above = z < depth - 1 ? neighbourhood.Row(y, z + 1) : kFullRow;
+            uint32_t inner = row & (row << 1) & (row >> 1) & neighbourhood.Row(y - 1, z) & neighbourhood.Row(y + 1, z)
+                & below & above;
+            uint32_t surface = (row & ~inner) >> 1 & kOwnRow;
+            for (int x = 0; x < size; x++)
+            {
+                if (surface & (1u << x))
+                {
+                    edit.surface.push_back(uint16_t(chunk->GetBlockOffsetOnHeap(x, y, z)));
+                }
+            }
+        }
+    }
+
+    if (edit.sectionMask != 0)
+    {
+        chunk->dirtySections.fetch_or(edit.sectionMask);
+        chunk->instancesDirty = true;
+    }
+}
+
+// light, block ticks and fluids run on the main thread like every other world change
+void RegionEditor::finish(std::vector<ChunkEdit>& edits, int64_t start)
+{
+    lastEdit = EditStats{};
+    std::vector<Chunk*> changedChunks;
+    for (const ChunkEdit& edit : edits)
+    {
+        if (!edit.previous.empty())
+        {
+            changedChunks.push_back(edit.chunk);
+            lastEdit.blocksChanged += static_cast<uint32_t>(edit.previous.size());
+        }
+    }
+    lastEdit.chunks = static_cast<uint32_t>(changedChunks.size());
+
+    // one user edit in the journal, unless the edit is itself an undo or redo being replayed
+    EditJournal& journal = world->GetJournal();
+    journal.Begin(EditJournal::UserEdit);
+    for (const ChunkEdit& edit : edits)
+    {
+        for (const auto& change : edit.previous)
+        {
+            int x, y, z;
+            decodeOffset(edit.chunk, change.offset, x, y, z);
+            const Block& block = edit.chunk->blocks[x][y][z];
+            journal.Record(edit.chunk, change.offset, change.type, change.fluidLevel, block.blockType,
+                           block.fluidLevel);
+        }
+    }
+    journal.Commit();
+
+    LightEngine& lighting = world->GetLighting();
+    if (lastEdit.blocksChanged <= static_cast<uint32_t>((int)PerBlockRelightLimit))
+    {
+        for (const ChunkEdit& edit : edits)
+        {
+            for (const auto& change : edit.previous)
+            {
+                BlockCoord coord;
+                coord.chunk = edit.chunk;
+                decodeOffset(edit.chunk, change.offset, coord.x, coord.y, coord.z);
+                lighting.OnBlockChanged(coord, change.type);
+            }
+        }
+    }
+    else
+    {
+        // light spreads at most 15 cells, so only the changed chunks and their direct neighbours can change
+        lastEdit.relitChunks = true;
+        std::unordered_set<Chunk*> relitSet;
+        for (Chunk* chunk : changedChunks)
+        {
+            for (int dx = -1; dx <= 1; dx++)
+            {
+                for (int dy = -1; dy <= 1; dy++)
+                {
+                    int x = dx < 0 ? -1 : dx * chunk->chunkSize;
+                    int y = dy < 0 ? -1 : dy * chunk->chunkSize;
+                    if (Chunk* neighbour = chunk->GetChunkAcross(x, y))
+                    {
+                        relitSet.insert(neighbour);
+                    }
+                }
+            }
+        }
+        std::vector<Chunk*> relit(relitSet.begin(), relitSet.end());
+        threadResultVector.clear();
+        for (Chunk* chunk : relit)
+        {
+            threadResultVector.emplace_back(thread_pool->enqueue([chunk]
+            {
+                chunk->light.Reset();
+                LightEngine::LightChunk(chunk);
+                chunk->dirtySections = (1u << WorldGenerator::SECTION_COUNT) - 1;
+                chunk->instancesDirty = true;
+            }));
+        }
+        waitThreadsWorkDone();
+        for (Chunk* chunk : relit)
+        {
+            lighting.QueueBorderStitch(chunk);
+        }
+    }
+
+    BlockTickScheduler& blockTicks = world->GetBlockTicks();
+    FluidSimulation& fluids = world->GetFluids();
+    for (const ChunkEdit& edit : edits)
+    {
+        for (uint16_t offset : edit.surface)
+        {
+            BlockCoord coord;
+            coord.chunk = edit.chunk;
+            decodeOffset(edit.chunk, offset, coord.x, coord.y, coord.z);
+            blockTicks.NotifyChanged(coord);
+            fluids.NotifyChanged(coord);
+        }
+        lastEdit.notified += static_cast<uint32_t>(edit.surface.size());
+    }
+
+    lastEdit.milliseconds = SystemTime::TimeBetweenTicks(start, SystemTime::GetCurrentTick()) * 1000.0;
+    if (LogRegionEdits)
+    {
+        std::cout << "region edit: " << lastEdit.blocksChanged << " blocks in " << lastEdit.chunks << " chunks, "
+            << lastEdit.notified << " notified, " << (lastEdit.relitChunks ? "chunks relit, " : "")
+            << lastEdit.milliseconds << "ms" << std::endl;
+    }
+}
+
+void RegionEditor::RunBenchmark(const Math::Vector3& center, int halfSize)
+{
+    float cellSize[3];
+    float gridOrigin[3];
+    world->getCellGrid(cellSize, gridOrigin);
+    const float position[3] = {center.GetX(), center.GetY(), center.GetZ()};
+    CellBox box;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        int cell = (int)std::floor((position[axis] - gridOrigin[axis]) / cellSize[axis]);
+        box.min[axis] = cell - halfSize;
+        box.max[axis] = cell + halfSize - 1;
+    }
+    box.min[1] = std::max(box.min[1], 0);
+    box.max[1] = std::min(box.max[1], WorldGenerator::WORLD_DEPTH - 1);
+
+    auto timed = [this](const char* name, auto&& operation)
+    {
+        int64_t start = SystemTime::GetCurrentTick();
+        operation();
+        double milliseconds = SystemTime::TimeBetweenTicks(start, SystemTime::GetCurrentTick()) * 1000.0;
+        std::cout << "region edit benchmark " << name << ": " << milliseconds << "ms";
+        if (lastEdit.blocksChanged > 0)
+        {
+            std::cout << ", " << lastEdit.blocksChanged << " blocks in " << lastEdit.chunks << " chunks";
+        }
+        std::cout << std::endl;
+        lastEdit = EditStats{};
+    };
+
+    // the copy is pasted back at the end, so the benchmark leaves the world as it found it
+    BlockClipboard clipboard;
+    timed("copy", [&] { Copy(box, clipboard); });
+    timed("fill", [&] { Fill(box, Stone); });
+    timed("replace", [&] { Replace(box, Stone, Air); });
+    timed("paste", [&] { Paste(clipboard, box.min, 0, true); });
+}
+
+void RegionEditor::waitThreadsWorkDone()
+{
+    for (auto&& result : threadResultVector)
+    {
+        result.wait();
+    }
+}
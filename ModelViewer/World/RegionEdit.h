@@ -0,0 +1,125 @@
+﻿/**
+ * 区域批量编辑：填充、替换、复制到剪贴板、旋转粘贴
+ * 1. 按受影响的 chunk 拆分任务，在线程池中并行、直接写入 chunk 存储，不逐块调用 WorldMap::SetBlock
+ * 2. 每个 chunk 用按行的位图 (每行 CHUNK_WIDTH 位，对应 x) 记录改变的格子，写完后每个 chunk 只失效一次：
+ *    AO 与可见性标记作用于改变的格子及其 26 邻域 (位运算膨胀)，dirtySections 一次性标记
+ * 3. 光照：改变的方块较少时逐块交给 LightEngine::OnBlockChanged；较多时重算受影响的 chunk 及相邻 chunk 的光照，
+ *    再排队拼接边界 (光最多传播 15 格，不会越过一个 chunk)
+ * 4. 方块 tick 和水流只通知位于编辑区域表面的改变格子，内部格子的邻居都在同一次编辑中改变
+ * 5. 每次编辑作为一个玩家编辑事务写入 EditJournal；Write 按单个格子写入，供撤销 / 重做回放
+ * 坐标为 WorldMap::getCellGrid 的世界格子坐标：X, Y (向上), Z，盒子包含两端
+ */
+#pragma once
+#include <cstdint>
+#include <future>
+#include <unordered_map>
+#include <vector>
+
+#include "ThreadPool.h"
+#include "VoxelRaycast.h"
+
+class WorldMap;
+
+struct CellBox
+{
+    int min[3];
+    int max[3];
+
+    int Size(int axis) const
+    {
+        return max[axis] - min[axis] + 1;
+    }
+};
+
+// blocks copied by RegionEditor::Copy, indexed [(y * sizeZ + z) * sizeX + x] relative to the copied box's min corner
+struct BlockClipboard
+{
+    int size[3] = {0, 0, 0};
+    std::vector<BlockResourceManager::BlockType> types;
+    std::vector<uint8_t> fluidLevels;
+
+    size_t Index(int x, int y, int z) const
+    {
+        return (size_t(y) * size[2] + z) * size[0] + x;
+    }
+};
+
+class RegionEditor
+{
+public:
+    struct EditStats
+    {
+        uint32_t chunks = 0;
+        uint32_t blocksChanged = 0;
+        // surface blocks handed to block ticks and fluids
+        uint32_t notified = 0;
+        // whole chunks were relit instead of per block light updates
+        bool relitChunks = false;
+        double milliseconds = 0.0;
+    };
+
+    RegionEditor(WorldMap* world, int threadCount);
+    ~RegionEditor();
+
+    void Fill(const CellBox& box, BlockResourceManager::BlockType type);
+    void Replace(const CellBox& box, BlockResourceManager::BlockType from, BlockResourceManager::BlockType to);
+    // cells of chunks that are not loaded are copied as air
+    void Copy(const CellBox& box, BlockClipboard& clipboard);
+    // the clipboard turned quarterTurns times 90 degrees around the up axis, its min corner at origin;
+    // air in the clipboard leaves the world untouched unless pasteAir is set
+    void Paste(const BlockClipboard& clipboard, const int origin[3], int quarterTurns, bool pasteAir);
+
+    struct BlockWrite
+    {
+        Chunk* chunk;
+        // GetBlockOffsetOnHeap
+        uint16_t offset;
+        BlockResourceManager::BlockType type;
+        uint8_t fluidLevel;
+    };
+    // scattered blocks with the same batched invalidation as the box edits, a block written twice keeps the last write
+    void Write(const std::vector<BlockWrite>& writes);
+
+    // copies a box around center, fills it, replaces the fill and pastes the copy back, printing the timings
+    void RunBenchmark(const Math::Vector3& center, int halfSize);
+
+    const EditStats& GetLastEditStats() const
+    {
+        return lastEdit;
+    }
+
+    // a changed block as it was before the edit
+    struct PreviousBlock
+    {
+        // GetBlockOffsetOnHeap
+        uint16_t offset;
+        BlockResourceManager::BlockType type;
+        uint8_t fluidLevel;
+    };
+
+    // the blocks one chunk task changed, rows of CHUNK_WIDTH x bits indexed [z][y]
+    struct ChunkEdit
+    {
+        static_assert(WorldGenerator::CHUNK_WIDTH <= 16, "a row of x bits has to fit in uint16_t");
+        Chunk* chunk = nullptr;
+        uint16_t changed[WorldGenerator::WORLD_DEPTH][WorldGenerator::CHUNK_WIDTH]{};
+        // every changed block once, in write order
+        std::vector<PreviousBlock> previous;
+        // changed blocks next to a block the edit left alone
+        std::vector<uint16_t> surface;
+        uint32_t sectionMask = 0;
+    };
+
+private:
+    template <typename Writer>
+    void apply(const CellBox& box, const Writer& writer);
+    void invalidate(std::vector<ChunkEdit>& edits);
+    void invalidateChunk(ChunkEdit& edit, const std::unordered_map<Chunk*, ChunkEdit*>& edits);
+    void finish(std::vector<ChunkEdit>& edits, int64_t start);
+    void waitThreadsWorkDone();
+
+    WorldMap* world;
+    ThreadPool* thread_pool;
+    std::vector<std::future<void>> threadResultVector{};
+    EditStats lastEdit;
+};
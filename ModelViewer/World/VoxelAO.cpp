@@ -0,0 +1,68 @@
+﻿#include "VoxelAO.h"
+
+namespace VoxelAO
+{
+    uint8_t BlockAO::GetCorner(int face, int corner) const
+    {
+        int bit = face * 8 + corner * 2;
+        return (Bits[bit / 32] >> (bit % 32)) & 0x3;
+    }
+
+    void BlockAO::SetCorner(int face, int corner, uint8_t ao)
+    {
+        int bit = face * 8 + corner * 2;
+        uint32_t& word = Bits[bit / 32];
+        word = (word & ~(0x3u << (bit % 32))) | (uint32_t(ao & 0x3) << (bit % 32));
+    }
+
+    bool BlockAO::IsFlipped(int face) const
+    {
+        return (Bits[1] >> (16 + face)) & 0x1;
+    }
+
+    void BlockAO::SetFlipped(int face, bool flipped)
+    {
+        Bits[1] = (Bits[1] & ~(0x1u << (16 + face))) | (uint32_t(flipped) << (16 + face));
+    }
+
+    void ComputeFaceAO(int face, OccluderQuery query, const void* context, uint8_t ao[CORNER_COUNT])
+    {
+        int axis = face / 2;
+        int sign = (face % 2 == 0) ? 1 : -1;
+        int uAxis = (axis + 1) % 3;
+        int vAxis = (axis + 2) % 3;
+
+        for (int corner = 0; corner < CORNER_COUNT; corner++)
+        {
+            int su = (corner & 0x1) ? 1 : -1;
+            int sv = (corner & 0x2) ? 1 : -1;
+
+            int side1[3] = {0, 0, 0};
+            int side2[3] = {0, 0, 0};
+            int diagonal[3] = {0, 0, 0};
+            side1[axis] = side2[axis] = diagonal[axis] = sign;
+            side1[uAxis] = diagonal[uAxis] = su;
+            side2[vAxis] = diagonal[vAxis] = sv;
+
+            ao[corner] = VertexAO(query(context, side1[0], side1[1], side1[2]),
+                                  query(context, side2[0], side2[1], side2[2]),
+                                  query(context, diagonal[0], diagonal[1], diagonal[2]));
+        }
+    }
+
+    BlockAO ComputeBlockAO(OccluderQuery query, const void* context)
+    {
+        BlockAO result;
+        for (int face = 0; face < FACE_COUNT; face++)
+        {
+            uint8_t ao[CORNER_COUNT];
+            ComputeFaceAO(face, query, context, ao);
+            for (int corner = 0; corner < CORNER_COUNT; corner++)
+            {
+                result.SetCorner(face, corner, ao[corner]);
+            }
+            result.SetFlipped(face, ShouldFlipQuad(ao));
+        }
+        return result;
+    }
+}
@@ -0,0 +1,53 @@
+﻿#pragma once
+#include <cstdint>
+
+/**
+ * 体素逐顶点环境光遮蔽 (per-vertex voxel ambient occlusion)
+ * 每个面的每个角只需要看与之相邻的 3 个方块：两个侧边方块和一个对角方块，
+ * 结果为 2bit (0 完全遮蔽 ~ 3 无遮蔽)，在生成实例数据时计算并缓存。
+ *
+ * 面与角的编号都在世界空间(Y 轴向上)下定义，与 DefaultVS.hlsl 中的解码保持一致：
+ *   face:   0:+X 1:-X 2:+Y 3:-Y 4:+Z 5:-Z
+ *   axis:   法线轴 a = face/2, 切线轴 u = (a+1)%3, v = (a+2)%3
+ *   corner: bit0 = 位于 u 正方向, bit1 = 位于 v 正方向
+ */
+namespace VoxelAO
+{
+    constexpr int FACE_COUNT = 6;
+    constexpr int CORNER_COUNT = 4;
+    constexpr uint8_t AO_NONE = 3;
+
+    // returns whether the cell at world-space offset (dx, dy, dz) from the block occludes light.
+    typedef bool (*OccluderQuery)(const void* context, int dx, int dy, int dz);
+
+    struct BlockAO
+    {
+        // faces 0..3 in Bits[0], faces 4..5 in the low 16 bits of Bits[1],
+        // one quad-flip bit per face starting at bit 16 of Bits[1].
+        uint32_t Bits[2] = {0xFFFFFFFF, 0x0000FFFF};
+
+        uint8_t GetCorner(int face, int corner) const;
+        void SetCorner(int face, int corner, uint8_t ao);
+        bool IsFlipped(int face) const;
+        void SetFlipped(int face, bool flipped);
+    };
+
+    // classic 3-neighbour corner term: both sides occluding fully darkens the corner.
+    inline uint8_t VertexAO(bool side1, bool side2, bool corner)
+    {
+        if (side1 && side2)
+        {
+            return 0;
+        }
+        return AO_NONE - (uint8_t(side1) + uint8_t(side2) + uint8_t(corner));
+    }
+
+    // split the quad along the diagonal whose corners differ less, avoiding anisotropic AO interpolation.
+    inline bool ShouldFlipQuad(const uint8_t ao[CORNER_COUNT])
+    {
+        return ao[0] + ao[3] > ao[1] + ao[2];
+    }
+
+    void ComputeFaceAO(int face, OccluderQuery query, const void* context, uint8_t ao[CORNER_COUNT]);
+    BlockAO ComputeBlockAO(OccluderQuery query, const void* context);
+}
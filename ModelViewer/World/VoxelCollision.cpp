@@ -0,0 +1,65 @@
+﻿#include "VoxelCollision.h"
+
+#include <algorithm>
+
+#include "WorldMap.h"
+
+namespace
+{
+    struct WorldQuery
+    {
+        WorldMap* world;
+        Chunk* lastChunk;
+    };
+
+    bool IsSolidCell(void* context, int x, int y, int z)
+    {
+        WorldQuery* query = static_cast<WorldQuery*>(context);
+        BlockCoord coord = query->world->getBlockAtCell(x, y, z, query->lastChunk);
+        return coord.IsValid() && BlockResourceManager::isSolidBlock(coord.GetBlock().blockType);
+    }
+}
+
+VoxelCollision::SweepResult VoxelCollision::SweepBox(WorldMap& world, const Math::AxisAlignedBox& box,
+                                                     const Math::Vector3& motion, float stepHeight)
+{
+    float cellSize[3];
+    float gridOrigin[3];
+    world.getCellGrid(cellSize, gridOrigin);
+
+    const Math::Vector3 boxMin = box.GetMin();
+    const Math::Vector3 boxMax = box.GetMax();
+    const float worldMin[3] = {boxMin.GetX(), boxMin.GetY(), boxMin.GetZ()};
+    const float worldMax[3] = {boxMax.GetX(), boxMax.GetY(), boxMax.GetZ()};
+    const float worldMotion[3] = {motion.GetX(), motion.GetY(), motion.GetZ()};
+
+    CellBox start;
+    float delta[3];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        start.min[axis] = (worldMin[axis] - gridOrigin[axis]) / cellSize[axis];
+        start.max[axis] = (worldMax[axis] - gridOrigin[axis]) / cellSize[axis];
+        delta[axis] = worldMotion[axis] / cellSize[axis];
+    }
+
+    WorldQuery query{&world, nullptr};
+    CellSweepResult cells = SweepCells(IsSolidCell, &query, start, delta, stepHeight / cellSize[1]);
+
+    SweepResult result;
+    result.moved = Math::Vector3(cells.moved[0] * cellSize[0], cells.moved[1] * cellSize[1],
+                                 cells.moved[2] * cellSize[2]);
+    std::copy(cells.blocked, cells.blocked + 3, result.blocked);
+    result.onGround = cells.onGround;
+    result.steppedUp = cells.steppedUp;
+    return result;
+}
+
+Math::Vector3 VoxelCollision::MoveEye(WorldMap& world, const CameraBody& body, const Math::Vector3& from,
+                                      const Math::Vector3& to, float stepHeight)
+{
+    Math::Vector3 feet = from - Math::Vector3(0.0f, body.eyeHeight, 0.0f);
+    Math::AxisAlignedBox box(feet - Math::Vector3(body.halfWidth, 0.0f, body.halfWidth),
+                             feet + Math::Vector3(body.halfWidth, body.height, body.halfWidth));
+    SweepResult result = SweepBox(world, box, to - from, stepHeight);
+    return from + result.moved;
+}
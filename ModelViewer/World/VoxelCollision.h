@@ -0,0 +1,45 @@
+﻿/**
+ * 体素碰撞：AABB 按 Y、X、Z 逐轴在方块网格中扫掠
+ * 1. 每一轴只检查扫掠体前沿新覆盖到的格子，开销与扫掠经过的格子数成正比，与 chunk 数量无关
+ * 2. 方块是否阻挡由 BlockResourceManager::BlockSolid 决定，格子空间的扫掠本身在 VoxelSweep.h 中，不依赖 WorldMap
+ * 3. 支持台阶自动抬升 (step-up) 与落地检测
+ * 查询只读取世界数据、不持有共享状态，可以在多个线程中同时为不同实体调用
+ */
+#pragma once
+#include "Math/BoundingBox.h"
+#include "Math/Vector.h"
+#include "VoxelSweep.h"
+
+class WorldMap;
+
+namespace VoxelCollision
+{
+    struct SweepResult
+    {
+        // displacement actually applied to the box
+        Math::Vector3 moved{Math::kZero};
+        // per world axis, whether the motion along it was cut short
+        bool blocked[3] = {};
+        // the box rests on a solid block after the move
+        bool onGround = false;
+        // the horizontal motion only got through by lifting the box onto a ledge
+        bool steppedUp = false;
+    };
+
+    // sweeps a world space box by motion; with stepHeight > 0 blocked horizontal motion may climb
+    // ledges up to that height, callers pass 0 for airborne bodies that should not step.
+    SweepResult SweepBox(WorldMap& world, const Math::AxisAlignedBox& box, const Math::Vector3& motion,
+                         float stepHeight = 0.0f);
+
+    // collision volume around a camera, in world units relative to the eye
+    struct CameraBody
+    {
+        float halfWidth;
+        float height;
+        float eyeHeight;
+    };
+
+    // moves the eye from one position towards another without entering solid blocks
+    Math::Vector3 MoveEye(WorldMap& world, const CameraBody& body, const Math::Vector3& from,
+                          const Math::Vector3& to, float stepHeight);
+}
@@ -0,0 +1,119 @@
+﻿/**
+ * 体素光照存储
+ * 每个格子两个 4bit 通道：天空光 (高 4 位) 和方块光 (低 4 位)，打包为 1 字节，按 16 格高的 section 分块存放；
+ * 整个 section 取值相同时 (例如地表以上全亮的空气) 只记录一个字节，不分配格子数组。
+ * 传播由 LightEngine 负责，这里只做存取。
+ */
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "WorldGenerator.h"
+
+namespace VoxelLight
+{
+    constexpr uint8_t MAX_LIGHT = 15;
+
+    enum Channel
+    {
+        SkyChannel = 0,
+        BlockChannel = 1,
+    };
+
+    inline uint8_t Pack(uint8_t sky, uint8_t block)
+    {
+        return uint8_t(sky << 4 | block);
+    }
+
+    inline uint8_t Unpack(uint8_t packed, Channel channel)
+    {
+        return channel == SkyChannel ? packed >> 4 : packed & 0xF;
+    }
+
+    class ChunkLight
+    {
+    public:
+        static constexpr int SECTION_CELLS =
+            WorldGenerator::CHUNK_WIDTH * WorldGenerator::CHUNK_WIDTH * WorldGenerator::SECTION_HEIGHT;
+
+        uint8_t GetPacked(int x, int y, int z) const
+        {
+            const Section& section = sections[z / WorldGenerator::SECTION_HEIGHT];
+            return section.cells.empty() ? section.uniform : section.cells[CellIndex(x, y, z)];
+        }
+
+        uint8_t Get(int x, int y, int z, Channel channel) const
+        {
+            return Unpack(GetPacked(x, y, z), channel);
+        }
+
+        void Set(int x, int y, int z, Channel channel, uint8_t value)
+        {
+            Section& section = sections[z / WorldGenerator::SECTION_HEIGHT];
+            uint8_t packed = section.cells.empty() ? section.uniform : section.cells[CellIndex(x, y, z)];
+            uint8_t updated = channel == SkyChannel ? Pack(value, packed & 0xF) : Pack(packed >> 4, value);
+            if (updated == packed)
+            {
+                return;
+            }
+            if (section.cells.empty())
+            {
+                section.cells.assign(SECTION_CELLS, section.uniform);
+            }
+            section.cells[CellIndex(x, y, z)] = updated;
+        }
+
+        // drops all light, e.g. before LightChunk relights a chunk that has been edited in bulk
+        void Reset()
+        {
+            for (Section& section : sections)
+            {
+                section.cells.clear();
+                section.uniform = 0;
+            }
+        }
+
+        // folds sections whose cells all hold the same value back into a single byte
+        void Compact()
+        {
+            for (Section& section : sections)
+            {
+                if (section.cells.empty())
+                {
+                    continue;
+                }
+                uint8_t first = section.cells[0];
+                bool uniform = true;
+                for (uint8_t value : section.cells)
+                {
+                    if (value != first)
+                    {
+                        uniform = false;
+                        break;
+                    }
+                }
+                if (uniform)
+                {
+                    section.uniform = first;
+                    section.cells.clear();
+                    section.cells.shrink_to_fit();
+                }
+            }
+        }
+
+    private:
+        struct Section
+        {
+            std::vector<uint8_t> cells;
+            uint8_t uniform = 0;
+        };
+
+        static int CellIndex(int x, int y, int z)
+        {
+            const int width = WorldGenerator::CHUNK_WIDTH;
+            return (z % WorldGenerator::SECTION_HEIGHT) * width * width + y * width + x;
+        }
+
+        Section sections[WorldGenerator::SECTION_COUNT];
+    };
+}
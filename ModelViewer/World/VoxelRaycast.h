@@ -0,0 +1,86 @@
+﻿/**
+ * 体素射线检测的公共数据结构
+ * 1. WorldMap::Raycast 单条射线 DDA 遍历，结果按值返回，多线程同时查询互不影响
+ * 2. WorldMap::RaycastBatch 批量射线以 SoA 形式输入，按 RAY_PACKET_WIDTH 条一组用 SIMD 同步推进，
+ *    结果按输入顺序写入连续数组
+ */
+#pragma once
+#include <vector>
+
+#include "Chunk.h"
+
+// rays traced together by WorldMap::RaycastBatch, one XMVECTOR lane each
+constexpr size_t RAY_PACKET_WIDTH = 4;
+
+// a block addressed by its chunk and chunk-local coordinates (z up)
+struct BlockCoord
+{
+    Chunk* chunk = nullptr;
+    int x = 0;
+    int y = 0;
+    int z = 0;
+
+    bool IsValid() const
+    {
+        return chunk != nullptr;
+    }
+
+    Block& GetBlock() const
+    {
+        return chunk->blocks[x][y][z];
+    }
+};
+
+// result of WorldMap::Raycast, returned by value so concurrent queries share no state
+struct RaycastHit
+{
+    // first non-air block along the ray, invalid when nothing was hit within the distance
+    BlockCoord block;
+    // last empty cell walked before block, invalid if the ray started inside it or came from outside the world
+    BlockCoord previous;
+    // world space normal of the face the ray entered block through, zero when it started inside
+    Math::Vector3 normal{Math::kZero};
+    // distance along the ray to the entry point, in units of the ray direction
+    float t = 0;
+
+    bool IsHit() const
+    {
+        return block.IsValid();
+    }
+};
+
+// SoA ray input of WorldMap::RaycastBatch, directions are expected to be normalized
+struct RayBatch
+{
+    std::vector<float> originX;
+    std::vector<float> originY;
+    std::vector<float> originZ;
+    std::vector<float> dirX;
+    std::vector<float> dirY;
+    std::vector<float> dirZ;
+    std::vector<float> maxDistance;
+
+    size_t Size() const
+    {
+        return originX.size();
+    }
+
+    void Add(const Math::Vector3& ori, const Math::Vector3& dir, float distance)
+    {
+        originX.push_back(ori.GetX());
+        originY.push_back(ori.GetY());
+        originZ.push_back(ori.GetZ());
+        dirX.push_back(dir.GetX());
+        dirY.push_back(dir.GetY());
+        dirZ.push_back(dir.GetZ());
+        maxDistance.push_back(distance);
+    }
+
+    void Clear()
+    {
+        for (auto* v : {&originX, &originY, &originZ, &dirX, &dirY, &dirZ, &maxDistance})
+        {
+            v->clear();
+        }
+    }
+};
@@ -0,0 +1,133 @@
+﻿#include "VoxelSweep.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    using namespace VoxelCollision;
+
+    class CellQuery
+    {
+    public:
+        CellQuery(SolidQuery query, void* context, uint32_t& tested) : query(query), context(context), tested(tested)
+        {
+        }
+
+        // whether any cell of the one cell thick slab at 'cell' along axis, spanning the box on the other axes, is solid
+        bool IsSlabSolid(const CellBox& box, int axis, int cell)
+        {
+            int lo[3];
+            int hi[3];
+            for (int i = 0; i < 3; i++)
+            {
+                lo[i] = i == axis ? cell : (int)std::floor(box.min[i] + SKIN);
+                hi[i] = i == axis ? cell : (int)std::floor(box.max[i] - SKIN);
+            }
+            for (int x = lo[0]; x <= hi[0]; x++)
+            {
+                for (int y = lo[1]; y <= hi[1]; y++)
+                {
+                    for (int z = lo[2]; z <= hi[2]; z++)
+                    {
+                        tested++;
+                        if (query(context, x, y, z))
+                        {
+                            return true;
+                        }
+                    }
+                }
+            }
+            return false;
+        }
+
+    private:
+        SolidQuery query;
+        void* context;
+        uint32_t& tested;
+    };
+
+    // moves the box along one axis by delta cells, stopping in front of the first solid slab it would enter
+    float SweepAxis(CellQuery& query, CellBox& box, int axis, float delta, bool& blocked)
+    {
+        blocked = false;
+        if (delta > 0.0f)
+        {
+            int first = (int)std::floor(box.max[axis] - SKIN) + 1;
+            int last = (int)std::floor(box.max[axis] + delta - SKIN);
+            for (int cell = first; cell <= last; cell++)
+            {
+                if (query.IsSlabSolid(box, axis, cell))
+                {
+                    delta = std::max(0.0f, cell - box.max[axis] - SKIN);
+                    blocked = true;
+                    break;
+                }
+            }
+        }
+        else if (delta < 0.0f)
+        {
+            int first = (int)std::floor(box.min[axis] + SKIN) - 1;
+            int last = (int)std::floor(box.min[axis] + delta + SKIN);
+            for (int cell = first; cell >= last; cell--)
+            {
+                if (query.IsSlabSolid(box, axis, cell))
+                {
+                    delta = std::min(0.0f, cell + 1 - box.min[axis] + SKIN);
+                    blocked = true;
+                    break;
+                }
+            }
+        }
+        box.min[axis] += delta;
+        box.max[axis] += delta;
+        return delta;
+    }
+
+    bool IsOnGround(CellQuery& query, const CellBox& box)
+    {
+        int below = (int)std::floor(box.min[1] + SKIN) - 1;
+        return box.min[1] - (below + 1) <= 2.0f * SKIN && query.IsSlabSolid(box, 1, below);
+    }
+}
+
+VoxelCollision::CellSweepResult VoxelCollision::SweepCells(SolidQuery solid, void* context, const CellBox& box,
+                                                           const float motion[3], float stepHeight)
+{
+    CellSweepResult result;
+    CellQuery query(solid, context, result.cellsTested);
+
+    // vertical first, so a body landing this step slides along the ground instead of catching on it
+    CellBox moved = box;
+    float* applied = result.moved;
+    applied[1] = SweepAxis(query, moved, 1, motion[1], result.blocked[1]);
+    applied[0] = SweepAxis(query, moved, 0, motion[0], result.blocked[0]);
+    applied[2] = SweepAxis(query, moved, 2, motion[2], result.blocked[2]);
+
+    // retry a blocked horizontal move lifted by stepHeight: up, across, then back down onto the ledge
+    if (stepHeight > 0.0f && (result.blocked[0] || result.blocked[2]) && motion[1] <= 0.0f)
+    {
+        CellBox stepped = box;
+        bool blocked[3];
+        float stepApplied[3];
+        float lift = SweepAxis(query, stepped, 1, stepHeight, blocked[1]);
+        stepApplied[0] = SweepAxis(query, stepped, 0, motion[0], blocked[0]);
+        stepApplied[2] = SweepAxis(query, stepped, 2, motion[2], blocked[2]);
+        stepApplied[1] = lift + SweepAxis(query, stepped, 1, motion[1] - lift, blocked[1]);
+
+        auto horizontal = [](const float* d)
+        {
+            return d[0] * d[0] + d[2] * d[2];
+        };
+        if (horizontal(stepApplied) > horizontal(applied))
+        {
+            moved = stepped;
+            std::copy(stepApplied, stepApplied + 3, applied);
+            std::copy(blocked, blocked + 3, result.blocked);
+            result.steppedUp = stepApplied[1] > 0.0f;
+        }
+    }
+
+    result.onGround = IsOnGround(query, moved);
+    return result;
+}
@@ -0,0 +1,38 @@
+﻿/**
+ * VoxelCollision 的格子空间扫掠，只依赖标准库，可以脱离 WorldMap 和 DirectXMath 单独测试
+ * 盒子与位移都以格子为单位，轴为 X、Y (向上)、Z；格子是否阻挡由调用方的 SolidQuery 回答，
+ * 与 VoxelAO::ComputeBlockAO 的 OccluderQuery 相同。
+ */
+#pragma once
+#include <cstdint>
+
+namespace VoxelCollision
+{
+    // returns whether the cell blocks movement; context is the caller's and may cache lookups
+    typedef bool (*SolidQuery)(void* context, int x, int y, int z);
+
+    // gap left between the box and a blocking face so the next sweep does not start inside it, in cells
+    constexpr float SKIN = 1e-3f;
+
+    struct CellBox
+    {
+        float min[3];
+        float max[3];
+    };
+
+    struct CellSweepResult
+    {
+        // displacement actually applied to the box, in cells
+        float moved[3] = {};
+        bool blocked[3] = {};
+        bool onGround = false;
+        bool steppedUp = false;
+        // cells handed to the query, grows with the cells the box swept through and not with the world's size
+        uint32_t cellsTested = 0;
+    };
+
+    // sweeps box by motion along Y, X, then Z; with stepHeight > 0 (in cells) a blocked horizontal move may climb
+    // ledges up to that height. x and z cells have the same size, so horizontal progress is compared in cells.
+    CellSweepResult SweepCells(SolidQuery query, void* context, const CellBox& box, const float motion[3],
+                               float stepHeight);
+}
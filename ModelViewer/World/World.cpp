@@ -6,4 +6,5 @@ namespace World
 {
     uint16_t UnitBlockSize = 50;
     float UnitBlockRadius = sqrt(std::pow(UnitBlockSize, 2)+std::pow(UnitBlockSize,2) + std::pow(UnitBlockSize,2)) /2 *1;
+    float UnitBlockStep = UnitBlockSize * 1.001f;
 }
@@ -5,5 +5,7 @@ namespace World
 {
     extern uint16_t UnitBlockSize;
     extern float UnitBlockRadius;
+    // distance between the centres of two adjacent blocks
+    extern float UnitBlockStep;
 }
 
@@ -1,18 +1,63 @@
 ﻿#include "WorldGenerator.h"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <ostream>
+#include <vector>
 
+#include "ClimateCache.h"
+#include "EngineTuning.h"
+#include "SystemTime.h"
 #include "World.h"
 
+BoolVar LatticeNoise("World/Generation/Lattice Noise", true);
+NumVar ContinentLattice("World/Generation/Continent Lattice", 4, 1, 16, 1);
+NumVar ErosionLattice("World/Generation/Erosion Lattice", 4, 1, 16, 1);
+NumVar PeaksValleysLattice("World/Generation/Peaks Valleys Lattice", 1, 1, 16, 1);
+NumVar TemperatureLattice("World/Generation/Temperature Lattice", 4, 1, 16, 1);
+NumVar HumidityLattice("World/Generation/Humidity Lattice", 4, 1, 16, 1);
+BoolVar ClimateTileCache("World/Generation/Climate Tile Cache", true);
+NumVar ClimateCacheTiles("World/Generation/Climate Cache Tiles", 256, 16, 4096, 16);
+BoolVar DensityTerrain("World/Generation/Density Terrain", true);
+NumVar OverhangStrength("World/Generation/Overhang Strength", 6, 0, 32, 1);
+NumVar CaveThreshold("World/Generation/Cave Threshold", 0.1f, 0.0f, 0.5f, 0.01f);
+
 namespace WorldGenerator
 {
-    SimplexNoise continent(0.05, 1, 2, 0.5);
-    SimplexNoise erosion(0.02, 1, 2, 0.5);
-    SimplexNoise peaksValleys(0.6, 1, 2, 0.5);
-    SimplexNoise temperature(0.01, 1, 2, 0.5);
-    SimplexNoise humidity(0.01, 1, 2, 0.5);
-    SimplexNoise caves(0.8, 1, 2, 0.5);
+    SimplexNoise continent(0.05, 1, 2, 0.5, 1);
+    SimplexNoise erosion(0.02, 1, 2, 0.5, 2);
+    SimplexNoise peaksValleys(0.6, 1, 2, 0.5, 3);
+    SimplexNoise temperature(0.01, 1, 2, 0.5, 4);
+    SimplexNoise humidity(0.01, 1, 2, 0.5, 5);
+    SimplexNoise caves(0.8, 1, 2, 0.5, 6);
+    SimplexNoise overhangs(1.5, 1, 2, 0.5, 7);
+
+    uint32_t worldSeed = 0;
+
+    namespace
+    {
+        void buildClimateTile(int tileX, int tileY, int chunkSize, ClimateCache::Tile& tile);
+
+        ClimateCache climateCache(buildClimateTile);
+    }
+
+    void SetSeed(uint32_t seed)
+    {
+        worldSeed = seed;
+        SimplexNoise::setSeed(static_cast<int>(seed));
+        for (SimplexNoise* noise : {&continent, &erosion, &peaksValleys, &temperature, &humidity, &caves, &overhangs})
+        {
+            noise->reseed(seed);
+        }
+        // tiles were sampled from the old noise
+        climateCache.Clear();
+    }
+
+    uint32_t GetSeed()
+    {
+        return worldSeed;
+    }
 
     Biomes BarrenIceField(GrassSnow, Dirt, 7, 0.01, 20, 1);
     Biomes InlandForest(GrassWilt, Dirt, 7, 0.01, 15, 1);
@@ -23,40 +68,85 @@ namespace WorldGenerator
     Biomes RainForest(Grass, Dirt, 12, 0.10, 15, 2);
     Biomes Savanna(Grass, Dirt, 12, 0.1, 0, 0);
     
-    int ANOTHER_HEIGHT = SEA_HEIGHT + 12;
-    std::map<float, float> ContinentalnessNodes = {
-        {-1.0, ANOTHER_HEIGHT},
-        {-0.4, ANOTHER_HEIGHT},
-        {-0.5, ANOTHER_HEIGHT + 15},
-        {0.0, ANOTHER_HEIGHT + 15},
-        {0.1, ANOTHER_HEIGHT + 25},
-        {0.2, ANOTHER_HEIGHT + 40},
-        {0.5, ANOTHER_HEIGHT + 45},
-        {1.0, ANOTHER_HEIGHT + 50},
+    struct SplineNode
+    {
+        float input;
+        float value;
+    };
+
+    template <size_t N>
+    constexpr bool isSorted(const SplineNode (&nodes)[N])
+    {
+        for (size_t i = 1; i < N; i++)
+        {
+            if (!(nodes[i - 1].input < nodes[i].input))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    constexpr int ANOTHER_HEIGHT = SEA_HEIGHT + 12;
+    constexpr SplineNode ContinentalnessNodes[] = {
+        {-1.0f, ANOTHER_HEIGHT},
+        {-0.5f, ANOTHER_HEIGHT + 15},
+        {-0.4f, ANOTHER_HEIGHT},
+        {0.0f, ANOTHER_HEIGHT + 15},
+        {0.1f, ANOTHER_HEIGHT + 25},
+        {0.2f, ANOTHER_HEIGHT + 40},
+        {0.5f, ANOTHER_HEIGHT + 45},
+        {1.0f, ANOTHER_HEIGHT + 50},
     };
 
-    std::map<float, float> ErosionNodes = {
-        {-1.0, 25},
-        {-0.7, 10},
-        {-0.6, 15},
-        {-0.2, 12},
-        {0.2, -10},
-        {0.4,-20},
-        {0.6,-20},
-        {0.65,-10},
-        {0.7,-10},
-        {0.75, -20},
-        {1.0, -25}
+    constexpr SplineNode ErosionNodes[] = {
+        {-1.0f, 25},
+        {-0.7f, 10},
+        {-0.6f, 15},
+        {-0.2f, 12},
+        {0.2f, -10},
+        {0.4f, -20},
+        {0.6f, -20},
+        {0.65f, -10},
+        {0.7f, -10},
+        {0.75f, -20},
+        {1.0f, -25}
     };
 
-    std::map<float, float> PeakValleysNodes = {
-        {-1.0, -5},
-        {-0.8, -3},
-        {-0.5, -1},
-        {0.0, 1.0},
-        {0.5, 8},
-        {0.7, 12},
-        {1.0, 10},
+    constexpr SplineNode PeakValleysNodes[] = {
+        {-1.0f, -5},
+        {-0.8f, -3},
+        {-0.5f, -1},
+        {0.0f, 1.0f},
+        {0.5f, 8},
+        {0.7f, 12},
+        {1.0f, 10},
+    };
+    static_assert(isSorted(ContinentalnessNodes) && isSorted(ErosionNodes) && isSorted(PeakValleysNodes),
+                  "spline nodes must be sorted by input");
+
+    // the biome of a column by region, temperature band and humidity band, see getHeightAndBiomes.
+    // region: bit 1 far inland (continent >= 0.1), bit 0 flat (erosion >= 0)
+    // temperature band: < TEMP_COLD, < TEMP_WARM, == TEMP_WARM, < TEMP_HOT, >= TEMP_HOT
+    // humidity band: <= HUMIDITY_DRY, > HUMIDITY_DRY
+    constexpr const Biomes* BiomeTable[4][5][2] = {
+        // coastline hills
+        {
+            {&FlourishIceField, &FlourishIceField}, {&Savanna, &Savanna}, {&Savanna, &RainForest},
+            {&Savanna, &RainForest}, {&Savanna, &RainForest}
+        },
+        // coastline
+        {{&Forest, &Forest}, {&Forest, &Forest}, {&Forest, &Forest}, {&Forest, &Forest}, {&Forest, &Forest}},
+        // inland mountains
+        {
+            {&BarrenIceField, &BarrenIceField}, {&InlandForest, &InlandForest}, {&InlandForest, &InlandForest},
+            {&InlandForest, &InlandForest}, {&InlandForest, &InlandForest}
+        },
+        // inland plains
+        {
+            {&InlandPlain, &InlandPlain}, {&InlandPlain, &InlandPlain}, {&InlandPlain, &InlandPlain},
+            {&Desert, &Desert}, {&Desert, &Desert}
+        },
     };
     
     BlockType getBlockType(float xCoor, float yCoor, int height, Biomes biomes, int z)
@@ -71,16 +161,7 @@ namespace WorldGenerator
             return Air;
         }
 
-        //dig out caves
-        // if (height > SEA_HEIGHT && z >= height - 35 && z <= height -10 && z>=SURFACE_HEIGHT)
-        // {
-        //     float zCoor = (z + 0.5f) * World::UnitBlockSize * 1.001 * COOR_STEP;
-        //     float isCave = caves.fractal(5, xCoor, yCoor, zCoor);
-        //     if (abs(isCave) < 0.1)
-        //     {
-        //         return BlocksCount;
-        //     }
-        // }
+        // caves are carved by the density terrain, see generateChunkGround
 
         // surfaceBlock
         if (z == height)
@@ -95,104 +176,857 @@ namespace WorldGenerator
         return Stone;
     }
 
-    float getSplineValue(float value, std::map<float, float> nodes)
+    // linear between the two nodes around value, past either end the missing node counts as (0, 0)
+    template <size_t N>
+    float getSplineValue(float value, const SplineNode (&nodes)[N])
+    {
+        // counting instead of searching keeps the loop free of branches
+        size_t below = 0;
+        for (size_t i = 0; i < N; i++)
+        {
+            below += nodes[i].input < value;
+        }
+        SplineNode start = below > 0 ? nodes[below - 1] : SplineNode{0, 0};
+        SplineNode end = below < N ? nodes[below] : SplineNode{0, 0};
+
+        float k = (end.value - start.value) / (end.input - start.input);
+        float b = end.value - end.input * k;
+
+        return value * k + b;
+    }
+
+
+    const size_t CONTINENT_OCTAVES = 4;
+    const size_t EROSION_OCTAVES = 5;
+    const size_t PEAKS_VALLEYS_OCTAVES = 4;
+    const size_t TEMPERATURE_OCTAVES = 4;
+    const size_t HUMIDITY_OCTAVES = 4;
+
+    ColumnNoise sampleColumnNoise(float x, float y)
+    {
+        ColumnNoise noise;
+        noise.continent = continent.fractal(CONTINENT_OCTAVES, x, y);
+        noise.erosion = erosion.fractal(EROSION_OCTAVES, x, y);
+        noise.peaksValleys = peaksValleys.fractal(PEAKS_VALLEYS_OCTAVES, x, y);
+        noise.temperature = temperature.fractal(TEMPERATURE_OCTAVES, x, y);
+        noise.humidity = humidity.fractal(HUMIDITY_OCTAVES, x, y);
+        return noise;
+    }
+
+    namespace
     {
-        float min = 0;
-        float max = 0;
-        float start = 0;
-        float end = 0;
-        for (auto node : nodes)
+        void batchColumnNoise(const float* x, const float* y, size_t count, ColumnNoise* out,
+                              SimplexNoise::SimdLevel level)
         {
-            if (node.first < value)
+            std::vector<float> values(count * 5);
+            const SimplexNoise::FractalField fields[5] = {
+                {&continent, CONTINENT_OCTAVES, values.data()},
+                {&erosion, EROSION_OCTAVES, values.data() + count},
+                {&peaksValleys, PEAKS_VALLEYS_OCTAVES, values.data() + count * 2},
+                {&temperature, TEMPERATURE_OCTAVES, values.data() + count * 3},
+                {&humidity, HUMIDITY_OCTAVES, values.data() + count * 4},
+            };
+            SimplexNoise::fractalFields(fields, 5, x, y, count, level);
+            for (size_t i = 0; i < count; i++)
             {
-                start = node.first;
-                min = node.second;
+                out[i] = {values[i], values[count + i], values[count * 2 + i], values[count * 3 + i],
+                          values[count * 4 + i]};
             }
-            else
+        }
+    }
+
+    void sampleColumnNoise(const float* x, const float* y, size_t count, ColumnNoise* out)
+    {
+        batchColumnNoise(x, y, count, out, SimplexNoise::SimdLevel::Best);
+    }
+
+    float ColumnCoordinate(float chunkOrigin, int column)
+    {
+        return (chunkOrigin + (column + 0.5f) * World::UnitBlockSize * 1.001) * COOR_STEP;
+    }
+
+    namespace
+    {
+        struct NoiseField
+        {
+            const SimplexNoise* noise;
+            size_t octaves;
+            float ColumnNoise::* value;
+            NumVar* lattice;
+            // field of the shared climate tiles, FieldCount when the field is not cached
+            ClimateCache::Field climate;
+        };
+
+        const NoiseField NoiseFields[5] = {
+            {&continent, CONTINENT_OCTAVES, &ColumnNoise::continent, &ContinentLattice, ClimateCache::Continent},
+            {&erosion, EROSION_OCTAVES, &ColumnNoise::erosion, &ErosionLattice, ClimateCache::Erosion},
+            {&peaksValleys, PEAKS_VALLEYS_OCTAVES, &ColumnNoise::peaksValleys, &PeaksValleysLattice,
+             ClimateCache::FieldCount},
+            {&temperature, TEMPERATURE_OCTAVES, &ColumnNoise::temperature, &TemperatureLattice, ClimateCache::Temperature},
+            {&humidity, HUMIDITY_OCTAVES, &ColumnNoise::humidity, &HumidityLattice, ClimateCache::Humidity},
+        };
+
+        // columns between two lattice points of a field, 1 when it is sampled at every column
+        int latticeSpacing(const NoiseField& field, int size, bool lattice)
+        {
+            int spacing = lattice ? static_cast<int>((float)*field.lattice) : 1;
+            // the lattice has to end on the chunk's far edge
+            return spacing > 1 && size % spacing == 0 ? spacing : 1;
+        }
+
+        int floorDiv(int value, int divisor)
+        {
+            return value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor);
+        }
+
+        // origin of chunk index within the world, as ChunkPipeline places it
+        float chunkOrigin(int chunk, int size)
+        {
+            return float((chunk - 0.5) * size * World::UnitBlockSize);
+        }
+
+        // lattice point (i, j) of the tile at tile column (i * SPACING, j * SPACING); coordinates are taken relative to
+        // the chunk the column falls in, so every point is the one that chunk would sample on its own
+        void buildClimateTile(int tileX, int tileY, int chunkSize, ClimateCache::Tile& tile)
+        {
+            const int points = ClimateCache::TILE_POINTS;
+            const size_t count = size_t(points) * points;
+            std::vector<float> x(count);
+            std::vector<float> y(count);
+            for (int i = 0; i < points; i++)
+            {
+                int columnX = tileX * ClimateCache::TILE_COLUMNS + i * ClimateCache::SPACING;
+                int chunkX = floorDiv(columnX, chunkSize);
+                float coordinateX = ColumnCoordinate(chunkOrigin(chunkX, chunkSize), columnX - chunkX * chunkSize);
+                for (int j = 0; j < points; j++)
+                {
+                    int columnY = tileY * ClimateCache::TILE_COLUMNS + j * ClimateCache::SPACING;
+                    int chunkY = floorDiv(columnY, chunkSize);
+                    x[i * points + j] = coordinateX;
+                    y[i * points + j] = ColumnCoordinate(chunkOrigin(chunkY, chunkSize), columnY - chunkY * chunkSize);
+                }
+            }
+
+            SimplexNoise::FractalField fields[ClimateCache::FieldCount];
+            for (const NoiseField& field : NoiseFields)
             {
-                end = node.first;
-                max = node.second;
-                break;
+                if (field.climate != ClimateCache::FieldCount)
+                {
+                    fields[field.climate] = {field.noise, field.octaves, tile.values[field.climate]};
+                }
             }
+            SimplexNoise::fractalFields(fields, ClimateCache::FieldCount, x.data(), y.data(), count);
         }
-        if (max == min)
+
+        // fills one member of the chunk's columns from a points x points lattice with spacing columns between points
+        void interpolateField(const float* field, int points, int spacing, int size, float ColumnNoise::* member,
+                              ColumnNoise* out)
         {
-            return max;
+            for (int cx = 0; cx < size; cx++)
+            {
+                int i = cx / spacing;
+                float tx = float(cx % spacing) / spacing;
+                for (int cy = 0; cy < size; cy++)
+                {
+                    float value;
+                    if (spacing == 1)
+                    {
+                        value = field[cx * size + cy];
+                    }
+                    else
+                    {
+                        int j = cy / spacing;
+                        float ty = float(cy % spacing) / spacing;
+                        const float* row = field + i * points + j;
+                        const float* next = row + points;
+                        float lower = row[0] + (next[0] - row[0]) * tx;
+                        float upper = row[1] + (next[1] - row[1]) * tx;
+                        value = lower + (upper - lower) * ty;
+                    }
+                    out[cx * size + cy].*member = value;
+                }
+            }
         }
 
-        float k = (max - min) / (end - start);
-        float b = max - end * k;
+        // climate fields on the cache's spacing are read from the chunk's tile, returns the fields it filled
+        unsigned sampleCachedClimate(float originX, float originY, int size, ColumnNoise* out)
+        {
+            const int spacing = ClimateCache::SPACING;
+            if (ClimateCache::TILE_COLUMNS % size != 0 || size % spacing != 0)
+            {
+                return 0;
+            }
+            int chunkX = static_cast<int>(std::lround(originX / (size * World::UnitBlockSize) + 0.5f));
+            int chunkY = static_cast<int>(std::lround(originY / (size * World::UnitBlockSize) + 0.5f));
+            if (chunkOrigin(chunkX, size) != originX || chunkOrigin(chunkY, size) != originY)
+            {
+                // not on the chunk grid, e.g. a probe at an arbitrary position
+                return 0;
+            }
+
+            int tileX = floorDiv(chunkX * size, ClimateCache::TILE_COLUMNS);
+            int tileY = floorDiv(chunkY * size, ClimateCache::TILE_COLUMNS);
+            // the chunk's first lattice point within the tile, its far edge is at most the tile's far edge
+            int firstI = (chunkX * size - tileX * ClimateCache::TILE_COLUMNS) / spacing;
+            int firstJ = (chunkY * size - tileY * ClimateCache::TILE_COLUMNS) / spacing;
+            int points = size / spacing + 1;
+            std::vector<float> field(size_t(points) * points);
+            std::shared_ptr<const ClimateCache::Tile> tile;
+            unsigned filled = 0;
+            for (int f = 0; f < 5; f++)
+            {
+                const NoiseField& noiseField = NoiseFields[f];
+                if (noiseField.climate == ClimateCache::FieldCount || latticeSpacing(noiseField, size, true) != spacing)
+                {
+                    continue;
+                }
+                if (!tile)
+                {
+                    climateCache.SetCapacity(static_cast<size_t>((float)ClimateCacheTiles));
+                    tile = climateCache.Get(tileX, tileY, size);
+                }
+                const float* values = tile->values[noiseField.climate];
+                for (int i = 0; i < points; i++)
+                {
+                    std::copy_n(values + (firstI + i) * ClimateCache::TILE_POINTS + firstJ, points, &field[i * points]);
+                }
+                interpolateField(field.data(), points, spacing, size, noiseField.value, out);
+                filled |= 1u << f;
+            }
+            return filled;
+        }
 
-        return value * k + b;
+        // returns the fractal evaluations spent by this chunk, tiles built for the cache are not counted
+        size_t sampleChunk(float originX, float originY, int size, ColumnNoise* out, bool lattice, bool cached)
+        {
+            size_t evaluations = 0;
+            unsigned filled = lattice && cached ? sampleCachedClimate(originX, originY, size, out) : 0;
+            // fields sharing a spacing are sampled in one fused batch; a spacing of 1 samples every column
+            for (int spacing = 1; spacing <= size; spacing++)
+            {
+                SimplexNoise::FractalField fields[5];
+                float ColumnNoise::* members[5];
+                size_t fieldCount = 0;
+                for (int f = 0; f < 5; f++)
+                {
+                    const NoiseField& field = NoiseFields[f];
+                    if (!(filled & 1u << f) && latticeSpacing(field, size, lattice) == spacing)
+                    {
+                        fields[fieldCount] = {field.noise, field.octaves, nullptr};
+                        members[fieldCount++] = field.value;
+                    }
+                }
+                if (fieldCount == 0)
+                {
+                    continue;
+                }
+
+                // lattice point (i, j) at column (i * spacing, j * spacing), the last row lies on the next chunk's edge
+                int points = spacing == 1 ? size : size / spacing + 1;
+                size_t count = size_t(points) * points;
+                std::vector<float> x(count);
+                std::vector<float> y(count);
+                std::vector<float> values(count * fieldCount);
+                for (int i = 0; i < points; i++)
+                {
+                    for (int j = 0; j < points; j++)
+                    {
+                        x[i * points + j] = ColumnCoordinate(originX, i * spacing);
+                        y[i * points + j] = ColumnCoordinate(originY, j * spacing);
+                    }
+                }
+                for (size_t f = 0; f < fieldCount; f++)
+                {
+                    fields[f].out = values.data() + f * count;
+                }
+                SimplexNoise::fractalFields(fields, fieldCount, x.data(), y.data(), count);
+                evaluations += count * fieldCount;
+
+                for (size_t f = 0; f < fieldCount; f++)
+                {
+                    interpolateField(values.data() + f * count, points, spacing, size, members[f], out);
+                }
+            }
+            return evaluations;
+        }
     }
 
+    void sampleChunkColumnNoise(float originX, float originY, int size, ColumnNoise* out)
+    {
+        sampleChunk(originX, originY, size, out, LatticeNoise, ClimateTileCache);
+    }
 
-    int getRealHeightAndBiomes(float x, float y, Biomes& biomes)
+    void RunLatticeNoiseReport()
     {
-        float cont = continent.fractal(4, x, y);
-        float ero = erosion.fractal(5, x, y);
-        float pea = peaksValleys.fractal(4, x, y);
+        const int size = 16;
+        const int radius = 8;
+        const char* names[5] = {"continent", "erosion", "peaks valleys", "temperature", "humidity"};
+        double squaredError[5] = {};
+        float maxError[5] = {};
+        size_t columns = 0;
+        size_t heightChanged = 0;
+        int maxHeightError = 0;
+        size_t biomeChanged = 0;
+        size_t fullEvaluations = 0;
+        size_t latticeEvaluations = 0;
+        double fullSeconds = 0.0;
+        double latticeSeconds = 0.0;
 
-        float height;
-        // float height = SURFACE_HEIGHT + 5 + (WORLD_DEPTH - SURFACE_HEIGHT) * 0.3 * (cont + 1) / 2;
-        height = getSplineValue(cont, ContinentalnessNodes);
-        height += getSplineValue(ero, ErosionNodes);
-        height += getSplineValue(pea, PeakValleysNodes);
+        std::vector<ColumnNoise> full(size * size);
+        std::vector<ColumnNoise> lattice(size * size);
+        for (int cx = -radius; cx < radius; cx++)
+        {
+            for (int cy = -radius; cy < radius; cy++)
+            {
+                // same origin as ChunkPipeline gives the chunk
+                float originX = float((cx - 0.5) * size * World::UnitBlockSize);
+                float originY = float((cy - 0.5) * size * World::UnitBlockSize);
+                int64_t start = SystemTime::GetCurrentTick();
+                fullEvaluations += sampleChunk(originX, originY, size, full.data(), false, false);
+                int64_t middle = SystemTime::GetCurrentTick();
+                latticeEvaluations += sampleChunk(originX, originY, size, lattice.data(), true, false);
+                int64_t end = SystemTime::GetCurrentTick();
+                fullSeconds += SystemTime::TimeBetweenTicks(start, middle);
+                latticeSeconds += SystemTime::TimeBetweenTicks(middle, end);
 
-        if (height >= WORLD_DEPTH * 0.95) height = WORLD_DEPTH * 0.95;
-        if (height < 0) height = 0;
+                for (int column = 0; column < size * size; column++)
+                {
+                    for (int f = 0; f < 5; f++)
+                    {
+                        float error = std::abs(full[column].*NoiseFields[f].value - lattice[column].*NoiseFields[f].value);
+                        squaredError[f] += double(error) * error;
+                        maxError[f] = std::max(maxError[f], error);
+                    }
+                    Biomes fullBiomes;
+                    Biomes latticeBiomes;
+                    auto fullRandom = ColumnRandom(cx, cy, column, SurfaceDepthRandom);
+                    auto latticeRandom = ColumnRandom(cx, cy, column, SurfaceDepthRandom);
+                    int fullHeight = getHeightAndBiomes(full[column], fullBiomes, fullRandom);
+                    int latticeHeight = getHeightAndBiomes(lattice[column], latticeBiomes, latticeRandom);
+                    heightChanged += fullHeight != latticeHeight;
+                    maxHeightError = std::max(maxHeightError, std::abs(fullHeight - latticeHeight));
+                    biomeChanged += fullBiomes.SurfaceBlock != latticeBiomes.SurfaceBlock
+                        || fullBiomes.PlantDensity != latticeBiomes.PlantDensity;
+                    columns++;
+                }
+            }
+        }
 
-        float h = humidity.fractal(4, x, y);
-        h = (h + 1) / 2;
-        float t = temperature.fractal(4, x, y);
-        t = (t + 1) / 2;
-        Biomes result;
+        size_t chunks = size_t(radius) * radius * 4;
+        std::cout << "lattice noise: " << chunks << " chunks, " << fullEvaluations / chunks << " -> "
+            << latticeEvaluations / chunks << " fractal evaluations per chunk, " << fullSeconds * 1000.0 << "ms -> "
+            << latticeSeconds * 1000.0 << "ms" << std::endl;
+        for (int f = 0; f < 5; f++)
+        {
+            std::cout << "  " << names[f] << " (lattice " << latticeSpacing(NoiseFields[f], size, true)
+                << "): max error " << maxError[f] << ", rms " << std::sqrt(squaredError[f] / columns) << std::endl;
+        }
+        std::cout << "  height differs in " << heightChanged << " of " << columns << " columns (max "
+            << maxHeightError << " blocks), biome differs in " << biomeChanged << std::endl;
+    }
+
+    void RunClimateCacheReport()
+    {
+        const int size = 16;
+        const int radius = 8;
+        float maxError[5] = {};
+        size_t latticeEvaluations = 0;
+        size_t cachedEvaluations = 0;
+        double latticeSeconds = 0.0;
+        double cachedSeconds = 0.0;
+        ClimateCache::Stats before = climateCache.GetStats();
 
-        if (cont < 0.1)
+        std::vector<ColumnNoise> lattice(size * size);
+        std::vector<ColumnNoise> cached(size * size);
+        for (int cx = -radius; cx < radius; cx++)
         {
-            // coastline
-            if (ero < 0.0)
+            for (int cy = -radius; cy < radius; cy++)
             {
-                // coastline hills
-                if (t < TEMP_COLD)
+                float originX = chunkOrigin(cx, size);
+                float originY = chunkOrigin(cy, size);
+                int64_t start = SystemTime::GetCurrentTick();
+                latticeEvaluations += sampleChunk(originX, originY, size, lattice.data(), true, false);
+                int64_t middle = SystemTime::GetCurrentTick();
+                cachedEvaluations += sampleChunk(originX, originY, size, cached.data(), true, true);
+                int64_t end = SystemTime::GetCurrentTick();
+                latticeSeconds += SystemTime::TimeBetweenTicks(start, middle);
+                cachedSeconds += SystemTime::TimeBetweenTicks(middle, end);
+
+                for (int column = 0; column < size * size; column++)
                 {
-                    result = FlourishIceField;
+                    for (int f = 0; f < 5; f++)
+                    {
+                        float error = std::abs(lattice[column].*NoiseFields[f].value - cached[column].*NoiseFields[f].value);
+                        maxError[f] = std::max(maxError[f], error);
+                    }
                 }
-                else if (t<TEMP_WARM)
+            }
+        }
+
+        // the cached time includes building the tiles this area missed
+        ClimateCache::Stats after = climateCache.GetStats();
+        size_t chunks = size_t(radius) * radius * 4;
+        uint64_t hits = after.hits - before.hits;
+        uint64_t misses = after.misses - before.misses;
+        std::cout << "climate cache: " << chunks << " chunks, " << latticeEvaluations / chunks << " -> "
+            << cachedEvaluations / chunks << " fractal evaluations per chunk, " << latticeSeconds * 1000.0 << "ms -> "
+            << cachedSeconds * 1000.0 << "ms, " << hits << " hits / " << misses << " misses" << std::endl;
+        std::cout << "  max difference to per chunk lattice: continent " << maxError[0] << ", erosion " << maxError[1]
+            << ", temperature " << maxError[3] << ", humidity " << maxError[4] << std::endl;
+        std::cout << "  since start: " << after.hits << " hits, " << after.misses << " misses ("
+            << (after.hits + after.misses > 0 ? after.hits * 100.0 / (after.hits + after.misses) : 0.0) << "% hit), "
+            << after.evictions << " evictions, " << after.tiles << " tiles resident" << std::endl;
+    }
+
+    namespace
+    {
+        const size_t OVERHANG_OCTAVES = 3;
+        const size_t CAVE_OCTAVES = 5;
+        // caves stay between CAVE_ROOF and CAVE_DEPTH blocks below their column's height
+        const int CAVE_ROOF = 10;
+        const int CAVE_DEPTH = 35;
+
+        float DepthCoordinate(int z)
+        {
+            return (z + 0.5f) * World::UnitBlockSize * 1.001 * COOR_STEP;
+        }
+
+        // one 3D noise field on the density lattice of a chunk, a point is evaluated the first time a cell needs it
+        class DensityLattice
+        {
+        public:
+            DensityLattice(const SimplexNoise& noise, size_t octaves, float originX, float originY, int cells,
+                           size_t& evaluations)
+                : noise(noise), octaves(octaves), originX(originX), originY(originY), points(cells + 1),
+                  evaluations(evaluations)
+            {
+                values.resize(size_t(points) * points * DEPTH_POINTS);
+                evaluated.resize(values.size(), false);
+            }
+
+            // the corners of cell (i, j, k), bit 0 of the index steps along x, bit 1 along y, bit 2 along z
+            void Corners(int i, int j, int k, float corners[8])
+            {
+                for (int corner = 0; corner < 8; corner++)
                 {
-                    result = Savanna;
+                    corners[corner] = point(i + (corner & 1), j + (corner >> 1 & 1), k + (corner >> 2));
                 }
-                else if (t<TEMP_HOT)
+            }
+
+            static float Interpolate(const float corners[8], float tx, float ty, float tz)
+            {
+                float c00 = corners[0] + (corners[1] - corners[0]) * tx;
+                float c10 = corners[2] + (corners[3] - corners[2]) * tx;
+                float c01 = corners[4] + (corners[5] - corners[4]) * tx;
+                float c11 = corners[6] + (corners[7] - corners[6]) * tx;
+                float c0 = c00 + (c10 - c00) * ty;
+                float c1 = c01 + (c11 - c01) * ty;
+                return c0 + (c1 - c0) * tz;
+            }
+
+        private:
+            static constexpr int DEPTH_POINTS = WORLD_DEPTH / DENSITY_CELL_HEIGHT + 1;
+
+            float point(int i, int j, int k)
+            {
+                size_t index = (size_t(i) * points + j) * DEPTH_POINTS + k;
+                if (!evaluated[index])
                 {
-                    if (h > HUMIDITY_DRY) result  = RainForest;
-                    else result = Savanna;
+                    values[index] = noise.fractal(octaves, ColumnCoordinate(originX, i * DENSITY_CELL_WIDTH),
+                                                  ColumnCoordinate(originY, j * DENSITY_CELL_WIDTH),
+                                                  DepthCoordinate(k * DENSITY_CELL_HEIGHT));
+                    evaluated[index] = true;
+                    evaluations++;
                 }
+                return values[index];
             }
-            else
+
+            const SimplexNoise& noise;
+            size_t octaves;
+            float originX;
+            float originY;
+            int points;
+            size_t& evaluations;
+            std::vector<float> values;
+            std::vector<bool> evaluated;
+        };
+
+        void heightmapBlocks(float originX, float originY, int size, const int* heights, const Biomes* biomes,
+                             BlockType* types)
+        {
+            for (int x = 0; x < size; x++)
             {
-                result = Forest;
+                float xCoor = ColumnCoordinate(originX, x);
+                for (int y = 0; y < size; y++)
+                {
+                    float yCoor = ColumnCoordinate(originY, y);
+                    int column = x * size + y;
+                    for (int z = 0; z < WORLD_DEPTH; z++)
+                    {
+                        types[column * WORLD_DEPTH + z] = getBlockType(xCoor, yCoor, heights[column], biomes[column], z);
+                    }
+                }
             }
+        }
+
+        // Stone where the density field is ground, Air elsewhere
+        void densityGround(float originX, float originY, int size, const int* heights, BlockType* types,
+                           DensityStats& stats)
+        {
+            const float strength = OverhangStrength;
+            const float threshold = CaveThreshold;
+            const int cells = size / DENSITY_CELL_WIDTH;
+            DensityLattice overhang(overhangs, OVERHANG_OCTAVES, originX, originY, cells, stats.evaluations);
+            DensityLattice cave(caves, CAVE_OCTAVES, originX, originY, cells, stats.evaluations);
+
+            for (int ci = 0; ci < cells; ci++)
+            {
+                for (int cj = 0; cj < cells; cj++)
+                {
+                    int x0 = ci * DENSITY_CELL_WIDTH;
+                    int y0 = cj * DENSITY_CELL_WIDTH;
+                    int lowest = WORLD_DEPTH;
+                    int highest = -1;
+                    for (int x = x0; x < x0 + DENSITY_CELL_WIDTH; x++)
+                    {
+                        for (int y = y0; y < y0 + DENSITY_CELL_WIDTH; y++)
+                        {
+                            lowest = std::min(lowest, heights[x * size + y]);
+                            highest = std::max(highest, heights[x * size + y]);
+                        }
+                    }
 
+                    for (int ck = 0; ck < WORLD_DEPTH / DENSITY_CELL_HEIGHT; ck++)
+                    {
+                        int z0 = ck * DENSITY_CELL_HEIGHT;
+                        int z1 = z0 + DENSITY_CELL_HEIGHT - 1;
+
+                        // trilinear values stay within their corners, so the corner bounds decide most cells whole
+                        float overhangCorners[8] = {};
+                        float overhangMin = -1.0f;
+                        float overhangMax = 1.0f;
+                        if (strength > 0 && lowest - z1 < strength && highest - z0 + strength >= 0)
+                        {
+                            overhang.Corners(ci, cj, ck, overhangCorners);
+                            overhangMin = *std::min_element(overhangCorners, overhangCorners + 8);
+                            overhangMax = *std::max_element(overhangCorners, overhangCorners + 8);
+                        }
+                        bool allGround = lowest - z1 + strength * overhangMin >= 0;
+                        bool allAir = highest - z0 + strength * overhangMax < 0;
+
+                        bool carve = false;
+                        float caveCorners[8];
+                        if (!allAir && threshold > 0 && highest > SEA_HEIGHT && z0 <= highest - CAVE_ROOF
+                            && z1 >= std::max(lowest - CAVE_DEPTH, SURFACE_HEIGHT))
+                        {
+                            cave.Corners(ci, cj, ck, caveCorners);
+                            carve = *std::min_element(caveCorners, caveCorners + 8) < threshold
+                                && *std::max_element(caveCorners, caveCorners + 8) > -threshold;
+                        }
+
+                        if ((allGround || allAir) && !carve)
+                        {
+                            BlockType fill = allGround ? Stone : Air;
+                            for (int x = x0; x < x0 + DENSITY_CELL_WIDTH; x++)
+                            {
+                                for (int y = y0; y < y0 + DENSITY_CELL_WIDTH; y++)
+                                {
+                                    BlockType* column = types + (x * size + y) * WORLD_DEPTH;
+                                    std::fill(column + z0, column + z1 + 1, fill);
+                                }
+                            }
+                            (allGround ? stats.solidCells : stats.airCells)++;
+                            continue;
+                        }
+                        (carve ? stats.caveCells : stats.mixedCells)++;
+
+                        for (int x = x0; x < x0 + DENSITY_CELL_WIDTH; x++)
+                        {
+                            float tx = float(x - x0) / DENSITY_CELL_WIDTH;
+                            for (int y = y0; y < y0 + DENSITY_CELL_WIDTH; y++)
+                            {
+                                float ty = float(y - y0) / DENSITY_CELL_WIDTH;
+                                int height = heights[x * size + y];
+                                BlockType* column = types + (x * size + y) * WORLD_DEPTH;
+                                for (int z = z0; z <= z1; z++)
+                                {
+                                    float tz = float(z - z0) / DENSITY_CELL_HEIGHT;
+                                    bool ground = allGround || (!allAir && height - z + strength *
+                                        DensityLattice::Interpolate(overhangCorners, tx, ty, tz) >= 0);
+                                    if (ground && carve && height > SEA_HEIGHT && z >= height - CAVE_DEPTH
+                                        && z <= height - CAVE_ROOF && z >= SURFACE_HEIGHT
+                                        && std::abs(DensityLattice::Interpolate(caveCorners, tx, ty, tz)) < threshold)
+                                    {
+                                        ground = false;
+                                    }
+                                    column[z] = ground ? Stone : Air;
+                                }
+                            }
+                        }
+                    }
+                }
+            }
         }
-        else
+
+        // the same layers as getBlockType, counted down from the last open air instead of from the height
+        void laySurface(int size, const int* heights, const Biomes* biomes, BlockType* types)
         {
-            // far inland
-            if (ero < 0.0)
+            const float strength = OverhangStrength;
+            for (int c = 0; c < size * size; c++)
             {
-                //inland mountains;
-                if (t < TEMP_COLD) result = BarrenIceField;
-                else result = InlandForest;
+                const Biomes& layers = biomes[c];
+                int height = heights[c];
+                BlockType* column = types + c * WORLD_DEPTH;
+                int covered = 0;
+                for (int z = WORLD_DEPTH - 1; z >= 0; z--)
+                {
+                    if (column[z] == Air)
+                    {
+                        // air around the surface opens the ground again, the air of caves further down does not
+                        if (z >= height - strength && z > height - CAVE_ROOF)
+                        {
+                            covered = 0;
+                        }
+                    }
+                    else
+                    {
+                        if (covered == 0)
+                        {
+                            column[z] = layers.SurfaceBlock;
+                        }
+                        else if (covered <= layers.ShallowSurfaceDepth + 1)
+                        {
+                            column[z] = layers.ShallowSurfaceBlock;
+                        }
+                        covered++;
+                    }
+                    if (height <= SEA_HEIGHT && z > SURFACE_HEIGHT && z == SEA_HEIGHT)
+                    {
+                        column[z] = Water;
+                    }
+                }
+            }
+        }
+
+        void generateBlocks(float originX, float originY, int size, const int* heights, const Biomes* biomes,
+                            BlockType* types, DensityStats& stats, bool density)
+        {
+            if (density && size % DENSITY_CELL_WIDTH == 0)
+            {
+                densityGround(originX, originY, size, heights, types, stats);
+                laySurface(size, heights, biomes, types);
             }
             else
             {
-                if (t > TEMP_WARM) result = Desert;
-                else result = InlandPlain;
+                heightmapBlocks(originX, originY, size, heights, biomes, types);
+            }
+        }
+    }
+
+    void generateChunkGround(float originX, float originY, int size, const int* heights, BlockType* types,
+                             DensityStats* stats)
+    {
+        DensityStats unused;
+        if (DensityTerrain && size % DENSITY_CELL_WIDTH == 0)
+        {
+            densityGround(originX, originY, size, heights, types, stats ? *stats : unused);
+            return;
+        }
+        for (int column = 0; column < size * size; column++)
+        {
+            for (int z = 0; z < WORLD_DEPTH; z++)
+            {
+                types[column * WORLD_DEPTH + z] = z <= heights[column] ? Stone : Air;
             }
         }
-        
+    }
+
+    void layChunkSurface(int size, const int* heights, const Biomes* biomes, BlockType* types)
+    {
+        laySurface(size, heights, biomes, types);
+    }
+
+    void RunDensityTerrainReport()
+    {
+        const int size = 16;
+        const int radius = 4;
+        const size_t volume = size_t(size) * size * WORLD_DEPTH;
+        DensityStats stats;
+        double columnSeconds = 0.0;
+        double heightmapSeconds = 0.0;
+        double densitySeconds = 0.0;
+        size_t opened = 0;
+        size_t filled = 0;
+
+        std::vector<ColumnNoise> noise(size * size);
+        std::vector<int> heights(size * size);
+        std::vector<Biomes> biomes(size * size);
+        std::vector<BlockType> heightmap(volume);
+        std::vector<BlockType> density(volume);
+        for (int cx = -radius; cx < radius; cx++)
+        {
+            for (int cy = -radius; cy < radius; cy++)
+            {
+                // same origin as ChunkPipeline gives the chunk
+                float originX = float((cx - 0.5) * size * World::UnitBlockSize);
+                float originY = float((cy - 0.5) * size * World::UnitBlockSize);
+                int64_t start = SystemTime::GetCurrentTick();
+                sampleChunkColumnNoise(originX, originY, size, noise.data());
+                for (int column = 0; column < size * size; column++)
+                {
+                    auto random = ColumnRandom(cx, cy, column, SurfaceDepthRandom);
+                    heights[column] = getHeightAndBiomes(noise[column], biomes[column], random);
+                }
+                int64_t columnsDone = SystemTime::GetCurrentTick();
+                DensityStats unused;
+                generateBlocks(originX, originY, size, heights.data(), biomes.data(), heightmap.data(), unused, false);
+                int64_t heightmapDone = SystemTime::GetCurrentTick();
+                generateBlocks(originX, originY, size, heights.data(), biomes.data(), density.data(), stats, true);
+                int64_t densityDone = SystemTime::GetCurrentTick();
+                columnSeconds += SystemTime::TimeBetweenTicks(start, columnsDone);
+                heightmapSeconds += SystemTime::TimeBetweenTicks(columnsDone, heightmapDone);
+                densitySeconds += SystemTime::TimeBetweenTicks(heightmapDone, densityDone);
+
+                for (size_t i = 0; i < volume; i++)
+                {
+                    bool wasAir = heightmap[i] == Air || heightmap[i] == Water;
+                    bool isAir = density[i] == Air || density[i] == Water;
+                    opened += !wasAir && isAir;
+                    filled += wasAir && !isAir;
+                }
+            }
+        }
+
+        size_t chunks = size_t(radius) * radius * 4;
+        size_t cells = stats.solidCells + stats.airCells + stats.mixedCells + stats.caveCells;
+        std::cout << "density terrain: " << chunks << " chunks, columns " << columnSeconds * 1000.0 / chunks
+            << "ms + heightmap blocks " << heightmapSeconds * 1000.0 / chunks << "ms vs density blocks "
+            << densitySeconds * 1000.0 / chunks << "ms per chunk" << std::endl;
+        std::cout << "  " << stats.evaluations / chunks << " 3D fractal evaluations per chunk, cells: "
+            << stats.solidCells * 100.0 / cells << "% ground, " << stats.airCells * 100.0 / cells << "% air, "
+            << stats.mixedCells * 100.0 / cells << "% interpolated, " << stats.caveCells * 100.0 / cells
+            << "% with caves" << std::endl;
+        std::cout << "  " << opened / chunks << " blocks opened (caves, overhangs) and " << filled / chunks
+            << " filled (overhangs) per chunk" << std::endl;
+    }
+
+    int getRealHeightAndBiomes(float x, float y, Biomes& biomes, CounterRandom::Stream& random)
+    {
+        return getHeightAndBiomes(sampleColumnNoise(x, y), biomes, random);
+    }
+
+    int getHeightAndBiomes(const ColumnNoise& noise, Biomes& biomes, CounterRandom::Stream& random)
+    {
+        float cont = noise.continent;
+        float ero = noise.erosion;
+        float pea = noise.peaksValleys;
+
+        float height;
+        // float height = SURFACE_HEIGHT + 5 + (WORLD_DEPTH - SURFACE_HEIGHT) * 0.3 * (cont + 1) / 2;
+        height = getSplineValue(cont, ContinentalnessNodes);
+        height += getSplineValue(ero, ErosionNodes);
+        height += getSplineValue(pea, PeakValleysNodes);
+
+        if (height >= WORLD_DEPTH * 0.95) height = WORLD_DEPTH * 0.95;
+        if (height < 0) height = 0;
+
+        float h = noise.humidity;
+        h = (h + 1) / 2;
+        float t = noise.temperature;
+        t = (t + 1) / 2;
+
+        int region = !(cont < 0.1) * 2 + !(ero < 0.0);
+        int temperatureBand = !(t < TEMP_COLD) + !(t < TEMP_WARM) + (t > TEMP_WARM) + !(t < TEMP_HOT);
+        Biomes result = *BiomeTable[region][temperatureBand][h > HUMIDITY_DRY];
+
         result.ShallowSurfaceDepth = result.ShallowSurfaceDepth * (1 + (random.NextInt(40) - 10) / 100);
         biomes = result;
 
         return height;
     }
+
+    void RunNoiseBenchmark()
+    {
+        // the columns of a 32 x 32 chunk area, laid out like Chunk::GenerateTerrain samples them
+        const int side = 32 * 16;
+        const size_t count = size_t(side) * side;
+        std::vector<float> x(count);
+        std::vector<float> y(count);
+        for (int i = 0; i < side; i++)
+        {
+            for (int j = 0; j < side; j++)
+            {
+                x[i * side + j] = ((i - side / 2) + 0.5f) * World::UnitBlockSize * 1.001f * COOR_STEP;
+                y[i * side + j] = ((j - side / 2) + 0.5f) * World::UnitBlockSize * 1.001f * COOR_STEP;
+            }
+        }
+
+        std::vector<ColumnNoise> reference(count);
+        std::vector<ColumnNoise> batch(count);
+        const char* names[] = {"scalar", "sse4.1", "avx2"};
+        SimplexNoise::SimdLevel supported = SimplexNoise::supportedSimdLevel();
+        for (int l = 0; l <= static_cast<int>(supported); l++)
+        {
+            auto level = static_cast<SimplexNoise::SimdLevel>(l);
+            std::vector<ColumnNoise>& out = l == 0 ? reference : batch;
+            int64_t start = SystemTime::GetCurrentTick();
+            batchColumnNoise(x.data(), y.data(), count, out.data(), level);
+            double seconds = SystemTime::TimeBetweenTicks(start, SystemTime::GetCurrentTick());
+            size_t mismatches = 0;
+            float maxError = 0.0f;
+            if (l > 0)
+            {
+                for (size_t i = 0; i < count; i++)
+                {
+                    const float* a = &reference[i].continent;
+                    const float* b = &batch[i].continent;
+                    for (int field = 0; field < 5; field++)
+                    {
+                        if (a[field] != b[field])
+                        {
+                            mismatches++;
+                            maxError = std::max(maxError, std::abs(a[field] - b[field]));
+                        }
+                    }
+                }
+            }
+            std::cout << "noise benchmark " << names[l] << ": " << count * 5 / seconds << " samples/sec ("
+                << count << " columns x 5 fields, " << seconds * 1000.0 << "ms)";
+            if (l > 0)
+            {
+                std::cout << ", " << mismatches << " values differ from scalar, max error " << maxError;
+            }
+            std::cout << std::endl;
+        }
+    }
+
+    void RunHeightBenchmark()
+    {
+        // uniformly spread noise values, so every spline segment and biome table entry is hit
+        const size_t count = 1 << 20;
+        std::vector<ColumnNoise> noise(count);
+        CounterRandom::Stream random(GetSeed(), 0, 0, 0, 0);
+        for (ColumnNoise& column : noise)
+        {
+            float* fields = &column.continent;
+            for (int field = 0; field < 5; field++)
+            {
+                fields[field] = random.NextFloat(2.0f) - 1.0f;
+            }
+        }
+
+        int64_t start = SystemTime::GetCurrentTick();
+        int64_t heightSum = 0;
+        int64_t depthSum = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            Biomes biomes;
+            auto depthRandom = ColumnRandom(0, 0, int(i), SurfaceDepthRandom);
+            heightSum += getHeightAndBiomes(noise[i], biomes, depthRandom);
+            depthSum += biomes.ShallowSurfaceDepth;
+        }
+        double seconds = SystemTime::TimeBetweenTicks(start, SystemTime::GetCurrentTick());
+        std::cout << "height benchmark: " << seconds * 1e9 / count << "ns per column (" << count << " columns, "
+            << seconds * 1000.0 << "ms), checksum " << heightSum << " / " << depthSum << std::endl;
+    }
 }
@@ -12,6 +12,11 @@ namespace WorldGenerator
     constexpr float TEMP_WARM = 0.7;
     constexpr float TEMP_HOT = 1;
     constexpr int WORLD_DEPTH = 128;
+    // blocks along x and y of a chunk, the light sections and region edit bitmaps are laid out for this width
+    constexpr int CHUNK_WIDTH = 16;
+    // chunks are split vertically into sections for ticking and instance rebuilds
+    constexpr int SECTION_HEIGHT = 16;
+    constexpr int SECTION_COUNT = WORLD_DEPTH / SECTION_HEIGHT;
     constexpr int SEA_HEIGHT = 30;
     constexpr int SURFACE_HEIGHT = 20;
     constexpr float COOR_STEP = 0.0006;
@@ -21,6 +26,22 @@ namespace WorldGenerator
     extern SimplexNoise temperature;
     extern SimplexNoise humidity;
 
+    // what a generation random stream is used for, streams of different purposes are independent
+    enum RandomPurpose : uint32_t
+    {
+        SurfaceDepthRandom = 1,
+        PlantRandom,
+        LeafRandom,
+    };
+
+    // reseeds every noise field, chunks generated afterwards are a pure function of the seed and their position
+    void SetSeed(uint32_t seed);
+    uint32_t GetSeed();
+    // the random numbers of one column of a chunk for one purpose
+    inline CounterRandom::Stream ColumnRandom(int chunkX, int chunkY, int column, RandomPurpose purpose)
+    {
+        return CounterRandom::Stream(GetSeed(), chunkX, chunkY, uint32_t(column), purpose);
+    }
 
 
     struct Biomes
@@ -48,7 +69,66 @@ namespace WorldGenerator
         }
     };
 
-    int getRealHeightAndBiomes(float x, float y, Biomes& biomes);
+    // the noise fields the height and biome of a column are chosen from
+    struct ColumnNoise
+    {
+        float continent;
+        float erosion;
+        float peaksValleys;
+        float temperature;
+        float humidity;
+    };
+    ColumnNoise sampleColumnNoise(float x, float y);
+    // the same for count columns in one fused SIMD batch, out[i] belongs to (x[i], y[i]) and equals the scalar result
+    void sampleColumnNoise(const float* x, const float* y, size_t count, ColumnNoise* out);
+
+    // noise coordinate of a chunk column along one axis, chunkOrigin is the chunk's originPoint on that axis
+    float ColumnCoordinate(float chunkOrigin, int column);
+    // the column noise of a size x size chunk, out[x * size + y]; with "World/Generation/Lattice Noise" on, each field
+    // is sampled every "<field> Lattice" columns and bilinearly interpolated in between. With
+    // "World/Generation/Climate Tile Cache" also on, the climate fields on the cache's spacing come from the
+    // ClimateCache tile shared with the neighbouring chunks
+    void sampleChunkColumnNoise(float originX, float originY, int size, ColumnNoise* out);
+    // compares lattice and full resolution column noise, heights and biomes over an area of chunks
+    void RunLatticeNoiseReport();
+    // compares climate read from the shared tiles with the chunks' own lattice and prints the cache's hit rate
+    void RunClimateCacheReport();
+
+    // blocks per cell of the coarse lattice the 3D density field is sampled on, along x / y and along z
+    constexpr int DENSITY_CELL_WIDTH = 4;
+    constexpr int DENSITY_CELL_HEIGHT = 8;
+
+    struct DensityStats
+    {
+        // cells filled without looking at their blocks
+        size_t solidCells = 0;
+        size_t airCells = 0;
+        // cells the density or cave field was interpolated per block in
+        size_t mixedCells = 0;
+        size_t caveCells = 0;
+        // 3D fractal evaluations at lattice points
+        size_t evaluations = 0;
+    };
+    // the ground of a size x size chunk as Stone / Air, types[(x * size + y) * WORLD_DEPTH + z], from the height of
+    // each column (index x * size + y). With "World/Generation/Density Terrain" on, ground is where
+    // height - z + strength * overhang noise >= 0 and caves are carved where the cave noise is near 0; both noises are
+    // sampled on a DENSITY_CELL_WIDTH x DENSITY_CELL_WIDTH x DENSITY_CELL_HEIGHT lattice and trilinearly interpolated
+    // only in cells whose corner bounds do not already decide them. Otherwise ground is everything up to the height.
+    void generateChunkGround(float originX, float originY, int size, const int* heights, BlockType* types,
+                             DensityStats* stats = nullptr);
+    // turns the ground into the biome's surface and shallow layers and adds the sea, the same layers getBlockType gives
+    void layChunkSurface(int size, const int* heights, const Biomes* biomes, BlockType* types);
+    // compares the cost and result of the heightmap and the density terrain over an area of chunks
+    void RunDensityTerrainReport();
+
+    // random is the column's SurfaceDepthRandom stream
+    int getHeightAndBiomes(const ColumnNoise& noise, Biomes& biomes, CounterRandom::Stream& random);
+    int getRealHeightAndBiomes(float x, float y, Biomes& biomes, CounterRandom::Stream& random);
+
+    // prints scalar and batched column noise throughput in samples per second and any mismatch between them
+    void RunNoiseBenchmark();
+    // times the spline heights and the biome lookup of getHeightAndBiomes per column
+    void RunHeightBenchmark();
 
     BlockType getBlockType(float xCoor, float yCoor, int height, Biomes biomes, int z);
 
@@ -1,18 +1,34 @@
 ﻿#include "WorldMap.h"
 
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+
+#include "EngineTuning.h"
+#include "SystemTime.h"
 #include "World.h"
+#include "Math/Random.h"
 using namespace Math;
 
+BoolVar LogInstanceStaging("Instances/Log Staging Stats", false);
+NumVar VisibleChunkBatch("Instances/Visible Chunk Batch", 32, 1, 256, 1);
+// stages one block at a time under the pool mutex as before the lock-free fill, to measure its contention
+BoolVar LegacyPerBlockStaging("Instances/Legacy Per Block Staging", false);
+NumVar PickDistance("World/Pick Distance (blocks)", 32, 1, 256, 1);
+NumVar PointLightIntensity("World/Light/Point Light Intensity", 0.02f, 0.0f, 1.0f, 0.005f);
+BoolVar LogChunkPipeline("World/Generation/Log Pipeline", false);
+BoolVar ReportHoleFillTimes("World/Generation/Report Hole Fill Times", false);
 
-float WorldMap::minEntityDis = INT_MAX;
-int WorldMap::entityX = 0;
-int WorldMap::entityY = 0;
-int WorldMap::entityZ = 0;
-int WorldMap::entityBlockX = 0;
-int WorldMap::entityBlockY = 0;
+// cells left of / behind the map origin belong to negative chunks
+static int floorDiv(int value, int divisor)
+{
+    return value >= 0 ? value / divisor : (value + 1) / divisor - 1;
+}
 
 WorldMap::WorldMap(int renderAreaCount, int unitAreaSize, int threadCount)
-    : RenderAreaCount(renderAreaCount), UnitAreaSize(unitAreaSize)
+    : RenderAreaCount(renderAreaCount), UnitAreaSize(unitAreaSize), regionEdits(this, threadCount),
+      pipeline(this, unitAreaSize, threadCount)
 {
     thread_pool = new ThreadPool(threadCount);
 
@@ -22,63 +38,114 @@ WorldMap::WorldMap(int renderAreaCount, int unitAreaSize, int threadCount)
     mapOriginPoint = Vector3((-0.5) * UnitAreaSize * World::UnitBlockSize,
                              (-0.5) * UnitAreaSize * World::UnitBlockSize, 0);
 
-    threadResultVector.clear();
     for (int x = 0 - (renderCount / 2); x <= renderCount / 2; x++)
     {
         for (int y = 0 - (renderCount / 2); y <= renderCount / 2; y++)
         {
-            // BlockPosition pos{x, y};
-            threadResultVector.emplace_back(thread_pool->enqueue([=]
+            pipeline.Request(x, y);
+        }
+    }
+    pipeline.WaitIdle();
+    publishGeneratedChunks();
+}
+
+void WorldMap::publishGeneratedChunks()
+{
+    std::vector<Chunk*> chunks;
+    pipeline.TakeFinished(chunks);
+    int64_t now = SystemTime::GetCurrentTick();
+    for (Chunk* block : chunks)
+    {
+        auto hole = visibleHoles.find(BlockPosition{block->posX, block->posY});
+        if (hole != visibleHoles.end())
+        {
+            // only the newest samples are kept
+            if (holeFillSeconds.size() >= 4096)
             {
-                bool result = createUnitWorldBlock({x, y});
-                return result;
-            }));
+                holeFillSeconds.erase(holeFillSeconds.begin(), holeFillSeconds.begin() + 2048);
+            }
+            holeFillSeconds.push_back(SystemTime::TimeBetweenTicks(hole->second, now));
+            visibleHoles.erase(hole);
         }
+        block->chunkId = nextChunkId++;
+        worldMap->emplace(BlockPosition{block->posX, block->posY}, block);
+        block->InvalidateNeighbourEdgeAO();
+        lighting.QueueBorderStitch(block);
     }
-    waitThreadsWorkDone();
+    if (LogChunkPipeline && !chunks.empty())
+    {
+        pipeline.PrintStats();
+    }
+}
+
+void WorldMap::assignOriginSlot(Chunk* chunk)
+{
+    uint32_t slot;
+    if (!freeOriginSlots.empty())
+    {
+        slot = freeOriginSlots.back();
+        freeOriginSlots.pop_back();
+    }
+    else
+    {
+        if (originSlotCount >= BlockResourceManager::MAX_CHUNK_NUMBER)
+        {
+            // the render area holds more chunks than the origin table and the 16 bit chunk index can address
+            std::cout << "out of chunk origin slots (" << BlockResourceManager::MAX_CHUNK_NUMBER << ")" << std::endl;
+            std::abort();
+        }
+        slot = originSlotCount++;
+    }
+    chunk->SetOriginSlot(slot);
+    BlockResourceManager::setChunkOrigin(slot, chunk->blocks[0][0][0].position, World::UnitBlockStep);
 }
 
-bool WorldMap::createUnitWorldBlock(BlockPosition pos)
+void WorldMap::releaseOriginSlot(Chunk* chunk)
 {
-    auto start = GetTickCount();
-    int x = pos.x;
-    int y = pos.y;
-    Vector3 originPoint = Vector3((x - 0.5) * UnitAreaSize * World::UnitBlockSize,
-                                  (y - 0.5) * UnitAreaSize * World::UnitBlockSize, 0);
-    Chunk* block = new Chunk(originPoint, UnitAreaSize);
-    block->worldMap = this;
-    block->posX = x;
-    block->posY = y;
-    worldMap->emplace(BlockPosition{x, y}, block);
-    auto end = GetTickCount();
-    std::cout << "world block generate time: " << end - start << "ms" << std::endl;
-    return true;
+    if (chunk->originSlot != Chunk::NO_ORIGIN_SLOT)
+    {
+        freeOriginSlots.push_back(chunk->originSlot);
+        chunk->originSlot = Chunk::NO_ORIGIN_SLOT;
+    }
 }
 
 void WorldMap::PutBlock(Vector3& ori, Vector3& dir, BlockResourceManager::BlockType type)
 {
-    Block* empty = nullptr;
-    Block* entity = nullptr;
-    FindPickBlock(ori, dir, empty, entity);
-    if (empty != nullptr)
+    RaycastHit hit = Raycast(ori, dir, (int)PickDistance * World::UnitBlockStep);
+    if (!hit.IsHit() || !hit.previous.IsValid())
     {
-        empty->blockType = type;
-        empty->adjacent2Air = true;
+        return;
     }
+    journal.Begin(EditJournal::UserEdit);
+    SetBlock(hit.previous, type);
+    journal.Commit();
 }
 
 void WorldMap::DeleteBlock(Vector3& ori, Vector3& dir)
 {
-    Block* empty = nullptr;
-    Block* entity = nullptr;
-    FindPickBlock(ori, dir, empty, entity);
-    if (entity != nullptr)
+    RaycastHit hit = Raycast(ori, dir, (int)PickDistance * World::UnitBlockStep);
+    if (!hit.IsHit())
     {
-        entity->blockType = Air;
-        entity->adjacent2Air = false;
+        return;
+    }
+    journal.Begin(EditJournal::UserEdit);
+    SetBlock(hit.block, Air);
+    journal.Commit();
+}
 
-        Chunk* worldBlock = worldMap->at(BlockPosition{entityBlockX, entityBlockY});
-        auto siblings = worldBlock->getSiblingBlocks(entityX, entityY, entityZ);
+void WorldMap::SetBlock(const BlockCoord& coord, BlockResourceManager::BlockType type, uint8_t fluidLevel)
+{
+    Block& block = coord.GetBlock();
+    BlockResourceManager::BlockType oldType = block.blockType;
+    journal.Record(coord.chunk, coord.chunk->GetBlockOffsetOnHeap(coord.x, coord.y, coord.z), oldType,
+                   block.fluidLevel, type, fluidLevel);
+    block.blockType = type;
+    block.transparent = isTransparentBlock(type);
+    block.fluidLevel = fluidLevel;
+    if (type == Air)
+    {
+        block.adjacent2Air = false;
+        auto siblings = coord.chunk->getSiblingBlocks(coord.x, coord.y, coord.z);
         for (auto sibling : siblings)
         {
             if (sibling && !sibling->IsNull())
@@ -87,42 +154,366 @@ void WorldMap::DeleteBlock(Vector3& ori, Vector3& dir)
             }
         }
     }
+    else
+    {
+        block.adjacent2Air = true;
+    }
+    coord.chunk->InvalidateAOAround(coord.x, coord.y, coord.z);
+    lighting.OnBlockChanged(coord, oldType);
+    blockTicks.NotifyChanged(coord);
+    fluids.NotifyChanged(coord);
+}
+
+void WorldMap::SetFluidLevel(const BlockCoord& coord, uint8_t fluidLevel)
+{
+    Block& block = coord.GetBlock();
+    journal.Record(coord.chunk, coord.chunk->GetBlockOffsetOnHeap(coord.x, coord.y, coord.z), block.blockType,
+                   block.fluidLevel, block.blockType, fluidLevel);
+    block.fluidLevel = fluidLevel;
 }
 
-void WorldMap::FindPickBlock(Vector3& ori, Vector3& dir, Block*& empty, Block*& entity)
+void WorldMap::TickBlocks(float deltaT, Math::Vector3 position)
 {
-    minEntityDis = INT_MAX;
-    for (auto worldBlock : BlocksNeedRender)
+    BlockPosition center = getPositionOfCamera(position);
+    // everything the simulation changes this frame is one transaction
+    journal.Begin(EditJournal::Simulation);
+    blockTicks.Update(deltaT, center.x, center.y);
+    fluids.Update(deltaT);
+    journal.Commit();
+    lighting.Update();
+}
+
+// Cells are laid out on the chunk grid: UnitAreaSize cells of UnitBlockSize per chunk horizontally
+// (the 0.1% block step gap stays inside the cell) and UnitBlockStep vertically, world Y is chunk z.
+void WorldMap::getCellGrid(float cellSize[3], float gridOrigin[3]) const
+{
+    cellSize[0] = World::UnitBlockSize;
+    cellSize[1] = World::UnitBlockStep;
+    cellSize[2] = World::UnitBlockSize;
+    gridOrigin[0] = mapOriginPoint.GetX();
+    gridOrigin[1] = 0.0f;
+    gridOrigin[2] = mapOriginPoint.GetY();
+}
+
+RaycastHit WorldMap::Raycast(const Vector3& ori, const Vector3& dir, float maxDistance)
+{
+    float cellSize[3];
+    float gridOrigin[3];
+    getCellGrid(cellSize, gridOrigin);
+    const float origin[3] = {ori.GetX(), ori.GetY(), ori.GetZ()};
+    const float direction[3] = {dir.GetX(), dir.GetY(), dir.GetZ()};
+
+    int cell[3];
+    int step[3];
+    float tMax[3];
+    float tDelta[3];
+    for (int axis = 0; axis < 3; axis++)
     {
-        worldBlock->FindPickBlock(ori, dir, empty, entity);
+        float p = (origin[axis] - gridOrigin[axis]) / cellSize[axis];
+        cell[axis] = (int)std::floor(p);
+        if (direction[axis] > 0.0f)
+        {
+            step[axis] = 1;
+            tDelta[axis] = cellSize[axis] / direction[axis];
+            tMax[axis] = (cell[axis] + 1 - p) * tDelta[axis];
+        }
+        else if (direction[axis] < 0.0f)
+        {
+            step[axis] = -1;
+            tDelta[axis] = -cellSize[axis] / direction[axis];
+            tMax[axis] = (p - cell[axis]) * tDelta[axis];
+        }
+        else
+        {
+            step[axis] = 0;
+            tDelta[axis] = FLT_MAX;
+            tMax[axis] = FLT_MAX;
+        }
     }
 
-    Chunk* worldBlock = worldMap->at(BlockPosition{entityBlockX, entityBlockY});
-    auto siblings = worldBlock->getSiblingBlocks(entityX, entityY, entityZ);
+    RaycastHit hit;
+    Chunk* lastChunk = nullptr;
+    int enteredAxis = -1;
+    float t = 0.0f;
+    while (t <= maxDistance)
+    {
+        BlockCoord current = getBlockAtCell(cell[0], cell[1], cell[2], lastChunk);
+        if (current.IsValid() && !current.GetBlock().IsNull())
+        {
+            hit.block = current;
+            hit.t = t;
+            if (enteredAxis >= 0)
+            {
+                float normal[3] = {0.0f, 0.0f, 0.0f};
+                normal[enteredAxis] = (float)-step[enteredAxis];
+                hit.normal = Vector3(normal[0], normal[1], normal[2]);
+            }
+            return hit;
+        }
+        hit.previous = current;
 
-    float t;
-    float minT = INT_MAX;
-    for (auto sibling : siblings)
+        int axis = tMax[0] < tMax[1] ? (tMax[0] < tMax[2] ? 0 : 2) : (tMax[1] < tMax[2] ? 1 : 2);
+        t = tMax[axis];
+        cell[axis] += step[axis];
+        tMax[axis] += tDelta[axis];
+        enteredAxis = axis;
+    }
+    return RaycastHit();
+}
+
+BlockCoord WorldMap::getBlockAtCell(int cellX, int cellY, int cellZ, Chunk*& lastChunk)
+{
+    BlockCoord coord;
+    if (cellY < 0 || cellY >= WorldGenerator::WORLD_DEPTH)
+    {
+        return coord;
+    }
+    int chunkX = floorDiv(cellX, UnitAreaSize);
+    int chunkY = floorDiv(cellZ, UnitAreaSize);
+    // consecutive cells almost always stay in one chunk, so skip the map lookup then
+    if (lastChunk == nullptr || lastChunk->posX != chunkX || lastChunk->posY != chunkY)
+    {
+        auto it = worldMap->find(BlockPosition{chunkX, chunkY});
+        if (it == worldMap->end())
+        {
+            return coord;
+        }
+        lastChunk = it->second;
+    }
+    coord.chunk = lastChunk;
+    coord.x = cellX - chunkX * UnitAreaSize;
+    coord.y = cellZ - chunkY * UnitAreaSize;
+    coord.z = cellY;
+    return coord;
+}
+
+void WorldMap::RaycastBatch(const RayBatch& rays, std::vector<RaycastHit>& hits)
+{
+    uint32_t count = static_cast<uint32_t>(rays.Size());
+    hits.assign(count, RaycastHit());
+
+    // rays starting in the same chunk section share packets, so their lanes walk the same block storage
+    const int sectionHeight = 16;
+    std::vector<uint64_t> keys(count);
+    std::vector<uint32_t> order(count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        int cellX = (int)std::floor((rays.originX[i] - mapOriginPoint.GetX()) / World::UnitBlockSize);
+        int cellY = (int)std::floor(rays.originY[i] / World::UnitBlockStep);
+        int cellZ = (int)std::floor((rays.originZ[i] - mapOriginPoint.GetY()) / World::UnitBlockSize);
+        uint64_t chunkX = static_cast<uint16_t>(floorDiv(cellX, UnitAreaSize));
+        uint64_t chunkY = static_cast<uint16_t>(floorDiv(cellZ, UnitAreaSize));
+        uint64_t section = static_cast<uint16_t>(floorDiv(cellY, sectionHeight));
+        keys[i] = (chunkX << 32) | (chunkY << 16) | section;
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&keys](uint32_t a, uint32_t b)
+    {
+        return keys[a] != keys[b] ? keys[a] < keys[b] : a < b;
+    });
+
+    for (uint32_t first = 0; first < count; first += RAY_PACKET_WIDTH)
+    {
+        traceRayPacket(rays, order.data() + first, std::min<size_t>(RAY_PACKET_WIDTH, count - first), hits);
+    }
+}
+
+// Runs the Raycast walk for up to four rays in lockstep: cell stepping, axis selection and distances are
+// computed on all lanes with DirectXMath, only the block lookups are done per lane.
+void WorldMap::traceRayPacket(const RayBatch& rays, const uint32_t* indices, size_t laneCount,
+                              std::vector<RaycastHit>& hits)
+{
+    using namespace DirectX;
+
+    // unused lanes repeat the first ray and start inactive
+    float lanes[7][RAY_PACKET_WIDTH];
+    const std::vector<float>* sources[7] = {
+        &rays.originX, &rays.originY, &rays.originZ, &rays.dirX, &rays.dirY, &rays.dirZ, &rays.maxDistance
+    };
+    for (size_t lane = 0; lane < RAY_PACKET_WIDTH; lane++)
+    {
+        uint32_t index = indices[lane < laneCount ? lane : 0];
+        for (int i = 0; i < 7; i++)
+        {
+            lanes[i][lane] = (*sources[i])[index];
+        }
+    }
+
+    float cellSize[3];
+    float gridOrigin[3];
+    getCellGrid(cellSize, gridOrigin);
+    const XMVECTOR zero = XMVectorZero();
+    const XMVECTOR one = XMVectorSplatOne();
+    const XMVECTOR far = XMVectorReplicate(FLT_MAX);
+
+    XMVECTOR cell[3];
+    XMVECTOR step[3];
+    XMVECTOR tMax[3];
+    XMVECTOR tDelta[3];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        XMVECTOR origin = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(lanes[axis]));
+        XMVECTOR direction = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(lanes[3 + axis]));
+        XMVECTOR size = XMVectorReplicate(cellSize[axis]);
+
+        XMVECTOR p = XMVectorDivide(XMVectorSubtract(origin, XMVectorReplicate(gridOrigin[axis])), size);
+        cell[axis] = XMVectorFloor(p);
+        XMVECTOR positive = XMVectorGreater(direction, zero);
+        XMVECTOR moving = XMVectorOrInt(positive, XMVectorLess(direction, zero));
+        step[axis] = XMVectorSelect(zero, XMVectorSelect(XMVectorNegate(one), one, positive), moving);
+
+        XMVECTOR delta = XMVectorDivide(size, XMVectorAbs(direction));
+        XMVECTOR toBoundary = XMVectorSelect(XMVectorSubtract(p, cell[axis]),
+                                             XMVectorSubtract(XMVectorAdd(cell[axis], one), p), positive);
+        tDelta[axis] = XMVectorSelect(far, delta, moving);
+        tMax[axis] = XMVectorSelect(far, XMVectorMultiply(toBoundary, delta), moving);
+    }
+
+    XMVECTOR t = zero;
+    XMVECTOR entered[3] = {XMVectorFalseInt(), XMVectorFalseInt(), XMVectorFalseInt()};
+    Chunk* lastChunk[RAY_PACKET_WIDTH] = {};
+    BlockCoord previous[RAY_PACKET_WIDTH];
+    uint32_t active = (1u << laneCount) - 1;
+
+    while (active != 0)
     {
-        if (sibling && sibling->IsNull()
-            && Chunk::Intersect(ori, dir, Chunk::GetScaledSizeAxisBox(sibling->position), t))
+        XMFLOAT4 cellLanes[3];
+        XMFLOAT4 tLanes;
+        for (int axis = 0; axis < 3; axis++)
         {
-            if (t < minT && t < minEntityDis)
+            XMStoreFloat4(&cellLanes[axis], cell[axis]);
+        }
+        XMStoreFloat4(&tLanes, t);
+        const float* cellX = &cellLanes[0].x;
+        const float* cellY = &cellLanes[1].x;
+        const float* cellZ = &cellLanes[2].x;
+        const float* tLane = &tLanes.x;
+
+        for (size_t lane = 0; lane < laneCount; lane++)
+        {
+            if ((active & (1u << lane)) == 0)
             {
-                minT = t;
-                empty = sibling;
+                continue;
             }
+            if (tLane[lane] > lanes[6][lane])
+            {
+                active &= ~(1u << lane);
+                continue;
+            }
+
+            BlockCoord current = getBlockAtCell((int)cellX[lane], (int)cellY[lane], (int)cellZ[lane], lastChunk[lane]);
+            if (current.IsValid() && !current.GetBlock().IsNull())
+            {
+                RaycastHit& hit = hits[indices[lane]];
+                hit.block = current;
+                hit.previous = previous[lane];
+                hit.t = tLane[lane];
+                float normal[3];
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    XMUINT4 mask;
+                    XMFLOAT4 steps;
+                    XMStoreUInt4(&mask, entered[axis]);
+                    XMStoreFloat4(&steps, step[axis]);
+                    normal[axis] = (&mask.x)[lane] ? -(&steps.x)[lane] : 0.0f;
+                }
+                hit.normal = Vector3(normal[0], normal[1], normal[2]);
+                active &= ~(1u << lane);
+                continue;
+            }
+            previous[lane] = current;
+        }
+
+        // same axis choice as Raycast: x if strictly nearest, otherwise y if nearer than z, otherwise z
+        XMVECTOR xNearer = XMVectorLess(tMax[0], tMax[1]);
+        entered[0] = XMVectorAndInt(xNearer, XMVectorLess(tMax[0], tMax[2]));
+        entered[1] = XMVectorAndCInt(XMVectorLess(tMax[1], tMax[2]), xNearer);
+        entered[2] = XMVectorNotEqualInt(XMVectorOrInt(entered[0], entered[1]), XMVectorTrueInt());
+        t = XMVectorSelect(XMVectorSelect(tMax[2], tMax[1], entered[1]), tMax[0], entered[0]);
+        for (int axis = 0; axis < 3; axis++)
+        {
+            cell[axis] = XMVectorAdd(cell[axis], XMVectorSelect(zero, step[axis], entered[axis]));
+            tMax[axis] = XMVectorAdd(tMax[axis], XMVectorSelect(zero, tDelta[axis], entered[axis]));
         }
     }
 }
 
-void WorldMap::updateBlockNeedRender(Vector3 position)
+void WorldMap::RunRaycastBenchmark(const Vector3& center)
+{
+    const uint32_t rayCount = 1 << 16;
+    const int rayLengths[] = {8, 32, 128};
+    const float spread = UnitAreaSize * World::UnitBlockSize * 4.0f;
+    const float worldHeight = WorldGenerator::WORLD_DEPTH * World::UnitBlockStep;
+
+    RandomNumberGenerator rng(20240601);
+    RayBatch rays;
+    std::vector<RaycastHit> scalarHits(rayCount);
+    std::vector<RaycastHit> batchHits;
+
+    for (int length : rayLengths)
+    {
+        rays.Clear();
+        float distance = length * World::UnitBlockStep;
+        for (uint32_t i = 0; i < rayCount; i++)
+        {
+            Vector3 ori(center.GetX() + rng.NextFloat(-spread, spread), rng.NextFloat(0.0f, worldHeight),
+                        center.GetZ() + rng.NextFloat(-spread, spread));
+            Vector3 dir(rng.NextFloat(-1.0f, 1.0f), rng.NextFloat(-1.0f, 1.0f), rng.NextFloat(-1.0f, 1.0f));
+            rays.Add(ori, Normalize(dir), distance);
+        }
+
+        int64_t start = SystemTime::GetCurrentTick();
+        for (uint32_t i = 0; i < rayCount; i++)
+        {
+            scalarHits[i] = Raycast(Vector3(rays.originX[i], rays.originY[i], rays.originZ[i]),
+                                    Vector3(rays.dirX[i], rays.dirY[i], rays.dirZ[i]), distance);
+        }
+        int64_t scalarEnd = SystemTime::GetCurrentTick();
+        RaycastBatch(rays, batchHits);
+        int64_t batchEnd = SystemTime::GetCurrentTick();
+
+        uint32_t hitCount = 0;
+        uint32_t mismatches = 0;
+        for (uint32_t i = 0; i < rayCount; i++)
+        {
+            const BlockCoord& a = scalarHits[i].block;
+            const BlockCoord& b = batchHits[i].block;
+            hitCount += a.IsValid();
+            mismatches += a.chunk != b.chunk || a.x != b.x || a.y != b.y || a.z != b.z;
+        }
+
+        double scalarTime = SystemTime::TimeBetweenTicks(start, scalarEnd);
+        double batchTime = SystemTime::TimeBetweenTicks(scalarEnd, batchEnd);
+        std::cout << "raycast benchmark: " << rayCount << " rays of " << length << " blocks, scalar "
+            << rayCount / scalarTime / 1e6 << " Mrays/s, packets of " << RAY_PACKET_WIDTH << " "
+            << rayCount / batchTime / 1e6 << " Mrays/s, hits " << hitCount
+            << ", mismatches " << mismatches << std::endl;
+    }
+}
+
+void WorldMap::updateBlockNeedRender(Vector3 position, const Camera* camera)
 {
     BlockPosition pos = getPositionOfCamera(position);
     BlocksNeedRender.clear();
 
+    std::function<bool(int, int)> inView;
+    if (camera != nullptr)
+    {
+        Frustum frustum = camera->GetWorldSpaceFrustum();
+        float size = UnitAreaSize * World::UnitBlockSize;
+        float height = WorldGenerator::WORLD_DEPTH * World::UnitBlockStep;
+        inView = [frustum, size, height](int x, int y)
+        {
+            return frustum.IntersectBoundingBox(AxisAlignedBox(Vector3((x - 0.5f) * size, 0.0f, (y - 0.5f) * size),
+                                                               Vector3((x + 0.5f) * size, height, (y + 0.5f) * size)));
+        };
+    }
+    updatePipelineFocus(position, pos, inView);
     initBufferArea(pos);
+    publishGeneratedChunks();
 
+    int64_t now = SystemTime::GetCurrentTick();
+    std::unordered_map<BlockPosition, int64_t, hashName> holes;
     for (int x = pos.x - (RenderAreaCount / 2); x <= pos.x + RenderAreaCount / 2; x++)
     {
         for (int y = pos.y - (RenderAreaCount / 2); y <= pos.y + RenderAreaCount / 2; y++)
@@ -130,16 +521,70 @@ void WorldMap::updateBlockNeedRender(Vector3 position)
             if (worldMap->find(BlockPosition{x, y}) == worldMap->end())
             {
                 std::cout << "nothing find in position x: " << x << "y " << y << std::endl;
+                if (!inView || inView(x, y))
+                {
+                    auto seen = visibleHoles.find(BlockPosition{x, y});
+                    holes.emplace(BlockPosition{x, y}, seen != visibleHoles.end() ? seen->second : now);
+                }
                 continue;
             }
             BlocksNeedRender.emplace_back(worldMap->at(BlockPosition{x, y}));
         }
     }
+    // holes that left the view or the render area are no longer waited for
+    visibleHoles.swap(holes);
+
+    if (ReportHoleFillTimes)
+    {
+        ReportHoleFillTimes = false;
+        reportHoleFillTimes();
+    }
+}
+
+void WorldMap::updatePipelineFocus(Vector3 position, BlockPosition center,
+                                   const std::function<bool(int, int)>& inView)
+{
+    float size = UnitAreaSize * World::UnitBlockSize;
+    int64_t now = SystemTime::GetCurrentTick();
+    ChunkPipeline::Focus focus;
+    focus.x = (position.GetX() - mapOriginPoint.GetX()) / size - 0.5f;
+    focus.y = (position.GetZ() - mapOriginPoint.GetY()) / size - 0.5f;
+    double seconds = lastFocusTick != 0 ? SystemTime::TimeBetweenTicks(lastFocusTick, now) : 0.0;
+    if (seconds > 0.0)
+    {
+        focus.velocityX = float((position.GetX() - lastFocusPosition.GetX()) / size / seconds);
+        focus.velocityY = float((position.GetZ() - lastFocusPosition.GetZ()) / size / seconds);
+    }
+    lastFocusPosition = position;
+    lastFocusTick = now;
+    // the same area initBufferArea requests
+    focus.centerX = center.x;
+    focus.centerY = center.y;
+    focus.radius = (RenderAreaCount + 2) / 2;
+    focus.inView = inView;
+    pipeline.SetFocus(focus);
+}
+
+void WorldMap::reportHoleFillTimes()
+{
+    if (holeFillSeconds.empty())
+    {
+        std::cout << "hole fill: no visible hole filled yet" << std::endl;
+        return;
+    }
+    std::vector<double> sorted = holeFillSeconds;
+    std::sort(sorted.begin(), sorted.end());
+    size_t last = sorted.size() - 1;
+    std::cout << "hole fill: " << sorted.size() << " visible holes, p50 " << sorted[last / 2] * 1000.0 << "ms, p99 "
+        << sorted[size_t(last * 0.99)] * 1000.0 << "ms, max " << sorted[last] * 1000.0 << "ms, "
+        << visibleHoles.size() << " open" << std::endl;
+    pipeline.PrintStats();
+    holeFillSeconds.clear();
 }
 
 std::vector<Chunk*>& WorldMap::getBlocksNeedRender(Vector3 position)
 {
-    updateBlockNeedRender(position);
+    updateBlockNeedRender(position, nullptr);
     return BlocksNeedRender;
 }
 
@@ -147,20 +592,189 @@ void WorldMap::renderVisibleBlocks(Camera& camera, GraphicsContext& context)
 {
     BlockResourceManager::clearVisibleBlocks();
     // update blocks
-    updateBlockNeedRender(camera.GetPosition());
+    updateBlockNeedRender(camera.GetPosition(), &camera);
 
     //render in multi-threading.
     threadResultVector.clear();
 
+    // rebuild the exposed instances of changed chunks only,
+    // clean chunks re-entering the render area just copy their cached payload back.
+    std::vector<Chunk*> dirtyChunks;
     for (auto& block : BlocksNeedRender)
     {
-        threadResultVector.emplace_back(thread_pool->enqueue([&]
+        // slots are only held inside the render area, so they never run out however far the camera travels
+        if (block->originSlot == Chunk::NO_ORIGIN_SLOT)
+        {
+            assignOriginSlot(block);
+        }
+        if (block->instancesDirty.exchange(false))
+        {
+            dirtyChunks.push_back(block);
+            threadResultVector.emplace_back(thread_pool->enqueue([=]
+            {
+                return block->BuildInstances();
+            }));
+        }
+        else if (!block->instancesResident)
+        {
+            dirtyChunks.push_back(block);
+        }
+    }
+    waitThreadsWorkDone();
+
+    for (auto block : dirtyChunks)
+    {
+        block->CommitInstances();
+    }
+
+    // chunks that left the render area give their pool ranges back.
+    std::unordered_set<Chunk*> chunksInRenderArea(BlocksNeedRender.begin(), BlocksNeedRender.end());
+    for (auto it = ChunksHoldingInstances.begin(); it != ChunksHoldingInstances.end();)
+    {
+        if (chunksInRenderArea.find(*it) == chunksInRenderArea.end())
+        {
+            (*it)->ReleaseInstances();
+            releaseOriginSlot(*it);
+            it = ChunksHoldingInstances.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    ChunksHoldingInstances.insert(dirtyChunks.begin(), dirtyChunks.end());
+
+    // per frame only the indices of the visible chunks' ranges are uploaded.
+    std::vector<Chunk*> visibleChunks;
+    uint32_t visibleTotals[BlockResourceManager::BucketCount] = {};
+    for (auto& block : BlocksNeedRender)
+    {
+        if (!block->IntersectFrustum(camera))
+        {
+            continue;
+        }
+        visibleChunks.push_back(block);
+        for (int i = 0; i < BlockResourceManager::BucketCount; i++)
+        {
+            visibleTotals[i] += block->instanceRanges[i].count;
+        }
+    }
+    for (int i = 0; i < BlockResourceManager::BucketCount; i++)
+    {
+        BlockResourceManager::getManager(static_cast<BlockResourceManager::RenderBucket>(i))
+            .PrepareVisibleIndices(visibleTotals[i]);
+    }
+
+    // each batch reserves its slice of the index buffers once and then writes without any lock.
+    threadResultVector.clear();
+    size_t batchSize = static_cast<size_t>((int)VisibleChunkBatch);
+    bool perBlock = LegacyPerBlockStaging;
+    for (size_t start = 0; start < visibleChunks.size(); start += batchSize)
+    {
+        size_t end = std::min(start + batchSize, visibleChunks.size());
+        threadResultVector.emplace_back(thread_pool->enqueue([&visibleChunks, start, end, perBlock]
         {
-            bool result = block->Render(camera, context);
-            return result;
+            if (perBlock)
+            {
+                addVisibleIndicesPerBlock(visibleChunks, start, end);
+            }
+            else
+            {
+                writeVisibleIndices(visibleChunks, start, end);
+            }
+            return true;
         }));
     }
     waitThreadsWorkDone();
+
+    for (int i = 0; i < BlockResourceManager::BucketCount; i++)
+    {
+        BlockResourceManager::getManager(static_cast<BlockResourceManager::RenderBucket>(i)).FinishVisibleIndices();
+    }
+
+    if (LogInstanceStaging)
+    {
+        BlockResourceManager::printStagingStats();
+    }
+}
+
+// lights are keyed by chunk slot and block offset, so the binner keeps a block's light in the same slot
+void WorldMap::GatherPointLights(std::vector<Lighting::LightGridBinner::PointLight>& lights)
+{
+    constexpr uint32_t OFFSET_BITS = 15;
+    lights.clear();
+    float cellSize[3];
+    float gridOrigin[3];
+    getCellGrid(cellSize, gridOrigin);
+    for (auto chunk : BlocksNeedRender)
+    {
+        for (int offset : chunk->emissiveBlocks)
+        {
+            int x = offset % chunk->chunkSize;
+            int y = offset / chunk->chunkSize % chunk->chunkSize;
+            int z = offset / (chunk->chunkSize * chunk->chunkSize);
+            uint8_t emission = BlockLightEmission[chunk->blocks[x][y][z].blockType];
+            const float cell[3] = {
+                float(chunk->posX * UnitAreaSize + x), float(z), float(chunk->posY * UnitAreaSize + y)
+            };
+            // same warm tint as the block light fill in DefaultPS
+            const float tint[3] = {1.0f, 0.85f, 0.6f};
+            float intensity = emission / float(VoxelLight::MAX_LIGHT) * PointLightIntensity;
+
+            Lighting::LightGridBinner::PointLight light;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                light.pos[axis] = gridOrigin[axis] + (cell[axis] + 0.5f) * cellSize[axis];
+                light.color[axis] = tint[axis] * intensity;
+            }
+            light.radius = emission * float(World::UnitBlockSize);
+            light.key = (chunk->originSlot << OFFSET_BITS) | uint32_t(offset);
+            lights.push_back(light);
+        }
+    }
+}
+
+void WorldMap::writeVisibleIndices(const std::vector<Chunk*>& chunks, size_t start, size_t end)
+{
+    for (int i = 0; i < BlockResourceManager::BucketCount; i++)
+    {
+        uint32_t batchCount = 0;
+        for (size_t c = start; c < end; c++)
+        {
+            batchCount += chunks[c]->instanceRanges[i].count;
+        }
+        if (batchCount == 0)
+        {
+            continue;
+        }
+
+        auto& manager = BlockResourceManager::getManager(static_cast<BlockResourceManager::RenderBucket>(i));
+        uint32_t* dst = manager.ReserveVisibleIndices(batchCount);
+        for (size_t c = start; c < end; c++)
+        {
+            const InstanceRange& range = chunks[c]->instanceRanges[i];
+            for (uint32_t k = 0; k < range.count; k++)
+            {
+                *dst++ = range.offset + k;
+            }
+        }
+    }
+}
+
+void WorldMap::addVisibleIndicesPerBlock(const std::vector<Chunk*>& chunks, size_t start, size_t end)
+{
+    for (int i = 0; i < BlockResourceManager::BucketCount; i++)
+    {
+        auto& manager = BlockResourceManager::getManager(static_cast<BlockResourceManager::RenderBucket>(i));
+        for (size_t c = start; c < end; c++)
+        {
+            const InstanceRange& range = chunks[c]->instanceRanges[i];
+            for (uint32_t k = 0; k < range.count; k++)
+            {
+                manager.AddVisibleIndex(range.offset + k);
+            }
+        }
+    }
 }
 
 void WorldMap::waitThreadsWorkDone()
@@ -188,18 +802,11 @@ void WorldMap::initBufferArea(BlockPosition pos)
     {
         for (int y = pos.y - (renderCount / 2); y <= pos.y + renderCount / 2; y++)
         {
-            BlockPosition blockPos{x, y};
-            if (worldMap->find(blockPos) != worldMap->end()
-                || BlocksCreating.find(blockPos) != BlocksCreating.end())
+            // requesting a chunk already on its way is a no-op
+            if (worldMap->find(BlockPosition{x, y}) == worldMap->end())
             {
-                continue;
+                pipeline.Request(x, y);
             }
-            BlocksCreating.insert(blockPos);
-            thread_pool->enqueue([=]
-            {
-                createUnitWorldBlock(blockPos);
-                BlocksCreating.erase(blockPos);
-            });
         }
     }
 }
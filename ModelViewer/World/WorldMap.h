@@ -1,20 +1,24 @@
 ﻿#pragma once
+#include <functional>
 #include <unordered_map>
 #include <unordered_set>
 
+#include "LightGridBinning.h"
 #include "ThreadPool.h"
+#include "BlockTicks.h"
+#include "ChunkPipeline.h"
+#include "EditJournal.h"
+#include "FluidSimulation.h"
+#include "LightEngine.h"
+#include "RegionEdit.h"
 #include "Chunk.h"
+#include "VoxelRaycast.h"
 
 using namespace Math;
+
 class WorldMap
 {
 public:
-    static float minEntityDis;
-    static int entityX;
-    static int entityY;
-    static int entityZ;
-    static int entityBlockX ;
-    static int entityBlockY ;
     struct BlockPosition
     {
         int x;
@@ -26,16 +30,58 @@ public:
         }
     };
     WorldMap(int renderAreaCount, int unitAreaSize, int threadCount);
-    bool createUnitWorldBlock(BlockPosition pos);
     void PutBlock(Vector3& ori, Vector3& dir, BlockResourceManager::BlockType type);
     void DeleteBlock(Vector3& ori, Vector3& dir);
-    void FindPickBlock(Vector3& ori, Vector3& dir, Block*& empty, Block*& entity);
+    // changes a block in place, keeps exposure and AO up to date and notifies block ticks and fluids
+    void SetBlock(const BlockCoord& coord, BlockResourceManager::BlockType type, uint8_t fluidLevel = 0);
+    // only the flow level of a fluid block changes, journaled like SetBlock but AO, light and instances stay as they are
+    void SetFluidLevel(const BlockCoord& coord, uint8_t fluidLevel);
+    // advances block ticks, fluid flow and pending light propagation, random ticks run around the camera position
+    void TickBlocks(float deltaT, Math::Vector3 position);
+    BlockTickScheduler& GetBlockTicks()
+    {
+        return blockTicks;
+    }
+    FluidSimulation& GetFluids()
+    {
+        return fluids;
+    }
+    LightEngine& GetLighting()
+    {
+        return lighting;
+    }
+    // fill / replace / copy / paste of whole boxes of cells, see RegionEdit.h
+    RegionEditor& GetRegionEdits()
+    {
+        return regionEdits;
+    }
+    // every block change, grouped into transactions, with undo / redo of user edits
+    EditJournal& GetJournal()
+    {
+        return journal;
+    }
+    int GetChunkSize() const
+    {
+        return UnitAreaSize;
+    }
+    // Amanatides-Woo voxel walk from ori along dir, visiting only the cells the ray crosses
+    RaycastHit Raycast(const Vector3& ori, const Vector3& dir, float maxDistance);
+    // same walk for many rays at once, hits[i] belongs to ray i
+    void RaycastBatch(const RayBatch& rays, std::vector<RaycastHit>& hits);
+    // prints scalar and batched rays per second for random rays around center
+    void RunRaycastBenchmark(const Vector3& center);
     std::vector<Chunk*>& getBlocksNeedRender(Math::Vector3 position);
     void renderVisibleBlocks(Camera& camera, GraphicsContext& context);
+    // the emissive blocks of the chunks in the render area as point lights, culled and ranked by LightGridBinner
+    void GatherPointLights(std::vector<Lighting::LightGridBinner::PointLight>& lights);
     void waitThreadsWorkDone();
 
     Chunk* getWorldBlockRef(int x, int y);
     bool hasBlock(int x, int y);
+    // world space size and origin of the block cells along world X, Y (up), Z
+    void getCellGrid(float cellSize[3], float gridOrigin[3]) const;
+    // block of a world cell (Y is the chunk z), lastChunk caches the chunk of the previous lookup
+    BlockCoord getBlockAtCell(int cellX, int cellY, int cellZ, Chunk*& lastChunk);
 
 private:
     struct hashName
@@ -46,15 +92,43 @@ private:
         }
     };
     void initBufferArea(BlockPosition pos);
-    void updateBlockNeedRender(Vector3 position);
+    // adds the chunks the pipeline finished to the world, main thread only
+    void publishGeneratedChunks();
+    // gives a chunk entering the render area a ChunkOriginTable slot, reusing slots of chunks that left it
+    void assignOriginSlot(Chunk* chunk);
+    void releaseOriginSlot(Chunk* chunk);
+    void traceRayPacket(const RayBatch& rays, const uint32_t* indices, size_t laneCount,
+                        std::vector<RaycastHit>& hits);
+    // camera may be null, then every position of the render area counts as in view
+    void updateBlockNeedRender(Vector3 position, const Camera* camera);
+    // ranks and trims the pipeline's work by the camera's chunk, motion and frustum
+    void updatePipelineFocus(Vector3 position, BlockPosition center, const std::function<bool(int, int)>& inView);
+    // p50 / p99 of the time from a hole first showing in view until its chunk was published
+    void reportHoleFillTimes();
+    static void writeVisibleIndices(const std::vector<Chunk*>& chunks, size_t start, size_t end);
+    static void addVisibleIndicesPerBlock(const std::vector<Chunk*>& chunks, size_t start, size_t end);
     BlockPosition getPositionOfCamera(Math::Vector3& position);
     Vector3 mapOriginPoint;
     ThreadPool* thread_pool;
     std::vector<std::future<bool>> threadResultVector{};
-    std::unordered_set<BlockPosition, hashName> BlocksCreating{};
+    uint32_t nextChunkId = 0;
+    std::vector<uint32_t> freeOriginSlots{};
+    uint32_t originSlotCount = 0;
     int UnitAreaSize;
     int RenderAreaCount;
     std::unordered_map<BlockPosition, Chunk*, hashName>* worldMap{};
     std::vector<Chunk*> BlocksNeedRender{};
+    BlockTickScheduler blockTicks{this};
+    FluidSimulation fluids{this};
+    LightEngine lighting{this};
+    RegionEditor regionEdits;
+    EditJournal journal{this};
+    ChunkPipeline pipeline;
+    Vector3 lastFocusPosition;
+    int64_t lastFocusTick = 0;
+    // render area positions in view without a chunk, with the tick they were first seen
+    std::unordered_map<BlockPosition, int64_t, hashName> visibleHoles{};
+    std::vector<double> holeFillSeconds{};
+    std::unordered_set<Chunk*> ChunksHoldingInstances{};
 
 };
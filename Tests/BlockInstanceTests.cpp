@@ -0,0 +1,110 @@
+#include "TestHarness.h"
+
+#include "../ModelViewer/Blocks/BlockInstance.h"
+
+using namespace BlockInstance;
+
+namespace
+{
+    bool sameFields(const InstanceFields& a, const InstanceFields& b)
+    {
+        return a.x == b.x && a.y == b.y && a.z == b.z && a.chunkIndex == b.chunkIndex && a.faceMask == b.faceMask
+            && a.blockType == b.blockType && a.ao.Bits[0] == b.ao.Bits[0] && a.ao.Bits[1] == b.ao.Bits[1]
+            && a.light == b.light;
+    }
+
+    InstanceFields roundTrip(const InstanceFields& fields)
+    {
+        return Decode(Encode(fields));
+    }
+}
+
+TEST(MaximumCoordinatesRoundTrip)
+{
+    InstanceFields fields;
+    fields.x = 1023;
+    fields.y = 1023;
+    fields.z = 255;
+    fields.chunkIndex = MAX_CHUNK_INDEX;
+    fields.blockType = 255;
+    CHECK(MAX_CHUNK_INDEX == 65535);
+    CHECK(sameFields(roundTrip(fields), fields));
+
+    PackedInstance packed = Encode(fields);
+    // 4 reserved bits of Position and 2 of Info stay clear
+    CHECK(packed.Position == 0x0FFFFFFF);
+    CHECK((packed.Info >> 30) == 0);
+}
+
+TEST(FieldsDoNotBleedIntoEachOther)
+{
+    InstanceFields fields;
+    fields.x = 1023;
+    fields.faceMask = 0;
+    fields.light = 0;
+    fields.ao.Bits[0] = 0;
+    fields.ao.Bits[1] = 0;
+    InstanceFields decoded = roundTrip(fields);
+    CHECK(decoded.x == 1023 && decoded.y == 0 && decoded.z == 0);
+
+    fields = InstanceFields();
+    fields.chunkIndex = 65535;
+    fields.faceMask = 0;
+    decoded = roundTrip(fields);
+    CHECK(decoded.chunkIndex == 65535 && decoded.faceMask == 0 && decoded.blockType == 0);
+
+    // out of range values are masked instead of spilling into the next field
+    fields = InstanceFields();
+    fields.x = 1024;
+    fields.chunkIndex = 65536;
+    decoded = roundTrip(fields);
+    CHECK(decoded.x == 0 && decoded.y == 0 && decoded.chunkIndex == 0 && decoded.faceMask == ALL_FACES);
+}
+
+TEST(EveryFaceMaskRoundTrips)
+{
+    for (uint32_t mask = 0; mask <= ALL_FACES; mask++)
+    {
+        InstanceFields fields;
+        fields.faceMask = uint8_t(mask);
+        fields.chunkIndex = 0x5A5A;
+        fields.blockType = 0xA5;
+        CHECK(sameFields(roundTrip(fields), fields));
+    }
+}
+
+TEST(EveryAOBitRoundTrips)
+{
+    // 24 corner pairs plus 6 flip bits, all below the light byte of AO[1]
+    for (int bit = 0; bit < 32 + 24; bit++)
+    {
+        InstanceFields fields;
+        fields.ao.Bits[0] = 0;
+        fields.ao.Bits[1] = 0;
+        fields.ao.Bits[bit / 32] = 1u << (bit % 32);
+        fields.light = 0;
+        CHECK(sameFields(roundTrip(fields), fields));
+    }
+    InstanceFields fields;
+    fields.ao = VoxelAO::BlockAO();
+    for (int face = 0; face < VoxelAO::FACE_COUNT; face++)
+    {
+        fields.ao.SetCorner(face, face % VoxelAO::CORNER_COUNT, uint8_t(face % 4));
+        fields.ao.SetFlipped(face, true);
+    }
+    CHECK(sameFields(roundTrip(fields), fields));
+}
+
+TEST(LightByteSitsInTopOfAO1)
+{
+    for (uint32_t light = 0; light < 256; light++)
+    {
+        InstanceFields fields;
+        fields.light = uint8_t(light);
+        PackedInstance packed = Encode(fields);
+        CHECK((packed.AO[1] >> LIGHT_SHIFT) == light);
+        // the AO bits below stay untouched
+        CHECK((packed.AO[1] & Mask(LIGHT_SHIFT)) == (fields.ao.Bits[1] & Mask(LIGHT_SHIFT)));
+        CHECK(sameFields(Decode(packed), fields));
+    }
+}
@@ -0,0 +1,9 @@
+// The MSVC cpuid intrinsics on top of gcc / clang's cpuid.h, which already provides __cpuidex.
+#pragma once
+#include <cpuid.h>
+
+#undef __cpuid
+inline void __cpuid(int info[4], int leaf)
+{
+    __cpuid_count(leaf, 0, info[0], info[1], info[2], info[3]);
+}
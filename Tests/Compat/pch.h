@@ -0,0 +1,3 @@
+// Stands in for Core/pch.h, the Windows / D3D precompiled header the Core sources include first.
+// The test project copies those sources into its build directory, so "pch.h" resolves here.
+#pragma once
@@ -0,0 +1,113 @@
+#include "TestHarness.h"
+
+#include <vector>
+
+#include "../ModelViewer/Entities/EntityIdTable.h"
+
+namespace
+{
+    // dense payload beside the table, removed the way EntitySystem removes its SoA arrays
+    struct Entities
+    {
+        EntityIdTable table;
+        std::vector<uint32_t> payload;
+
+        uint32_t Create(uint32_t value)
+        {
+            uint32_t id = table.Add();
+            payload.push_back(value);
+            return id;
+        }
+
+        void Destroy(uint32_t id)
+        {
+            uint32_t index = table.Remove(id);
+            payload[index] = payload.back();
+            payload.pop_back();
+        }
+
+        uint32_t Get(uint32_t id) const
+        {
+            return payload[table.GetIndex(id)];
+        }
+    };
+}
+
+TEST(IdsSurviveSwapRemove)
+{
+    Entities entities;
+    uint32_t ids[5];
+    for (uint32_t i = 0; i < 5; i++)
+    {
+        ids[i] = entities.Create(100 + i);
+    }
+
+    // removing from the middle moves the last entity into index 1
+    entities.Destroy(ids[1]);
+    CHECK(!entities.table.IsAlive(ids[1]));
+    CHECK(entities.table.GetCount() == 4);
+    CHECK(entities.table.GetIndex(ids[4]) == 1);
+    for (uint32_t i : {0u, 2u, 3u, 4u})
+    {
+        CHECK(entities.table.IsAlive(ids[i]));
+        CHECK(entities.Get(ids[i]) == 100 + i);
+    }
+
+    // removing the last entity moves nothing
+    entities.Destroy(ids[3]);
+    CHECK(entities.table.GetCount() == 3);
+    CHECK(entities.Get(ids[0]) == 100);
+    CHECK(entities.Get(ids[2]) == 102);
+    CHECK(entities.Get(ids[4]) == 104);
+
+    // dense index and id agree both ways
+    for (uint32_t index = 0; index < entities.table.GetCount(); index++)
+    {
+        CHECK(entities.table.GetIndex(entities.table.GetId(index)) == index);
+    }
+}
+
+TEST(ReleasedIdsAreReused)
+{
+    Entities entities;
+    uint32_t a = entities.Create(1);
+    uint32_t b = entities.Create(2);
+    entities.Destroy(a);
+    CHECK(!entities.table.IsAlive(a));
+
+    uint32_t c = entities.Create(3);
+    CHECK(c == a);
+    CHECK(entities.Get(b) == 2);
+    CHECK(entities.Get(c) == 3);
+    CHECK(!entities.table.IsAlive(EntityIdTable::InvalidId));
+    CHECK(!entities.table.IsAlive(7));
+}
+
+TEST(RemovingEverythingLeavesAnEmptyTable)
+{
+    Entities entities;
+    std::vector<uint32_t> ids;
+    for (uint32_t i = 0; i < 64; i++)
+    {
+        ids.push_back(entities.Create(i));
+    }
+    // every other entity first, then the rest from the back
+    for (uint32_t i = 0; i < 64; i += 2)
+    {
+        entities.Destroy(ids[i]);
+    }
+    for (uint32_t i = 1; i < 64; i += 2)
+    {
+        CHECK(entities.Get(ids[i]) == i);
+    }
+    for (uint32_t i = 63; i < 64; i -= 2)
+    {
+        entities.Destroy(ids[i]);
+    }
+    CHECK(entities.table.GetCount() == 0);
+    CHECK(entities.payload.empty());
+    for (uint32_t id : ids)
+    {
+        CHECK(!entities.table.IsAlive(id));
+    }
+}
@@ -0,0 +1,124 @@
+#include "TestHarness.h"
+
+#include <utility>
+
+#include "../ModelViewer/Blocks/BlockInstance.h"
+#include "../ModelViewer/Blocks/InstanceRangeAllocator.h"
+
+TEST(AllocatesFirstFit)
+{
+    InstanceRangeAllocator allocator(100);
+    InstanceRange a = allocator.Allocate(10);
+    InstanceRange b = allocator.Allocate(20);
+    CHECK(a.offset == 0 && a.count == 10);
+    CHECK(b.offset == 10 && b.count == 20);
+    CHECK(allocator.GetUsedCount() == 30);
+
+    allocator.Free(a);
+    // the hole at 0 fits 5, 15 does not fit and goes behind b
+    CHECK(allocator.Allocate(5).offset == 0);
+    CHECK(allocator.Allocate(15).offset == 30);
+    CHECK(allocator.Allocate(5).offset == 5);
+    CHECK(allocator.GetUsedCount() == 45);
+}
+
+TEST(FreeMergesWithBothNeighbours)
+{
+    InstanceRangeAllocator allocator(30);
+    InstanceRange a = allocator.Allocate(10);
+    InstanceRange b = allocator.Allocate(10);
+    InstanceRange c = allocator.Allocate(10);
+    CHECK(allocator.GetFreeRangeCount() == 0);
+    allocator.Free(a);
+    allocator.Free(c);
+    CHECK(allocator.GetFreeRangeCount() == 2);
+    allocator.Free(b);
+    CHECK(allocator.GetFreeRangeCount() == 1);
+    CHECK(allocator.GetUsedCount() == 0);
+    InstanceRange all = allocator.Allocate(30);
+    CHECK(all.offset == 0 && all.count == 30);
+}
+
+TEST(FailsWhenFullAndGrowKeepsOffsets)
+{
+    InstanceRangeAllocator allocator(16);
+    InstanceRange a = allocator.Allocate(12);
+    CHECK(!allocator.Allocate(8).IsValid());
+
+    allocator.Grow(32);
+    CHECK(allocator.GetCapacity() == 32);
+    // the grown space merges with the free tail [12, 16)
+    CHECK(allocator.GetFreeRangeCount() == 1);
+    InstanceRange b = allocator.Allocate(8);
+    CHECK(b.offset == 12);
+    CHECK(a.offset == 0 && allocator.GetUsedCount() == 20);
+
+    // shrinking is ignored
+    allocator.Grow(8);
+    CHECK(allocator.GetCapacity() == 32);
+}
+
+TEST(EmptyAndInvalidRangesAreNoOps)
+{
+    InstanceRangeAllocator allocator(8);
+    CHECK(!allocator.Allocate(0).IsValid());
+    allocator.Free(InstanceRange());
+    CHECK(allocator.GetUsedCount() == 0);
+    CHECK(allocator.GetFreeRangeCount() == 1);
+}
+
+TEST(DeltaUploadsOnlyChangedRuns)
+{
+    std::vector<uint32_t> pool(16, 0);
+    std::vector<uint32_t> instances = {1, 2, 3, 4, 5, 6};
+    std::vector<std::pair<uint32_t, uint32_t>> runs;
+    auto record = [&](uint32_t first, uint32_t count)
+    {
+        runs.emplace_back(first, count);
+    };
+
+    CHECK(CopyChangedRuns(pool, 4, instances, record) == 6);
+    CHECK(runs.size() == 1 && runs[0] == std::make_pair(4u, 6u));
+    for (uint32_t i = 0; i < 6; i++)
+    {
+        CHECK(pool[4 + i] == instances[i]);
+    }
+    CHECK(pool[3] == 0 && pool[10] == 0);
+
+    // writing the same set again uploads nothing
+    runs.clear();
+    CHECK(CopyChangedRuns(pool, 4, instances, record) == 0);
+    CHECK(runs.empty());
+
+    // two separate edits become two runs, adjacent edits one
+    instances[0] = 10;
+    instances[3] = 40;
+    instances[4] = 50;
+    CHECK(CopyChangedRuns(pool, 4, instances, record) == 3);
+    CHECK(runs.size() == 2);
+    CHECK(runs[0] == std::make_pair(4u, 1u));
+    CHECK(runs[1] == std::make_pair(7u, 2u));
+}
+
+TEST(DeltaComparesPackedInstances)
+{
+    BlockInstance::InstanceFields fields;
+    fields.x = 3;
+    fields.chunkIndex = 7;
+    std::vector<BlockInstance::PackedInstance> pool(4, BlockInstance::Encode(fields));
+    std::vector<BlockInstance::PackedInstance> instances(pool.begin(), pool.begin() + 2);
+    uint32_t uploads = 0;
+    auto count = [&](uint32_t, uint32_t)
+    {
+        uploads++;
+    };
+    CHECK(CopyChangedRuns(pool, 1, instances, count) == 0);
+
+    // moving the chunk to another origin slot changes only the chunk index
+    BlockInstance::SetChunkIndex(instances[1], 65535);
+    CHECK(BlockInstance::Decode(instances[1]).chunkIndex == 65535);
+    CHECK(BlockInstance::Decode(instances[1]).x == 3);
+    CHECK(CopyChangedRuns(pool, 1, instances, count) == 1);
+    CHECK(uploads == 1);
+    CHECK(BlockInstance::Decode(pool[2]).chunkIndex == 65535);
+}
@@ -0,0 +1,174 @@
+#include "TestHarness.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "../Model/LightGridBinning.h"
+
+using namespace Lighting;
+
+namespace
+{
+    typedef LightGridBinner::PointLight PointLight;
+
+    // camera at the origin looking down +z with a 90 degree fov, clip = (x, y, z, z); 64x64 pixels in 4x4 tiles
+    LightGridBinner::View view()
+    {
+        LightGridBinner::View view{};
+        view.viewProj[0] = 1.0f;
+        view.viewProj[5] = 1.0f;
+        view.viewProj[10] = 1.0f;
+        view.viewProj[11] = 1.0f;
+        view.width = 64;
+        view.height = 64;
+        view.tileDim = 16;
+        return view;
+    }
+
+    // a small light at depth 10 that only touches the tile (column, row)
+    PointLight lightInTile(uint32_t column, uint32_t row, uint32_t key, float brightness = 1.0f)
+    {
+        float x = -7.5f + 5.0f * column;
+        float y = 7.5f - 5.0f * row;
+        return PointLight{{x, y, 10.0f}, 0.5f, {brightness, brightness, brightness}, key};
+    }
+
+    int slotOfKey(const LightGridBinner& binner, uint32_t key)
+    {
+        const std::vector<PointLight>& slots = binner.GetSlots();
+        for (size_t slot = 0; slot < slots.size(); slot++)
+        {
+            if (slots[slot].radius > 0.0f && slots[slot].key == key)
+            {
+                return static_cast<int>(slot);
+            }
+        }
+        return -1;
+    }
+
+    const uint32_t* tileLights(const LightGridBinner& binner, uint32_t tile)
+    {
+        return &binner.GetGrid()[tile * binner.GetTileStride()];
+    }
+}
+
+TEST(GridLayoutMatchesComputeShader)
+{
+    LightGridBinner binner(8);
+    std::vector<PointLight> lights = {lightInTile(0, 0, 20), lightInTile(0, 0, 10), lightInTile(2, 1, 30)};
+    CHECK(binner.Bin(view(), lights));
+    CHECK(binner.GetTileCountX() == 4 && binner.GetTileCountY() == 4);
+    CHECK(binner.GetTileStride() == 9);
+    CHECK(binner.GetGrid().size() == 16 * 9);
+    CHECK(binner.GetBitMask().size() == 16 * 4);
+
+    // count header first, then slot indices in ascending order
+    const uint32_t* first = tileLights(binner, 0);
+    CHECK(first[0] == 2);
+    CHECK(first[1] < first[2]);
+    CHECK(binner.GetTileUsedWords(0) == 3);
+    CHECK(binner.GetBitMask()[0] == ((1u << first[1]) | (1u << first[2])));
+    CHECK(binner.GetBitMask()[1] == 0 && binner.GetBitMask()[2] == 0 && binner.GetBitMask()[3] == 0);
+
+    uint32_t other = 1 * 4 + 2;
+    CHECK(tileLights(binner, other)[0] == 1);
+    CHECK(int(tileLights(binner, other)[1]) == slotOfKey(binner, 30));
+    CHECK(binner.GetBitMask()[other * 4] == 1u << slotOfKey(binner, 30));
+
+    for (uint32_t tile = 0; tile < 16; tile++)
+    {
+        if (tile != 0 && tile != other)
+        {
+            CHECK(tileLights(binner, tile)[0] == 0);
+        }
+    }
+}
+
+TEST(SlotsStayStableAcrossFrames)
+{
+    LightGridBinner binner(8);
+    std::vector<PointLight> lights = {lightInTile(0, 0, 1), lightInTile(1, 0, 2), lightInTile(2, 0, 3)};
+    binner.Bin(view(), lights);
+    int slotA = slotOfKey(binner, 1);
+    int slotB = slotOfKey(binner, 2);
+    int slotC = slotOfKey(binner, 3);
+    CHECK(slotA >= 0 && slotB >= 0 && slotC >= 0);
+
+    // gather order changes, light 2 goes away and light 4 arrives
+    lights = {lightInTile(3, 3, 4), lightInTile(2, 0, 3), lightInTile(0, 0, 1)};
+    CHECK(binner.Bin(view(), lights));
+    CHECK(slotOfKey(binner, 1) == slotA);
+    CHECK(slotOfKey(binner, 3) == slotC);
+    CHECK(slotOfKey(binner, 2) == -1);
+    CHECK(slotOfKey(binner, 4) == slotB);
+    CHECK(binner.SlotsChanged());
+}
+
+TEST(MaxLightsKeepsBrightestAndBreaksTiesByKey)
+{
+    LightGridBinner binner(2);
+    // same footprint, so the score only differs by brightness
+    std::vector<PointLight> lights = {lightInTile(1, 1, 5), lightInTile(1, 1, 3), lightInTile(1, 1, 7),
+                                      lightInTile(1, 1, 9, 2.0f)};
+    binner.Bin(view(), lights);
+    CHECK(binner.GetStats().candidates == 4);
+    CHECK(binner.GetStats().culled == 0);
+    CHECK(binner.GetStats().binned == 2);
+    CHECK(slotOfKey(binner, 9) >= 0);
+    CHECK(slotOfKey(binner, 3) >= 0);
+    CHECK(slotOfKey(binner, 5) == -1);
+    CHECK(slotOfKey(binner, 7) == -1);
+    CHECK(tileLights(binner, 1 * 4 + 1)[0] == 2);
+
+    // the same lights gathered in reverse select the same ones
+    std::reverse(lights.begin(), lights.end());
+    binner.Bin(view(), lights);
+    CHECK(slotOfKey(binner, 9) >= 0);
+    CHECK(slotOfKey(binner, 3) >= 0);
+}
+
+TEST(LightCrossingNearPlaneCoversEveryTile)
+{
+    LightGridBinner binner(8);
+    std::vector<PointLight> lights = {PointLight{{0.0f, 0.0f, 0.5f}, 2.0f, {1.0f, 1.0f, 1.0f}, 1},
+                                      PointLight{{0.0f, 0.0f, -10.0f}, 1.0f, {1.0f, 1.0f, 1.0f}, 2}};
+    binner.Bin(view(), lights);
+    // the light entirely behind the camera is culled
+    CHECK(binner.GetStats().culled == 1);
+    CHECK(binner.GetStats().binned == 1);
+    for (uint32_t tile = 0; tile < 16; tile++)
+    {
+        CHECK(tileLights(binner, tile)[0] == 1);
+    }
+}
+
+TEST(DirtyRunsCoalesceAndUnchangedInputSkips)
+{
+    LightGridBinner binner(8);
+    std::vector<PointLight> lights = {lightInTile(0, 0, 1), lightInTile(3, 3, 2)};
+    CHECK(binner.Bin(view(), lights));
+    // first frame uploads the whole grid in one run
+    CHECK(binner.GetDirtyTileRuns().size() == 1);
+    CHECK(binner.GetDirtyTileRuns()[0] == std::make_pair(0u, 16u));
+    CHECK(binner.SlotsChanged());
+
+    CHECK(!binner.Bin(view(), lights));
+    CHECK(binner.GetStats().skipped);
+    CHECK(binner.GetDirtyTileRuns().empty());
+    CHECK(!binner.SlotsChanged());
+
+    // light 1 moves from tile 0 to tile 1 and light 3 appears in tile 3; tile 2 in between stays clean
+    lights = {lightInTile(1, 0, 1), lightInTile(3, 3, 2), lightInTile(3, 0, 3)};
+    CHECK(binner.Bin(view(), lights));
+    CHECK(!binner.GetStats().skipped);
+    CHECK(binner.GetStats().dirtyTiles == 3);
+    CHECK(binner.GetDirtyTileRuns().size() == 2);
+    CHECK(binner.GetDirtyTileRuns()[0] == std::make_pair(0u, 2u));
+    CHECK(binner.GetDirtyTileRuns()[1] == std::make_pair(3u, 4u));
+
+    // a new candidate that is culled changes the input but not the grid
+    lights.push_back(PointLight{{0.0f, 0.0f, -10.0f}, 1.0f, {1.0f, 1.0f, 1.0f}, 4});
+    CHECK(binner.Bin(view(), lights));
+    CHECK(binner.GetDirtyTileRuns().empty());
+    CHECK(!binner.SlotsChanged());
+}
@@ -0,0 +1,165 @@
+#include "TestHarness.h"
+
+#include <cstring>
+#include <vector>
+
+#include "../Core/SimplexNoise.h"
+
+namespace
+{
+    typedef SimplexNoise::SimdLevel SimdLevel;
+
+    // every instruction set the batch functions have that this CPU runs
+    std::vector<SimdLevel> levels()
+    {
+        std::vector<SimdLevel> result = {SimdLevel::Scalar};
+        if (SimplexNoise::supportedSimdLevel() >= SimdLevel::Sse41)
+        {
+            result.push_back(SimdLevel::Sse41);
+        }
+        if (SimplexNoise::supportedSimdLevel() >= SimdLevel::Avx2)
+        {
+            result.push_back(SimdLevel::Avx2);
+        }
+        return result;
+    }
+
+    // world-generation sized coordinates, negative and positive, with some exactly on integer lattice points
+    struct Points
+    {
+        std::vector<float> x;
+        std::vector<float> y;
+
+        explicit Points(size_t count)
+        {
+            uint32_t state = 12345;
+            for (size_t i = 0; i < count; i++)
+            {
+                state = state * 1664525u + 1013904223u;
+                float a = float(int32_t(state >> 8) - (1 << 23)) / 4096.0f;
+                state = state * 1664525u + 1013904223u;
+                float b = float(int32_t(state >> 8) - (1 << 23)) / 4096.0f;
+                x.push_back(i % 7 == 0 ? float(int32_t(a)) : a);
+                y.push_back(i % 11 == 0 ? float(int32_t(b)) : b);
+            }
+        }
+    };
+
+    bool sameBits(float a, float b)
+    {
+        return std::memcmp(&a, &b, sizeof(float)) == 0;
+    }
+
+    // counts whose last group of 4 or 8 points is partial, plus empty and single point batches
+    const size_t TailCounts[] = {0, 1, 3, 4, 5, 7, 8, 9, 12, 13, 15, 16, 17, 1003};
+
+    // the batch must not write past count, the slot after it keeps this value
+    const float Sentinel = 12345.0f;
+}
+
+TEST(NoiseBatchMatchesScalarBitForBit)
+{
+    SimplexNoise noise(0.01f, 1.0f, 2.0f, 0.5f, 3);
+    Points points(1003);
+    for (SimdLevel level : levels())
+    {
+        for (size_t count : TailCounts)
+        {
+            std::vector<float> out(count + 1, Sentinel);
+            noise.noiseBatch(points.x.data(), points.y.data(), out.data(), count, level);
+            size_t mismatches = 0;
+            for (size_t i = 0; i < count; i++)
+            {
+                mismatches += sameBits(out[i], noise.noise(points.x[i], points.y[i])) ? 0 : 1;
+            }
+            CHECK(mismatches == 0);
+            CHECK(out[count] == Sentinel);
+        }
+    }
+}
+
+TEST(FractalBatchMatchesScalarBitForBit)
+{
+    SimplexNoise noise(0.003f, 2.0f, 2.1f, 0.45f, 7);
+    Points points(1003);
+    // 16 is the most the lanes handle, 20 takes the scalar fallback
+    const size_t octaveCounts[] = {1, 4, 8, 16, 20};
+    for (SimdLevel level : levels())
+    {
+        for (size_t octaves : octaveCounts)
+        {
+            for (size_t count : TailCounts)
+            {
+                std::vector<float> out(count + 1, Sentinel);
+                noise.fractalBatch(octaves, points.x.data(), points.y.data(), out.data(), count, level);
+                size_t mismatches = 0;
+                for (size_t i = 0; i < count; i++)
+                {
+                    mismatches += sameBits(out[i], noise.fractal(octaves, points.x[i], points.y[i])) ? 0 : 1;
+                }
+                CHECK(mismatches == 0);
+                CHECK(out[count] == Sentinel);
+            }
+        }
+    }
+}
+
+TEST(FractalFieldsMatchScalarBitForBit)
+{
+    // up to 8 fields go through the lanes, 11 take the scalar fallback
+    const size_t fieldCounts[] = {1, 3, 8, 11};
+    std::vector<SimplexNoise> noises;
+    for (uint32_t f = 0; f < 11; f++)
+    {
+        noises.emplace_back(0.002f * (f + 1), 1.0f + f, 2.0f, 0.5f, f);
+    }
+    Points points(1003);
+    for (SimdLevel level : levels())
+    {
+        for (size_t fieldCount : fieldCounts)
+        {
+            for (size_t count : TailCounts)
+            {
+                std::vector<std::vector<float>> outs(fieldCount, std::vector<float>(count + 1, Sentinel));
+                std::vector<SimplexNoise::FractalField> fields;
+                for (size_t f = 0; f < fieldCount; f++)
+                {
+                    fields.push_back({&noises[f], 1 + f % 6, outs[f].data()});
+                }
+                SimplexNoise::fractalFields(fields.data(), fieldCount, points.x.data(), points.y.data(), count, level);
+                size_t mismatches = 0;
+                for (size_t f = 0; f < fieldCount; f++)
+                {
+                    for (size_t i = 0; i < count; i++)
+                    {
+                        float expected = noises[f].fractal(fields[f].octaves, points.x[i], points.y[i]);
+                        mismatches += sameBits(outs[f][i], expected) ? 0 : 1;
+                    }
+                    CHECK(outs[f][count] == Sentinel);
+                }
+                CHECK(mismatches == 0);
+            }
+        }
+    }
+}
+
+TEST(FieldWithTooManyOctavesFallsBackForAllFields)
+{
+    SimplexNoise first(0.01f, 1.0f, 2.0f, 0.5f, 1);
+    SimplexNoise second(0.02f, 1.0f, 2.0f, 0.5f, 2);
+    Points points(37);
+    for (SimdLevel level : levels())
+    {
+        std::vector<float> a(37);
+        std::vector<float> b(37);
+        SimplexNoise::FractalField fields[] = {{&first, 6, a.data()}, {&second, 17, b.data()}};
+        SimplexNoise::fractalFields(fields, 2, points.x.data(), points.y.data(), 37, level);
+        size_t mismatches = 0;
+        for (size_t i = 0; i < 37; i++)
+        {
+            mismatches += sameBits(a[i], first.fractal(6, points.x[i], points.y[i])) ? 0 : 1;
+            mismatches += sameBits(b[i], second.fractal(17, points.x[i], points.y[i])) ? 0 : 1;
+        }
+        CHECK(mismatches == 0);
+    }
+}
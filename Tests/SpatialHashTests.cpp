@@ -0,0 +1,146 @@
+#include "TestHarness.h"
+
+#include <vector>
+
+#include "../ModelViewer/Entities/SpatialHash.h"
+
+namespace
+{
+    // unit cells with a corner on the world origin
+    struct Entities
+    {
+        std::vector<float> x, y, z;
+
+        void Add(float px, float py, float pz)
+        {
+            x.push_back(px);
+            y.push_back(py);
+            z.push_back(pz);
+        }
+
+        void Build(SpatialHash& hash, float halfX = 0.0f, float halfY = 0.0f, float halfZ = 0.0f) const
+        {
+            const float cellSize[3] = {1.0f, 1.0f, 1.0f};
+            const float origin[3] = {};
+            const float maxHalf[3] = {halfX, halfY, halfZ};
+            hash.Configure(cellSize, origin);
+            hash.Build(x.data(), y.data(), z.data(), static_cast<uint32_t>(x.size()), maxHalf);
+        }
+    };
+
+    // how often each entity index was visited by one query
+    std::vector<int> query(const SpatialHash& hash, float minX, float minY, float minZ,
+                           float maxX, float maxY, float maxZ)
+    {
+        std::vector<int> visits(hash.GetEntityCount(), 0);
+        const float boxMin[3] = {minX, minY, minZ};
+        const float boxMax[3] = {maxX, maxY, maxZ};
+        hash.ForEachCandidate(boxMin, boxMax, [&](uint32_t index)
+        {
+            visits[index]++;
+        });
+        return visits;
+    }
+}
+
+TEST(CollidingBucketsReportEachEntityOnce)
+{
+    // two entities give four buckets, cells 0 and 4 along x differ only above the bucket mask and share a bucket
+    Entities entities;
+    entities.Add(0.5f, 0.5f, 0.5f);
+    entities.Add(4.5f, 0.5f, 0.5f);
+    SpatialHash hash;
+    entities.Build(hash);
+
+    // both cells are scanned, each scan walks the shared bucket
+    std::vector<int> all = query(hash, 0.0f, 0.0f, 0.0f, 5.0f, 0.9f, 0.9f);
+    CHECK(all[0] == 1);
+    CHECK(all[1] == 1);
+
+    // only cell 0 is scanned, the entity of cell 4 sits in the same bucket but is skipped
+    std::vector<int> first = query(hash, 0.1f, 0.1f, 0.1f, 0.9f, 0.9f, 0.9f);
+    CHECK(first[0] == 1);
+    CHECK(first[1] == 0);
+}
+
+TEST(ManyEntitiesPerBucketReportedOnce)
+{
+    // an 8 x 8 x 8 block of cells with two entities each fills every bucket with several cells
+    Entities entities;
+    for (int x = -4; x < 4; x++)
+    {
+        for (int y = -4; y < 4; y++)
+        {
+            for (int z = -4; z < 4; z++)
+            {
+                entities.Add(x + 0.25f, y + 0.25f, z + 0.25f);
+                entities.Add(x + 0.75f, y + 0.75f, z + 0.75f);
+            }
+        }
+    }
+    SpatialHash hash;
+    entities.Build(hash);
+    CHECK(hash.GetEntityCount() == 1024);
+
+    std::vector<int> visits = query(hash, -4.0f, -4.0f, -4.0f, 3.9f, 3.9f, 3.9f);
+    int wrong = 0;
+    for (int count : visits)
+    {
+        wrong += count != 1;
+    }
+    CHECK(wrong == 0);
+}
+
+TEST(NegativeCellsRoundDown)
+{
+    Entities entities;
+    entities.Add(-0.5f, -0.5f, -0.5f);
+    entities.Add(-1.5f, -1.5f, -1.5f);
+    entities.Add(0.5f, 0.5f, 0.5f);
+    SpatialHash hash;
+    entities.Build(hash);
+
+    // -0.5 lies in cell -1, not in cell 0 as truncation towards zero would give
+    std::vector<int> minusOne = query(hash, -0.9f, -0.9f, -0.9f, -0.1f, -0.1f, -0.1f);
+    CHECK(minusOne[0] == 1);
+    CHECK(minusOne[1] == 0);
+    CHECK(minusOne[2] == 0);
+
+    std::vector<int> minusTwo = query(hash, -1.9f, -1.9f, -1.9f, -1.1f, -1.1f, -1.1f);
+    CHECK(minusTwo[0] == 0);
+    CHECK(minusTwo[1] == 1);
+    CHECK(minusTwo[2] == 0);
+
+    std::vector<int> zero = query(hash, 0.1f, 0.1f, 0.1f, 0.9f, 0.9f, 0.9f);
+    CHECK(zero[0] == 0);
+    CHECK(zero[1] == 0);
+    CHECK(zero[2] == 1);
+}
+
+TEST(QueryGrowsByLargestHalfExtent)
+{
+    // the centre is in cell 2, a box of half size 1 along x reaches into cell 1
+    Entities entities;
+    entities.Add(2.5f, 0.5f, 0.5f);
+    SpatialHash hash;
+
+    entities.Build(hash);
+    CHECK(query(hash, 1.2f, 0.2f, 0.2f, 1.8f, 0.8f, 0.8f)[0] == 0);
+
+    entities.Build(hash, 1.0f, 0.0f, 0.0f);
+    CHECK(query(hash, 1.2f, 0.2f, 0.2f, 1.8f, 0.8f, 0.8f)[0] == 1);
+    // the growth is per axis, the same distance along y stays out of reach
+    CHECK(query(hash, 2.2f, -1.8f, 0.2f, 2.8f, -1.2f, 0.8f)[0] == 0);
+
+    entities.Build(hash, 1.0f, 2.0f, 0.0f);
+    CHECK(query(hash, 2.2f, -1.8f, 0.2f, 2.8f, -1.2f, 0.8f)[0] == 1);
+}
+
+TEST(EmptyHashVisitsNothing)
+{
+    Entities entities;
+    SpatialHash hash;
+    entities.Build(hash);
+    CHECK(hash.GetEntityCount() == 0);
+    CHECK(query(hash, -10.0f, -10.0f, -10.0f, 10.0f, 10.0f, 10.0f).empty());
+}
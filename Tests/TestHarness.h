@@ -0,0 +1,70 @@
+/**
+ * 不依赖 D3D 的单元测试
+ * 只覆盖纯标准库实现的模块 (AO、实例编码、光源分块、碰撞、噪声、实体粗筛等)，可以在任意平台上用 g++ / clang / MSVC 编译：
+ *   cmake -S Tests -B build && cmake --build build && ctest --test-dir build
+ * 每个测试文件是一个独立的可执行文件，TEST 注册用例，CHECK 失败时打印位置并让进程返回非 0。
+ */
+#pragma once
+#include <cstdio>
+#include <vector>
+
+namespace TestHarness
+{
+    struct Case
+    {
+        const char* name;
+        void (*run)();
+    };
+
+    inline std::vector<Case>& Cases()
+    {
+        static std::vector<Case> cases;
+        return cases;
+    }
+
+    inline int& Failures()
+    {
+        static int failures = 0;
+        return failures;
+    }
+
+    struct Registration
+    {
+        Registration(const char* name, void (*run)())
+        {
+            Cases().push_back({name, run});
+        }
+    };
+
+    inline void Fail(const char* file, int line, const char* expression)
+    {
+        std::printf("%s(%d): CHECK failed: %s\n", file, line, expression);
+        Failures()++;
+    }
+
+    inline int RunAll()
+    {
+        for (const Case& test : Cases())
+        {
+            int before = Failures();
+            test.run();
+            std::printf("[%s] %s\n", Failures() == before ? "pass" : "FAIL", test.name);
+        }
+        std::printf("%zu tests, %d failed checks\n", Cases().size(), Failures());
+        return Failures() == 0 ? 0 : 1;
+    }
+}
+
+#define TEST(name) \
+    static void name(); \
+    static TestHarness::Registration name##Registration(#name, name); \
+    static void name()
+
+#define CHECK(expression) \
+    do \
+    { \
+        if (!(expression)) \
+        { \
+            TestHarness::Fail(__FILE__, __LINE__, #expression); \
+        } \
+    } while (0)
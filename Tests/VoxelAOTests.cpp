@@ -0,0 +1,103 @@
+#include "TestHarness.h"
+
+#include <set>
+#include <tuple>
+
+#include "../ModelViewer/World/VoxelAO.h"
+
+using namespace VoxelAO;
+
+namespace
+{
+    // occluding cells as offsets from the block
+    typedef std::set<std::tuple<int, int, int>> Occluders;
+
+    bool isOccluder(const void* context, int dx, int dy, int dz)
+    {
+        return static_cast<const Occluders*>(context)->count(std::make_tuple(dx, dy, dz)) != 0;
+    }
+
+    // face +Z: u is x, v is y, corner 0 at (-x, -y)
+    const int TOP = 4;
+}
+
+TEST(OpenFaceIsUnoccluded)
+{
+    Occluders none;
+    BlockAO ao = ComputeBlockAO(isOccluder, &none);
+    for (int face = 0; face < FACE_COUNT; face++)
+    {
+        for (int corner = 0; corner < CORNER_COUNT; corner++)
+        {
+            CHECK(ao.GetCorner(face, corner) == AO_NONE);
+        }
+        CHECK(!ao.IsFlipped(face));
+    }
+}
+
+TEST(TwoSidesDarkenCornerFully)
+{
+    // both sides of corner 0 occlude, its diagonal does not
+    Occluders cells = {std::make_tuple(-1, 0, 1), std::make_tuple(0, -1, 1)};
+    uint8_t ao[CORNER_COUNT];
+    ComputeFaceAO(TOP, isOccluder, &cells, ao);
+    CHECK(ao[0] == 0);
+    CHECK(ao[1] == 2);
+    CHECK(ao[2] == 2);
+    CHECK(ao[3] == AO_NONE);
+    CHECK(VertexAO(true, true, false) == 0);
+    CHECK(VertexAO(true, true, true) == 0);
+}
+
+TEST(SingleCornerDarkensOneStep)
+{
+    Occluders cells = {std::make_tuple(-1, -1, 1)};
+    uint8_t ao[CORNER_COUNT];
+    ComputeFaceAO(TOP, isOccluder, &cells, ao);
+    CHECK(ao[0] == 2);
+    CHECK(ao[1] == AO_NONE);
+    CHECK(ao[2] == AO_NONE);
+    CHECK(ao[3] == AO_NONE);
+
+    // the same cell does not touch the bottom face
+    ComputeFaceAO(TOP + 1, isOccluder, &cells, ao);
+    for (int corner = 0; corner < CORNER_COUNT; corner++)
+    {
+        CHECK(ao[corner] == AO_NONE);
+    }
+}
+
+TEST(AnisotropicFaceFlipsQuad)
+{
+    // darkening corner 1 makes the 0-3 diagonal the brighter pair, so the quad splits along 1-2
+    Occluders cells = {std::make_tuple(1, -1, 1)};
+    BlockAO ao = ComputeBlockAO(isOccluder, &cells);
+    CHECK(ao.GetCorner(TOP, 1) == 2);
+    CHECK(ao.IsFlipped(TOP));
+    CHECK(!ao.IsFlipped(TOP + 1));
+
+    // darkening corner 0 instead keeps the default split
+    Occluders other = {std::make_tuple(-1, -1, 1)};
+    CHECK(!ComputeBlockAO(isOccluder, &other).IsFlipped(TOP));
+}
+
+TEST(CornerBitsRoundTrip)
+{
+    BlockAO ao;
+    for (int face = 0; face < FACE_COUNT; face++)
+    {
+        for (int corner = 0; corner < CORNER_COUNT; corner++)
+        {
+            ao.SetCorner(face, corner, uint8_t((face + corner) % 4));
+        }
+        ao.SetFlipped(face, face % 2 == 1);
+    }
+    for (int face = 0; face < FACE_COUNT; face++)
+    {
+        for (int corner = 0; corner < CORNER_COUNT; corner++)
+        {
+            CHECK(ao.GetCorner(face, corner) == (face + corner) % 4);
+        }
+        CHECK(ao.IsFlipped(face) == (face % 2 == 1));
+    }
+}
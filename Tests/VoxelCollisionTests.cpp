@@ -0,0 +1,160 @@
+#include "TestHarness.h"
+
+#include <cmath>
+#include <set>
+#include <tuple>
+
+#include "../ModelViewer/World/VoxelSweep.h"
+
+using namespace VoxelCollision;
+
+namespace
+{
+    // a floor filling every cell with y <= floorTop, plus single solid cells
+    struct Grid
+    {
+        int floorTop = -1000;
+        std::set<std::tuple<int, int, int>> cells;
+        uint32_t visited = 0;
+    };
+
+    bool isSolid(void* context, int x, int y, int z)
+    {
+        Grid* grid = static_cast<Grid*>(context);
+        grid->visited++;
+        return y <= grid->floorTop || grid->cells.count(std::make_tuple(x, y, z)) != 0;
+    }
+
+    bool near(float a, float b)
+    {
+        return std::abs(a - b) < 1e-4f;
+    }
+
+    // 0.6 x 1.8 x 0.6 cells, like the camera body, with its feet at (x, y, z)
+    CellBox body(float x, float y, float z)
+    {
+        return CellBox{{x - 0.3f, y, z - 0.3f}, {x + 0.3f, y + 1.8f, z + 0.3f}};
+    }
+
+    CellSweepResult sweep(Grid& grid, const CellBox& box, float dx, float dy, float dz, float stepHeight = 0.0f)
+    {
+        const float motion[3] = {dx, dy, dz};
+        return SweepCells(isSolid, &grid, box, motion, stepHeight);
+    }
+}
+
+TEST(FallingBodyLandsOnFloor)
+{
+    Grid grid;
+    grid.floorTop = 0;
+    CellSweepResult result = sweep(grid, body(0.5f, 3.0f, 0.5f), 0.0f, -5.0f, 0.0f);
+    CHECK(result.blocked[1]);
+    CHECK(!result.blocked[0] && !result.blocked[2]);
+    // feet end SKIN above the floor's top face at y = 1
+    CHECK(near(3.0f + result.moved[1], 1.0f + SKIN));
+    CHECK(result.onGround);
+}
+
+TEST(AirborneBodyIsNotOnGround)
+{
+    Grid grid;
+    grid.floorTop = 0;
+    CellSweepResult result = sweep(grid, body(0.5f, 3.0f, 0.5f), 0.0f, -1.0f, 0.0f);
+    CHECK(!result.blocked[1]);
+    CHECK(near(result.moved[1], -1.0f));
+    CHECK(!result.onGround);
+}
+
+TEST(LedgeStopsHorizontalMotionWithSkinGap)
+{
+    Grid grid;
+    grid.floorTop = 0;
+    // a one block ledge from x = 2 on
+    for (int x = 2; x < 8; x++)
+    {
+        grid.cells.insert(std::make_tuple(x, 1, 0));
+    }
+    CellBox start = body(0.5f, 1.0f + SKIN, 0.5f);
+    CellSweepResult result = sweep(grid, start, 3.0f, 0.0f, 0.0f);
+    CHECK(result.blocked[0]);
+    CHECK(!result.steppedUp);
+    // the box's face stops SKIN in front of the ledge
+    CHECK(near(start.max[0] + result.moved[0], 2.0f - SKIN));
+    CHECK(near(result.moved[1], 0.0f));
+    CHECK(result.onGround);
+
+    // pushing again from the resting position does not creep into the ledge
+    CellBox resting = start;
+    resting.min[0] += result.moved[0];
+    resting.max[0] += result.moved[0];
+    CellSweepResult again = sweep(grid, resting, 1.0f, 0.0f, 0.0f);
+    CHECK(again.blocked[0]);
+    CHECK(near(again.moved[0], 0.0f));
+}
+
+TEST(StepHeightClimbsOneBlockLedge)
+{
+    Grid grid;
+    grid.floorTop = 0;
+    for (int x = 2; x < 8; x++)
+    {
+        grid.cells.insert(std::make_tuple(x, 1, 0));
+    }
+    CellBox start = body(0.5f, 1.0f + SKIN, 0.5f);
+    CellSweepResult result = sweep(grid, start, 3.0f, 0.0f, 0.0f, 1.1f);
+    CHECK(result.steppedUp);
+    CHECK(!result.blocked[0]);
+    CHECK(near(result.moved[0], 3.0f));
+    // now standing on the ledge top at y = 2
+    CHECK(near(start.min[1] + result.moved[1], 2.0f + SKIN));
+    CHECK(result.onGround);
+
+    // a two block wall is too high for the same step
+    for (int x = 2; x < 8; x++)
+    {
+        grid.cells.insert(std::make_tuple(x, 2, 0));
+    }
+    result = sweep(grid, start, 3.0f, 0.0f, 0.0f, 1.1f);
+    CHECK(!result.steppedUp);
+    CHECK(result.blocked[0]);
+    CHECK(near(start.max[0] + result.moved[0], 2.0f - SKIN));
+}
+
+TEST(GroundedBodySlidesAlongFloor)
+{
+    Grid grid;
+    grid.floorTop = 0;
+    CellSweepResult result = sweep(grid, body(0.5f, 1.0f + SKIN, 0.5f), 2.0f, -0.5f, 1.0f);
+    // the floor stops the fall without catching the horizontal move
+    CHECK(result.blocked[1]);
+    CHECK(!result.blocked[0] && !result.blocked[2]);
+    CHECK(near(result.moved[0], 2.0f) && near(result.moved[2], 1.0f));
+    CHECK(result.onGround);
+}
+
+TEST(CellsVisitedEqualCellsSwept)
+{
+    // away from any cell boundary below, so the ground test looks nothing up
+    CellBox box{{0.2f, 1.5f, 0.2f}, {0.8f, 3.3f, 0.8f}};
+    // the box covers y cells 1..3, so each slab along x or z holds 3 cells
+    const uint32_t slabCells = 3;
+    const float lengths[] = {1.0f, 3.0f, 10.0f};
+    for (float length : lengths)
+    {
+        Grid grid;
+        CellSweepResult result = sweep(grid, box, length, 0.0f, 0.0f);
+        CHECK(grid.visited == uint32_t(length) * slabCells);
+        CHECK(result.cellsTested == grid.visited);
+    }
+
+    // x then z: 2 slabs, then 3 slabs from the moved box
+    Grid grid;
+    CellSweepResult result = sweep(grid, box, 2.0f, 0.0f, 3.0f);
+    CHECK(grid.visited == (2 + 3) * slabCells);
+    CHECK(result.cellsTested == grid.visited);
+
+    // a move that stays inside the cells it already covers looks nothing up
+    Grid still;
+    sweep(still, box, 0.1f, 0.0f, 0.0f);
+    CHECK(still.visited == 0);
+}
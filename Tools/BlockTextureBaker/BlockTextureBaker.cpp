@@ -0,0 +1,813 @@
+//
+// BlockTextureBaker
+//
+// Bakes the per-face textures of every block under Resources/Blocks into the single
+// texture array sampled by the voxel renderer (ModelViewer/Blocks/BlockResourceManager).
+//
+//   <root>/<block name>/textures/*.dds|*.tga     source textures (uncompressed RGBA8)
+//   <root>/block_textures.dds                     R8G8B8A8_UNORM_SRGB array, full mip chain
+//   <root>/block_textures.layers                  binary BlockType x face -> layer table
+//   <root>/block_textures.json                    the same table for humans and scripts
+//
+// A texture whose name contains "top", "bottom" or "side" is only used for those faces,
+// any other base colour texture covers the remaining faces.  Blocks without a usable
+// texture get a flat colour layer so the array always covers every BlockType.
+//
+// Sources are resized to one resolution and mipmapped in linear space.  Fully transparent
+// texels are padded with the colour of their opaque neighbours and colour is weighted by
+// alpha while filtering, so cutout edges do not darken towards lower mips.  Cutout alpha
+// coverage is preserved per mip.
+//
+// Work is spread over threads per layer, but every layer is written into a preassigned
+// slot and all arithmetic runs in a fixed order, so the output is byte-for-byte identical
+// between runs.  PNG/JPEG are not decoded; convert them to .dds or .tga first.
+//
+// Builds with the Visual Studio project or on Linux with:
+//   g++ -std=c++17 -O2 -pthread BlockTextureBaker.cpp -o BlockTextureBaker
+//
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define kMajorVersion    1
+#define kMinorVersion    0
+
+#define kMaxTextureDimension 4096
+#define kFaceCount 6
+
+using namespace std;
+namespace fs = std::filesystem;
+
+// Must match BlockResourceManager::BlockType and BlockFallbackColors (RGBA8 packed as 0xAABBGGRR)
+struct BlockTypeInfo
+{
+    const char* name;
+    uint32_t fallbackColor;
+};
+
+const BlockTypeInfo g_BlockTypes[] =
+{
+    { "grass",        0xFF3FA04Au },
+    { "stone",        0xFF7F7F7Fu },
+    { "leaf",         0xFF2E7A2Fu },
+    { "dirt",         0xFF2F4A79u },
+    { "water",        0xB0C8602Fu },
+    { "wood_oak",     0xFF305A8Au },
+    { "diamond",      0xFFE0E26Au },
+    { "redstonelamp", 0xFF2F6FD8u },
+    { "torch",        0xFF30B0F0u },
+    { "sand",         0xFF9CD8E2u },
+    { "grass_snow",   0xFFF2F2F2u },
+    { "grass_wilt",   0xFF3C98A8u },
+    { "grass_leaf",   0xC040B050u },
+};
+const uint32_t kBlockTypeCount = sizeof(g_BlockTypes) / sizeof(g_BlockTypes[0]);
+
+// Face order of the voxel cube (Model/Shaders/VoxelBlock.hlsli), world +Y is up
+const char* g_FaceNames[kFaceCount] = { "+x", "-x", "+y", "-y", "+z", "-z" };
+const int kTopFace = 2;
+const int kBottomFace = 3;
+
+// Layout of the .layers file, read by BlockResourceManager::loadBlockTextureLayers (little endian):
+//   char magic[4] = "BTLT", uint32_t version, blockTypeCount, faceCount, layerCount,
+//   uint16_t layers[blockTypeCount][faceCount]
+
+// A layer is either a source file or a flat colour
+struct LayerSource
+{
+    string path;
+    uint32_t color = 0;
+};
+
+struct Image
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    vector<float> texels;   // linear RGBA
+
+    float* At(uint32_t x, uint32_t y) { return &texels[(y * width + x) * 4]; }
+    const float* At(uint32_t x, uint32_t y) const { return &texels[(y * width + x) * 4]; }
+};
+
+uint32_t g_Size = 128;
+uint32_t g_MipCount = 0;
+vector<LayerSource> g_Layers;
+vector<vector<uint8_t>> g_BakedLayers;   // all mips of one layer, RGBA8 sRGB
+atomic<size_t> g_NextLayerIdx(0);
+
+float g_SRGBToLinear[256];
+float g_SRGBThresholds[255];    // linear value halfway (in sRGB) between two 8 bit codes
+
+void InitializeColorTables()
+{
+    for (int i = 0; i < 256; ++i)
+    {
+        double c = i / 255.0;
+        g_SRGBToLinear[i] = (float)(c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4));
+    }
+    for (int i = 0; i < 255; ++i)
+    {
+        double c = (i + 0.5) / 255.0;
+        g_SRGBThresholds[i] = (float)(c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4));
+    }
+}
+
+uint8_t LinearToSRGB8( float v )
+{
+    return (uint8_t)(upper_bound(g_SRGBThresholds, g_SRGBThresholds + 255, v) - g_SRGBThresholds);
+}
+
+uint8_t UnitToUnorm8( float v )
+{
+    return (uint8_t)min(max((int)(v * 255.0f + 0.5f), 0), 255);
+}
+
+string ToLower( string s )
+{
+    transform(s.begin(), s.end(), s.begin(), [](char c) { return (char)tolower((unsigned char)c); });
+    return s;
+}
+
+vector<uint8_t> ReadFileBytes( const string& path )
+{
+    ifstream file(path, ios_base::in | ios_base::binary);
+    if (!file)
+        throw runtime_error("Unable to open " + path);
+    return vector<uint8_t>(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+}
+
+uint32_t ReadU32( const vector<uint8_t>& data, size_t offset )
+{
+    if (offset + 4 > data.size())
+        throw runtime_error("Unexpected end of file");
+    return data[offset] | (data[offset + 1] << 8) | (data[offset + 2] << 16) | ((uint32_t)data[offset + 3] << 24);
+}
+
+uint16_t ReadU16( const vector<uint8_t>& data, size_t offset )
+{
+    if (offset + 2 > data.size())
+        throw runtime_error("Unexpected end of file");
+    return (uint16_t)(data[offset] | (data[offset + 1] << 8));
+}
+
+Image AllocateImage( uint32_t width, uint32_t height )
+{
+    if (width == 0 || height == 0 || width > kMaxTextureDimension || height > kMaxTextureDimension)
+        throw runtime_error("Unsupported texture dimensions");
+    Image image;
+    image.width = width;
+    image.height = height;
+    image.texels.resize((size_t)width * height * 4);
+    return image;
+}
+
+void StoreTexel( Image& image, uint32_t x, uint32_t y, uint8_t r, uint8_t g, uint8_t b, uint8_t a )
+{
+    float* t = image.At(x, y);
+    t[0] = g_SRGBToLinear[r];
+    t[1] = g_SRGBToLinear[g];
+    t[2] = g_SRGBToLinear[b];
+    t[3] = a / 255.0f;
+}
+
+uint8_t ExtractChannel( uint32_t pixel, uint32_t mask )
+{
+    if (mask == 0)
+        return 0xFF;
+    uint32_t shift = 0;
+    while (((mask >> shift) & 1) == 0)
+        ++shift;
+    uint32_t bits = mask >> shift;
+    uint32_t value = (pixel & mask) >> shift;
+    return (uint8_t)((value * 255 + bits / 2) / bits);
+}
+
+// Top mip of an uncompressed DDS: DX10 RGBA8/BGRA8/BGRX8 or a legacy 24/32 bit RGB mask format
+Image LoadDDS( const string& path )
+{
+    vector<uint8_t> data = ReadFileBytes(path);
+    if (data.size() < 128 || memcmp(data.data(), "DDS ", 4) != 0)
+        throw runtime_error(path + " is not a DDS file");
+
+    uint32_t height = ReadU32(data, 12);
+    uint32_t width = ReadU32(data, 16);
+    uint32_t pfFlags = ReadU32(data, 80);
+    uint32_t fourCC = ReadU32(data, 84);
+    uint32_t bitCount = ReadU32(data, 88);
+    uint32_t masks[4] = { ReadU32(data, 92), ReadU32(data, 96), ReadU32(data, 100), ReadU32(data, 104) };
+    size_t offset = 128;
+
+    const uint32_t kDDPF_ALPHAPIXELS = 0x1;
+    const uint32_t kDDPF_FOURCC = 0x4;
+    const uint32_t kDDPF_RGB = 0x40;
+
+    if ((pfFlags & kDDPF_FOURCC) && fourCC == 0x30315844) // 'DX10'
+    {
+        uint32_t dxgiFormat = ReadU32(data, 128);
+        offset += 20;
+        bitCount = 32;
+        switch (dxgiFormat)
+        {
+        case 28: case 29:   // R8G8B8A8_UNORM(_SRGB)
+            masks[0] = 0x000000FF; masks[1] = 0x0000FF00; masks[2] = 0x00FF0000; masks[3] = 0xFF000000;
+            break;
+        case 87: case 91:   // B8G8R8A8_UNORM(_SRGB)
+            masks[0] = 0x00FF0000; masks[1] = 0x0000FF00; masks[2] = 0x000000FF; masks[3] = 0xFF000000;
+            break;
+        case 88: case 93:   // B8G8R8X8_UNORM(_SRGB)
+            masks[0] = 0x00FF0000; masks[1] = 0x0000FF00; masks[2] = 0x000000FF; masks[3] = 0;
+            break;
+        default:
+            throw runtime_error(path + " uses an unsupported DXGI format (only uncompressed 8 bit RGBA)");
+        }
+    }
+    else if (pfFlags & kDDPF_RGB)
+    {
+        if (bitCount != 24 && bitCount != 32)
+            throw runtime_error(path + " must be 24 or 32 bits per pixel");
+        if ((pfFlags & kDDPF_ALPHAPIXELS) == 0)
+            masks[3] = 0;
+    }
+    else
+    {
+        throw runtime_error(path + " is compressed, only uncompressed DDS files are supported");
+    }
+
+    Image image = AllocateImage(width, height);
+    uint32_t bytesPerPixel = bitCount / 8;
+    if (offset + (size_t)width * height * bytesPerPixel > data.size())
+        throw runtime_error(path + " is truncated");
+
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            const uint8_t* p = &data[offset + ((size_t)y * width + x) * bytesPerPixel];
+            uint32_t pixel = p[0] | (p[1] << 8) | (p[2] << 16) | (bytesPerPixel == 4 ? (uint32_t)p[3] << 24 : 0);
+            StoreTexel(image, x, y, ExtractChannel(pixel, masks[0]), ExtractChannel(pixel, masks[1]),
+                ExtractChannel(pixel, masks[2]), ExtractChannel(pixel, masks[3]));
+        }
+    }
+    return image;
+}
+
+// Uncompressed or RLE true colour TGA, 24 or 32 bits per pixel
+Image LoadTGA( const string& path )
+{
+    vector<uint8_t> data = ReadFileBytes(path);
+    if (data.size() < 18)
+        throw runtime_error(path + " is not a TGA file");
+
+    uint8_t idLength = data[0];
+    uint8_t colorMapType = data[1];
+    uint8_t imageType = data[2];
+    uint16_t width = ReadU16(data, 12);
+    uint16_t height = ReadU16(data, 14);
+    uint8_t bitCount = data[16];
+    bool topDown = (data[17] & 0x20) != 0;
+
+    if (colorMapType != 0 || (imageType != 2 && imageType != 10) || (bitCount != 24 && bitCount != 32))
+        throw runtime_error(path + " must be a 24 or 32 bit true colour TGA");
+
+    Image image = AllocateImage(width, height);
+    uint32_t bytesPerPixel = bitCount / 8;
+    size_t offset = 18 + idLength;
+    size_t texelCount = (size_t)width * height;
+    vector<uint8_t> pixels(texelCount * bytesPerPixel);
+
+    if (imageType == 2)
+    {
+        if (offset + pixels.size() > data.size())
+            throw runtime_error(path + " is truncated");
+        memcpy(pixels.data(), &data[offset], pixels.size());
+    }
+    else
+    {
+        size_t written = 0;
+        while (written < texelCount)
+        {
+            if (offset >= data.size())
+                throw runtime_error(path + " is truncated");
+            uint8_t packet = data[offset++];
+            size_t count = (packet & 0x7F) + 1;
+            if (written + count > texelCount || offset + bytesPerPixel * ((packet & 0x80) ? 1 : count) > data.size())
+                throw runtime_error(path + " has a malformed RLE packet");
+            for (size_t i = 0; i < count; ++i)
+            {
+                memcpy(&pixels[(written + i) * bytesPerPixel], &data[offset], bytesPerPixel);
+                if ((packet & 0x80) == 0)
+                    offset += bytesPerPixel;
+            }
+            if (packet & 0x80)
+                offset += bytesPerPixel;
+            written += count;
+        }
+    }
+
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        uint32_t row = topDown ? y : height - 1 - y;
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            const uint8_t* p = &pixels[((size_t)row * width + x) * bytesPerPixel];
+            StoreTexel(image, x, y, p[2], p[1], p[0], bytesPerPixel == 4 ? p[3] : 0xFF);
+        }
+    }
+    return image;
+}
+
+Image LoadLayerSource( const LayerSource& source )
+{
+    if (source.path.empty())
+    {
+        Image image = AllocateImage(1, 1);
+        uint32_t c = source.color;
+        StoreTexel(image, 0, 0, c & 0xFF, (c >> 8) & 0xFF, (c >> 16) & 0xFF, (c >> 24) & 0xFF);
+        return image;
+    }
+    if (ToLower(fs::path(source.path).extension().string()) == ".tga")
+        return LoadTGA(source.path);
+    return LoadDDS(source.path);
+}
+
+// Gives fully transparent texels the average colour of their non transparent neighbours,
+// growing outwards, so filtering across a cutout edge never pulls in undefined colour.
+void PadTransparentTexels( Image& image )
+{
+    vector<uint8_t> known(image.width * image.height);
+    bool anyKnown = false;
+    for (uint32_t i = 0; i < known.size(); ++i)
+    {
+        known[i] = image.texels[i * 4 + 3] > 0.0f;
+        anyKnown = anyKnown || known[i];
+    }
+    if (!anyKnown)
+        return;
+
+    vector<uint8_t> next = known;
+    for (bool changed = true; changed; )
+    {
+        changed = false;
+        for (uint32_t y = 0; y < image.height; ++y)
+        {
+            for (uint32_t x = 0; x < image.width; ++x)
+            {
+                if (known[y * image.width + x])
+                    continue;
+
+                float sum[3] = { 0.0f, 0.0f, 0.0f };
+                int count = 0;
+                for (int dy = -1; dy <= 1; ++dy)
+                {
+                    for (int dx = -1; dx <= 1; ++dx)
+                    {
+                        // block faces tile, so the neighbourhood wraps around
+                        uint32_t nx = (x + image.width + dx) % image.width;
+                        uint32_t ny = (y + image.height + dy) % image.height;
+                        if (!known[ny * image.width + nx])
+                            continue;
+                        const float* n = image.At(nx, ny);
+                        sum[0] += n[0]; sum[1] += n[1]; sum[2] += n[2];
+                        ++count;
+                    }
+                }
+                if (count == 0)
+                    continue;
+
+                float* t = image.At(x, y);
+                t[0] = sum[0] / count; t[1] = sum[1] / count; t[2] = sum[2] / count;
+                next[y * image.width + x] = 1;
+                changed = true;
+            }
+        }
+        known = next;
+    }
+}
+
+// Area filter in linear space with alpha weighted colour; covers both up and down sampling
+Image Resample( const Image& src, uint32_t width, uint32_t height )
+{
+    Image dst = AllocateImage(width, height);
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        uint32_t y0 = (uint32_t)((uint64_t)y * src.height / height);
+        uint32_t y1 = max(y0 + 1, (uint32_t)((uint64_t)(y + 1) * src.height / height));
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            uint32_t x0 = (uint32_t)((uint64_t)x * src.width / width);
+            uint32_t x1 = max(x0 + 1, (uint32_t)((uint64_t)(x + 1) * src.width / width));
+
+            float weighted[3] = { 0.0f, 0.0f, 0.0f };
+            float plain[3] = { 0.0f, 0.0f, 0.0f };
+            float alpha = 0.0f;
+            for (uint32_t sy = y0; sy < y1; ++sy)
+            {
+                for (uint32_t sx = x0; sx < x1; ++sx)
+                {
+                    const float* s = src.At(sx, sy);
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        weighted[c] += s[c] * s[3];
+                        plain[c] += s[c];
+                    }
+                    alpha += s[3];
+                }
+            }
+
+            float count = (float)((x1 - x0) * (y1 - y0));
+            float* d = dst.At(x, y);
+            for (int c = 0; c < 3; ++c)
+                d[c] = alpha > 0.0f ? weighted[c] / alpha : plain[c] / count;
+            d[3] = alpha / count;
+        }
+    }
+    return dst;
+}
+
+float AlphaCoverage( const Image& image, float scale )
+{
+    uint32_t covered = 0;
+    for (size_t i = 3; i < image.texels.size(); i += 4)
+        covered += image.texels[i] * scale >= 0.5f;
+    return (float)covered / (image.width * image.height);
+}
+
+// Scales a mip's alpha so the share of texels passing a 0.5 alpha test matches the top mip
+void PreserveAlphaCoverage( Image& mip, float targetCoverage )
+{
+    float low = 0.0f;
+    float high = 4.0f;
+    for (int i = 0; i < 16; ++i)
+    {
+        float mid = (low + high) * 0.5f;
+        if (AlphaCoverage(mip, mid) < targetCoverage)
+            low = mid;
+        else
+            high = mid;
+    }
+    for (size_t i = 3; i < mip.texels.size(); i += 4)
+        mip.texels[i] = min(mip.texels[i] * high, 1.0f);
+}
+
+// Only textures with fully transparent texels are alpha tested; translucent ones (water) keep their alpha
+bool HasCutoutAlpha( const Image& image )
+{
+    for (size_t i = 3; i < image.texels.size(); i += 4)
+        if (image.texels[i] == 0.0f)
+            return true;
+    return false;
+}
+
+void AppendMip( vector<uint8_t>& output, const Image& mip )
+{
+    for (size_t i = 0; i < mip.texels.size(); i += 4)
+    {
+        output.push_back(LinearToSRGB8(mip.texels[i]));
+        output.push_back(LinearToSRGB8(mip.texels[i + 1]));
+        output.push_back(LinearToSRGB8(mip.texels[i + 2]));
+        output.push_back(UnitToUnorm8(mip.texels[i + 3]));
+    }
+}
+
+vector<uint8_t> BakeLayer( const LayerSource& source )
+{
+    Image image = LoadLayerSource(source);
+    PadTransparentTexels(image);
+    Image mip = Resample(image, g_Size, g_Size);
+
+    bool cutout = HasCutoutAlpha(mip);
+    float coverage = cutout ? AlphaCoverage(mip, 1.0f) : 0.0f;
+
+    vector<uint8_t> output;
+    AppendMip(output, mip);
+    for (uint32_t level = 1; level < g_MipCount; ++level)
+    {
+        PadTransparentTexels(mip);
+        mip = Resample(mip, max(mip.width / 2, 1u), max(mip.height / 2, 1u));
+        if (cutout)
+            PreserveAlphaCoverage(mip, coverage);
+        AppendMip(output, mip);
+    }
+    return output;
+}
+
+void WorkerFunc( void )
+{
+    for (size_t idx = g_NextLayerIdx++; idx < g_Layers.size(); idx = g_NextLayerIdx++)
+    {
+        try
+        {
+            g_BakedLayers[idx] = BakeLayer(g_Layers[idx]);
+        }
+        catch (exception& e)
+        {
+            printf("Warning: %s, using a flat colour\n", e.what());
+            LayerSource flat;
+            flat.color = 0xFFFF00FF;
+            g_BakedLayers[idx] = BakeLayer(flat);
+        }
+    }
+}
+
+bool IsColorTexture( const string& stem )
+{
+    const char* kIgnored[] = { "emissive", "normal", "metallic", "roughness", "occlusion", "specular" };
+    for (const char* token : kIgnored)
+        if (stem.find(token) != string::npos)
+            return false;
+    return true;
+}
+
+uint32_t AddLayer( map<string, uint32_t>& layerIndices, const string& key, const LayerSource& source )
+{
+    auto it = layerIndices.find(key);
+    if (it != layerIndices.end())
+        return it->second;
+    uint32_t index = (uint32_t)g_Layers.size();
+    layerIndices[key] = index;
+    g_Layers.push_back(source);
+    return index;
+}
+
+// Assigns every (block type, face) a layer; identical sources share one layer
+void CollectLayers( const fs::path& root, vector<uint16_t>& faceLayers )
+{
+    map<string, uint32_t> layerIndices;
+    faceLayers.assign(kBlockTypeCount * kFaceCount, 0);
+
+    for (uint32_t type = 0; type < kBlockTypeCount; ++type)
+    {
+        // sorted so the chosen textures do not depend on directory enumeration order
+        vector<fs::path> candidates;
+        fs::path textureDir = root / g_BlockTypes[type].name / "textures";
+        if (fs::is_directory(textureDir))
+        {
+            for (const auto& entry : fs::directory_iterator(textureDir))
+            {
+                string ext = ToLower(entry.path().extension().string());
+                if (entry.is_regular_file() && (ext == ".dds" || ext == ".tga")
+                    && IsColorTexture(ToLower(entry.path().stem().string())))
+                    candidates.push_back(entry.path());
+            }
+        }
+        sort(candidates.begin(), candidates.end());
+
+        string facePaths[kFaceCount];
+        for (const fs::path& path : candidates)
+        {
+            string stem = ToLower(path.stem().string());
+            for (int face = 0; face < kFaceCount; ++face)
+            {
+                bool match = face == kTopFace ? stem.find("top") != string::npos
+                    : face == kBottomFace ? stem.find("bottom") != string::npos
+                    : stem.find("side") != string::npos;
+                if (match && facePaths[face].empty())
+                    facePaths[face] = path.generic_string();
+            }
+        }
+        for (const fs::path& path : candidates)
+        {
+            string stem = ToLower(path.stem().string());
+            if (stem.find("top") != string::npos || stem.find("bottom") != string::npos
+                || stem.find("side") != string::npos)
+                continue;
+            for (int face = 0; face < kFaceCount; ++face)
+                if (facePaths[face].empty())
+                    facePaths[face] = path.generic_string();
+            break;
+        }
+
+        for (int face = 0; face < kFaceCount; ++face)
+        {
+            LayerSource source;
+            string key;
+            if (facePaths[face].empty())
+            {
+                source.color = g_BlockTypes[type].fallbackColor;
+                char colorKey[16];
+                snprintf(colorKey, sizeof(colorKey), "#%08X", source.color);
+                key = colorKey;
+            }
+            else
+            {
+                source.path = facePaths[face];
+                key = source.path;
+            }
+            faceLayers[type * kFaceCount + face] = (uint16_t)AddLayer(layerIndices, key, source);
+        }
+
+        if (candidates.empty())
+            printf("%-13s flat colour (no .dds/.tga in %s)\n", g_BlockTypes[type].name, textureDir.generic_string().c_str());
+        else
+            printf("%-13s %zu source texture(s)\n", g_BlockTypes[type].name, candidates.size());
+    }
+}
+
+void WriteU32( ofstream& file, uint32_t value )
+{
+    uint8_t bytes[4] = { (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24) };
+    file.write((const char*)bytes, 4);
+}
+
+void WriteTextureArray( const string& fileName )
+{
+    ofstream file(fileName, ios_base::out | ios_base::binary | ios_base::trunc);
+    if (!file)
+        throw runtime_error("Unable to write " + fileName);
+
+    const uint32_t kDDSD_CAPS_HEIGHT_WIDTH_PITCH_PIXELFORMAT = 0x100F;
+    const uint32_t kDDSD_MIPMAPCOUNT = 0x20000;
+    const uint32_t kDDPF_FOURCC = 0x4;
+    const uint32_t kDDSCAPS_COMPLEX_TEXTURE_MIPMAP = 0x401008;
+
+    file.write("DDS ", 4);
+    WriteU32(file, 124);
+    WriteU32(file, kDDSD_CAPS_HEIGHT_WIDTH_PITCH_PIXELFORMAT | kDDSD_MIPMAPCOUNT);
+    WriteU32(file, g_Size);             // height
+    WriteU32(file, g_Size);             // width
+    WriteU32(file, g_Size * 4);         // pitch
+    WriteU32(file, 0);                  // depth
+    WriteU32(file, g_MipCount);
+    for (int i = 0; i < 11; ++i)
+        WriteU32(file, 0);
+    WriteU32(file, 32);                 // pixel format
+    WriteU32(file, kDDPF_FOURCC);
+    file.write("DX10", 4);
+    for (int i = 0; i < 5; ++i)
+        WriteU32(file, 0);
+    WriteU32(file, kDDSCAPS_COMPLEX_TEXTURE_MIPMAP);
+    for (int i = 0; i < 4; ++i)
+        WriteU32(file, 0);
+
+    WriteU32(file, 29);                 // DXGI_FORMAT_R8G8B8A8_UNORM_SRGB
+    WriteU32(file, 3);                  // D3D10_RESOURCE_DIMENSION_TEXTURE2D
+    WriteU32(file, 0);
+    WriteU32(file, (uint32_t)g_BakedLayers.size());
+    WriteU32(file, 0);
+
+    // DDS arrays store each slice with its full mip chain
+    for (const vector<uint8_t>& layer : g_BakedLayers)
+        file.write((const char*)layer.data(), layer.size());
+}
+
+void WriteLayerTable( const string& fileName, const vector<uint16_t>& faceLayers )
+{
+    ofstream file(fileName, ios_base::out | ios_base::binary | ios_base::trunc);
+    if (!file)
+        throw runtime_error("Unable to write " + fileName);
+
+    file.write("BTLT", 4);
+    WriteU32(file, 1);
+    WriteU32(file, kBlockTypeCount);
+    WriteU32(file, kFaceCount);
+    WriteU32(file, (uint32_t)g_Layers.size());
+    for (uint16_t layer : faceLayers)
+    {
+        uint8_t bytes[2] = { (uint8_t)layer, (uint8_t)(layer >> 8) };
+        file.write((const char*)bytes, 2);
+    }
+}
+
+void WriteManifest( const string& fileName, const fs::path& root, const vector<uint16_t>& faceLayers )
+{
+    ofstream file(fileName, ios_base::out | ios_base::binary | ios_base::trunc);
+    if (!file)
+        throw runtime_error("Unable to write " + fileName);
+
+    file << "{\n";
+    file << "  \"version\": 1,\n";
+    file << "  \"format\": \"R8G8B8A8_UNORM_SRGB\",\n";
+    file << "  \"size\": " << g_Size << ",\n";
+    file << "  \"mipCount\": " << g_MipCount << ",\n";
+    file << "  \"layers\": [\n";
+    for (size_t i = 0; i < g_Layers.size(); ++i)
+    {
+        file << "    ";
+        if (g_Layers[i].path.empty())
+        {
+            char color[16];
+            snprintf(color, sizeof(color), "%08X", g_Layers[i].color);
+            file << "{ \"color\": \"" << color << "\" }";
+        }
+        else
+        {
+            // relative to the blocks directory so the manifest does not depend on where it was baked
+            file << "{ \"source\": \"" << fs::path(g_Layers[i].path).lexically_relative(root).generic_string() << "\" }";
+        }
+        file << (i + 1 < g_Layers.size() ? ",\n" : "\n");
+    }
+    file << "  ],\n";
+    file << "  \"blocks\": [\n";
+    for (uint32_t type = 0; type < kBlockTypeCount; ++type)
+    {
+        file << "    { \"type\": " << type << ", \"name\": \"" << g_BlockTypes[type].name << "\", \"faces\": {";
+        for (int face = 0; face < kFaceCount; ++face)
+            file << " \"" << g_FaceNames[face] << "\": " << faceLayers[type * kFaceCount + face] << (face + 1 < kFaceCount ? "," : " ");
+        file << "} }" << (type + 1 < kBlockTypeCount ? ",\n" : "\n");
+    }
+    file << "  ]\n";
+    file << "}\n";
+}
+
+int main( int argc, const char** argv )
+{
+    string inputDir = "";
+    string outputName = "";
+    uint32_t numThreads = thread::hardware_concurrency();
+
+    try
+    {
+        if (argc < 2)
+            throw runtime_error("No blocks directory specified");
+        inputDir = argv[1];
+
+        for (int arg = 2; arg < argc; ++arg)
+        {
+            if (argv[arg][0] != '-')
+                throw runtime_error("Malformed option");
+
+            if (arg + 1 == argc)
+                throw runtime_error("Missing operand");
+            else if (strcmp("-size", argv[arg]) == 0)
+                g_Size = (uint32_t)atoi(argv[++arg]);
+            else if (strcmp("-output", argv[arg]) == 0)
+                outputName = argv[++arg];
+            else if (strcmp("-threads", argv[arg]) == 0)
+                numThreads = (uint32_t)atoi(argv[++arg]);
+            else
+                throw runtime_error("Invalid option");
+        }
+
+        if (g_Size == 0 || g_Size > kMaxTextureDimension || (g_Size & (g_Size - 1)) != 0)
+            throw runtime_error("Size must be a power of two no larger than 4096");
+    }
+    catch (exception& e)
+    {
+        printf(
+            "Error: %s\n\n"
+            "Usage:  %s <blocks directory> [options]*\n\n"
+            "Options:\n\n"
+            "-output <string>\n\tThe root name of resultant files.\n\tDefaults to <blocks directory>/block_textures.\n"
+            "-size <integer>\n\tThe layer resolution, a power of two.\n\tDefaults to 128.\n"
+            "-threads <integer>\n\tWorker threads.\n\tDefaults to the hardware thread count.\n"
+            "\n\nExample:  %s ../../Resources/Blocks -size 64\n\n", e.what(), argv[0], argv[0]);
+        return 1;
+    }
+
+    fs::path root(inputDir);
+    if (outputName.length() == 0)
+        outputName = (root / "block_textures").string();
+
+    g_MipCount = 1;
+    while ((g_Size >> (g_MipCount - 1)) > 1)
+        ++g_MipCount;
+    numThreads = max(numThreads, 1u);
+
+    printf("\n[ Block texture array baker v.%d.%d ]\n\n", kMajorVersion, kMinorVersion);
+    printf("Blocks Directory: \"%s\"\n", inputDir.c_str());
+    printf("Layer Size: %u (%u mips)\n", g_Size, g_MipCount);
+    printf("Output Name: %s\n", outputName.c_str());
+    printf("Threads: %u\n\n", numThreads);
+
+    try
+    {
+        if (!fs::is_directory(root))
+            throw runtime_error(inputDir + " is not a directory");
+
+        InitializeColorTables();
+
+        vector<uint16_t> faceLayers;
+        CollectLayers(root, faceLayers);
+        g_BakedLayers.resize(g_Layers.size());
+
+        vector<thread> threads;
+        for (uint32_t i = 1; i < numThreads; ++i)
+            threads.push_back(thread(WorkerFunc));
+        WorkerFunc();
+        for_each(threads.begin(), threads.end(), []( thread& t ) { t.join(); });
+
+        WriteTextureArray(outputName + ".dds");
+        WriteLayerTable(outputName + ".layers", faceLayers);
+        WriteManifest(outputName + ".json", root, faceLayers);
+
+        printf("\n%zu layers baked into %s.dds\n", g_Layers.size(), outputName.c_str());
+        printf("\nComplete!\n");
+    }
+    catch (exception& e)
+    {
+        printf("\nFailed: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}